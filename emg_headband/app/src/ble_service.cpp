@@ -1,12 +1,19 @@
 #include "emg_adc.hpp"
+#include "emg_packet.hpp"
+#include "emg_codec.hpp"
+#ifdef CONFIG_EMG_DSP
+#include "emg_dsp.hpp"
+#endif
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 LOG_MODULE_REGISTER(ble_svc, LOG_LEVEL_INF);
 
 /* 128-bit base UUID: 3F5Bxxxx-D946-4844-B1CE-B29134DDEAF5 */
 #define BT_UUID_EMG_SERVICE  BT_UUID_128_ENCODE(0x3F5B0001,0xD946,0x4844,0xB1CE,0xB29134DDEAF5)
 #define BT_UUID_EMG_DATA_CH  BT_UUID_128_ENCODE(0x3F5B0002,0xD946,0x4844,0xB1CE,0xB29134DDEAF5)
+#define BT_UUID_EMG_CTRL_CH  BT_UUID_128_ENCODE(0x3F5B0003,0xD946,0x4844,0xB1CE,0xB29134DDEAF5)
 
 static struct bt_conn *current_conn;
 static uint8_t notify_enabled;
@@ -17,12 +24,37 @@ static ssize_t ccc_cfg(const bt_gatt_attr*, uint16_t, uint16_t flags, const void
     return len;
 }
 
+#ifdef CONFIG_EMG_DSP
+/* Control characteristic: one byte, the emg_stream_kind to stream */
+static ssize_t ctrl_read(bt_conn *conn, const bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t mode = emg_dsp_mode();
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &mode, sizeof(mode));
+}
+
+static ssize_t ctrl_write(bt_conn*, const bt_gatt_attr*, const void *buf, uint16_t len, uint16_t offset,
+                          uint8_t)
+{
+    if (offset != 0) return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    if (len != 1) return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    uint8_t mode = *(const uint8_t*)buf;
+    if (emg_dsp_set_mode(mode) != 0) return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    LOG_INF("stream mode %u", mode);
+    return len;
+}
+#endif
+
 BT_GATT_SERVICE_DEFINE(emg_svc,
     BT_GATT_PRIMARY_SERVICE(BT_UUID_EMG_SERVICE),
     BT_GATT_CHARACTERISTIC(BT_UUID_EMG_DATA_CH,
         BT_GATT_CHRC_NOTIFY,
         BT_GATT_PERM_NONE, NULL, NULL, NULL),
     BT_GATT_CCC(ccc_cfg, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+#ifdef CONFIG_EMG_DSP
+    BT_GATT_CHARACTERISTIC(BT_UUID_EMG_CTRL_CH,
+        BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+        BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, ctrl_read, ctrl_write, NULL),
+#endif
 );
 
 static void connected(struct bt_conn *conn, uint8_t err)
@@ -43,19 +75,216 @@ void ble_service_init()
     LOG_INF("BLE advertising");
 }
 
+/* Link statistics, logged every CONFIG_EMG_BLE_STATS_INTERVAL_MS */
+static struct {
+    uint32_t notifies;
+    uint32_t notify_errors;
+    uint32_t frames;
+    uint32_t bytes;
+    uint64_t latency_sum_us;                     // ADC timestamp -> notify, per frame
+    uint32_t latency_max_us;
+    int64_t  since_ms;
+} link_stats;
+
+static int send_notify(const void *data, uint16_t len, uint32_t frames)
+{
+    int err = bt_gatt_notify(current_conn, &emg_svc.attrs[1], data, len);
+    if (err) {
+        link_stats.notify_errors++;
+    } else {
+        link_stats.notifies++;
+        link_stats.frames += frames;
+        link_stats.bytes  += len;
+    }
+    return err;
+}
+
+/* n frames delivered, the oldest stamped base_us; age_sum_us = sum of each
+ * frame's tick minus base_us */
+static void note_latency(uint32_t base_us, uint32_t n, uint64_t age_sum_us)
+{
+    uint32_t oldest = emg_now_us() - base_us;
+    link_stats.latency_sum_us += (uint64_t)oldest * n - age_sum_us;
+    if (oldest > link_stats.latency_max_us) link_stats.latency_max_us = oldest;
+}
+
+static void stats_maybe_log()
+{
+    if (CONFIG_EMG_BLE_STATS_INTERVAL_MS == 0) return;
+    int64_t now = k_uptime_get();
+    int64_t dt  = now - link_stats.since_ms;
+    if (dt < CONFIG_EMG_BLE_STATS_INTERVAL_MS) return;
+
+    emg_pool_stats_t pool;
+    emg_pool_stats_get(&pool);
+    uint32_t frames = link_stats.frames ? link_stats.frames : 1;
+    LOG_INF("tx: %u notif/s, %u frames/s, %u B/s, lat avg %u us max %u us, "
+            "notify err %u, pool drop %u hw %u/%u",
+            (uint32_t)(link_stats.notifies * 1000 / dt), (uint32_t)(link_stats.frames * 1000 / dt),
+            (uint32_t)(link_stats.bytes * 1000 / dt), (uint32_t)(link_stats.latency_sum_us / frames),
+            link_stats.latency_max_us, link_stats.notify_errors,
+            pool.dropped, pool.high_water, pool.capacity);
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+    LOG_INF("adc: %u DMA overruns", pool.dma_overruns);
+#endif
+#ifdef CONFIG_EMG_DSP
+    emg_dsp_stats_t dsp;
+    emg_dsp_stats_get(&dsp, true);
+    LOG_INF("dsp: mode %u, %u blocks, avg %u us max %u us per block",
+            emg_dsp_mode(), dsp.blocks, dsp.avg_us, dsp.max_us);
+#endif
+    link_stats = {};
+    link_stats.since_ms = now;
+}
+
+#ifdef CONFIG_EMG_BLE_BATCH
+/* Batch under construction; see emg_packet.hpp / emg_codec.hpp for the layouts */
+constexpr size_t FRAME_BYTES = emg_batch_frame_bytes(EMG_CH);
+static uint8_t  batch_buf[EMG_BATCH_MAX_PAYLOAD];
+static uint16_t batch_len;
+static uint32_t batch_frames;
+static uint32_t batch_base_us;
+static uint64_t batch_age_sum_us;                // sum of (tick - base) over the batch
+static uint16_t batch_seq;
+static uint8_t  batch_kind;                      // every frame in a batch has the same kind
+static int64_t  batch_deadline_ms;
+#ifdef CONFIG_EMG_BLE_CODEC
+static emg_codec::Encoder codec(EMG_CH, CONFIG_EMG_CODEC_KEYFRAME_INTERVAL);
+#endif
+
+/* Payload bytes one notification may carry on the current connection */
+static uint16_t batch_capacity()
+{
+    uint16_t mtu = bt_gatt_get_mtu(current_conn);
+    uint16_t cap = mtu > 3 ? mtu - 3 : 0;
+    return MIN(cap, (uint16_t)sizeof(batch_buf));
+}
+
+static void batch_reset()
+{
+    batch_frames = 0;
+    batch_len = 0;
+    batch_age_sum_us = 0;
+}
+
+static void batch_flush()
+{
+    if (batch_frames == 0) return;
+#ifdef CONFIG_EMG_BLE_CODEC
+    batch_len = codec.finish();
+#endif
+    if (send_notify(batch_buf, batch_len, batch_frames) == 0) {
+        note_latency(batch_base_us, batch_frames, batch_age_sum_us);
+    } else {
+#ifdef CONFIG_EMG_BLE_CODEC
+        codec.force_keyframe();                  // receiver cannot continue from a lost packet
+#endif
+    }
+    batch_seq++;                                 // a failed notify still shows up as a gap
+    batch_reset();
+}
+
+/* Append f to the current batch; false if it does not fit (flush and retry) */
+static bool batch_add(const emg_frame_t *f, uint16_t cap)
+{
+#ifdef CONFIG_EMG_BLE_CODEC
+    if (batch_frames == 0) codec.begin(batch_buf, cap, batch_seq, f->kind);
+    if (!codec.add(f->tick_us, f->sample)) return false;
+#else
+    if (batch_frames == 0) {
+        if (EMG_BATCH_HDR_BYTES + FRAME_BYTES > cap) return false;
+        batch_buf[0] = EMG_PKT_BATCH | (f->kind << 4);
+        batch_buf[1] = EMG_CH;
+        sys_put_le16(batch_seq, &batch_buf[2]);
+        sys_put_le32(f->tick_us, &batch_buf[4]);
+        batch_len = EMG_BATCH_HDR_BYTES;
+    } else if (batch_len + FRAME_BYTES > cap || f->tick_us - batch_base_us > UINT16_MAX) {
+        return false;
+    }
+    uint8_t *p = &batch_buf[batch_len];
+    sys_put_le16((uint16_t)(f->tick_us - (batch_frames ? batch_base_us : f->tick_us)), p);
+    for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+        sys_put_le16((uint16_t)f->sample[ch], p + 2 + 2 * ch);
+    }
+    batch_len += FRAME_BYTES;
+#endif
+    if (batch_frames == 0) {
+        batch_kind = f->kind;
+        batch_base_us = f->tick_us;
+        batch_deadline_ms = k_uptime_get() + CONFIG_EMG_BLE_FLUSH_MS;
+    }
+    batch_age_sum_us += f->tick_us - batch_base_us;
+    batch_frames++;
+    return true;
+}
+
+/* True when no further frame can fit. The codec's frame size varies, so
+ * there a full batch is noticed when the next add() fails. */
+static bool batch_full(uint16_t cap)
+{
+#ifdef CONFIG_EMG_BLE_CODEC
+    return batch_frames >= 255;
+#else
+    return batch_len + FRAME_BYTES > cap;
+#endif
+}
+
+/* Worker thread: pack frames into MTU-sized notifications, flushing when the
+ * next frame would not fit or CONFIG_EMG_BLE_FLUSH_MS after the first one */
+void ble_tx_thread()
+{
+    while (true) {
+        k_timeout_t wait = K_FOREVER;
+        if (batch_frames) {
+            int64_t left = batch_deadline_ms - k_uptime_get();
+            wait = K_MSEC(left > 0 ? left : 0);
+        }
+        auto *f = (emg_frame_t*)k_fifo_get(&EMG_TX_FIFO, wait);
+        if (!f) {
+            batch_flush();                       // deadline reached
+            stats_maybe_log();
+            continue;
+        }
+        if (!(notify_enabled && current_conn)) {
+            batch_reset();
+#ifdef CONFIG_EMG_BLE_CODEC
+            codec.force_keyframe();              // predictor moved over frames never sent
+#endif
+            emg_frame_free(f);
+            continue;
+        }
+
+        if (batch_frames && f->kind != batch_kind) batch_flush();
+        uint16_t cap = batch_capacity();
+        if (!batch_add(f, cap)) {
+            batch_flush();
+            if (!batch_add(f, cap)) {
+                LOG_WRN_ONCE("MTU %u too small for a frame", cap + 3);
+            }
+        }
+        emg_frame_free(f);
+
+        if (batch_full(cap) || (batch_frames && k_uptime_get() >= batch_deadline_ms)) {
+            batch_flush();
+        }
+        stats_maybe_log();
+    }
+}
+#else
 /* Worker thread: pop frames and notify */
 void ble_tx_thread()
 {
     emg_frame_t *f;
     while (true) {
-        f = (emg_frame_t*)k_fifo_get(&adc_fifo, K_FOREVER);
+        f = (emg_frame_t*)k_fifo_get(&EMG_TX_FIFO, K_FOREVER);
         if (notify_enabled && current_conn) {
-            bt_gatt_notify(current_conn, &emg_svc.attrs[1],
-                           f->sample, sizeof(f->sample));
+            if (send_notify(f->sample, sizeof(f->sample), 1) == 0) note_latency(f->tick_us, 1, 0);
         }
-        k_free(f);
+        emg_frame_free(f);
+        stats_maybe_log();
     }
 }
+#endif
 
 K_THREAD_DEFINE(ble_tx_id, 1024, ble_tx_thread, NULL, NULL, NULL,
                 5, 0, 0);
@@ -1,30 +1,193 @@
 #include "emg_adc.hpp"
+#include "emg_packet.hpp"
 #include <zephyr/device.h>
 #include <zephyr/drivers/clock_control.h>
 #include <zephyr/drivers/timer/nrf_rtc_timer.h>   // STM32 uses generic timer; choose TIM2
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+#include <zephyr/drivers/dma.h>
+#ifndef CONFIG_EMG_SIM_ADC
+#include <stm32_ll_adc.h>
+#endif
+#endif
 LOG_MODULE_REGISTER(emg_adc, LOG_LEVEL_INF);
 
+#ifndef CONFIG_EMG_SIM_ADC
 static const struct device *adc = DEVICE_DT_GET_ONE(st_stm32_adc);
+#endif
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+constexpr uint32_t BLOCK = CONFIG_EMG_DSP_BLOCK;
+static int16_t dma_ring[2 * BLOCK][EMG_CH];      // circular: first half, second half
+#else
 static int16_t dma_buf[2][EMG_CH];               // ping-pong
 static uint8_t buf_idx;
+#endif
 
+/* Fixed frame pool: ISR allocates, BLE thread frees. Bounded, so a BLE stall
+ * costs frames (per the overflow policy) instead of the heap. */
+K_MEM_SLAB_DEFINE_STATIC(frame_slab, sizeof(emg_frame_t), CONFIG_EMG_FRAME_POOL_SIZE, 4);
+
+static atomic_t pool_policy = ATOMIC_INIT(IS_ENABLED(CONFIG_EMG_POOL_DROP_NEWEST)
+                                          ? (atomic_val_t)emg_overflow_policy::drop_newest
+                                          : (atomic_val_t)emg_overflow_policy::drop_oldest);
+static atomic_t pool_produced;
+static atomic_t pool_dropped;
+static atomic_t pool_high_water;
+static atomic_t pool_overruns;
+
+/* O(1) frame for the ISR: a free pool block, or under drop_oldest the oldest
+ * queued frame (tx_fifo holds older frames than adc_fifo). NULL means drop
+ * this sample. */
+static emg_frame_t *frame_take()
+{
+    void *block;
+    if (k_mem_slab_alloc(&frame_slab, &block, K_NO_WAIT) == 0) {
+        atomic_val_t used = k_mem_slab_num_used_get(&frame_slab);
+        if (used > atomic_get(&pool_high_water)) {
+            atomic_set(&pool_high_water, used);  // ISR is the only writer
+        }
+        return static_cast<emg_frame_t*>(block);
+    }
+
+    atomic_inc(&pool_dropped);
+    if (atomic_get(&pool_policy) == (atomic_val_t)emg_overflow_policy::drop_oldest) {
+        void *old = k_fifo_get(&tx_fifo, K_NO_WAIT);
+        if (!old) old = k_fifo_get(&adc_fifo, K_NO_WAIT);
+        return static_cast<emg_frame_t*>(old);
+    }
+    return nullptr;
+}
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+/* Finished halves, handed to the consumer by value; the samples stay in
+ * dma_ring */
+K_MSGQ_DEFINE(adc_block_q, sizeof(emg_block_t), 4, 4);
+static atomic_t halves_done;
+static uint32_t adc_start_us;                    // first conversion
+
+/* Half-transfer (DMA_STATUS_BLOCK) or transfer-complete (DMA_STATUS_COMPLETE)
+ * interrupt of the circular DMA: one per BLOCK frames */
+static void dma_block_callback(const struct device*, void*, uint32_t, int status)
+{
+    if (status < 0) {
+        atomic_inc(&pool_overruns);
+        return;
+    }
+    uint32_t seq = (uint32_t)atomic_inc(&halves_done);
+    emg_block_t blk;
+    blk.sample  = &dma_ring[status == DMA_STATUS_COMPLETE ? BLOCK : 0];
+    blk.frames  = BLOCK;
+    blk.seq     = seq;
+    blk.tick_us = adc_start_us + (uint32_t)((uint64_t)seq * BLOCK * 1000000u / EMG_SPS);
+    if (k_msgq_put(&adc_block_q, &blk, K_NO_WAIT) != 0) {
+        atomic_inc(&pool_overruns);              // consumer already a queue behind
+    }
+}
+
+int emg_adc_block_get(emg_block_t *blk, k_timeout_t timeout)
+{
+    return k_msgq_get(&adc_block_q, blk, timeout);
+}
+
+bool emg_adc_block_done(const emg_block_t *blk)
+{
+    /* The DMA refills a half once the other one has completed after it */
+    if ((uint32_t)atomic_get(&halves_done) - blk->seq <= 1) return true;
+    atomic_inc(&pool_overruns);
+    return false;
+}
+
+emg_frame_t *emg_frame_alloc()
+{
+    emg_frame_t *frame = frame_take();
+    if (frame) atomic_inc(&pool_produced);
+    return frame;
+}
+#else
 static void dma_callback(const struct device*, void*, uint32_t, int)
 {
-    auto *frame = (emg_frame_t*)k_malloc(sizeof(emg_frame_t));
-    frame->tick_us = k_cycle_get_32() / (CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC / 1000000);
-    memcpy(frame->sample, dma_buf[buf_idx], sizeof(frame->sample));
-    k_fifo_put(&adc_fifo, frame);
+    emg_frame_t *frame = frame_take();
+    if (frame) {
+        frame->tick_us = emg_now_us();
+        memcpy(frame->sample, dma_buf[buf_idx], sizeof(frame->sample));
+        frame->kind = EMG_KIND_RAW;
+        k_fifo_put(&adc_fifo, frame);
+        atomic_inc(&pool_produced);
+    }
     buf_idx ^= 1;
 }
+#endif
 
-void emg_adc_init()
+void emg_frame_free(emg_frame_t *frame)
 {
-    /* Timer trigger @1 kHz */
-    const struct device *tim = DEVICE_DT_GET(DT_ALIAS(timer2));
-    timer_configure(tim, 1000);  // helper util you’d write for TIM & Zephyr counter API
+    k_mem_slab_free(&frame_slab, frame);
+}
 
-    /* ADC sequence */
+void emg_pool_set_policy(emg_overflow_policy policy)
+{
+    atomic_set(&pool_policy, (atomic_val_t)policy);
+}
+
+void emg_pool_stats_get(emg_pool_stats_t *stats)
+{
+    stats->produced   = atomic_get(&pool_produced);
+    stats->dropped    = atomic_get(&pool_dropped);
+    stats->in_use     = k_mem_slab_num_used_get(&frame_slab);
+    stats->high_water = atomic_get(&pool_high_water);
+    stats->capacity   = CONFIG_EMG_FRAME_POOL_SIZE;
+    stats->dma_overruns = atomic_get(&pool_overruns);
+}
+
+#ifdef CONFIG_EMG_SIM_ADC
+/* Per-channel sawtooth, 12-bit range, easy to check on the host */
+static void sim_sample(int16_t *frame)
+{
+    static uint32_t n;
+    for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+        frame[ch] = (int16_t)(((n + ch * 100u) * (ch + 1u)) & 0x0FFF);
+    }
+    n++;
+}
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+/* native_sim: a k_timer at the block rate fills the next half of the ring
+ * and raises the half/full-transfer callback, in ISR context */
+constexpr uint32_t SIM_PERIOD_US = BLOCK * 1000000u / EMG_SPS;
+
+static void sim_adc_tick(struct k_timer*)
+{
+    static uint8_t half;
+    for (uint32_t i = 0; i < BLOCK; i++) sim_sample(dma_ring[half * BLOCK + i]);
+    dma_block_callback(nullptr, nullptr, 0, half ? DMA_STATUS_COMPLETE : DMA_STATUS_BLOCK);
+    half ^= 1;
+}
+#else
+/* native_sim: a k_timer at EMG_SPS stands in for TIM2 + ADC DMA. The expiry
+ * handler runs in ISR context, like the real DMA callback. */
+constexpr uint32_t SIM_PERIOD_US = 1000000u / EMG_SPS;
+
+static void sim_adc_tick(struct k_timer*)
+{
+    sim_sample(dma_buf[buf_idx]);
+    dma_callback(nullptr, nullptr, 0, 0);
+}
+#endif
+
+K_TIMER_DEFINE(sim_adc_timer, sim_adc_tick, NULL);
+
+void emg_adc_init()
+{
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+    adc_start_us = emg_now_us();
+#endif
+    k_timer_start(&sim_adc_timer, K_USEC(SIM_PERIOD_US), K_USEC(SIM_PERIOD_US));
+    LOG_INF("Simulated ADC started @%u Hz x %d ch", EMG_SPS, EMG_CH);
+}
+#else
+static void adc_channels_setup()
+{
     struct adc_channel_cfg ch = {
         .gain             = ADC_GAIN_1,
         .reference        = ADC_REF_INTERNAL,
@@ -34,7 +197,75 @@ void emg_adc_init()
         ch.channel_id = i;
         adc_channel_setup(adc, &ch);
     }
+}
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+#define ADC_NODE DT_NODELABEL(adc1)
+static const struct device *adc_dma = DEVICE_DT_GET(DT_DMAS_CTLR_BY_IDX(ADC_NODE, 0));
+constexpr uint32_t ADC_DMA_CH = DT_DMAS_CELL_BY_IDX(ADC_NODE, 0, channel);
 
+void emg_adc_init()
+{
+    /* Timer trigger @EMG_SPS; each trigger scans all EMG_CH channels */
+    const struct device *tim = DEVICE_DT_GET(DT_ALIAS(timer2));
+    timer_configure(tim, EMG_SPS);  // helper util you’d write for TIM & Zephyr counter API
+    adc_channels_setup();
+
+    /* Scan ranks 1..EMG_CH = channels 0..EMG_CH-1, started by TIM2 TRGO. The
+     * ADC keeps requesting DMA after the first buffer so the stream never
+     * stops; the Zephyr ADC API has no continuous mode, hence LL. */
+    static const uint32_t ranks[] = {LL_ADC_REG_RANK_1, LL_ADC_REG_RANK_2, LL_ADC_REG_RANK_3,
+                                     LL_ADC_REG_RANK_4, LL_ADC_REG_RANK_5};
+    static const uint32_t lengths[] = {LL_ADC_REG_SEQ_SCAN_DISABLE, LL_ADC_REG_SEQ_SCAN_ENABLE_2RANKS,
+                                       LL_ADC_REG_SEQ_SCAN_ENABLE_3RANKS, LL_ADC_REG_SEQ_SCAN_ENABLE_4RANKS,
+                                       LL_ADC_REG_SEQ_SCAN_ENABLE_5RANKS};
+    static_assert(EMG_CH <= ARRAY_SIZE(ranks), "add scan ranks for more channels");
+    for (uint8_t i = 0; i < EMG_CH; ++i) {
+        LL_ADC_REG_SetSequencerRanks(ADC1, ranks[i], __LL_ADC_DECIMAL_NB_TO_CHANNEL(i));
+    }
+    LL_ADC_SetSequencersScanMode(ADC1, LL_ADC_SEQ_SCAN_ENABLE);
+    LL_ADC_REG_SetSequencerLength(ADC1, lengths[EMG_CH - 1]);
+    LL_ADC_REG_SetTriggerSource(ADC1, LL_ADC_REG_TRIG_EXT_TIM2_TRGO);
+    LL_ADC_REG_SetDMATransfer(ADC1, LL_ADC_REG_DMA_TRANSFER_UNLIMITED);
+
+    /* Circular DMA over both halves: half-transfer and transfer-complete
+     * interrupts, one per BLOCK frames whatever EMG_SPS is */
+    struct dma_block_config blk = {};
+    blk.source_address  = LL_ADC_DMA_GetRegAddr(ADC1, LL_ADC_DMA_REG_REGULAR_DATA);
+    blk.dest_address    = (uint32_t)(uintptr_t)dma_ring;
+    blk.block_size      = sizeof(dma_ring);
+    blk.source_addr_adj = DMA_ADDR_ADJ_NO_CHANGE;
+    blk.dest_addr_adj   = DMA_ADDR_ADJ_INCREMENT;
+
+    struct dma_config cfg = {};
+    cfg.channel_direction   = PERIPHERAL_TO_MEMORY;
+    cfg.cyclic              = 1;
+    cfg.source_data_size    = sizeof(int16_t);
+    cfg.dest_data_size      = sizeof(int16_t);
+    cfg.source_burst_length = 1;
+    cfg.dest_burst_length   = 1;
+    cfg.block_count         = 1;
+    cfg.head_block          = &blk;
+    cfg.dma_callback        = dma_block_callback;
+
+    if (dma_config(adc_dma, ADC_DMA_CH, &cfg) != 0 || dma_start(adc_dma, ADC_DMA_CH) != 0) {
+        LOG_ERR("ADC DMA setup failed");
+        return;
+    }
+    adc_start_us = emg_now_us();
+    LL_ADC_Enable(ADC1);
+    LL_ADC_REG_StartConversionExtTrig(ADC1, LL_ADC_REG_TRIG_EXT_RISING);
+    LOG_INF("ADC started @%u Hz x %d ch, circular DMA, %u-frame blocks", EMG_SPS, EMG_CH, BLOCK);
+}
+#else
+void emg_adc_init()
+{
+    /* Timer trigger @EMG_SPS */
+    const struct device *tim = DEVICE_DT_GET(DT_ALIAS(timer2));
+    timer_configure(tim, EMG_SPS);  // helper util you’d write for TIM & Zephyr counter API
+    adc_channels_setup();
+
+    /* ADC sequence */
     struct adc_sequence seq = {
         .channels    = BIT_MASK(EMG_CH),
         .buffer      = dma_buf[0],
@@ -45,5 +276,7 @@ void emg_adc_init()
     };
 
     adc_dma_start(adc, &seq, dma_callback);       // Zephyr v4.2 helper
-    LOG_INF("ADC started @1 kHz x %d ch", EMG_CH);
+    LOG_INF("ADC started @%u Hz x %d ch", EMG_SPS, EMG_CH);
 }
+#endif
+#endif
@@ -3,13 +3,77 @@
 #include <zephyr/drivers/adc.h>
 
 constexpr uint8_t  EMG_CH   = 5;          // 3-5 sensors; pick 5 max
-constexpr uint16_t EMG_SPS  = 1000;       // target sample rate
+constexpr uint16_t EMG_SPS  = CONFIG_EMG_SPS; // sample rate, frames/s
 
 struct emg_frame_t {
+    void    *fifo_reserved;               // first word belongs to k_fifo
     uint32_t tick_us;                     // µs timestamp
     int16_t  sample[EMG_CH];
+    uint8_t  kind;                        // emg_stream_kind of sample[] (emg_packet.hpp)
 };
 
-// double-buffer for DMA ping-pong
+// Frame timestamp base: µs since boot, wrapping at 2^32 (~71 min). Monotonic
+// and ISR-safe; also used by the BLE thread to measure frame latency.
+inline uint32_t emg_now_us()
+{
+    return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+// What the ADC ISR does when every pool frame is queued or in flight
+enum class emg_overflow_policy : uint8_t {
+    drop_newest,                          // discard the incoming frame
+    drop_oldest,                          // recycle the oldest queued frame
+};
+
+struct emg_pool_stats_t {
+    uint32_t produced;                    // frames queued by the ISR
+    uint32_t dropped;                     // frames lost to overflow (either policy)
+    uint32_t in_use;                      // frames currently queued or being sent
+    uint32_t high_water;                  // max in_use seen
+    uint32_t capacity;                    // CONFIG_EMG_FRAME_POOL_SIZE
+    uint32_t dma_overruns;                // blocks overwritten before they were read
+};
+
+// ADC ISR -> DSP stage -> BLE thread queues. Frames come from a fixed
+// k_mem_slab pool (O(1), ISR-safe, no heap); return them with emg_frame_free().
+// Without CONFIG_EMG_DSP the BLE thread reads adc_fifo directly.
 inline k_fifo adc_fifo;
+inline k_fifo tx_fifo;
+#ifdef CONFIG_EMG_DSP
+#define EMG_TX_FIFO tx_fifo
+#else
+#define EMG_TX_FIFO adc_fifo
+#endif
 void emg_adc_init();
+void emg_frame_free(emg_frame_t *frame);
+
+void emg_pool_set_policy(emg_overflow_policy policy);
+void emg_pool_stats_get(emg_pool_stats_t *stats);
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+// Block mode: the ADC DMA runs circularly over a ring of two blocks of
+// CONFIG_EMG_DSP_BLOCK frames and interrupts once per finished half. The
+// half is handed out as-is (no pool frame, no copy); the consumer must read
+// it before the DMA comes round again, one block period later.
+struct emg_block_t {
+    const int16_t (*sample)[EMG_CH];      // frames [0, frames), inside the DMA ring
+    uint16_t frames;
+    uint32_t seq;                         // halves completed before this one
+    uint32_t tick_us;                     // timestamp of frame 0
+};
+
+// Frame i of a block, on the sample clock: blocks are timestamped from the
+// number of conversions since start, not from when the interrupt ran
+inline uint32_t emg_block_tick(const emg_block_t *blk, uint32_t i)
+{
+    return blk->tick_us + (uint32_t)((uint64_t)i * 1000000u / EMG_SPS);
+}
+
+int emg_adc_block_get(emg_block_t *blk, k_timeout_t timeout);
+// Call after reading a block: false if the DMA may have overwritten part of
+// it meanwhile (counted in dma_overruns); discard what was read.
+bool emg_adc_block_done(const emg_block_t *blk);
+
+// Pool frame for a consumer thread (same overflow policy as the ISR)
+emg_frame_t *emg_frame_alloc();
+#endif
@@ -0,0 +1,273 @@
+#include "emg_dsp.hpp"
+#include <arm_math.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+LOG_MODULE_REGISTER(emg_dsp, LOG_LEVEL_INF);
+
+constexpr uint32_t BLOCK  = CONFIG_EMG_DSP_BLOCK;
+constexpr uint8_t  STAGES = 3;                   // highpass, mains notch, lowpass
+constexpr int16_t  ADC_MID  = 2048;              // 12-bit mid-scale
+constexpr int      IN_SHIFT = 3;                 // ADC counts -> q15 with 2x headroom
+
+/* Biquads designed at start-up (RBJ cookbook), shared by all channels */
+static q15_t coeffs[6 * STAGES];
+static q15_t state[EMG_CH][4 * STAGES];
+static arm_biquad_casd_df1_inst_q15 biquad[EMG_CH];
+
+/* Block under construction; samples channel-major for CMSIS */
+static emg_frame_t *blk[BLOCK];
+#ifndef CONFIG_EMG_ADC_BLOCK_DMA
+static uint32_t blk_len;
+#endif
+static q15_t    x[EMG_CH][BLOCK];
+static q15_t    y[EMG_CH][BLOCK];
+
+static atomic_t dsp_mode = ATOMIC_INIT(CONFIG_EMG_DSP_DEFAULT_MODE);
+static atomic_t stat_blocks;
+static atomic_t stat_cycles;
+static atomic_t stat_max_cycles;
+
+/* Store b0 b1 b2 / a0 a1 a2 as one q15 DF1 stage {b0, 0, b1, b2, -a1, -a2}.
+ * Coefficients are scaled by 1/2 to fit [-1, 1); postShift 1 undoes it. */
+static void set_stage(uint8_t s, float b0, float b1, float b2, float a0, float a1, float a2)
+{
+    const float c[6] = {b0 / a0, 0.0f, b1 / a0, b2 / a0, -a1 / a0, -a2 / a0};
+    for (int i = 0; i < 6; i++) {
+        float v = roundf(c[i] * 16384.0f);
+        coeffs[6 * s + i] = (q15_t)CLAMP(v, -32768.0f, 32767.0f);
+    }
+}
+
+/* A corner at or above Nyquist has no valid biquad; keep every corner
+ * below 0.45 fs, which the low EMG_SPS settings otherwise violate */
+static float corner_hz(float hz, float fs, const char *what)
+{
+    const float max_hz = 0.45f * fs;
+    if (hz <= max_hz) return hz;
+    LOG_WRN("%s %d Hz is above 0.45 x %d sps, using %d Hz", what, (int)hz, (int)fs, (int)max_hz);
+    return max_hz;
+}
+
+static void design_filters()
+{
+    const float fs = EMG_SPS;
+    const float q_bw = 0.70710678f;              // Butterworth
+    float w, al;
+
+    w  = 2.0f * PI * corner_hz(CONFIG_EMG_DSP_HIGHPASS_HZ, fs, "highpass") / fs;
+    al = sinf(w) / (2.0f * q_bw);
+    set_stage(0, (1 + cosf(w)) / 2, -(1 + cosf(w)), (1 + cosf(w)) / 2,
+              1 + al, -2 * cosf(w), 1 - al);
+
+    w  = 2.0f * PI * corner_hz(CONFIG_EMG_DSP_MAINS_HZ, fs, "mains notch") / fs;
+    al = sinf(w) / (2.0f * 10.0f);               // Q 10: ~5 Hz wide at 50 Hz
+    set_stage(1, 1, -2 * cosf(w), 1, 1 + al, -2 * cosf(w), 1 - al);
+
+    w  = 2.0f * PI * corner_hz(CONFIG_EMG_DSP_LOWPASS_HZ, fs, "lowpass") / fs;
+    al = sinf(w) / (2.0f * q_bw);
+    set_stage(2, (1 - cosf(w)) / 2, 1 - cosf(w), (1 - cosf(w)) / 2,
+              1 + al, -2 * cosf(w), 1 - al);
+}
+
+static void filters_reset()
+{
+    for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+        arm_biquad_cascade_df1_init_q15(&biquad[ch], STAGES, coeffs, state[ch], 1);
+    }
+}
+
+/* x -> y through each channel's cascade */
+static void filter_block()
+{
+    for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+        arm_biquad_cascade_df1_q15(&biquad[ch], x[ch], y[ch], BLOCK);
+    }
+}
+
+/* RMS or MAV of each channel of y, in ADC counts */
+static void envelope(uint8_t mode, int16_t *out)
+{
+    for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+        q15_t env;
+        if (mode == EMG_KIND_RMS) {
+            arm_rms_q15(y[ch], BLOCK, &env);
+        } else {
+            arm_abs_q15(y[ch], x[ch], BLOCK);   // x[ch] is free by now
+            arm_mean_q15(x[ch], BLOCK, &env);
+        }
+        out[ch] = (int16_t)(env >> IN_SHIFT);
+    }
+}
+
+static void note_time(uint32_t t0)
+{
+    uint32_t dt = k_cycle_get_32() - t0;
+    atomic_inc(&stat_blocks);
+    atomic_add(&stat_cycles, (atomic_val_t)dt);
+    if ((atomic_val_t)dt > atomic_get(&stat_max_cycles)) atomic_set(&stat_max_cycles, (atomic_val_t)dt);
+}
+
+static inline q15_t to_q15(int16_t adc)
+{
+    return (q15_t)((adc - ADC_MID) * (1 << IN_SHIFT));
+}
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+/* Block mode: read the DMA half in place. Only what goes on to the BLE
+ * thread is copied, into pool frames. */
+static void process_dma_block(const emg_block_t *b, uint8_t mode)
+{
+    uint32_t t0 = k_cycle_get_32();
+    uint32_t n = 0;
+
+    if (mode == EMG_KIND_RAW) {
+        for (uint32_t i = 0; i < BLOCK; i++) {
+            emg_frame_t *f = emg_frame_alloc();
+            if (!f) break;
+            f->tick_us = emg_block_tick(b, i);
+            memcpy(f->sample, b->sample[i], sizeof(f->sample));
+            f->kind = EMG_KIND_RAW;
+            blk[n++] = f;
+        }
+    } else {
+        for (uint32_t i = 0; i < BLOCK; i++) {
+            for (uint8_t ch = 0; ch < EMG_CH; ++ch) x[ch][i] = to_q15(b->sample[i][ch]);
+        }
+    }
+    if (!emg_adc_block_done(b)) {                // DMA lapped us: torn data
+        for (uint32_t i = 0; i < n; i++) emg_frame_free(blk[i]);
+        return;
+    }
+    if (mode == EMG_KIND_RAW) {
+        for (uint32_t i = 0; i < n; i++) k_fifo_put(&tx_fifo, blk[i]);
+        return;
+    }
+
+    filter_block();
+    if (mode == EMG_KIND_FILTERED) {
+        for (uint32_t i = 0; i < BLOCK; i++) {
+            emg_frame_t *f = emg_frame_alloc();
+            if (!f) break;
+            f->tick_us = emg_block_tick(b, i);
+            for (uint8_t ch = 0; ch < EMG_CH; ++ch) f->sample[ch] = (int16_t)(y[ch][i] >> IN_SHIFT);
+            f->kind = mode;
+            k_fifo_put(&tx_fifo, f);
+        }
+    } else if (emg_frame_t *f = emg_frame_alloc()) {
+        f->tick_us = emg_block_tick(b, BLOCK - 1);  // the tick ends the window
+        envelope(mode, f->sample);
+        f->kind = mode;
+        k_fifo_put(&tx_fifo, f);
+    }
+    note_time(t0);
+}
+#else
+/* Hand the collected frames on unprocessed (mode change) */
+static void forward_raw()
+{
+    for (uint32_t i = 0; i < blk_len; i++) k_fifo_put(&tx_fifo, blk[i]);
+    blk_len = 0;
+}
+
+static void process_block(uint8_t mode)
+{
+    uint32_t t0 = k_cycle_get_32();
+
+    for (uint32_t i = 0; i < BLOCK; i++) {
+        for (uint8_t ch = 0; ch < EMG_CH; ++ch) x[ch][i] = to_q15(blk[i]->sample[ch]);
+    }
+    filter_block();
+
+    if (mode == EMG_KIND_FILTERED) {
+        for (uint32_t i = 0; i < BLOCK; i++) {
+            for (uint8_t ch = 0; ch < EMG_CH; ++ch) {
+                blk[i]->sample[ch] = (int16_t)(y[ch][i] >> IN_SHIFT);
+            }
+            blk[i]->kind = mode;
+        }
+    } else {
+        /* One frame per block: the newest one, so its tick ends the window */
+        envelope(mode, blk[BLOCK - 1]->sample);
+        blk[BLOCK - 1]->kind = mode;
+    }
+    note_time(t0);
+
+    if (mode == EMG_KIND_FILTERED) {
+        for (uint32_t i = 0; i < BLOCK; i++) k_fifo_put(&tx_fifo, blk[i]);
+    } else {
+        for (uint32_t i = 0; i + 1 < BLOCK; i++) emg_frame_free(blk[i]);
+        k_fifo_put(&tx_fifo, blk[BLOCK - 1]);
+    }
+    blk_len = 0;
+}
+#endif
+
+int emg_dsp_set_mode(uint8_t mode)
+{
+    if (mode >= EMG_KIND_COUNT) return -EINVAL;
+    atomic_set(&dsp_mode, mode);
+    return 0;
+}
+
+uint8_t emg_dsp_mode()
+{
+    return (uint8_t)atomic_get(&dsp_mode);
+}
+
+void emg_dsp_stats_get(emg_dsp_stats_t *stats, bool reset)
+{
+    uint32_t blocks = atomic_get(&stat_blocks);
+    uint32_t cycles = atomic_get(&stat_cycles);
+    stats->blocks = blocks;
+    stats->avg_us = blocks ? k_cyc_to_us_floor32(cycles / blocks) : 0;
+    stats->max_us = k_cyc_to_us_floor32(atomic_get(&stat_max_cycles));
+    if (reset) {
+        atomic_clear(&stat_blocks);
+        atomic_clear(&stat_cycles);
+        atomic_clear(&stat_max_cycles);
+    }
+}
+
+/* Worker thread: adc_fifo (or DMA blocks) -> (filter / envelope) -> tx_fifo */
+void emg_dsp_thread()
+{
+    design_filters();
+    filters_reset();
+    uint8_t blk_mode = emg_dsp_mode();
+    LOG_INF("DSP stage: mode %u, %u-frame blocks", blk_mode, BLOCK);
+
+#ifdef CONFIG_EMG_ADC_BLOCK_DMA
+    while (true) {
+        emg_block_t b;
+        if (emg_adc_block_get(&b, K_FOREVER) != 0) continue;
+        uint8_t mode = emg_dsp_mode();
+        if (mode != blk_mode) {
+            filters_reset();                     // no transient from the old stream
+            blk_mode = mode;
+        }
+        process_dma_block(&b, mode);
+    }
+#else
+    while (true) {
+        auto *f = (emg_frame_t*)k_fifo_get(&adc_fifo, K_FOREVER);
+        uint8_t mode = emg_dsp_mode();
+        if (mode != blk_mode) {
+            forward_raw();
+            filters_reset();                     // no transient from the old stream
+            blk_mode = mode;
+        }
+        if (mode == EMG_KIND_RAW) {
+            k_fifo_put(&tx_fifo, f);
+            continue;
+        }
+        blk[blk_len++] = f;
+        if (blk_len == BLOCK) process_block(mode);
+    }
+#endif
+}
+
+K_THREAD_DEFINE(emg_dsp_id, 2048, emg_dsp_thread, NULL, NULL, NULL,
+                4, 0, 0);
@@ -0,0 +1,31 @@
+#pragma once
+#include "emg_adc.hpp"
+#include "emg_packet.hpp"
+
+// On-device processing between adc_fifo and the BLE thread (CONFIG_EMG_DSP).
+//
+// The DSP thread collects CONFIG_EMG_DSP_BLOCK frames, runs them through a
+// CMSIS-DSP q15 biquad cascade per channel (highpass, mains notch, lowpass)
+// and forwards to tx_fifo, depending on the mode:
+//   EMG_KIND_RAW       every frame untouched, no added latency
+//   EMG_KIND_FILTERED  every frame, samples replaced by the filtered signal
+//   EMG_KIND_RMS/MAV   one frame per block carrying the envelope of the
+//                      filtered block (EMG_SPS / CONFIG_EMG_DSP_BLOCK)
+// Output samples stay in ADC counts; filtered ones are centred on 0.
+//
+// With CONFIG_EMG_ADC_BLOCK_DMA the thread reads whole blocks straight out
+// of the ADC's circular DMA ring instead of frames from adc_fifo, and takes
+// pool frames only for what it forwards.
+
+struct emg_dsp_stats_t {
+    uint32_t blocks;                      // blocks filtered since the last reset
+    uint32_t avg_us;                      // processing time per block
+    uint32_t max_us;
+};
+
+// Switch mode; takes effect at the next frame. A partly collected block is
+// forwarded raw. Returns -EINVAL for an unknown mode.
+int emg_dsp_set_mode(uint8_t mode);
+uint8_t emg_dsp_mode();
+
+void emg_dsp_stats_get(emg_dsp_stats_t *stats, bool reset);
@@ -4,6 +4,7 @@ extern void ble_service_init();
 int main()
 {
     k_fifo_init(&adc_fifo);
+    k_fifo_init(&tx_fifo);
     emg_adc_init();
     ble_service_init();
     return 0;
@@ -0,0 +1,384 @@
+#pragma once
+// Lossless EMG frame codec for EMG_PKT_DELTA notifications.
+//
+// The headband firmware uses the Encoder; the ground unit and host tools use
+// the Decoder. Header-only, no heap, no Zephyr dependencies.
+//
+// Packet layout (little-endian):
+//   0   u8   format         EMG_PKT_DELTA | kind << 4 (see emg_packet.hpp)
+//   1   u8   channels
+//   2   u16  seq            +1 per packet
+//   4   u32  base_tick_us   timestamp of frame 0
+//   8   u8   n_frames
+//   9   u8   flags          bit0 keyframe, bit1 keyframe samples are 16-bit
+//   10  u16  dt0_us         tick(frame 1) - tick(frame 0), 0 if one frame
+//   12  k[1 + channels]     Rice parameters, 4 bits each, low nibble first;
+//                           stream 0 is time, then one per channel
+//   ..  bitstream, LSB first:
+//     frame 0   keyframe: each sample raw, 12 bits (unsigned) or 16 bits
+//               otherwise: per channel R(s - s_prev), s_prev = last frame of
+//               the previous packet
+//     frame i   (i >= 2 only) R(dt_i - dt_{i-1}), then for every frame i >= 1
+//               per channel R(s_i - s_{i-1})
+//   R(d) is the Rice code of zigzag(d) with the stream's k: q = v >> k ones
+//   and a zero, then the k low bits. q >= 15 escapes: 15 ones, then v raw
+//   (17 bits for samples, 32 for time).
+//
+// Non-keyframe packets continue from the previous packet, so after a lost
+// packet (sequence gap) the decoder drops packets until the next keyframe.
+// The encoder emits one every keyframe_interval packets; interval 1 makes
+// every packet self-contained.
+#include "emg_packet.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace emg_codec {
+
+constexpr int    MAX_CH       = 16;
+constexpr size_t HDR_FIXED    = 12;
+constexpr int    RICE_ESCAPE  = 15;
+constexpr int    SAMPLE_RAW_BITS = 17;
+constexpr int    TIME_RAW_BITS   = 32;
+
+constexpr uint8_t FLAG_KEYFRAME = 0x01;
+constexpr uint8_t FLAG_WIDE     = 0x02;
+
+constexpr size_t header_bytes(int channels)
+{
+    return HDR_FIXED + (1 + channels + 1) / 2;
+}
+
+inline uint32_t zigzag(int32_t v)   { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t  unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline int rice_bits(uint32_t v, int k, int raw_bits)
+{
+    uint32_t q = v >> k;
+    return (q < (uint32_t)RICE_ESCAPE) ? (int)q + 1 + k : RICE_ESCAPE + raw_bits;
+}
+
+// Rice parameter that roughly minimises the code length for a stream whose
+// zigzag values average sum / n
+inline int choose_k(uint32_t sum, uint32_t n)
+{
+    if (n == 0) return 0;
+    uint32_t mean = sum / n;
+    int k = 0;
+    while (k < 15 && (mean >> (k + 1)) != 0) k++;
+    return k;
+}
+
+class BitWriter {
+public:
+    void reset(uint8_t *buf, size_t cap_bytes)
+    {
+        buf_ = buf; cap_bits_ = cap_bytes * 8; pos_ = 0;
+    }
+    size_t bits() const      { return pos_; }
+    size_t bytes() const     { return (pos_ + 7) / 8; }
+    size_t free_bits() const { return cap_bits_ - pos_; }
+
+    void put(uint32_t v, int n)
+    {
+        for (int i = 0; i < n; i++, pos_++) {
+            uint8_t &b = buf_[pos_ >> 3];
+            if ((pos_ & 7) == 0) b = 0;
+            b |= (uint8_t)(((v >> i) & 1u) << (pos_ & 7));
+        }
+    }
+
+    void rice(uint32_t v, int k, int raw_bits)
+    {
+        uint32_t q = v >> k;
+        if (q < (uint32_t)RICE_ESCAPE) {
+            put((1u << q) - 1, (int)q + 1);         // q ones, then a zero
+            put(v, k);
+        } else {
+            put((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+            put(v, raw_bits);
+        }
+    }
+
+private:
+    uint8_t *buf_ = nullptr;
+    size_t   cap_bits_ = 0;
+    size_t   pos_ = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t *buf, size_t len_bytes) : buf_(buf), len_bits_(len_bytes * 8) {}
+    bool ok() const { return ok_; }
+
+    uint32_t get(int n)
+    {
+        if (pos_ + (size_t)n > len_bits_) { ok_ = false; return 0; }
+        uint32_t v = 0;
+        for (int i = 0; i < n; i++, pos_++) {
+            v |= (uint32_t)((buf_[pos_ >> 3] >> (pos_ & 7)) & 1u) << i;
+        }
+        return v;
+    }
+
+    uint32_t rice(int k, int raw_bits)
+    {
+        uint32_t q = 0;
+        while (q < (uint32_t)RICE_ESCAPE && get(1)) q++;
+        if (q == (uint32_t)RICE_ESCAPE) return get(raw_bits);
+        return (q << k) | get(k);
+    }
+
+private:
+    const uint8_t *buf_;
+    size_t len_bits_;
+    size_t pos_ = 0;
+    bool   ok_ = true;
+};
+
+// -----------------------------------------------------------------------------
+// Encoder: begin() a packet, add() frames until one does not fit (or the
+// flush deadline), finish() to get the packet length.
+// -----------------------------------------------------------------------------
+class Encoder {
+public:
+    Encoder(uint8_t channels, uint16_t keyframe_interval)
+        : ch_(channels > MAX_CH ? MAX_CH : channels),
+          key_interval_(keyframe_interval ? keyframe_interval : 1)
+    {
+        for (int s = 0; s <= MAX_CH; s++) k_[s] = 2;
+    }
+
+    // Next packet is a keyframe (e.g. after a failed notify)
+    void force_keyframe() { since_key_ = 0; }
+
+    // kind (emg_stream_kind) goes into the format byte; a packet of another
+    // kind than the previous one is always a keyframe
+    void begin(uint8_t *out, size_t cap, uint16_t seq, uint8_t kind = EMG_KIND_RAW)
+    {
+        out_ = out;
+        cap_ = cap;
+        n_ = 0;
+        if (kind != kind_) { since_key_ = 0; kind_ = kind; }
+        key_ = (since_key_ == 0) || !have_prev_;
+        wide_ = false;
+        for (int s = 0; s <= ch_; s++) { sum_[s] = 0; cnt_[s] = 0; }
+        size_t hdr = header_bytes(ch_);
+        if (cap < hdr) { cap_ = 0; return; }
+        memset(out, 0, hdr);
+        out[0] = (uint8_t)(EMG_PKT_DELTA | (kind << 4));
+        out[1] = ch_;
+        out[2] = (uint8_t)seq;
+        out[3] = (uint8_t)(seq >> 8);
+        for (int s = 0; s <= ch_; s++) out[HDR_FIXED + s / 2] |= (uint8_t)(k_[s] << (4 * (s & 1)));
+        bw_.reset(out + hdr, cap - hdr);
+    }
+
+    // Append one frame; returns false and leaves the packet unchanged if it
+    // does not fit
+    bool add(uint32_t tick_us, const int16_t *sample)
+    {
+        if (cap_ == 0 || n_ == 255) return false;
+
+        int32_t dd = 0;
+        int bits = 0;
+        if (n_ == 0) {
+            if (key_) {
+                bool wide = false;
+                for (int c = 0; c < ch_; c++) wide |= (sample[c] < 0 || sample[c] > 0x0FFF);
+                bits = ch_ * (wide ? 16 : 12);
+                if (bits > (int)bw_.free_bits()) return false;
+                wide_ = wide;
+            } else {
+                for (int c = 0; c < ch_; c++) {
+                    bits += rice_bits(zigzag(sample[c] - last_[c]), k_[1 + c], SAMPLE_RAW_BITS);
+                }
+            }
+        } else {
+            uint32_t dt = tick_us - last_tick_;
+            if (n_ == 1) {
+                if (dt > 0xFFFF) return false;
+            } else {
+                dd = (int32_t)(dt - last_dt_);
+                bits += rice_bits(zigzag(dd), k_[0], TIME_RAW_BITS);
+            }
+            for (int c = 0; c < ch_; c++) {
+                bits += rice_bits(zigzag(sample[c] - last_[c]), k_[1 + c], SAMPLE_RAW_BITS);
+            }
+        }
+        if (bits > (int)bw_.free_bits()) return false;
+
+        // Write
+        if (n_ == 0) {
+            base_tick_ = tick_us;
+            if (key_) {
+                for (int c = 0; c < ch_; c++) bw_.put((uint16_t)sample[c], wide_ ? 16 : 12);
+            } else {
+                for (int c = 0; c < ch_; c++) putSample(c, sample[c] - last_[c]);
+            }
+        } else {
+            uint32_t dt = tick_us - last_tick_;
+            if (n_ == 1) {
+                dt0_ = (uint16_t)dt;
+            } else {
+                uint32_t v = zigzag(dd);
+                bw_.rice(v, k_[0], TIME_RAW_BITS);
+                track(0, v);
+            }
+            for (int c = 0; c < ch_; c++) putSample(c, sample[c] - last_[c]);
+            last_dt_ = dt;
+        }
+        last_tick_ = tick_us;
+        for (int c = 0; c < ch_; c++) last_[c] = sample[c];
+        n_++;
+        return true;
+    }
+
+    // Fill in the header; returns the packet length (0 if no frames)
+    size_t finish()
+    {
+        if (n_ == 0) return 0;
+        out_[4] = (uint8_t)base_tick_;
+        out_[5] = (uint8_t)(base_tick_ >> 8);
+        out_[6] = (uint8_t)(base_tick_ >> 16);
+        out_[7] = (uint8_t)(base_tick_ >> 24);
+        out_[8] = n_;
+        out_[9] = (key_ ? FLAG_KEYFRAME : 0) | (wide_ ? FLAG_WIDE : 0);
+        uint16_t dt0 = (n_ > 1) ? dt0_ : 0;
+        out_[10] = (uint8_t)dt0;
+        out_[11] = (uint8_t)(dt0 >> 8);
+
+        // Adapt the Rice parameters for the next packet
+        for (int s = 0; s <= ch_; s++) {
+            if (cnt_[s]) k_[s] = choose_k(sum_[s], cnt_[s]);
+        }
+        have_prev_ = true;
+        since_key_ = (uint16_t)((since_key_ + 1) % key_interval_);
+        return header_bytes(ch_) + bw_.bytes();
+    }
+
+    uint8_t frames() const { return n_; }
+
+private:
+    void putSample(int c, int32_t d)
+    {
+        uint32_t v = zigzag(d);
+        bw_.rice(v, k_[1 + c], SAMPLE_RAW_BITS);
+        track(1 + c, v);
+    }
+
+    void track(int s, uint32_t v)
+    {
+        sum_[s] += (v > 0xFFFF ? 0xFFFF : v);
+        cnt_[s]++;
+    }
+
+    uint8_t   ch_;
+    uint16_t  key_interval_;
+    uint16_t  since_key_ = 0;
+    bool      have_prev_ = false;
+    uint8_t   kind_ = EMG_KIND_RAW;
+
+    uint8_t  *out_ = nullptr;
+    size_t    cap_ = 0;
+    BitWriter bw_;
+    uint8_t   n_ = 0;
+    bool      key_ = true;
+    bool      wide_ = false;
+    uint32_t  base_tick_ = 0;
+    uint16_t  dt0_ = 0;
+
+    uint32_t  last_tick_ = 0;
+    uint32_t  last_dt_ = 0;
+    int16_t   last_[MAX_CH] = {};
+    uint8_t   k_[1 + MAX_CH];
+    uint32_t  sum_[1 + MAX_CH] = {};
+    uint32_t  cnt_[1 + MAX_CH] = {};
+};
+
+// -----------------------------------------------------------------------------
+// Decoder: keeps the last frame of the previous packet for non-keyframes.
+// -----------------------------------------------------------------------------
+class Decoder {
+public:
+    enum Status : int {
+        NEED_KEYFRAME = -1,   // sequence gap or no keyframe seen yet; packet dropped
+        MALFORMED     = -2,
+        TOO_MANY      = -3,   // more frames than max_frames, or channel count mismatch
+    };
+
+    // Decode one packet into ticks[0:n) and samples[0:n * channels) (frame
+    // major). Returns n, or a negative Status.
+    int decode(const uint8_t *pkt, size_t len, uint32_t *ticks, int16_t *samples,
+               size_t max_frames, int max_channels = MAX_CH)
+    {
+        if (len < HDR_FIXED || emg_pkt_type(pkt[0]) != EMG_PKT_DELTA) return MALFORMED;
+        kind_ = emg_pkt_kind(pkt[0]);
+        int ch = pkt[1];
+        if (ch == 0 || ch > MAX_CH || len < header_bytes(ch)) return MALFORMED;
+        if (ch > max_channels) return TOO_MANY;
+        uint16_t seq = (uint16_t)(pkt[2] | (pkt[3] << 8));
+        uint32_t base = (uint32_t)pkt[4] | ((uint32_t)pkt[5] << 8) |
+                        ((uint32_t)pkt[6] << 16) | ((uint32_t)pkt[7] << 24);
+        int n = pkt[8];
+        uint8_t flags = pkt[9];
+        uint32_t dt0 = (uint32_t)(pkt[10] | (pkt[11] << 8));
+        if ((size_t)n > max_frames) return TOO_MANY;
+
+        bool key = flags & FLAG_KEYFRAME;
+        bool continues = have_prev_ && ch == ch_ && seq == (uint16_t)(last_seq_ + 1);
+        last_seq_ = seq;
+        if (!key && !continues) {
+            have_prev_ = false;
+            return NEED_KEYFRAME;
+        }
+        ch_ = ch;
+
+        int k[1 + MAX_CH];
+        for (int s = 0; s <= ch; s++) k[s] = (pkt[HDR_FIXED + s / 2] >> (4 * (s & 1))) & 0x0F;
+
+        BitReader br(pkt + header_bytes(ch), len - header_bytes(ch));
+        uint32_t tick = base, dt = dt0;
+        for (int i = 0; i < n; i++) {
+            int16_t *out = samples + (size_t)i * ch;
+            if (i == 0) {
+                for (int c = 0; c < ch; c++) {
+                    if (key) {
+                        out[c] = (flags & FLAG_WIDE) ? (int16_t)br.get(16) : (int16_t)br.get(12);
+                    } else {
+                        out[c] = (int16_t)(last_[c] + unzigzag(br.rice(k[1 + c], SAMPLE_RAW_BITS)));
+                    }
+                }
+            } else {
+                if (i >= 2) dt += (uint32_t)unzigzag(br.rice(k[0], TIME_RAW_BITS));
+                tick += dt;
+                const int16_t *prev = out - ch;
+                for (int c = 0; c < ch; c++) {
+                    out[c] = (int16_t)(prev[c] + unzigzag(br.rice(k[1 + c], SAMPLE_RAW_BITS)));
+                }
+            }
+            ticks[i] = tick;
+        }
+        if (!br.ok()) {
+            have_prev_ = false;
+            return MALFORMED;
+        }
+        if (n > 0) {
+            memcpy(last_, samples + (size_t)(n - 1) * ch, sizeof(int16_t) * ch);
+            have_prev_ = true;
+        }
+        return n;
+    }
+
+    int channels() const { return ch_; }
+    int kind() const     { return kind_; }  // emg_stream_kind of the last packet
+
+private:
+    int      ch_ = 0;
+    int      kind_ = 0;
+    bool     have_prev_ = false;
+    uint16_t last_seq_ = 0;
+    int16_t  last_[MAX_CH] = {};
+};
+
+} // namespace emg_codec
@@ -0,0 +1,52 @@
+#pragma once
+// Over-the-air formats of the EMG data characteristic. Everything is
+// little-endian; host/emg_receiver.py mirrors these layouts.
+//
+// Legacy (CONFIG_EMG_BLE_BATCH=n): one notification per frame carrying
+// EMG_CH x int16 samples and nothing else.
+//
+// Batch (EMG_PKT_BATCH): one notification carries as many frames as fit in
+// the ATT MTU.
+//   offset 0  u8   format        EMG_PKT_BATCH | kind << 4
+//          1  u8   channels
+//          2  u16  seq           +1 per notification; gaps mean lost packets
+//          4  u32  base_tick_us  timestamp of the first frame
+//          8  frames[n]: { u16 dt_us; i16 sample[channels]; }
+// dt_us is relative to base_tick_us; n = (len - 8) / (2 + 2 * channels).
+//
+// Delta (EMG_PKT_DELTA, CONFIG_EMG_BLE_CODEC): same 8-byte prefix, frames
+// losslessly compressed; see emg_codec.hpp for the rest of the layout.
+//
+// The high nibble of the format byte is the emg_stream_kind of the samples
+// (selected on the headband through the control characteristic). Filtered
+// samples and envelopes are in ADC counts like raw ones; envelope frames
+// come once per DSP block and carry the tick of the block's last sample.
+#include <stdint.h>
+#include <stddef.h>
+
+enum : uint8_t {
+    EMG_PKT_BATCH = 0x01,
+    EMG_PKT_DELTA = 0x02,
+};
+
+enum emg_stream_kind : uint8_t {
+    EMG_KIND_RAW      = 0,                // ADC samples as read
+    EMG_KIND_FILTERED = 1,                // highpass + mains notch + lowpass
+    EMG_KIND_RMS      = 2,                // RMS envelope of the filtered signal
+    EMG_KIND_MAV      = 3,                // mean absolute value envelope
+    EMG_KIND_COUNT
+};
+
+inline uint8_t emg_pkt_type(uint8_t format) { return format & 0x0F; }
+inline uint8_t emg_pkt_kind(uint8_t format) { return format >> 4; }
+
+constexpr size_t EMG_BATCH_HDR_BYTES = 8;
+
+constexpr size_t emg_batch_frame_bytes(size_t channels)
+{
+    return 2 + 2 * channels;
+}
+
+// Largest notification payload we build: LE data length 251 minus L2CAP (4)
+// and ATT (3) headers
+constexpr size_t EMG_BATCH_MAX_PAYLOAD = 244;
@@ -1,25 +1,150 @@
 #!/usr/bin/env python3
-import asyncio, struct, csv, time
+import asyncio, struct, csv, sys, time
 from bleak import BleakScanner, BleakClient
 
 DATA_UUID = "3f5b0002-d946-4844-b1ce-b29134ddeaf5"
+CTRL_UUID = "3f5b0003-d946-4844-b1ce-b29134ddeaf5"   # 1 byte: stream mode
+MODES = ["raw", "filtered", "rms", "mav"]             # emg_stream_kind
 
-async def main():
-    dev = await BleakScanner.find_device_by_filter(lambda d, _: "EMG_HEADBAND" in d.name)
+NUM_CH = 5                # legacy packets carry no header
+EMG_PKT_BATCH = 0x01      # see common/emg_packet.hpp
+EMG_PKT_DELTA = 0x02      # see common/emg_codec.hpp
+BATCH_HDR = struct.Struct("<BBHI")  # format, channels, seq, base_tick_us
+DELTA_HDR = struct.Struct("<BBHIBBH")  # ... + n_frames, flags, dt0_us
+RICE_ESCAPE = 15
+
+
+class BitReader:
+    """LSB-first bit reader matching emg_codec::BitReader."""
+
+    def __init__(self, data):
+        self.v = int.from_bytes(data, "little")
+        self.n = 8 * len(data)
+        self.pos = 0
+
+    def get(self, n):
+        if self.pos + n > self.n:
+            raise ValueError("truncated packet")
+        out = (self.v >> self.pos) & ((1 << n) - 1)
+        self.pos += n
+        return out
+
+    def rice(self, k, raw_bits):
+        q = 0
+        while q < RICE_ESCAPE and self.get(1):
+            q += 1
+        if q == RICE_ESCAPE:
+            return self.get(raw_bits)
+        return (q << k) | self.get(k)
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+class DeltaDecoder:
+    """Python port of emg_codec::Decoder (keeps state across packets)."""
+
+    def __init__(self):
+        self.last = None
+        self.last_seq = None
+
+    def decode(self, data):
+        _, ch, seq, base, n, flags, dt0 = DELTA_HDR.unpack_from(data, 0)
+        key = flags & 1
+        continues = (self.last is not None and len(self.last) == ch
+                     and seq == ((self.last_seq or 0) + 1) & 0xFFFF)
+        self.last_seq = seq
+        if not key and not continues:
+            self.last = None
+            return seq, []          # lost the chain; wait for a keyframe
+        hdr = DELTA_HDR.size + (ch + 2) // 2
+        ks = [(data[DELTA_HDR.size + s // 2] >> (4 * (s & 1))) & 0x0F for s in range(ch + 1)]
+        br = BitReader(data[hdr:])
+        frames, tick, dt, prev = [], base, dt0, self.last
+        for i in range(n):
+            if i == 0:
+                if key:
+                    bits = 16 if flags & 2 else 12
+                    cur = [br.get(bits) for _ in range(ch)]
+                    if bits == 16:
+                        cur = [c - 0x10000 if c & 0x8000 else c for c in cur]
+                else:
+                    cur = [p + unzigzag(br.rice(ks[1 + c], 17)) for c, p in enumerate(prev)]
+            else:
+                if i >= 2:
+                    dt = (dt + unzigzag(br.rice(ks[0], 32))) & 0xFFFFFFFF
+                tick = (tick + dt) & 0xFFFFFFFF
+                cur = [p + unzigzag(br.rice(ks[1 + c], 17)) for c, p in enumerate(prev)]
+            cur = [((c + 0x8000) & 0xFFFF) - 0x8000 for c in cur]   # int16 wrap
+            frames.append((tick, cur))
+            prev = cur
+        self.last = prev
+        return seq, frames
+
+
+delta_decoder = DeltaDecoder()
+
+
+def decode(data):
+    """Return (seq, kind, [(tick_us, samples), ...]) for one notification.
+
+    kind is the stream mode (index into MODES). Legacy packets are exactly
+    NUM_CH int16 raw samples with no timestamp; they decode as seq None,
+    tick_us None.
+    """
+    if len(data) == 2 * NUM_CH:
+        return None, 0, [(None, list(struct.unpack("<" + "h" * NUM_CH, data)))]
+    fmt, channels, seq, base_us = BATCH_HDR.unpack_from(data, 0)
+    kind, fmt = fmt >> 4, fmt & 0x0F
+    if fmt == EMG_PKT_DELTA:
+        seq, frames = delta_decoder.decode(data)
+        return seq, kind, frames
+    if fmt != EMG_PKT_BATCH:
+        raise ValueError(f"unknown packet format 0x{fmt:02x}")
+    frame = struct.Struct("<H" + "h" * channels)
+    frames = []
+    for off in range(BATCH_HDR.size, len(data) - frame.size + 1, frame.size):
+        dt, *samples = frame.unpack_from(data, off)
+        frames.append(((base_us + dt) & 0xFFFFFFFF, samples))
+    return seq, kind, frames
+
+
+async def main(mode=None):
+    dev = await BleakScanner.find_device_by_filter(lambda d, _: "EMG_HEADBAND" in (d.name or ""))
     if not dev:
         print("Device not found"); return
 
     async with BleakClient(dev) as c, open("emg_log.csv", "w", newline="") as f:
         writer = csv.writer(f)
+        writer.writerow(["host_s", "tick_us", "seq", "kind", *[f"ch{i}" for i in range(NUM_CH)]])
         t0 = time.time()
+        stats = {"notifies": 0, "frames": 0, "bytes": 0, "lost": 0, "last_seq": None}
 
         def cb(handle, data):
             now = time.time() - t0
-            samples = struct.unpack("<" + "h"*5, data)  # 5 channels
-            writer.writerow([now, *samples])
+            seq, kind, frames = decode(bytes(data))
+            if seq is not None:
+                last = stats["last_seq"]
+                if last is not None:
+                    stats["lost"] += (seq - last - 1) & 0xFFFF
+                stats["last_seq"] = seq
+            stats["notifies"] += 1
+            stats["frames"] += len(frames)
+            stats["bytes"] += len(data)
+            for tick_us, samples in frames:
+                writer.writerow([f"{now:.6f}", tick_us, seq, MODES[kind] if kind < len(MODES) else kind, *samples])
 
+        if mode is not None:
+            await c.write_gatt_char(CTRL_UUID, bytes([MODES.index(mode)]), response=True)
         await c.start_notify(DATA_UUID, cb)
         print("Logging… Ctrl-C to stop")
-        while True: await asyncio.sleep(1)
+        while True:
+            await asyncio.sleep(1)
+            print(f"{stats['notifies']} notif/s, {stats['frames']} frames/s, "
+                  f"{stats['bytes']} B/s, {stats['lost']} packets lost")
+            stats.update(notifies=0, frames=0, bytes=0)
 
-asyncio.run(main())
+if __name__ == "__main__":
+    # optional argument: stream mode to select (raw, filtered, rms, mav)
+    asyncio.run(main(sys.argv[1] if len(sys.argv) > 1 else None))
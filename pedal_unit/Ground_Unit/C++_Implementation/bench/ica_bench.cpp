@@ -0,0 +1,457 @@
+// Benchmark for the ground-unit ICA engines.
+//
+// Sweeps channels x window length x component count over synthetic mixtures
+// and reports, per configuration and engine: wall time per window, iterations
+// to convergence, heap allocations per window (steady state) and throughput
+// in samples/s. Results can be written as CSV/JSON and compared against a
+// previous CSV to catch regressions between releases.
+//
+//   ica_bench [--quick] [--reps N] [--max-iter N] [--engine internal|eigen|all]
+//             [--mode symmetric|deflation|all] [--threads 1,2,4] [--csv out.csv]
+//             [--json out.json] [--baseline old.csv] [--tolerance 0.15]
+//
+// --mode all (the default) runs every engine in both modes; deflation rows
+// are named "<engine>/defl" and their iterations are summed over the
+// components. A summary at the end gives the symmetric/deflation time ratio
+// per configuration and, per engine, channel count and window, the largest
+// component count at which deflation is still the faster mode.
+//
+// --threads adds an "internal/tN" row per listed pool size: the internal
+// engine with a ThreadPool of N threads attached to its workspace (windows
+// below ICA_PARALLEL_MIN_SAMPLES still run on one thread).
+//
+// Exit status is 1 when a workspace-path row (the internal engine's rows)
+// allocated after its warm-up window, or when --baseline is given and any
+// configuration got slower than baseline * (1 + tolerance). It is 2 on a
+// usage error, including a --baseline that cannot be read or that matches
+// none of the measured configurations.
+#include "mainprocess_internal.hpp"
+#include "thread_pool.hpp"
+#ifdef ICA_BENCH_HAVE_EIGEN
+#include "mainprocess.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Allocation counting
+//   On glibc every malloc-family call is interposed (this also catches Eigen,
+//   which allocates through malloc rather than operator new). Elsewhere only
+//   operator new is counted.
+// -----------------------------------------------------------------------------
+static std::atomic<long> g_allocs{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void  __libc_free(void*);
+
+void* malloc(size_t n)            { g_allocs.fetch_add(1, std::memory_order_relaxed); return __libc_malloc(n); }
+void* calloc(size_t c, size_t n)  { g_allocs.fetch_add(1, std::memory_order_relaxed); return __libc_calloc(c, n); }
+void* realloc(void* p, size_t n)  { g_allocs.fetch_add(1, std::memory_order_relaxed); return __libc_realloc(p, n); }
+void* memalign(size_t a, size_t n){ g_allocs.fetch_add(1, std::memory_order_relaxed); return __libc_memalign(a, n); }
+void* aligned_alloc(size_t a, size_t n) { return memalign(a, n); }
+int posix_memalign(void** out, size_t a, size_t n) {
+    void* p = memalign(a, n);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+void free(void* p)                { __libc_free(p); }
+}
+#else
+void* operator new(std::size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+// -----------------------------------------------------------------------------
+// Synthetic data: n_features sources (sine, square, sawtooth, Laplacian and
+// uniform noise in rotation) mixed by a random well-conditioned matrix.
+// -----------------------------------------------------------------------------
+static void makeMixture(int n_samples, int n_features, unsigned seed, Matrix& X) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uni(-1.0f, 1.0f);
+    std::exponential_distribution<float> expo(1.0f);
+
+    Matrix S(n_samples, n_features);
+    for (int j = 0; j < n_features; j++) {
+        float f = 0.002f + 0.013f * j;
+        for (int i = 0; i < n_samples; i++) {
+            float v;
+            switch (j % 5) {
+            case 0:  v = std::sin(f * i); break;
+            case 1:  v = (std::fmod(f * i, 2.0f) < 1.0f) ? 1.0f : -1.0f; break;
+            case 2:  v = std::fmod(f * i, 2.0f) - 1.0f; break;
+            case 3:  v = (uni(rng) < 0 ? -1.0f : 1.0f) * expo(rng); break;
+            default: v = uni(rng); break;
+            }
+            at(S, i, j) = v;
+        }
+    }
+    Matrix A = randomMatrix(n_features, n_features);
+    for (int j = 0; j < n_features; j++) at(A, j, j) += 2.0f;
+    reshape(X, n_samples, n_features);
+    gemm(S, Trans::No, A, Trans::Yes, X);
+}
+
+// -----------------------------------------------------------------------------
+// Measurement
+// -----------------------------------------------------------------------------
+struct Result {
+    std::string engine;
+    int channels = 0, samples = 0, components = 0, reps = 0;
+    double mean_ms = 0, median_ms = 0, max_ms = 0;
+    double iterations = 0;
+    double allocs_per_window = 0;
+    double samples_per_s = 0;
+    bool workspace = false;     // runs in a reused IcaWorkspace: must not allocate
+
+    std::string key() const {
+        std::ostringstream k;
+        k << engine << '/' << channels << '/' << samples << '/' << components;
+        return k.str();
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+template <typename RunFn>
+static Result measure(const std::string& engine, int C, int N, int k, int reps, RunFn run,
+                      bool workspace = false) {
+    Result r;
+    r.engine = engine;
+    r.workspace = workspace;
+    r.channels = C;
+    r.samples = N;
+    r.components = k;
+    r.reps = reps;
+
+    run(); // warm-up: sizes workspaces, faults in pages, grows scratch buffers
+
+    std::vector<double> ms;
+    ms.reserve(reps);
+    long iters = 0;
+    long allocs_before = g_allocs.load();
+    for (int i = 0; i < reps; i++) {
+        auto t0 = Clock::now();
+        iters += run();
+        auto t1 = Clock::now();
+        ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    long allocs = g_allocs.load() - allocs_before;
+
+    std::vector<double> sorted = ms;
+    std::sort(sorted.begin(), sorted.end());
+    for (double v : ms) r.mean_ms += v;
+    r.mean_ms /= reps;
+    r.median_ms = sorted[sorted.size() / 2];
+    r.max_ms = sorted.back();
+    r.iterations = static_cast<double>(iters) / reps;
+    r.allocs_per_window = static_cast<double>(allocs) / reps;
+    r.samples_per_s = (r.median_ms > 0) ? N / (r.median_ms * 1e-3) : 0.0;
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+// Output
+// -----------------------------------------------------------------------------
+static const char* kCsvHeader =
+    "engine,channels,samples,components,reps,mean_ms,median_ms,max_ms,iterations,allocs_per_window,samples_per_s";
+
+static void writeCsv(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << kCsvHeader << '\n';
+    for (const auto& r : results) {
+        out << r.engine << ',' << r.channels << ',' << r.samples << ',' << r.components << ','
+            << r.reps << ',' << r.mean_ms << ',' << r.median_ms << ',' << r.max_ms << ','
+            << r.iterations << ',' << r.allocs_per_window << ',' << r.samples_per_s << '\n';
+    }
+}
+
+static void writeJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out << "    {\"engine\": \"" << r.engine << "\", \"channels\": " << r.channels
+            << ", \"samples\": " << r.samples << ", \"components\": " << r.components
+            << ", \"reps\": " << r.reps << ", \"mean_ms\": " << r.mean_ms
+            << ", \"median_ms\": " << r.median_ms << ", \"max_ms\": " << r.max_ms
+            << ", \"iterations\": " << r.iterations
+            << ", \"allocs_per_window\": " << r.allocs_per_window
+            << ", \"samples_per_s\": " << r.samples_per_s << "}"
+            << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+// engine/channels/samples/components -> median_ms from a CSV written by
+// writeCsv. False if the file cannot be read.
+static bool readBaseline(const std::string& path, std::map<std::string, double>& base) {
+    base.clear();
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot read baseline %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+        std::vector<std::string> f;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, ',')) f.push_back(cell);
+        if (f.size() < 7) continue;
+        base[f[0] + '/' + f[1] + '/' + f[2] + '/' + f[3]] = std::atof(f[6].c_str());
+    }
+    return true;
+}
+
+// Symmetric vs deflation: median time ratio per configuration, then the
+// largest k at which deflation still wins for each engine/channels/window
+static void printCrossover(const std::vector<Result>& results) {
+    std::map<std::string, const Result*> defl;
+    for (const auto& r : results) {
+        const std::string suffix = "/defl";
+        if (r.engine.size() > suffix.size() &&
+            r.engine.compare(r.engine.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            Result base = r;
+            base.engine.resize(r.engine.size() - suffix.size());
+            defl[base.key()] = &r;
+        }
+    }
+
+    std::printf("\nsymmetric / deflation (median ms; > 1: deflation is faster)\n");
+    std::printf("%-13s %4s %6s %3s %10s %10s %9s %9s %8s\n", "engine", "ch", "N", "k", "sym_ms", "defl_ms",
+                "sym_it", "defl_it", "ratio");
+    // engine/channels/samples -> (largest k where deflation wins, or 0; k tested)
+    std::map<std::string, std::pair<int, std::vector<int>>> best;
+    std::vector<std::string> order;
+    for (const auto& r : results) {
+        auto it = defl.find(r.key());
+        if (it == defl.end()) continue;
+        const Result& d = *it->second;
+        const double ratio = (d.median_ms > 0) ? r.median_ms / d.median_ms : 0.0;
+        std::printf("%-13s %4d %6d %3d %10.3f %10.3f %9.1f %9.1f %8.2f\n", r.engine.c_str(), r.channels,
+                    r.samples, r.components, r.median_ms, d.median_ms, r.iterations, d.iterations, ratio);
+        const std::string group = r.engine + '/' + std::to_string(r.channels) + '/' + std::to_string(r.samples);
+        if (!best.count(group)) order.push_back(group);
+        auto& b = best[group];
+        b.second.push_back(r.components);
+        if (ratio > 1.0) b.first = std::max(b.first, r.components);
+    }
+    for (const auto& group : order) {
+        const auto& b = best[group];
+        if (b.first == 0) {
+            std::printf("crossover %-20s symmetric faster for every k tested\n", group.c_str());
+        } else if (b.first == *std::max_element(b.second.begin(), b.second.end())) {
+            std::printf("crossover %-20s deflation faster for every k tested (up to %d)\n", group.c_str(), b.first);
+        } else {
+            std::printf("crossover %-20s deflation faster up to k = %d\n", group.c_str(), b.first);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    int reps = 5;
+    int max_iter = 200;
+    std::string engine = "all", mode = "all", csv_path, json_path, baseline_path;
+    double tolerance = 0.15;
+    std::vector<int> thread_set;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "missing value for %s\n", a.c_str());
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (a == "--quick")          quick = true;
+        else if (a == "--reps")      reps = std::max(1, std::atoi(next().c_str()));
+        else if (a == "--max-iter")  max_iter = std::max(1, std::atoi(next().c_str()));
+        else if (a == "--engine")    engine = next();
+        else if (a == "--mode")      mode = next();
+        else if (a == "--threads") {
+            std::stringstream list(next());
+            std::string item;
+            while (std::getline(list, item, ',')) thread_set.push_back(std::max(1, std::atoi(item.c_str())));
+        }
+        else if (a == "--csv")       csv_path = next();
+        else if (a == "--json")      json_path = next();
+        else if (a == "--baseline")  baseline_path = next();
+        else if (a == "--tolerance") tolerance = std::atof(next().c_str());
+        else {
+            std::fprintf(stderr, "usage: %s [--quick] [--reps N] [--max-iter N] [--engine internal|eigen|all]\n"
+                                 "          [--mode symmetric|deflation|all] [--threads 1,2,4] [--csv out.csv]\n"
+                                 "          [--json out.json] [--baseline old.csv] [--tolerance 0.15]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<int> channel_set   = quick ? std::vector<int>{4, 8, 16} : std::vector<int>{4, 8, 16, 32, 64};
+    std::vector<int> sample_set    = quick ? std::vector<int>{100, 1000} : std::vector<int>{100, 1000, 10000};
+    std::vector<int> component_set = quick ? std::vector<int>{2} : std::vector<int>{2, 4, 8};
+    const float tol = 1e-4f;
+
+    bool run_internal = (engine == "all" || engine == "internal");
+    bool run_symmetric = (mode == "all" || mode == "symmetric");
+    bool run_deflation = (mode == "all" || mode == "deflation");
+    if (!run_symmetric && !run_deflation) {
+        std::fprintf(stderr, "unknown mode %s\n", mode.c_str());
+        return 2;
+    }
+    // A baseline that cannot be read would silently disable the gate: check
+    // it before spending the run
+    std::map<std::string, double> base;
+    if (!baseline_path.empty() && !readBaseline(baseline_path, base)) return 2;
+
+#ifdef ICA_BENCH_HAVE_EIGEN
+    bool run_eigen = (engine == "all" || engine == "eigen");
+#else
+    if (engine == "eigen") {
+        std::fprintf(stderr, "built without Eigen\n");
+        return 2;
+    }
+#endif
+
+    std::vector<std::unique_ptr<ThreadPool>> pools;
+    for (int t : thread_set) pools.emplace_back(new ThreadPool(t));
+
+    std::printf("%-13s %4s %6s %3s %10s %10s %10s %8s %10s %12s\n",
+                "engine", "ch", "N", "k", "mean_ms", "median_ms", "max_ms", "iters", "allocs/win", "samples/s");
+
+    std::vector<Result> results;
+    for (int C : channel_set) {
+        for (int N : sample_set) {
+            if (N < 4 * C) continue; // under-determined covariance, not a meaningful window
+            Matrix X(0, 0);
+            makeMixture(N, C, 1234u + C * 7919u + N, X);
+            for (int k : component_set) {
+                if (k > C) continue;
+                std::vector<Result> rows;
+
+                if (run_internal) {
+                    IcaWorkspace ws(N, C, k);
+                    if (run_symmetric) {
+                        rows.push_back(measure("internal", C, N, k, reps, [&]() {
+                            fastICA(X, k, ws, max_iter, tol);
+                            return ws.iterations;
+                        }, true));
+                    }
+                    if (run_deflation) {
+                        rows.push_back(measure("internal/defl", C, N, k, reps, [&]() {
+                            fastICA(X, k, ws, max_iter, tol, nullptr, ContrastOptions(), IcaMode::Deflation);
+                            return ws.iterations;
+                        }, true));
+                    }
+                    for (auto& pool : pools) {
+                        if (!run_symmetric) break;
+                        ws.pool = pool.get();
+                        std::string name = "internal/t" + std::to_string(pool->size());
+                        rows.push_back(measure(name, C, N, k, reps, [&]() {
+                            fastICA(X, k, ws, max_iter, tol);
+                            return ws.iterations;
+                        }, true));
+                    }
+                }
+#ifdef ICA_BENCH_HAVE_EIGEN
+                if (run_eigen) {
+                    Eigen::MatrixXf XE(N, C);
+                    for (int i = 0; i < N; i++)
+                        for (int j = 0; j < C; j++) XE(i, j) = at(X, i, j);
+                    if (run_symmetric) {
+                        rows.push_back(measure("eigen", C, N, k, reps, [&]() {
+                            int iters = 0;
+                            Eigen::MatrixXf S = fastICA(XE, k, max_iter, tol, &iters);
+                            return iters;
+                        }));
+                    }
+                    if (run_deflation) {
+                        rows.push_back(measure("eigen/defl", C, N, k, reps, [&]() {
+                            int iters = 0;
+                            Eigen::MatrixXf S = fastICA(XE, k, max_iter, tol, &iters, IcaMode::Deflation);
+                            return iters;
+                        }));
+                    }
+                }
+#endif
+                for (const auto& r : rows) {
+                    std::printf("%-13s %4d %6d %3d %10.3f %10.3f %10.3f %8.1f %10.1f %12.0f\n",
+                                r.engine.c_str(), r.channels, r.samples, r.components, r.mean_ms,
+                                r.median_ms, r.max_ms, r.iterations, r.allocs_per_window, r.samples_per_s);
+                    std::fflush(stdout);
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (run_symmetric && run_deflation) printCrossover(results);
+
+    if (!csv_path.empty())  writeCsv(csv_path, results);
+    if (!json_path.empty()) writeJson(json_path, results);
+
+    int status = 0;
+    int allocating = 0;
+    for (const auto& r : results) {
+        if (r.workspace && r.allocs_per_window > 0) {
+            std::printf("ALLOCATES %s: %.1f allocations per window after warm-up\n", r.key().c_str(),
+                        r.allocs_per_window);
+            allocating++;
+        }
+    }
+    if (allocating) status = 1;
+
+    if (!baseline_path.empty()) {
+        int regressions = 0, compared = 0;
+        for (const auto& r : results) {
+            auto it = base.find(r.key());
+            if (it == base.end() || it->second <= 0) continue;
+            compared++;
+            double ratio = r.median_ms / it->second;
+            if (ratio > 1.0 + tolerance) {
+                std::printf("REGRESSION %s: %.3f ms -> %.3f ms (x%.2f)\n",
+                            r.key().c_str(), it->second, r.median_ms, ratio);
+                regressions++;
+            }
+        }
+        std::printf("%d regression(s) in %d configuration(s) against %s (tolerance %.0f%%)\n",
+                    regressions, compared, baseline_path.c_str(), tolerance * 100.0);
+        if (regressions) status = 1;
+        if (compared == 0) {
+            std::fprintf(stderr, "baseline %s matches none of the measured configurations\n",
+                         baseline_path.c_str());
+            return 2;
+        }
+    }
+    return status;
+}
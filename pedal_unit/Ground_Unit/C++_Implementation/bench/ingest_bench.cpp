@@ -0,0 +1,265 @@
+// Benchmark for the headband ingest path (emg_ingest.hpp).
+//
+// A sender thread plays the headband: it produces frames at --rate, packs
+// them into batch or delta notifications of at most EMG_BATCH_MAX_PAYLOAD
+// bytes and sends each one as a datagram to the transport under test. An
+// EmgIngest thread receives, parses and publishes into a SpscFrameRing, and
+// a consumer thread drains the ring the way an IcaPipeline does (but
+// polling every --poll-us instead of every hop, so the ring's own latency is
+// visible). Each frame carries its index in samples 0-1, which lets the
+// consumer report send -> consume latency per frame, gaps and throughput.
+//
+//   ingest_bench [--transport udp:PORT|unix:PATH] [--rate HZ] [--channels N]
+//                [--seconds S] [--format batch|delta] [--poll-us N]
+//
+// Exit status is 1 if fewer frames arrived than were sent.
+#include "emg_codec.hpp"
+#include "emg_ingest.hpp"
+#include "emg_packet.hpp"
+#include "spsc_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string transport = "udp:47011";
+    double rate = 10000.0;       // frames/s: 10x the headband's 1 kHz
+    int channels = 5;
+    double seconds = 3.0;
+    bool delta = false;
+    int poll_us = 100;
+};
+
+// Ring as wide as the codec allows; unused channels stay zero
+constexpr size_t kRingChannels = emg_codec::MAX_CH;
+using BenchRing = SpscFrameRing<float, kRingChannels, 4096>;
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count());
+}
+
+// Frame i: index in samples 0-1 (12 bits each, so keyframes stay narrow),
+// a slow wave around mid-scale on the rest
+void makeFrame(uint32_t i, int channels, int16_t* s) {
+    s[0] = static_cast<int16_t>(i & 0x0FFF);
+    s[1] = static_cast<int16_t>((i >> 12) & 0x0FFF);
+    for (int c = 2; c < channels; c++) {
+        s[c] = static_cast<int16_t>(2048 + 300.0 * std::sin(0.01 * i * (c + 1)));
+    }
+}
+
+uint32_t frameIndex(const float* s) {
+    return static_cast<uint32_t>(s[0]) | (static_cast<uint32_t>(s[1]) << 12);
+}
+
+// Plays the headband. sent_ns[i] is set just before frame i's packet goes out.
+void sendStream(const Options& opt, uint32_t total, std::atomic<uint64_t>* sent_ns,
+                std::atomic<uint64_t>& packets_sent) {
+    ingest::DatagramSender tx(opt.transport);
+    if (!tx.ok()) {
+        std::fprintf(stderr, "sender: cannot open %s\n", opt.transport.c_str());
+        return;
+    }
+    const uint32_t period_us = static_cast<uint32_t>(1e6 / opt.rate);
+    const size_t batch_frames = (EMG_BATCH_MAX_PAYLOAD - EMG_BATCH_HDR_BYTES) /
+                                emg_batch_frame_bytes(static_cast<size_t>(opt.channels));
+    emg_codec::Encoder enc(static_cast<uint8_t>(opt.channels), 64);
+
+    uint8_t pkt[EMG_BATCH_MAX_PAYLOAD];
+    size_t len = 0;
+    uint32_t first = 0;          // first frame in pkt
+    uint32_t n = 0;              // frames in pkt
+    uint16_t seq = 0;
+
+    auto begin = [&](uint32_t i) {
+        first = i;
+        n = 0;
+        if (opt.delta) {
+            enc.begin(pkt, sizeof(pkt), seq);
+        } else {
+            const uint32_t tick = i * period_us;
+            pkt[0] = EMG_PKT_BATCH;
+            pkt[1] = static_cast<uint8_t>(opt.channels);
+            pkt[2] = static_cast<uint8_t>(seq);
+            pkt[3] = static_cast<uint8_t>(seq >> 8);
+            std::memcpy(pkt + 4, &tick, 4);
+            len = EMG_BATCH_HDR_BYTES;
+        }
+    };
+    auto add = [&](uint32_t i, const int16_t* s) {
+        const uint32_t tick = i * period_us;
+        if (opt.delta) return enc.add(tick, s);
+        if (n == batch_frames) return false;
+        const uint16_t dt = static_cast<uint16_t>(tick - first * period_us);
+        std::memcpy(pkt + len, &dt, 2);
+        std::memcpy(pkt + len + 2, s, 2 * static_cast<size_t>(opt.channels));
+        len += emg_batch_frame_bytes(static_cast<size_t>(opt.channels));
+        return true;
+    };
+    auto flush = [&]() {
+        if (n == 0) return;
+        if (opt.delta) len = enc.finish();
+        const uint64_t t = nowNs();
+        for (uint32_t k = first; k < first + n; k++) sent_ns[k].store(t, std::memory_order_relaxed);
+        tx.send(pkt, len);
+        packets_sent.fetch_add(1, std::memory_order_relaxed);
+        seq++;
+    };
+
+    const auto t0 = Clock::now();
+    int16_t s[emg_codec::MAX_CH];
+    uint32_t i = 0;
+    begin(0);
+    while (i < total) {
+        const double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+        const uint32_t due = std::min(total, static_cast<uint32_t>(elapsed * opt.rate));
+        if (i == due) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        for (; i < due; i++) {
+            makeFrame(i, opt.channels, s);
+            if (!add(i, s)) {
+                flush();
+                begin(i);
+                add(i, s);
+            }
+            n++;
+        }
+    }
+    flush();
+}
+
+double percentile(std::vector<uint32_t>& v, double p) {
+    if (v.empty()) return 0.0;
+    size_t k = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(k), v.end());
+    return v[k];
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--transport" && (v = next())) {
+            opt.transport = v;
+        } else if (a == "--rate" && (v = next())) {
+            opt.rate = std::atof(v);
+        } else if (a == "--channels" && (v = next())) {
+            opt.channels = std::atoi(v);
+        } else if (a == "--seconds" && (v = next())) {
+            opt.seconds = std::atof(v);
+        } else if (a == "--format" && (v = next())) {
+            opt.delta = std::string(v) == "delta";
+        } else if (a == "--poll-us" && (v = next())) {
+            opt.poll_us = std::atoi(v);
+        } else {
+            return false;
+        }
+    }
+    return opt.rate > 0 && opt.seconds > 0 && opt.channels >= 2 &&
+           opt.channels <= static_cast<int>(kRingChannels);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: ingest_bench [--transport udp:PORT|unix:PATH] [--rate HZ] "
+                             "[--channels N] [--seconds S] [--format batch|delta] [--poll-us N]\n");
+        return 2;
+    }
+
+    std::string error;
+    auto transport = ingest::makeTransport(opt.transport, &error);
+    if (!transport) {
+        std::fprintf(stderr, "%s: %s\n", opt.transport.c_str(), error.c_str());
+        return 2;
+    }
+
+    const uint32_t total = static_cast<uint32_t>(opt.rate * opt.seconds);
+    std::unique_ptr<std::atomic<uint64_t>[]> sent_ns(new std::atomic<uint64_t>[total]);
+    for (uint32_t i = 0; i < total; i++) sent_ns[i].store(0);
+    std::vector<uint32_t> latency_us;
+    latency_us.reserve(total);
+
+    static BenchRing ring;
+    ingest::EmgIngest<BenchRing> source(ring, std::move(transport));
+    source.start();
+
+    // Consumer: drain the ring like an IcaPipeline, measuring each frame
+    std::atomic<bool> sender_done{false};
+    uint64_t received = 0;
+    uint32_t gaps = 0;
+    std::thread consumer([&]() {
+        uint32_t expect = 0;
+        auto drained_at = Clock::now();
+        while (!sender_done.load() || Clock::now() - drained_at < std::chrono::milliseconds(200)) {
+            auto w = ring.window(ring.readable());
+            if (!w) {
+                std::this_thread::sleep_for(std::chrono::microseconds(opt.poll_us));
+                continue;
+            }
+            const uint64_t t = nowNs();
+            auto visit = [&](const float* f, size_t frames) {
+                for (size_t k = 0; k < frames; k++, f += kRingChannels) {
+                    uint32_t i = frameIndex(f);
+                    if (i >= total) continue;
+                    if (i != expect) gaps++;
+                    expect = i + 1;
+                    uint64_t s = sent_ns[i].load(std::memory_order_relaxed);
+                    if (s && t > s) latency_us.push_back(static_cast<uint32_t>((t - s) / 1000));
+                    received++;
+                }
+            };
+            visit(w.first, w.first_frames);
+            visit(w.second, w.second_frames);
+            ring.consume(w.frames());
+            drained_at = Clock::now();
+        }
+    });
+
+    std::atomic<uint64_t> packets_sent{0};
+    const auto t0 = Clock::now();
+    sendStream(opt, total, sent_ns.get(), packets_sent);
+    const double send_s = std::chrono::duration<double>(Clock::now() - t0).count();
+    sender_done.store(true);
+    consumer.join();
+    source.stop();
+
+    const ingest::IngestStats& st = source.stats();
+    const uint64_t packets = st.packets.load();
+    std::printf("transport      %s (%s, %d ch)\n", opt.transport.c_str(),
+                opt.delta ? "delta" : "batch", opt.channels);
+    std::printf("offered        %.0f frames/s for %.1f s: %u frames in %llu packets\n",
+                opt.rate, opt.seconds, total, (unsigned long long)packets_sent.load());
+    std::printf("received       %llu frames (%.0f frames/s), %llu packets, %.1f kB/s\n",
+                (unsigned long long)received, received / send_s, (unsigned long long)packets,
+                st.bytes.load() / send_s / 1000.0);
+    std::printf("published      %llu frames into the ring\n", (unsigned long long)st.frames.load());
+    std::printf("lost           %llu packets (seq), %llu bad, %llu ring drops, %u gaps\n",
+                (unsigned long long)st.lost_packets.load(), (unsigned long long)st.bad_packets.load(),
+                (unsigned long long)st.ring_drops.load(), gaps);
+    std::printf("parse+publish  avg %.2f us, max %.2f us per packet\n",
+                packets ? st.parse_ns_sum.load() / 1000.0 / packets : 0.0, st.parse_ns_max.load() / 1000.0);
+    std::printf("send->consume  p50 %.0f us, p99 %.0f us, p99.9 %.0f us, max %.0f us\n",
+                percentile(latency_us, 0.50), percentile(latency_us, 0.99),
+                percentile(latency_us, 0.999), percentile(latency_us, 1.0));
+    return received < total ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+// Benchmark for the control output stage (gain_output.hpp).
+//
+// Part 1 times what the compute thread pays per gain update: a
+// GainPort::publish() against writing the same update straight to a sink
+// the way analogWrite did (formatted line, flushed, on the calling thread).
+// --direct picks that sink (default: a file in /tmp; a terminal or a pipe
+// is slower and less predictable still).
+//
+// Part 2 runs the stage for --seconds with a file sink and a publisher that
+// samples a 1 Hz full-scale sine every --period-ms (the ICA cadence) as the
+// target, then reads the trajectory back and reports the output rate, the
+// largest jump between targets against the steepest output slope once the
+// output has caught up (the interpolation: the sine itself peaks at 801/s),
+// the steepest slope against the slew limit, and the targets and ticks that
+// were dropped.
+//
+// Part 3 publishes a valid target, then NaN and infinite ones, then another
+// valid one, and checks that the port dropped the bad targets, never wrote a
+// non-finite gain and settled on the last valid target.
+//
+//   output_bench [--rate HZ] [--slew PER_S] [--period-ms MS] [--seconds S]
+//                [--updates N] [--direct PATH]
+//
+// Exit status is 1 if a step exceeds the slew limit or part 3 fails.
+#include "gain_output.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    double rate = 1000.0;        // output ticks/s
+    float slew = 1020.0f;        // gain units/s
+    double period_ms = 10.0;     // between targets (a 10-frame hop at 1 kHz)
+    double seconds = 2.0;
+    int updates = 100000;        // part 1
+    std::string direct = "/tmp/output_bench_direct.txt";
+};
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--rate" && (v = next())) {
+            opt.rate = std::atof(v);
+        } else if (a == "--slew" && (v = next())) {
+            opt.slew = static_cast<float>(std::atof(v));
+        } else if (a == "--period-ms" && (v = next())) {
+            opt.period_ms = std::atof(v);
+        } else if (a == "--seconds" && (v = next())) {
+            opt.seconds = std::atof(v);
+        } else if (a == "--updates" && (v = next())) {
+            opt.updates = std::atoi(v);
+        } else if (a == "--direct" && (v = next())) {
+            opt.direct = v;
+        } else {
+            return false;
+        }
+    }
+    return opt.rate > 0 && opt.slew > 0 && opt.period_ms > 0 && opt.seconds > 0 && opt.updates > 0;
+}
+
+double percentile(std::vector<uint32_t>& v, double p) {
+    if (v.empty()) return 0.0;
+    size_t k = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(k), v.end());
+    return v[k];
+}
+
+void printRow(const char* name, std::vector<uint32_t>& ns) {
+    std::printf("%-10s %10.0f %10.0f %10.0f %10.0f\n", name, percentile(ns, 0.5), percentile(ns, 0.99),
+                percentile(ns, 0.999), percentile(ns, 1.0));
+}
+
+// Part 1: compute-side cost per update
+bool timeUpdates(const Options& opt) {
+    std::FILE* direct = std::fopen(opt.direct.c_str(), "w");
+    if (!direct) {
+        std::perror(opt.direct.c_str());
+        return false;
+    }
+    output::GainStage stage(output::StageOptions{opt.rate, opt.slew});
+    output::GainPort& port = stage.addPort("bench", 2, {});
+    stage.start();
+
+    std::vector<uint32_t> publish_ns, direct_ns;
+    publish_ns.reserve(opt.updates);
+    direct_ns.reserve(opt.updates);
+    for (int i = 0; i < opt.updates; i++) {
+        const float gains[2] = {static_cast<float>(i % 256), static_cast<float>(255 - i % 256)};
+
+        auto t0 = Clock::now();
+        port.publish(gains, 2);
+        auto t1 = Clock::now();
+        std::fprintf(direct, "Pin 1 set to %d\nPin 2 set to %d\n", (int)gains[0], (int)gains[1]);
+        std::fflush(direct);
+        auto t2 = Clock::now();
+
+        publish_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+        direct_ns.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()));
+    }
+    stage.stop();
+    std::fclose(direct);
+
+    std::printf("compute-side cost per update, %d updates (ns)\n", opt.updates);
+    std::printf("%-10s %10s %10s %10s %10s\n", "path", "p50", "p99", "p99.9", "max");
+    printRow("publish", publish_ns);
+    printRow("direct", direct_ns);
+    return true;
+}
+
+// Part 2: output trajectory under a sampled sine
+bool runTrajectory(const Options& opt) {
+    const std::string path = "/tmp/output_bench_trajectory.csv";
+    std::string error;
+    std::vector<std::unique_ptr<output::Sink>> sinks;
+    sinks.push_back(output::makeSink("file:" + path, &error));
+    if (!sinks.back()) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    int targets = 0;
+    float last_target = 127.5f, max_jump = 0.0f;
+    uint64_t ticks, skipped, superseded;
+    {
+        output::GainStage stage(output::StageOptions{opt.rate, opt.slew});
+        output::GainPort& port = stage.addPort("bench", 1, std::move(sinks));
+        stage.start();
+        const auto t0 = Clock::now();
+        const auto period = std::chrono::duration<double, std::milli>(opt.period_ms);
+        for (auto next = t0; Clock::now() - t0 < std::chrono::duration<double>(opt.seconds);
+             next += std::chrono::duration_cast<Clock::duration>(period)) {
+            std::this_thread::sleep_until(next);
+            const double t = std::chrono::duration<double>(next - t0).count();
+            const float gain = static_cast<float>(127.5 + 127.5 * std::sin(2.0 * M_PI * t));
+            if (targets++ > 0) max_jump = std::max(max_jump, std::fabs(gain - last_target));
+            last_target = gain;
+            port.publish(&gain, 1);
+        }
+        stage.stop();
+        ticks = stage.ticks();
+        skipped = stage.ticksSkipped();
+        superseded = port.superseded();
+    }
+
+    // Read back (the sink was closed with the stage)
+    std::FILE* f = std::fopen(path.c_str(), "r");
+    if (!f) {
+        std::perror(path.c_str());
+        return false;
+    }
+    char line[128];
+    std::fgets(line, sizeof(line), f);    // header
+    unsigned long long t_ns, t_first = 0, t_last = 0;
+    float g, prev = 0.0f, max_slope = 0.0f, max_slew = 0.0f;
+    double max_dt = 0.0;
+    size_t rows = 0;
+    while (std::fscanf(f, "%llu,%f", &t_ns, &g) == 2) {
+        if (rows == 0) {
+            t_first = t_ns;
+        } else {
+            // Allowed step scales with the time since the previous tick
+            const double dt = (t_ns - t_last) * 1e-9;
+            max_dt = std::max(max_dt, dt);
+            const float slope = static_cast<float>(std::fabs(g - prev) / dt);
+            // The ramp up from 0 to the first targets is slew-bound; leave it out
+            if (rows > 0.5 * opt.rate) max_slope = std::max(max_slope, slope);
+            max_slew = std::max(max_slew, slope / opt.slew);
+        }
+        prev = g;
+        t_last = t_ns;
+        rows++;
+    }
+    std::fclose(f);
+    std::remove(path.c_str());
+
+    const double span = (t_last - t_first) * 1e-9;
+    std::printf("\ntrajectory: %d targets (1 Hz sine, 0..255) every %.1f ms, output %.0f Hz, slew %.0f/s\n",
+                targets, opt.period_ms, opt.rate, opt.slew);
+    std::printf("ticks %llu (%.0f/s), skipped %llu, superseded targets %llu, longest tick gap %.2f ms\n",
+                (unsigned long long)ticks, span > 0 ? (rows - 1) / span : 0.0, (unsigned long long)skipped,
+                (unsigned long long)superseded, max_dt * 1e3);
+    std::printf("largest jump between targets %.2f, steepest output slope %.0f/s after 500 ms\n",
+                max_jump, max_slope);
+    std::printf("steepest output slope / slew limit %.3f\n", max_slew);
+    return max_slew <= 1.0f + 1e-3f;
+}
+
+// Part 3: recovery from non-finite targets
+bool checkNonFinite(const Options& opt) {
+    const std::string path = "/tmp/output_bench_nonfinite.csv";
+    std::string error;
+    std::vector<std::unique_ptr<output::Sink>> sinks;
+    sinks.push_back(output::makeSink("file:" + path, &error));
+    if (!sinks.back()) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    // Long enough for a full-scale move at the slew limit
+    const auto settle = std::chrono::duration<double>(1.5 * 255.0 / opt.slew);
+    const float first = 100.0f, last = 200.0f;
+    const float bad[] = {NAN, INFINITY, -INFINITY};
+    uint64_t rejected;
+    {
+        output::GainStage stage(output::StageOptions{opt.rate, opt.slew});
+        output::GainPort& port = stage.addPort("bench", 2, std::move(sinks));
+        stage.start();
+        const float gains[2] = {first, first};
+        port.publish(gains, 2);
+        std::this_thread::sleep_for(settle);
+        for (float b : bad) {
+            const float g[2] = {first, b};
+            port.publish(g, 2);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        // The ramp to it spans the interval since the first target
+        const float again[2] = {last, last};
+        port.publish(again, 2);
+        std::this_thread::sleep_for(2 * settle + std::chrono::milliseconds(100));
+        stage.stop();
+        rejected = port.rejected();
+    }
+
+    std::FILE* f = std::fopen(path.c_str(), "r");
+    if (!f) {
+        std::perror(path.c_str());
+        return false;
+    }
+    char line[128];
+    std::fgets(line, sizeof(line), f);    // header
+    unsigned long long t_ns;
+    float g0 = 0.0f, g1 = 0.0f;
+    size_t rows = 0, nonfinite = 0;
+    while (std::fscanf(f, "%llu,%f,%f", &t_ns, &g0, &g1) == 3) {
+        if (!std::isfinite(g0) || !std::isfinite(g1)) nonfinite++;
+        rows++;
+    }
+    std::fclose(f);
+    std::remove(path.c_str());
+
+    const bool ok = rows > 0 && nonfinite == 0 && rejected == sizeof(bad) / sizeof(bad[0]) &&
+                    std::fabs(g0 - last) < 0.5f && std::fabs(g1 - last) < 0.5f;
+    std::printf("\nnon-finite targets: %llu of %zu rejected, %zu non-finite ticks of %zu, final %.1f %.1f "
+                "(want %.0f): %s\n",
+                (unsigned long long)rejected, sizeof(bad) / sizeof(bad[0]), nonfinite, rows, g0, g1, last,
+                ok ? "ok" : "FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: output_bench [--rate HZ] [--slew PER_S] [--period-ms MS] [--seconds S]\n"
+                             "                    [--updates N] [--direct PATH]\n");
+        return 2;
+    }
+    if (!timeUpdates(opt)) return 1;
+    const bool trajectory_ok = runTrajectory(opt);
+    const bool nonfinite_ok = checkNonFinite(opt);
+    return trajectory_ok && nonfinite_ok ? 0 : 1;
+}
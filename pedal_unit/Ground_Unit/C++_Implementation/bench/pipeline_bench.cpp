@@ -0,0 +1,263 @@
+// Load test for running many stream pipelines in one process (ica_pipeline.hpp).
+//
+// For each worker count x stream count, a producer thread plays every stream
+// at once: each tick it publishes one frame of a synthetic two-source mixture
+// (different mixing per stream) into that stream's ring. One IcaPipeline per
+// stream drains its ring on a shared PipelineScheduler. Stream 0 runs at a
+// higher priority than the rest, so its latency shows what priorities buy
+// once the workers saturate.
+//
+// Per configuration it reports the windows solved against the hops offered,
+// the mean time inside a step, hop latency (due -> gains out) p50/p99/max
+// over all streams and p99 for stream 0, deadline misses, the share of
+// windows whose solve the deadline cut short (they still emit gains from the
+// best unmixing so far), ring drops and the process CPU load.
+//
+// With --calibrate N the pipelines run two-rate: a background estimator per
+// stream re-solves on the last N frames every --recalibrate frames and the
+// steps only apply its unmixing. The estimates column counts its solves.
+//
+//   pipeline_bench [--streams 1,2,4,8,16] [--workers 1,4] [--seconds S]
+//                  [--rate HZ] [--window N] [--hop N] [--deadline-ms MS]
+//                  [--calibrate N] [--recalibrate N]
+#include "ica_pipeline.hpp"
+#include "spsc_ring.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<int> streams{1, 2, 4, 8, 16};
+    std::vector<int> workers;    // default: 1 and one per hardware thread
+    double seconds = 3.0;
+    double rate = 1000.0;        // frames/s per stream (the headband's rate)
+    int window = 100;
+    int hop = 10;
+    double deadline_ms = 10.0;
+    int calibrate = 0;           // two-rate calibration window (0: off)
+    int recalibrate = 500;
+};
+
+constexpr size_t kChannels = 5;
+using BenchRing = SpscFrameRing<float, kChannels, 1024>;
+
+std::vector<int> parseList(const char* s) {
+    std::vector<int> out;
+    std::stringstream list(s);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (std::atoi(item.c_str()) > 0) out.push_back(std::atoi(item.c_str()));
+    }
+    return out;
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--streams" && (v = next())) {
+            opt.streams = parseList(v);
+        } else if (a == "--workers" && (v = next())) {
+            opt.workers = parseList(v);
+        } else if (a == "--seconds" && (v = next())) {
+            opt.seconds = std::atof(v);
+        } else if (a == "--rate" && (v = next())) {
+            opt.rate = std::atof(v);
+        } else if (a == "--window" && (v = next())) {
+            opt.window = std::atoi(v);
+        } else if (a == "--hop" && (v = next())) {
+            opt.hop = std::atoi(v);
+        } else if (a == "--deadline-ms" && (v = next())) {
+            opt.deadline_ms = std::atof(v);
+        } else if (a == "--calibrate" && (v = next())) {
+            opt.calibrate = std::atoi(v);
+        } else if (a == "--recalibrate" && (v = next())) {
+            opt.recalibrate = std::atoi(v);
+        } else {
+            return false;
+        }
+    }
+    return !opt.streams.empty() && opt.seconds > 0 && opt.rate > 0 && opt.window > 0 && opt.hop > 0 &&
+           opt.calibrate >= 0 && opt.recalibrate > 0;
+}
+
+double cpuSeconds() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+double percentile(std::vector<uint32_t>& v, double p) {
+    if (v.empty()) return 0.0;
+    size_t k = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(k), v.end());
+    return v[k];
+}
+
+struct Stream {
+    std::unique_ptr<BenchRing> ring = std::make_unique<BenchRing>();
+    std::unique_ptr<RingSource<BenchRing>> source;
+    std::unique_ptr<IcaPipeline> pipeline;
+    float mixing[kChannels][2];
+    std::vector<uint32_t> latency_us;   // written by whichever worker runs the pipeline
+};
+
+// Frame i of stream s: a sine and a square wave at stream-specific
+// frequencies, mixed into kChannels with a little noise
+void makeFrame(Stream& st, int s, uint32_t i, std::mt19937& rng, float* out) {
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    const float a = std::sin(0.013f * (s + 1) * i);
+    const float b = (std::fmod(0.0021f * (s + 3) * i, 1.0f) < 0.5f) ? 1.0f : -1.0f;
+    for (size_t c = 0; c < kChannels; c++) {
+        out[c] = st.mixing[c][0] * a + st.mixing[c][1] * b + noise(rng);
+    }
+}
+
+struct Row {
+    int workers, streams;
+    uint64_t windows, offered, misses, hops, dropped, cut, estimates;
+    double run_us, p50, p99, max, p99_first, cpu;
+};
+
+Row runConfig(const Options& opt, int workers, int n_streams) {
+    std::vector<Stream> streams(n_streams);
+    std::atomic<bool> finished{false};
+    const uint64_t deadline_ns = static_cast<uint64_t>(opt.deadline_ms * 1e6);
+    const size_t total = static_cast<size_t>(opt.rate * opt.seconds);
+
+    PipelineScheduler scheduler(workers);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    for (int s = 0; s < n_streams; s++) {
+        Stream& st = streams[s];
+        for (auto& row : st.mixing) {
+            row[0] = u(rng);
+            row[1] = u(rng);
+        }
+        st.latency_us.reserve(total / opt.hop + 16);
+        st.source = std::make_unique<RingSource<BenchRing>>(*st.ring, &finished);
+        PipelineConfig cfg;
+        cfg.name = "stream" + std::to_string(s);
+        cfg.window = opt.window;
+        cfg.hop = opt.hop;
+        cfg.deadline_ns = deadline_ns;
+        cfg.priority = (s == 0) ? 1 : 0;
+        cfg.calibration_window = opt.calibrate;
+        cfg.recalibrate_every = opt.recalibrate;
+        st.pipeline = std::make_unique<IcaPipeline>(cfg, *st.source, nullptr);
+        scheduler.add(*st.pipeline);
+    }
+    scheduler.setObserver([&](int id, uint64_t latency_ns, uint64_t) {
+        streams[id].latency_us.push_back(static_cast<uint32_t>(latency_ns / 1000));
+    });
+
+    const double cpu0 = cpuSeconds();
+    const auto t0 = Clock::now();
+    scheduler.start();
+
+    // Producer: every stream gets the frames due by now
+    std::thread producer([&]() {
+        std::mt19937 noise_rng(7);
+        float frame[kChannels];
+        size_t i = 0;
+        while (i < total) {
+            const double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+            const size_t due = std::min(total, static_cast<size_t>(elapsed * opt.rate));
+            if (i == due) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            for (; i < due; i++) {
+                for (int s = 0; s < n_streams; s++) {
+                    makeFrame(streams[s], s, static_cast<uint32_t>(i), noise_rng, frame);
+                    streams[s].ring->push(frame);
+                }
+            }
+        }
+        finished.store(true, std::memory_order_release);
+    });
+    producer.join();
+    while (!scheduler.allDone()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scheduler.stop();
+    const double wall = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    Row r{};
+    r.workers = workers;
+    r.streams = n_streams;
+    r.offered = static_cast<uint64_t>(n_streams) * (total / opt.hop);
+    std::vector<uint32_t> all;
+    for (int s = 0; s < n_streams; s++) {
+        Stream& st = streams[s];
+        PipelineStats ps = scheduler.stats(s);
+        r.windows += st.pipeline->windows();
+        r.cut += st.pipeline->windowsOutOfTime();
+        if (st.pipeline->estimator()) r.estimates += st.pipeline->estimator()->estimates();
+        r.hops += ps.hops;
+        r.misses += ps.deadline_misses;
+        r.run_us += ps.run_sum_ns / 1000.0;
+        r.dropped += st.ring->dropped();
+        all.insert(all.end(), st.latency_us.begin(), st.latency_us.end());
+    }
+    r.run_us = r.hops ? r.run_us / r.hops : 0.0;
+    r.p99_first = percentile(streams[0].latency_us, 0.99);
+    r.p50 = percentile(all, 0.50);
+    r.p99 = percentile(all, 0.99);
+    r.max = percentile(all, 1.0);
+    r.cpu = (cpuSeconds() - cpu0) / wall * 100.0;
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: pipeline_bench [--streams 1,2,4,8,16] [--workers 1,4] [--seconds S]\n"
+                             "                      [--rate HZ] [--window N] [--hop N] [--deadline-ms MS]\n"
+                             "                      [--calibrate N] [--recalibrate N]\n");
+        return 2;
+    }
+    if (opt.workers.empty()) {
+        int hw = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        opt.workers = (hw > 1) ? std::vector<int>{1, hw} : std::vector<int>{1};
+    }
+
+    std::printf("%zu ch at %.0f Hz per stream, window %d, hop %d, deadline %.1f ms, %.1f s per row\n",
+                kChannels, opt.rate, opt.window, opt.hop, opt.deadline_ms, opt.seconds);
+    if (opt.calibrate > 0) {
+        std::printf("two-rate: re-estimate on %d frames every %d frames\n", opt.calibrate, opt.recalibrate);
+    }
+    std::printf("%7s %7s %9s %9s %8s %8s %8s %8s %10s %8s %6s %8s %6s %10s\n", "workers", "streams", "windows",
+                "offered", "run_us", "p50_us", "p99_us", "max_us", "p99_prio", "late%", "cut%", "dropped", "cpu%",
+                "estimates");
+    for (int w : opt.workers) {
+        for (int s : opt.streams) {
+            Row r = runConfig(opt, w, s);
+            std::printf("%7d %7d %9llu %9llu %8.0f %8.0f %8.0f %8.0f %10.0f %8.2f %6.2f %8llu %6.0f %10llu\n",
+                        r.workers, r.streams, (unsigned long long)r.windows, (unsigned long long)r.offered,
+                        r.run_us, r.p50, r.p99, r.max, r.p99_first,
+                        r.hops ? 100.0 * r.misses / r.hops : 0.0,
+                        r.windows ? 100.0 * r.cut / r.windows : 0.0, (unsigned long long)r.dropped, r.cpu,
+                        (unsigned long long)r.estimates);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
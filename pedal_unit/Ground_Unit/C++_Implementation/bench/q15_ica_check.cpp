@@ -0,0 +1,284 @@
+// Host reference for the fixed-point engine (q15_ica.hpp).
+//
+// For each channel/component shape the targets use, draws --trials random
+// mixtures of known sources (sine, square, Laplacian, sawtooth) plus sensor
+// noise, quantizes them to 12-bit ADC counts around mid-scale, and solves
+// every window with both the float engine and q15FastICA. It reports:
+//   sep     separation quality: per true source, the best |correlation| with
+//           any recovered component, averaged over the sources; the mean and
+//           median over trials, and the worst source seen
+//   agree   per float component, the best |correlation| with a fixed-point
+//           component
+//   iters, us   mean iterations and wall time per window on this host
+// and an FNV-1a hash of every fixed-point W and S. The fixed-point path is
+// integer-only, so a target fed the same frames must reproduce the hash;
+// --save-frames writes them (raw int16 little-endian, window after window,
+// shapes in the order printed) for replay on the target.
+//
+//   q15_ica_check [--trials N] [--samples N] [--seed S] [--max-iter N] [--margin M]
+//                 [--save-frames FILE]
+//
+// Exit status is 1 if the fixed-point median separation of any shape falls
+// more than --margin (default 0.02) below the float engine's. (The median,
+// because either engine now and then settles on a noise direction instead
+// of a source, from its own random start.)
+#include "mainprocess_internal.hpp"
+#include "q15_ica.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kMaxSamples = 2048;
+
+struct Options {
+    int trials = 20;
+    int samples = 1000;
+    unsigned seed = 1;
+    int max_iter = 1000;
+    double margin = 0.02;
+    std::string save_frames;
+};
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--trials" && (v = next())) {
+            opt.trials = std::atoi(v);
+        } else if (a == "--samples" && (v = next())) {
+            opt.samples = std::atoi(v);
+        } else if (a == "--seed" && (v = next())) {
+            opt.seed = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+        } else if (a == "--max-iter" && (v = next())) {
+            opt.max_iter = std::atoi(v);
+        } else if (a == "--margin" && (v = next())) {
+            opt.margin = std::atof(v);
+        } else if (a == "--save-frames" && (v = next())) {
+            opt.save_frames = v;
+        } else {
+            return false;
+        }
+    }
+    return opt.trials > 0 && opt.samples >= 2 && opt.samples <= kMaxSamples && opt.max_iter > 0;
+}
+
+// K sources (n x K, column j = source j), mixed into C channels of int16
+// ADC counts: 12-bit, mid-scale offset, peak at ~75% of the range
+void makeWindow(int n, int C, int K, std::mt19937& rng, std::vector<float>& sources,
+                std::vector<int16_t>& frames) {
+    std::uniform_real_distribution<float> uni(-1.0f, 1.0f);
+    std::exponential_distribution<float> expo(1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+
+    sources.assign(static_cast<size_t>(n) * K, 0.0f);
+    const float phase = 10.0f * (uni(rng) + 1.0f);
+    for (int j = 0; j < K; j++) {
+        const float f = 0.011f + 0.017f * j;
+        for (int i = 0; i < n; i++) {
+            float t = f * i + phase;
+            float v;
+            switch (j % 4) {
+            case 0:  v = std::sin(t); break;
+            case 1:  v = (std::fmod(t, 2.0f) < 1.0f) ? 1.0f : -1.0f; break;
+            case 2:  v = (uni(rng) < 0 ? -1.0f : 1.0f) * expo(rng); break;
+            default: v = std::fmod(t, 2.0f) - 1.0f; break;
+            }
+            sources[static_cast<size_t>(i) * K + j] = v;
+        }
+    }
+
+    std::vector<float> A(static_cast<size_t>(C) * K);
+    for (auto& a : A) a = uni(rng);
+    for (int j = 0; j < K; j++) A[static_cast<size_t>(j) * K + j] += 1.5f;
+
+    std::vector<float> mixed(static_cast<size_t>(n) * C);
+    float peak = 0.0f;
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < C; c++) {
+            float v = noise(rng);
+            for (int j = 0; j < K; j++) v += A[static_cast<size_t>(c) * K + j] * sources[static_cast<size_t>(i) * K + j];
+            mixed[static_cast<size_t>(i) * C + c] = v;
+            peak = std::max(peak, std::fabs(v));
+        }
+    }
+    frames.resize(mixed.size());
+    for (size_t i = 0; i < mixed.size(); i++) {
+        frames[i] = static_cast<int16_t>(std::lround(2048.0f + 1500.0f * mixed[i] / peak));
+    }
+}
+
+double correlation(const float* a, size_t sa, const float* b, size_t sb, int n) {
+    double ma = 0, mb = 0;
+    for (int i = 0; i < n; i++) {
+        ma += a[i * sa];
+        mb += b[i * sb];
+    }
+    ma /= n;
+    mb /= n;
+    double ab = 0, aa = 0, bb = 0;
+    for (int i = 0; i < n; i++) {
+        double x = a[i * sa] - ma, y = b[i * sb] - mb;
+        ab += x * y;
+        aa += x * x;
+        bb += y * y;
+    }
+    return (aa > 0 && bb > 0) ? std::fabs(ab) / std::sqrt(aa * bb) : 0.0;
+}
+
+// For each row of ref (stride ref_s between samples), the best |corr| with
+// any row of est (component-major, K x n); returns the mean, updates worst
+double bestMatch(const float* ref, size_t ref_row, size_t ref_s, int ref_rows, const float* est,
+                 int est_rows, int n, double& worst) {
+    double sum = 0.0;
+    for (int j = 0; j < ref_rows; j++) {
+        double best = 0.0;
+        for (int i = 0; i < est_rows; i++) {
+            best = std::max(best, correlation(ref + j * ref_row, ref_s, est + static_cast<size_t>(i) * n, 1, n));
+        }
+        sum += best;
+        worst = std::min(worst, best);
+    }
+    return sum / ref_rows;
+}
+
+uint64_t fnv1a(uint64_t h, const int16_t* v, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t u = static_cast<uint16_t>(v[i]);
+        for (int b = 0; b < 2; b++) {
+            h ^= (u >> (8 * b)) & 0xFF;
+            h *= 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+double median(std::vector<double> v) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t m = v.size() / 2;
+    return (v.size() % 2) ? v[m] : 0.5 * (v[m - 1] + v[m]);
+}
+
+struct Row {
+    int C = 0, K = 0;
+    double sep_float = 0, sep_fixed = 0, min_float = 1, min_fixed = 1, agree = 0, min_agree = 1;
+    double med_float = 0, med_fixed = 0;
+    double iters_float = 0, iters_fixed = 0, us_float = 0, us_fixed = 0;
+    int failed = 0;               // windows q15Whiten rejected
+    uint64_t hash = 14695981039346656037ull;
+};
+
+template <int C, int K>
+Row runShape(const Options& opt, FILE* save) {
+    Row row;
+    row.C = C;
+    row.K = K;
+    const int n = opt.samples;
+    std::mt19937 rng(opt.seed * 7919u + C * 31u + K);
+
+    auto fixed = std::unique_ptr<Q15IcaWorkspace<C, K, kMaxSamples>>(new Q15IcaWorkspace<C, K, kMaxSamples>());
+    IcaWorkspace ws(n, C, K);
+    Matrix data(n, C);
+    std::vector<float> sources, S_fixed(static_cast<size_t>(K) * n);
+    std::vector<int16_t> frames;
+    std::vector<double> trials_float, trials_fixed;
+
+    for (int t = 0; t < opt.trials; t++) {
+        makeWindow(n, C, K, rng, sources, frames);
+        for (size_t i = 0; i < frames.size(); i++) data.data[i] = frames[i];
+        for (size_t i = 0; save && i < frames.size(); i++) {
+            uint16_t u = static_cast<uint16_t>(frames[i]);
+            std::fputc(u & 0xFF, save);
+            std::fputc(u >> 8, save);
+        }
+
+        auto t0 = Clock::now();
+        const Matrix& S = fastICA(data, K, ws, opt.max_iter);
+        auto t1 = Clock::now();
+        const int16_t* Sq = q15FastICA(Q15Frames{frames.data(), C}, n, *fixed, opt.max_iter);
+        auto t2 = Clock::now();
+        row.us_float += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        row.us_fixed += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        row.iters_float += ws.iterations;
+
+        trials_float.push_back(bestMatch(sources.data(), 1, K, K, S.data.data(), K, n, row.min_float));
+        row.sep_float += trials_float.back();
+        if (!Sq) {
+            row.failed++;
+            row.min_fixed = 0.0;
+            trials_fixed.push_back(0.0);
+            continue;
+        }
+        row.iters_fixed += fixed->iterations;
+        for (size_t i = 0; i < S_fixed.size(); i++) S_fixed[i] = Sq[i];
+        trials_fixed.push_back(bestMatch(sources.data(), 1, K, K, S_fixed.data(), K, n, row.min_fixed));
+        row.sep_fixed += trials_fixed.back();
+        row.agree += bestMatch(S.data.data(), n, 1, K, S_fixed.data(), K, n, row.min_agree);
+        row.hash = fnv1a(row.hash, fixed->W, K * K);
+        row.hash = fnv1a(row.hash, Sq, static_cast<size_t>(K) * n);
+    }
+
+    const double T = opt.trials;
+    row.sep_float /= T;
+    row.sep_fixed /= T;
+    row.med_float = median(trials_float);
+    row.med_fixed = median(trials_fixed);
+    row.agree /= T;
+    row.iters_float /= T;
+    row.iters_fixed /= T;
+    row.us_float /= T;
+    row.us_fixed /= T;
+    return row;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: q15_ica_check [--trials N] [--samples N<=%d] [--seed S] [--max-iter N]\n"
+                             "                     [--margin M] [--save-frames FILE]\n", kMaxSamples);
+        return 2;
+    }
+
+    FILE* save = nullptr;
+    if (!opt.save_frames.empty() && !(save = std::fopen(opt.save_frames.c_str(), "wb"))) {
+        std::perror(opt.save_frames.c_str());
+        return 2;
+    }
+
+    // The simpleCA sketch (4 ch), the headband (5 ch) and the 8-channel boards
+    std::vector<Row> rows;
+    rows.push_back(runShape<4, 2>(opt, save));
+    rows.push_back(runShape<5, 2>(opt, save));
+    rows.push_back(runShape<5, 3>(opt, save));
+    rows.push_back(runShape<8, 4>(opt, save));
+    if (save) std::fclose(save);
+
+    std::printf("%d trials of %d samples, seed %u\n", opt.trials, opt.samples, opt.seed);
+    std::printf("%3s %3s %9s %9s %9s %9s %9s %9s %8s %9s %9s %9s %9s  %-16s\n", "C", "K", "sep_float",
+                "sep_q15", "med_float", "med_q15", "min_float", "min_q15", "agree", "it_float", "it_q15",
+                "us_float", "us_q15", "hash");
+    int status = 0;
+    for (const Row& r : rows) {
+        const bool ok = r.failed == 0 && r.med_fixed >= r.med_float - opt.margin;
+        if (!ok) status = 1;
+        std::printf("%3d %3d %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %8.4f %9.1f %9.1f %9.1f %9.1f  %016llx %s\n",
+                    r.C, r.K, r.sep_float, r.sep_fixed, r.med_float, r.med_fixed, r.min_float, r.min_fixed,
+                    r.agree, r.iters_float,
+                    r.iters_fixed, r.us_float, r.us_fixed, (unsigned long long)r.hash, ok ? "ok" : "FAIL");
+    }
+    return status;
+}
@@ -0,0 +1,219 @@
+// Stress check for the lock-free frame ring (spsc_ring.hpp).
+//
+// A producer thread pushes --frames sequence-stamped frames (sample c of
+// frame s is s * channels + c) while a consumer thread reads them back on
+// another core, both pausing for random short spins so the ring runs
+// empty, full and everywhere between, and the reads cross the wrap. The
+// consumer checks every frame it sees:
+//
+//   torn        a frame whose samples are not all from one sequence number
+//   reordered   a sequence number not above the one before it (window();
+//               in latest() mode, a window that is not the newest frames
+//               in order)
+//   miscounted  received + dropped() != frames in window() mode, or
+//               dropped() != the beginWrite() calls that returned nullptr
+//
+// Both consumer modes run: window()/consume() in batches of 1..--batch
+// frames, then latest(--batch) as the pipelines' sliding window does.
+//
+//   spsc_stress [--frames N] [--batch N]
+//
+// Exit status is 1 on any torn, reordered or miscounted frame.
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr size_t kChannels = 8;
+constexpr size_t kCapacity = 256;
+using Ring = SpscFrameRing<uint32_t, kChannels, kCapacity>;
+
+struct Options {
+    uint32_t frames = 2000000;
+    size_t batch = 64;          // most frames per window() / latest() read
+};
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (a == "--frames" && (v = next())) {
+            opt.frames = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+        } else if (a == "--batch" && (v = next())) {
+            opt.batch = static_cast<size_t>(std::atoi(v));
+        } else {
+            return false;
+        }
+    }
+    // Sequence numbers times channels must not wrap a sample
+    return opt.frames > 0 && opt.frames <= UINT32_MAX / kChannels && opt.batch >= 1 && opt.batch <= kCapacity;
+}
+
+// xorshift32: cheap per-thread randomness for the pauses
+struct Rng {
+    uint32_t s;
+    uint32_t next() {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        return s;
+    }
+};
+
+// Now and then spin for a while or give up the CPU, so each side sometimes
+// falls behind (the yield also interleaves the two on a single core)
+void jitter(Rng& rng) {
+    uint32_t r = rng.next();
+    if ((r & 0xff) != 0) return;
+    if (r & 0x100) {
+        std::this_thread::yield();
+        return;
+    }
+    for (uint32_t i = (r >> 9) & 0x3ff; i > 0; i--) std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+struct Result {
+    uint64_t received = 0;
+    uint64_t torn = 0;
+    uint64_t reordered = 0;
+    uint64_t reads = 0;
+    uint64_t wrapped = 0;       // reads whose window crossed the wrap
+};
+
+// Sequence number of a frame, or -1 if its samples disagree
+int64_t frameSeq(const uint32_t* f) {
+    const uint32_t seq = f[0] / kChannels;
+    for (size_t c = 0; c < kChannels; c++) {
+        if (f[c] != seq * kChannels + c) return -1;
+    }
+    return seq;
+}
+
+uint32_t produce(Ring& ring, const Options& opt, std::atomic<bool>& done) {
+    Rng rng{0x12345678u};
+    uint32_t rejected = 0;
+    for (uint32_t seq = 0; seq < opt.frames; seq++) {
+        jitter(rng);
+        // Mostly wait for room, as a replay source does; now and then write
+        // into a full ring anyway so the drop path runs too
+        while (ring.writable() == 0 && (rng.next() & 0xf) != 0) std::this_thread::yield();
+        uint32_t* slot = ring.beginWrite();
+        if (!slot) {
+            rejected++;
+            continue;
+        }
+        for (size_t c = 0; c < kChannels; c++) slot[c] = seq * kChannels + static_cast<uint32_t>(c);
+        ring.publish();
+    }
+    done.store(true, std::memory_order_release);
+    return rejected;
+}
+
+// window()/consume(): every published frame, in order
+void consumeInOrder(Ring& ring, const Options& opt, const std::atomic<bool>& done, Result& r) {
+    Rng rng{0x9e3779b9u};
+    int64_t last = -1;
+    for (;;) {
+        const bool finished = done.load(std::memory_order_acquire);
+        jitter(rng);
+        Ring::Window w = ring.window(1 + rng.next() % opt.batch);
+        if (!w) {
+            if (finished && ring.readable() == 0) break;
+            continue;
+        }
+        r.reads++;
+        if (w.second_frames) r.wrapped++;
+        for (size_t i = 0; i < w.frames(); i++) {
+            const int64_t seq = frameSeq(w.frame(i));
+            if (seq < 0) {
+                r.torn++;
+            } else {
+                if (seq <= last) r.reordered++;
+                last = seq;
+            }
+        }
+        r.received += w.frames();
+        ring.consume(w.frames());
+    }
+}
+
+// latest(n): the newest n frames in order, and never older than the
+// previous read's newest
+void consumeLatest(Ring& ring, const Options& opt, const std::atomic<bool>& done, Result& r) {
+    Rng rng{0x85ebca6bu};
+    int64_t last_newest = -1;
+    while (!done.load(std::memory_order_acquire) || ring.readable() > opt.batch) {
+        jitter(rng);
+        // Only read once something arrived since the last latest()
+        if (ring.readable() <= opt.batch) {
+            std::this_thread::yield();
+            continue;
+        }
+        Ring::Window w = ring.latest(opt.batch);
+        if (!w) continue;
+        r.reads++;
+        if (w.second_frames) r.wrapped++;
+        int64_t prev = -1;
+        for (size_t i = 0; i < w.frames(); i++) {
+            const int64_t seq = frameSeq(w.frame(i));
+            if (seq < 0) {
+                r.torn++;
+                continue;
+            }
+            if (seq <= prev) r.reordered++;
+            prev = seq;
+        }
+        if (prev >= 0) {
+            if (prev < last_newest) r.reordered++;
+            last_newest = prev;
+        }
+        r.received += w.frames();
+    }
+}
+
+bool run(const char* name, const Options& opt,
+         void (*consume)(Ring&, const Options&, const std::atomic<bool>&, Result&), bool exact) {
+    static Ring ring_in_order, ring_latest;
+    Ring& ring = exact ? ring_in_order : ring_latest;
+    std::atomic<bool> done{false};
+    Result r;
+    uint32_t rejected = 0;
+    std::thread producer([&] { rejected = produce(ring, opt, done); });
+    std::thread consumer([&] { consume(ring, opt, done, r); });
+    producer.join();
+    consumer.join();
+
+    // In window() mode every frame is either received or dropped
+    const uint64_t miscounted = (ring.dropped() != rejected ? 1 : 0) +
+                                (exact && r.received + ring.dropped() != opt.frames ? 1 : 0);
+    const bool ok = r.torn == 0 && r.reordered == 0 && miscounted == 0;
+    std::printf("%-10s %10u %10llu %10u %8llu %8llu %8llu %8llu %10llu  %s\n", name, opt.frames,
+                (unsigned long long)r.received, ring.dropped(), (unsigned long long)r.reads,
+                (unsigned long long)r.wrapped, (unsigned long long)r.torn, (unsigned long long)r.reordered,
+                (unsigned long long)miscounted, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: spsc_stress [--frames N] [--batch N]\n");
+        return 2;
+    }
+    std::printf("%zu channels, capacity %zu frames, reads of at most %zu frames\n", kChannels, kCapacity,
+                opt.batch);
+    std::printf("%-10s %10s %10s %10s %8s %8s %8s %8s %10s\n", "mode", "frames", "received", "dropped",
+                "reads", "wrapped", "torn", "reorder", "miscount");
+    const bool in_order = run("window", opt, consumeInOrder, true);
+    const bool latest = run("latest", opt, consumeLatest, false);
+    return in_order && latest ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#pragma once
+// Ground-unit ingest of the headband's EMG stream.
+//
+// EmgIngest runs a receive loop on its own thread: a Transport (see
+// emg_transport.hpp) hands it one notification payload at a time, a
+// PacketParser decodes it (legacy, batch or delta layouts from
+// emg_headband/common/emg_packet.hpp) and every frame is written straight
+// into a slot of the SpscFrameRing a stream's IcaPipeline reads. There is no
+// queue in between and the loop never allocates, so a frame is visible to
+// the consumer one parse after its datagram arrives. When the consumer falls
+// a full ring behind, frames are dropped at the ring (ring.dropped()) and
+// the latency stays bounded by the ring size.
+#include "emg_codec.hpp"
+#include "emg_packet.hpp"
+#include "emg_transport.hpp"
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace ingest {
+
+// Channels in a legacy (headerless) notification
+constexpr int kLegacyChannels = 5;
+
+// Decodes notification payloads into frames. Keeps the state that spans
+// packets: the delta decoder's previous frame and the sequence number.
+class PacketParser {
+public:
+    enum Status : int {
+        NEED_KEYFRAME = emg_codec::Decoder::NEED_KEYFRAME,
+        MALFORMED     = emg_codec::Decoder::MALFORMED,
+        TOO_MANY      = emg_codec::Decoder::TOO_MANY,
+    };
+
+    // Call sink(tick_us, samples, channels, kind) for each frame of pkt, in
+    // order. Returns the number of frames or a negative Status. Legacy
+    // packets carry no timestamp; their frames get tick_us 0.
+    template <class Sink>
+    int parse(const uint8_t* pkt, size_t len, Sink&& sink) {
+        if (len == 2 * kLegacyChannels) {
+            int16_t s[kLegacyChannels];
+            for (int c = 0; c < kLegacyChannels; c++) s[c] = le16(pkt + 2 * c);
+            sink(uint32_t(0), static_cast<const int16_t*>(s), kLegacyChannels, uint8_t(EMG_KIND_RAW));
+            return 1;
+        }
+        if (len < EMG_BATCH_HDR_BYTES) return MALFORMED;
+        const uint8_t type = emg_pkt_type(pkt[0]);
+        const uint8_t kind = emg_pkt_kind(pkt[0]);
+        const int ch = pkt[1];
+        if (ch == 0 || ch > emg_codec::MAX_CH) return MALFORMED;
+        noteSeq(static_cast<uint16_t>(pkt[2] | (pkt[3] << 8)));
+
+        if (type == EMG_PKT_BATCH) {
+            const size_t fb = emg_batch_frame_bytes(static_cast<size_t>(ch));
+            if ((len - EMG_BATCH_HDR_BYTES) % fb != 0) return MALFORMED;
+            const uint32_t base = le32(pkt + 4);
+            int16_t s[emg_codec::MAX_CH];
+            int n = 0;
+            for (const uint8_t* f = pkt + EMG_BATCH_HDR_BYTES; f + fb <= pkt + len; f += fb, n++) {
+                for (int c = 0; c < ch; c++) s[c] = le16(f + 2 + 2 * c);
+                sink(base + static_cast<uint16_t>(le16(f)), static_cast<const int16_t*>(s), ch, kind);
+            }
+            return n;
+        }
+        if (type == EMG_PKT_DELTA) {
+            int n = delta_.decode(pkt, len, ticks_, samples_, kMaxFrames);
+            for (int i = 0; i < n; i++) {
+                sink(ticks_[i], static_cast<const int16_t*>(samples_ + i * ch), ch, kind);
+            }
+            return n;
+        }
+        return MALFORMED;
+    }
+
+    // Packets missing from sequence gaps so far
+    uint64_t lostPackets() const { return lost_; }
+
+private:
+    static constexpr size_t kMaxFrames = 255;  // n_frames is a u8
+
+    static int16_t  le16(const uint8_t* p) { return static_cast<int16_t>(p[0] | (p[1] << 8)); }
+    static uint32_t le32(const uint8_t* p) {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    void noteSeq(uint16_t seq) {
+        if (have_seq_) lost_ += static_cast<uint16_t>(seq - last_seq_ - 1);
+        last_seq_ = seq;
+        have_seq_ = true;
+    }
+
+    emg_codec::Decoder delta_;
+    uint32_t ticks_[kMaxFrames];
+    int16_t  samples_[kMaxFrames * emg_codec::MAX_CH];
+    bool     have_seq_ = false;
+    uint16_t last_seq_ = 0;
+    uint64_t lost_ = 0;
+};
+
+// Counters of one EmgIngest; written by its thread, readable from any other
+struct IngestStats {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> frames{0};          // published into the ring
+    std::atomic<uint64_t> ring_drops{0};      // parsed, but the ring was full
+    std::atomic<uint64_t> lost_packets{0};    // sequence gaps
+    std::atomic<uint64_t> bad_packets{0};     // malformed, or delta packets lost to a gap
+    std::atomic<uint64_t> parse_ns_max{0};    // receive -> last frame published, per packet
+    std::atomic<uint64_t> parse_ns_sum{0};
+    std::atomic<uint32_t> last_tick_us{0};    // headband timestamp of the newest frame
+};
+
+// Receives from a Transport into a SpscFrameRing<float, C, N> on its own
+// thread. Frames with fewer channels than the ring are zero-padded, extra
+// channels are ignored; samples stay in ADC counts.
+template <class Ring>
+class EmgIngest {
+public:
+    EmgIngest(Ring& ring, std::unique_ptr<Transport> transport)
+        : ring_(ring), transport_(std::move(transport)) {}
+    ~EmgIngest() { stop(); }
+    EmgIngest(const EmgIngest&) = delete;
+    EmgIngest& operator=(const EmgIngest&) = delete;
+
+    // Record every received payload (see CaptureWriter); call before start()
+    void record(std::unique_ptr<CaptureWriter> capture) { capture_ = std::move(capture); }
+
+    void start() {
+        stop_.store(false);
+        thread_ = std::thread(&EmgIngest::run, this);
+    }
+
+    void stop() {
+        stop_.store(true);
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // False once the transport has finished (end of replay, link lost)
+    bool running() const { return !done_.load(std::memory_order_acquire); }
+
+    const IngestStats& stats() const { return stats_; }
+
+private:
+    static uint64_t nowNs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void run() {
+        uint8_t buf[kMaxPayload];
+        while (!stop_.load(std::memory_order_relaxed)) {
+            int len = transport_->receive(buf, sizeof(buf), 100);
+            if (len < 0) break;
+            if (len == 0) continue;
+            const uint64_t t0 = nowNs();
+            if (capture_) capture_->write(t0, buf, static_cast<size_t>(len));
+
+            uint32_t last_tick = 0;
+            uint64_t published = 0;
+            int n = parser_.parse(buf, static_cast<size_t>(len),
+                                  [&](uint32_t tick, const int16_t* s, int ch, uint8_t) {
+                float* slot = ring_.beginWrite();
+                if (!slot) return;  // counted by the ring, and below
+                size_t c = 0;
+                for (; c < Ring::channels && c < static_cast<size_t>(ch); c++) slot[c] = s[c];
+                for (; c < Ring::channels; c++) slot[c] = 0.0f;
+                ring_.publish();
+                published++;
+                last_tick = tick;
+            });
+
+            const uint64_t dt = nowNs() - t0;
+            stats_.packets.fetch_add(1, std::memory_order_relaxed);
+            stats_.bytes.fetch_add(static_cast<uint64_t>(len), std::memory_order_relaxed);
+            stats_.lost_packets.store(parser_.lostPackets(), std::memory_order_relaxed);
+            if (n < 0) {
+                stats_.bad_packets.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            stats_.frames.fetch_add(published, std::memory_order_relaxed);
+            stats_.ring_drops.fetch_add(static_cast<uint64_t>(n) - published, std::memory_order_relaxed);
+            if (published) stats_.last_tick_us.store(last_tick, std::memory_order_relaxed);
+            stats_.parse_ns_sum.fetch_add(dt, std::memory_order_relaxed);
+            if (dt > stats_.parse_ns_max.load(std::memory_order_relaxed)) {
+                stats_.parse_ns_max.store(dt, std::memory_order_relaxed);
+            }
+        }
+        done_.store(true, std::memory_order_release);
+    }
+
+    Ring& ring_;
+    std::unique_ptr<Transport> transport_;
+    std::unique_ptr<CaptureWriter> capture_;
+    PacketParser parser_;
+    IngestStats stats_;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> done_{false};
+    std::thread thread_;
+};
+
+} // namespace ingest
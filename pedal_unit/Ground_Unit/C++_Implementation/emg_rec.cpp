@@ -0,0 +1,386 @@
+// Converts EMG logs to and from the binary recording format (emg_recording.hpp).
+//
+//   emg_rec import IN OUT.emgrec [--rate HZ] [--gain G] [--offset C]
+//                                [--chunk FRAMES] [--raw]
+//       IN is one of
+//         emg_log.csv from emg_headband/host/emg_receiver.py (header row
+//           "host_s,tick_us,seq,kind,ch0,..."); timestamps from tick_us, rows
+//           of another kind than the first are skipped
+//         a serial dump from signal_acquisition/Interface.py
+//           ("HH:MM:SS:mmm,v0,v1,..."); lines that are not all integers
+//           (boot messages) or have another column count are skipped
+//         an EMGCAP01 capture (mainprocess_internal --record); timestamps
+//           from the headband's tick_us
+//       --rate defaults to the median frame interval. Samples are stored as
+//       int16 if they fit, f32 otherwise; int16 chunks are Rice coded unless
+//       --raw is given.
+//   emg_rec export IN.emgrec OUT.csv      t_s, then one column per channel
+//   emg_rec info IN.emgrec [--scan]       header and chunks; --scan decodes
+//                                         every frame and reports throughput
+#include "emg_ingest.hpp"
+#include "emg_recording.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Everything read from an input log, before choosing the sample type
+struct Parsed {
+    int channels = 0;
+    bool timestamps = true;
+    std::vector<std::string> labels;
+    std::vector<int32_t> samples;        // frame-major
+    std::vector<int64_t> t_ns;           // per frame, from 0
+    size_t skipped = 0;
+};
+
+struct ImportOptions {
+    float rate_hz = 0.0f;
+    float gain = 1.0f;
+    float offset = 0.0f;
+    uint32_t chunk_frames = 4096;
+    bool compress = true;
+};
+
+// Split on commas in place; fields point into line
+size_t splitCsv(char* line, std::vector<char*>& fields) {
+    fields.clear();
+    char* p = line;
+    fields.push_back(p);
+    for (; *p; p++) {
+        if (*p == ',') {
+            *p = '\0';
+            fields.push_back(p + 1);
+        } else if (*p == '\r' || *p == '\n') {
+            *p = '\0';
+            break;
+        }
+    }
+    return fields.size();
+}
+
+bool parseInt(const char* s, long long& v) {
+    if (*s == '\0') return false;
+    char* end = nullptr;
+    v = std::strtoll(s, &end, 10);
+    return *end == '\0';
+}
+
+// "HH:MM:SS:mmm" -> ms since midnight
+bool parseClock(const char* s, int64_t& ms) {
+    int h, m, sec, milli;
+    if (std::sscanf(s, "%d:%d:%d:%d", &h, &m, &sec, &milli) != 4) return false;
+    ms = ((int64_t(h) * 60 + m) * 60 + sec) * 1000 + milli;
+    return true;
+}
+
+bool importReceiverCsv(std::FILE* f, char* header, Parsed& out) {
+    std::vector<char*> fields;
+    const size_t cols = splitCsv(header, fields);
+    if (cols < 5) return false;
+    out.channels = static_cast<int>(cols - 4);
+    for (size_t c = 4; c < cols; c++) out.labels.emplace_back(fields[c]);
+
+    std::string kind;
+    uint32_t prev_tick = 0;
+    int64_t tick = 0;
+    char line[1024];
+    while (std::fgets(line, sizeof(line), f)) {
+        if (splitCsv(line, fields) != cols) {
+            out.skipped++;
+            continue;
+        }
+        if (kind.empty()) kind = fields[3];
+        long long t, v;
+        bool ok = kind == fields[3] && parseInt(fields[1], t);
+        for (size_t c = 4; ok && c < cols; c++) ok = parseInt(fields[c], v);
+        if (!ok) {
+            out.skipped++;
+            continue;
+        }
+        const uint32_t now = static_cast<uint32_t>(t);
+        if (!out.t_ns.empty()) tick += static_cast<uint32_t>(now - prev_tick);  // u32 wrap
+        prev_tick = now;
+        out.t_ns.push_back(tick * 1000);
+        for (size_t c = 4; c < cols; c++) out.samples.push_back(static_cast<int32_t>(std::atoll(fields[c])));
+    }
+    return true;
+}
+
+void importSerialDump(std::FILE* f, char* first, Parsed& out) {
+    std::vector<char*> fields;
+    int64_t day = 0, prev_ms = -1, t0 = 0;
+    char line[1024];
+    for (char* l = first; l; l = std::fgets(line, sizeof(line), f)) {
+        const size_t cols = splitCsv(l, fields);
+        int64_t ms;
+        long long v;
+        bool ok = cols >= 2 && parseClock(fields[0], ms) &&
+                  (out.channels == 0 || cols == static_cast<size_t>(out.channels) + 1);
+        for (size_t c = 1; ok && c < cols; c++) ok = parseInt(fields[c], v);
+        if (!ok) {
+            out.skipped++;
+            continue;
+        }
+        if (out.channels == 0) {
+            out.channels = static_cast<int>(cols - 1);
+            t0 = ms;
+        }
+        if (prev_ms >= 0 && ms + day < prev_ms - 12 * 3600 * 1000) day += 24 * 3600 * 1000;  // midnight
+        prev_ms = ms + day;
+        out.t_ns.push_back((ms + day - t0) * 1000000);
+        for (size_t c = 1; c < cols; c++) out.samples.push_back(static_cast<int32_t>(std::atoll(fields[c])));
+    }
+}
+
+bool importCapture(const std::string& path, Parsed& out, std::string& error) {
+    auto transport = ingest::makeTransport("replay:" + path + "@0", &error);
+    if (!transport) return false;
+    ingest::PacketParser parser;
+    uint8_t buf[ingest::kMaxPayload];
+    uint32_t prev_tick = 0;
+    int64_t tick = 0;
+    int len;
+    while ((len = transport->receive(buf, sizeof(buf), 1000)) >= 0) {
+        if (len == 0) continue;
+        const bool legacy = len == 2 * ingest::kLegacyChannels;
+        int n = parser.parse(buf, static_cast<size_t>(len),
+                             [&](uint32_t t, const int16_t* s, int ch, uint8_t) {
+            if (out.channels == 0) out.channels = ch;
+            if (ch != out.channels) return;
+            if (legacy) {
+                t = prev_tick;               // no tick: keep the previous frame's time
+            }
+            if (!out.samples.empty()) tick += static_cast<uint32_t>(t - prev_tick);
+            prev_tick = t;
+            out.t_ns.push_back(tick * 1000);
+            out.samples.insert(out.samples.end(), s, s + ch);
+        });
+        if (n < 0) out.skipped++;
+    }
+    // Legacy packets carry no ticks
+    out.timestamps = std::any_of(out.t_ns.begin(), out.t_ns.end(), [](int64_t t) { return t != 0; });
+    return true;
+}
+
+float medianRate(const std::vector<int64_t>& t_ns) {
+    std::vector<int64_t> dt;
+    for (size_t i = 1; i < t_ns.size(); i++) {
+        if (t_ns[i] > t_ns[i - 1]) dt.push_back(t_ns[i] - t_ns[i - 1]);
+    }
+    if (dt.empty()) return 0.0f;
+    std::nth_element(dt.begin(), dt.begin() + static_cast<long>(dt.size() / 2), dt.end());
+    return static_cast<float>(1e9 / static_cast<double>(dt[dt.size() / 2]));
+}
+
+int cmdImport(const std::string& in, const std::string& out_path, const ImportOptions& opt) {
+    Parsed p;
+    char magic[8] = {};
+    {
+        std::ifstream probe(in, std::ios::binary);
+        if (!probe) {
+            std::fprintf(stderr, "%s: cannot open\n", in.c_str());
+            return 1;
+        }
+        probe.read(magic, sizeof(magic));
+    }
+    if (std::memcmp(magic, "EMGCAP01", 8) == 0) {
+        std::string error;
+        if (!importCapture(in, p, error)) {
+            std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+            return 1;
+        }
+    } else {
+        std::FILE* f = std::fopen(in.c_str(), "r");
+        if (!f) {
+            std::fprintf(stderr, "%s: cannot open\n", in.c_str());
+            return 1;
+        }
+        char first[1024];
+        if (std::fgets(first, sizeof(first), f)) {
+            if (std::strncmp(first, "host_s,", 7) == 0) {
+                importReceiverCsv(f, first, p);
+            } else {
+                importSerialDump(f, first, p);
+            }
+        }
+        std::fclose(f);
+    }
+    if (p.channels == 0 || p.samples.empty()) {
+        std::fprintf(stderr, "%s: no frames found\n", in.c_str());
+        return 1;
+    }
+
+    const size_t frames = p.samples.size() / static_cast<size_t>(p.channels);
+    recording::RecordingInfo info;
+    info.channels = p.channels;
+    info.timestamps = p.timestamps;
+    info.rate_hz = opt.rate_hz > 0.0f ? opt.rate_hz : medianRate(p.t_ns);
+    info.gain = opt.gain;
+    info.offset = opt.offset;
+    info.chunk_frames = opt.chunk_frames;
+    info.labels = p.labels;
+    const bool fits = std::all_of(p.samples.begin(), p.samples.end(),
+                                  [](int32_t v) { return v >= INT16_MIN && v <= INT16_MAX; });
+    info.type = fits ? recording::SAMPLE_I16 : recording::SAMPLE_F32;
+    if (!p.timestamps && info.rate_hz <= 0.0f) {
+        std::fprintf(stderr, "%s: no timestamps, give --rate\n", in.c_str());
+        return 1;
+    }
+
+    recording::RecordingWriter w(out_path, info, opt.compress);
+    std::vector<float> frame(static_cast<size_t>(p.channels));
+    for (size_t i = 0; i < frames && w.ok(); i++) {
+        const int32_t* s = &p.samples[i * static_cast<size_t>(p.channels)];
+        for (int c = 0; c < p.channels; c++) frame[c] = static_cast<float>(s[c]);
+        w.append(frame.data(), p.timestamps ? p.t_ns[i] : 0);
+    }
+    if (!w.close()) {
+        std::fprintf(stderr, "%s: %s\n", out_path.c_str(), w.error().c_str());
+        return 1;
+    }
+    std::printf("%s: %zu frames x %d ch (%s), %.1f Hz, %zu lines skipped -> %" PRIu64 " bytes\n",
+                out_path.c_str(), frames, p.channels, fits ? "int16" : "f32", info.rate_hz,
+                p.skipped, w.bytes());
+    return 0;
+}
+
+int cmdExport(const std::string& in, const std::string& out_path) {
+    std::string error;
+    auto rec = recording::Recording::open(in, &error);
+    if (!rec) {
+        std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+        return 1;
+    }
+    std::FILE* f = std::fopen(out_path.c_str(), "w");
+    if (!f) {
+        std::fprintf(stderr, "%s: cannot create\n", out_path.c_str());
+        return 1;
+    }
+    const auto& info = rec->info();
+    const size_t ch = static_cast<size_t>(info.channels);
+    std::fprintf(f, "t_s");
+    for (size_t c = 0; c < ch; c++) {
+        if (info.labels[c].empty()) {
+            std::fprintf(f, ",ch%zu", c);
+        } else {
+            std::fprintf(f, ",%s", info.labels[c].c_str());
+        }
+    }
+    std::fprintf(f, "\n");
+    constexpr size_t kBatch = 4096;
+    std::vector<float> buf(kBatch * ch);
+    std::vector<int64_t> t(kBatch);
+    for (uint64_t first = 0; first < rec->frames();) {
+        size_t n = rec->read(first, kBatch, buf.data(), t.data());
+        if (n == 0) break;
+        for (size_t i = 0; i < n; i++) {
+            std::fprintf(f, "%.6f", t[i] / 1e9);
+            for (size_t c = 0; c < ch; c++) std::fprintf(f, ",%g", buf[i * ch + c]);
+            std::fprintf(f, "\n");
+        }
+        first += n;
+    }
+    return std::fclose(f) == 0 ? 0 : 1;
+}
+
+int cmdInfo(const std::string& in, bool scan) {
+    std::string error;
+    auto rec = recording::Recording::open(in, &error);
+    if (!rec) {
+        std::fprintf(stderr, "%s: %s\n", in.c_str(), error.c_str());
+        return 1;
+    }
+    const auto& info = rec->info();
+    const double seconds = rec->frames() ? (rec->timeOf(rec->frames() - 1) - rec->timeOf(0)) / 1e9 : 0.0;
+    std::printf("%s\n", in.c_str());
+    std::printf("  %d ch, %s, %.2f Hz nominal, gain %g, offset %g%s\n", info.channels,
+                info.type == recording::SAMPLE_I16 ? "int16" : "f32", info.rate_hz, info.gain,
+                info.offset, info.timestamps ? ", timestamped" : "");
+    std::printf("  %" PRIu64 " frames, %.1f s, %zu chunks of %u frames\n", rec->frames(), seconds,
+                rec->chunks(), info.chunk_frames);
+    const double raw = static_cast<double>(rec->frames()) * info.channels *
+                       (info.type == recording::SAMPLE_I16 ? 2 : 4);
+    std::printf("  %zu bytes, %.2f bytes/frame (%.0f%% of raw samples)\n", rec->fileBytes(),
+                rec->frames() ? static_cast<double>(rec->fileBytes()) / rec->frames() : 0.0,
+                raw > 0 ? 100.0 * rec->fileBytes() / raw : 0.0);
+    if (!scan) return 0;
+
+    constexpr size_t kBatch = 4096;
+    std::vector<float> buf(kBatch * static_cast<size_t>(info.channels));
+    const auto t0 = std::chrono::steady_clock::now();
+    uint64_t read = 0;
+    double checksum = 0.0;
+    while (read < rec->frames()) {
+        size_t n = rec->read(read, kBatch, buf.data());
+        if (n == 0) break;
+        checksum += buf[0];
+        read += n;
+    }
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("  scan: %" PRIu64 " frames in %.3f s, %.1f M frames/s, %.0f MB/s of file (%g)\n", read,
+                s, read / s / 1e6, rec->fileBytes() / s / 1e6, checksum);
+    return read == rec->frames() ? 0 : 1;
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: emg_rec import IN OUT [--rate HZ] [--gain G] [--offset C] [--chunk N] [--raw]\n"
+                 "       emg_rec export IN OUT.csv\n"
+                 "       emg_rec info IN [--scan]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    const std::string cmd = argv[1];
+    if (cmd == "info") {
+        return cmdInfo(argv[2], argc > 3 && std::string(argv[3]) == "--scan");
+    }
+    if (argc < 4) {
+        usage();
+        return 2;
+    }
+    if (cmd == "export") return cmdExport(argv[2], argv[3]);
+    if (cmd != "import") {
+        usage();
+        return 2;
+    }
+    ImportOptions opt;
+    for (int i = 4; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (a == "--raw") {
+            opt.compress = false;
+        } else if (a == "--rate" && v) {
+            opt.rate_hz = std::strtof(v, nullptr);
+            i++;
+        } else if (a == "--gain" && v) {
+            opt.gain = std::strtof(v, nullptr);
+            i++;
+        } else if (a == "--offset" && v) {
+            opt.offset = std::strtof(v, nullptr);
+            i++;
+        } else if (a == "--chunk" && v) {
+            opt.chunk_frames = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+            i++;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    return cmdImport(argv[2], argv[3], opt);
+}
@@ -0,0 +1,574 @@
+#include "emg_recording.hpp"
+#include "emg_codec.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Multi-byte fields are written and read in host order: every platform the
+// ground unit runs on (x86-64, AArch64, ESP32) is little-endian.
+
+namespace recording {
+
+namespace {
+
+const char kMagic[8] = {'E', 'M', 'G', 'R', 'E', 'C', '0', '1'};
+constexpr uint16_t kVersion = 1;
+constexpr size_t kHeaderBytes = 64;
+constexpr size_t kChunkHeaderBytes = 16;
+constexpr size_t kIndexEntryBytes = 24;
+constexpr uint8_t kFlagTimestamps = 0x01;
+constexpr int kMaxChannels = 256;
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+template <typename T>
+T load(const uint8_t* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+template <typename T>
+void store(uint8_t* p, T v) {
+    std::memcpy(p, &v, sizeof(T));
+}
+
+void setError(std::string* error, const std::string& what) {
+    if (error) *error = what;
+}
+
+int64_t frameTimeNs(uint64_t frame, float rate_hz) {
+    return rate_hz > 0.0f ? static_cast<int64_t>(static_cast<double>(frame) * 1e9 / rate_hz) : 0;
+}
+
+// Header (without labels) for info and the totals known at close
+void packHeader(uint8_t* h, const RecordingInfo& info, uint64_t frames, uint64_t index_offset,
+                uint32_t chunks) {
+    std::memset(h, 0, kHeaderBytes);
+    std::memcpy(h, kMagic, sizeof(kMagic));
+    store<uint16_t>(h + 8, kVersion);
+    store<uint16_t>(h + 10, static_cast<uint16_t>(info.channels));
+    h[12] = info.type;
+    h[13] = info.timestamps ? kFlagTimestamps : 0;
+    store<uint16_t>(h + 14, static_cast<uint16_t>(kHeaderBytes + kLabelBytes * info.channels));
+    store<float>(h + 16, info.rate_hz);
+    store<float>(h + 20, info.gain);
+    store<float>(h + 24, info.offset);
+    store<uint32_t>(h + 28, info.chunk_frames);
+    store<uint64_t>(h + 32, frames);
+    store<uint64_t>(h + 40, index_offset);
+    store<uint32_t>(h + 48, chunks);
+    store<int64_t>(h + 56, info.start_unix_ns);
+}
+
+// Rice stream in the bit layout of emg_codec (LSB first, escape after
+// RICE_ESCAPE ones), read a 64-bit word at a time. Reads past the end see
+// zeros; overrun() tells afterwards whether that happened.
+class WordBitReader {
+public:
+    WordBitReader(const uint8_t* p, size_t len) : p_(p), end_(p + len), avail_(len * 8) {}
+
+    uint32_t get(int k) {
+        if (k == 0) return 0;
+        if (n_ < k) refill();
+        uint32_t v = static_cast<uint32_t>(buf_ & ((uint64_t(1) << k) - 1));
+        take(k);
+        return v;
+    }
+
+    uint32_t rice(int k, int raw_bits) {
+        refill();
+        uint64_t ones = ~buf_;
+        int q = ones ? __builtin_ctzll(ones) : 64;
+        if (q >= emg_codec::RICE_ESCAPE) {
+            take(emg_codec::RICE_ESCAPE);
+            return get(raw_bits);
+        }
+        take(q + 1);
+        return (static_cast<uint32_t>(q) << k) | get(k);
+    }
+
+    bool overrun() const { return used_ > avail_; }
+
+private:
+    void refill() {
+        if (n_ > 56) return;
+        if (end_ - p_ >= 8) {
+            buf_ |= load<uint64_t>(p_) << n_;
+            p_ += (63 - n_) >> 3;
+            n_ |= 56;
+            return;
+        }
+        while (n_ <= 56) {
+            if (p_ < end_) buf_ |= uint64_t(*p_++) << n_;
+            n_ += 8;
+        }
+    }
+
+    void take(int bits) {
+        buf_ >>= bits;
+        n_ -= bits;
+        used_ += static_cast<size_t>(bits);
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint64_t buf_ = 0;
+    int n_ = 0;
+    size_t used_ = 0;
+    size_t avail_;
+};
+
+// One Rice stream: u8 k, u32 bytes, bits. Returns the bytes written.
+size_t putStream(uint8_t* out, const uint32_t* zz, uint32_t n, int raw_bits) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) sum += zz[i];
+    const int k = emg_codec::choose_k(static_cast<uint32_t>(std::min<uint64_t>(sum / n, UINT32_MAX)), 1);
+    emg_codec::BitWriter bw;
+    bw.reset(out + 5, (static_cast<size_t>(n) * 47 + 7) / 8);
+    for (uint32_t i = 0; i < n; i++) bw.rice(zz[i], k, raw_bits);
+    out[0] = static_cast<uint8_t>(k);
+    store<uint32_t>(out + 1, static_cast<uint32_t>(bw.bytes()));
+    return 5 + bw.bytes();
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// RecordingWriter
+// -----------------------------------------------------------------------------
+RecordingWriter::RecordingWriter(const std::string& path, const RecordingInfo& info, bool compress)
+    : info_(info), compress_(compress && info.type == SAMPLE_I16) {
+    if (info_.channels <= 0 || info_.channels > kMaxChannels || info_.chunk_frames == 0) {
+        error_ = "bad channel count or chunk size";
+        return;
+    }
+    info_.labels.resize(static_cast<size_t>(info_.channels));
+    const size_t ch = static_cast<size_t>(info_.channels);
+    time_us_.resize(info_.timestamps ? info_.chunk_frames : 0);
+    if (info_.type == SAMPLE_I16) {
+        i16_.resize(ch * info_.chunk_frames);
+    } else {
+        f32_.resize(ch * info_.chunk_frames);
+    }
+    // Worst case of a Rice chunk: 47 bits per value plus the stream headers
+    scratch_.resize((ch + 1) * (5 + (static_cast<size_t>(info_.chunk_frames) * 47 + 7) / 8));
+
+    f_ = std::fopen(path.c_str(), "wb");
+    if (!f_) {
+        error_ = path + ": " + std::strerror(errno);
+        return;
+    }
+    uint8_t h[kHeaderBytes];
+    packHeader(h, info_, 0, 0, 0);
+    writeBytes(h, sizeof(h));
+    for (const std::string& label : info_.labels) {
+        char l[kLabelBytes] = {};
+        std::memcpy(l, label.data(), std::min(label.size(), kLabelBytes - 1));
+        writeBytes(l, sizeof(l));
+    }
+    pad8();
+}
+
+RecordingWriter::~RecordingWriter() {
+    close();
+}
+
+void RecordingWriter::fail(const std::string& what) {
+    if (error_.empty()) error_ = what;
+    if (f_) std::fclose(f_);
+    f_ = nullptr;
+}
+
+bool RecordingWriter::writeBytes(const void* data, size_t len) {
+    if (!f_) return false;
+    if (std::fwrite(data, 1, len, f_) != len) {
+        fail(std::string("write: ") + std::strerror(errno));
+        return false;
+    }
+    offset_ += len;
+    return true;
+}
+
+bool RecordingWriter::pad8() {
+    static const uint8_t zeros[8] = {};
+    return writeBytes(zeros, align8(offset_) - offset_);
+}
+
+bool RecordingWriter::appendTime(int64_t t_ns) {
+    if (!info_.timestamps) {
+        if (n_ == 0) chunk_t0_ = frameTimeNs(frames_, info_.rate_hz);
+        return true;
+    }
+    if (frames_ != 0 && t_ns < last_t_) t_ns = last_t_;
+    last_t_ = t_ns;
+    // Offsets within a chunk are u32 us: start a new chunk after ~71 min
+    if (n_ != 0 && (t_ns - chunk_t0_) / 1000 > int64_t(UINT32_MAX)) {
+        if (!flushChunk()) return false;
+    }
+    if (n_ == 0) chunk_t0_ = t_ns;
+    time_us_[n_] = static_cast<uint32_t>((t_ns - chunk_t0_) / 1000);
+    return true;
+}
+
+bool RecordingWriter::append(const int16_t* frame, int64_t t_ns) {
+    if (!f_ || !appendTime(t_ns)) return false;
+    const size_t stride = info_.chunk_frames;
+    for (int c = 0; c < info_.channels; c++) {
+        if (info_.type == SAMPLE_I16) {
+            i16_[c * stride + n_] = frame[c];
+        } else {
+            f32_[c * stride + n_] = frame[c];
+        }
+    }
+    frames_++;
+    return ++n_ < info_.chunk_frames || flushChunk();
+}
+
+bool RecordingWriter::append(const float* frame, int64_t t_ns) {
+    if (!f_ || !appendTime(t_ns)) return false;
+    const size_t stride = info_.chunk_frames;
+    for (int c = 0; c < info_.channels; c++) {
+        if (info_.type == SAMPLE_I16) {
+            float v = std::nearbyint(frame[c]);
+            i16_[c * stride + n_] = static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, v)));
+        } else {
+            f32_[c * stride + n_] = frame[c];
+        }
+    }
+    frames_++;
+    return ++n_ < info_.chunk_frames || flushChunk();
+}
+
+bool RecordingWriter::flushChunk() {
+    if (!f_ || n_ == 0) return f_ != nullptr;
+    const size_t ch = static_cast<size_t>(info_.channels);
+    const size_t stride = info_.chunk_frames;
+    index_.push_back({offset_, frames_ - n_, chunk_t0_});
+
+    const size_t time_bytes = info_.timestamps ? align8(4 * size_t(n_)) : 0;
+    const size_t col_bytes = align8((info_.type == SAMPLE_I16 ? 2 : 4) * size_t(n_));
+    const size_t raw_bytes = time_bytes + ch * col_bytes;
+
+    // Rice-code into scratch_; keep it if it is smaller than the raw columns
+    size_t rice_bytes = 0;
+    if (compress_) {
+        std::vector<uint32_t> zz(n_);
+        uint8_t* out = scratch_.data();
+        if (info_.timestamps) {
+            uint32_t prev_t = 0, prev_dt = 0;
+            for (uint32_t i = 0; i < n_; i++) {
+                uint32_t dt = time_us_[i] - prev_t;
+                zz[i] = emg_codec::zigzag(static_cast<int32_t>(dt - prev_dt));
+                prev_t = time_us_[i];
+                prev_dt = dt;
+            }
+            out += putStream(out, zz.data(), n_, emg_codec::TIME_RAW_BITS);
+        }
+        for (size_t c = 0; c < ch; c++) {
+            const int16_t* col = &i16_[c * stride];
+            int32_t prev = 0;
+            for (uint32_t i = 0; i < n_; i++) {
+                zz[i] = emg_codec::zigzag(col[i] - prev);
+                prev = col[i];
+            }
+            out += putStream(out, zz.data(), n_, emg_codec::SAMPLE_RAW_BITS);
+        }
+        rice_bytes = static_cast<size_t>(out - scratch_.data());
+    }
+    const bool rice = compress_ && rice_bytes < raw_bytes;
+
+    uint8_t hdr[kChunkHeaderBytes] = {};
+    store<uint32_t>(hdr, n_);
+    hdr[4] = rice ? CODEC_RICE : CODEC_RAW;
+    store<uint32_t>(hdr + 8, static_cast<uint32_t>(rice ? rice_bytes : raw_bytes));
+    writeBytes(hdr, sizeof(hdr));
+    if (rice) {
+        writeBytes(scratch_.data(), rice_bytes);
+    } else {
+        if (info_.timestamps) {
+            writeBytes(time_us_.data(), 4 * size_t(n_));
+            pad8();
+        }
+        for (size_t c = 0; c < ch; c++) {
+            if (info_.type == SAMPLE_I16) {
+                writeBytes(&i16_[c * stride], 2 * size_t(n_));
+            } else {
+                writeBytes(&f32_[c * stride], 4 * size_t(n_));
+            }
+            pad8();
+        }
+    }
+    pad8();
+    n_ = 0;
+    return f_ != nullptr;
+}
+
+bool RecordingWriter::close() {
+    if (!f_) return error_.empty();
+    flushChunk();
+    const uint64_t index_offset = offset_;
+    for (const IndexEntry& e : index_) {
+        uint8_t b[kIndexEntryBytes];
+        store<uint64_t>(b, e.offset);
+        store<uint64_t>(b + 8, e.first_frame);
+        store<int64_t>(b + 16, e.t_ns);
+        writeBytes(b, sizeof(b));
+    }
+    if (!f_) return false;
+    uint8_t h[kHeaderBytes];
+    packHeader(h, info_, frames_, index_offset, static_cast<uint32_t>(index_.size()));
+    if (std::fseek(f_, 0, SEEK_SET) != 0 || std::fwrite(h, 1, sizeof(h), f_) != sizeof(h)) {
+        fail(std::string("write header: ") + std::strerror(errno));
+        return false;
+    }
+    const bool ok = std::fclose(f_) == 0;
+    f_ = nullptr;
+    if (!ok) error_ = std::string("close: ") + std::strerror(errno);
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// Recording
+// -----------------------------------------------------------------------------
+std::unique_ptr<Recording> Recording::open(const std::string& path, std::string* error) {
+    std::unique_ptr<Recording> rec(new Recording());
+    rec->fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (rec->fd_ < 0) {
+        setError(error, path + ": " + std::strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(rec->fd_, &st) != 0 || st.st_size < static_cast<off_t>(kHeaderBytes)) {
+        setError(error, path + ": not a recording");
+        return nullptr;
+    }
+    rec->size_ = static_cast<size_t>(st.st_size);
+    void* m = ::mmap(nullptr, rec->size_, PROT_READ, MAP_PRIVATE, rec->fd_, 0);
+    if (m == MAP_FAILED) {
+        setError(error, path + ": mmap: " + std::strerror(errno));
+        return nullptr;
+    }
+    rec->map_ = static_cast<const uint8_t*>(m);
+    ::madvise(m, rec->size_, MADV_SEQUENTIAL);
+    if (!rec->parseHeader(error)) return nullptr;
+    return rec;
+}
+
+Recording::~Recording() {
+    if (map_) ::munmap(const_cast<uint8_t*>(map_), size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool Recording::parseHeader(std::string* error) {
+    const uint8_t* h = map_;
+    if (std::memcmp(h, kMagic, sizeof(kMagic)) != 0) {
+        setError(error, "not an EMGREC01 recording");
+        return false;
+    }
+    if (load<uint16_t>(h + 8) != kVersion) {
+        setError(error, "unsupported recording version");
+        return false;
+    }
+    info_.channels = load<uint16_t>(h + 10);
+    info_.type = static_cast<SampleType>(h[12]);
+    info_.timestamps = (h[13] & kFlagTimestamps) != 0;
+    info_.rate_hz = load<float>(h + 16);
+    info_.gain = load<float>(h + 20);
+    info_.offset = load<float>(h + 24);
+    info_.chunk_frames = load<uint32_t>(h + 28);
+    frames_ = load<uint64_t>(h + 32);
+    const uint64_t index_offset = load<uint64_t>(h + 40);
+    chunks_ = load<uint32_t>(h + 48);
+    info_.start_unix_ns = load<int64_t>(h + 56);
+
+    const size_t header_bytes = kHeaderBytes + kLabelBytes * static_cast<size_t>(info_.channels);
+    if (info_.channels == 0 || info_.channels > kMaxChannels || info_.type > SAMPLE_F32 ||
+        info_.chunk_frames == 0 || load<uint16_t>(h + 14) != header_bytes || header_bytes > size_) {
+        setError(error, "corrupt recording header");
+        return false;
+    }
+    if (index_offset == 0 && frames_ == 0) {
+        setError(error, "recording was not closed (no index)");
+        return false;
+    }
+    if (index_offset > size_ || (size_ - index_offset) / kIndexEntryBytes < chunks_) {
+        setError(error, "corrupt recording index");
+        return false;
+    }
+    index_ = map_ + index_offset;
+    for (int c = 0; c < info_.channels; c++) {
+        const char* l = reinterpret_cast<const char*>(h + kHeaderBytes + kLabelBytes * c);
+        info_.labels.emplace_back(l, strnlen(l, kLabelBytes));
+    }
+    samples_.resize(static_cast<size_t>(info_.channels) * info_.chunk_frames);
+    times_.resize(info_.chunk_frames);
+    return true;
+}
+
+size_t Recording::chunkOf(uint64_t frame) const {
+    size_t lo = 0, hi = chunks_;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (load<uint64_t>(index_ + mid * kIndexEntryBytes + 8) <= frame) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool Recording::decodeChunk(size_t c) {
+    if (c == cached_) return true;
+    cached_ = SIZE_MAX;
+    const uint8_t* e = index_ + c * kIndexEntryBytes;
+    const uint64_t offset = load<uint64_t>(e);
+    const int64_t t0 = load<int64_t>(e + 16);
+    if (offset > size_ || size_ - offset < kChunkHeaderBytes) return false;
+    const uint8_t* hdr = map_ + offset;
+    const uint32_t n = load<uint32_t>(hdr);
+    const uint8_t codec = hdr[4];
+    const uint32_t bytes = load<uint32_t>(hdr + 8);
+    if (n == 0 || n > info_.chunk_frames || size_ - offset - kChunkHeaderBytes < bytes) return false;
+    const uint8_t* p = hdr + kChunkHeaderBytes;
+    const uint8_t* end = p + bytes;
+    const size_t ch = static_cast<size_t>(info_.channels);
+    const size_t stride = info_.chunk_frames;
+    const uint64_t first = load<uint64_t>(e + 8);
+
+    if (codec == CODEC_RAW) {
+        const size_t time_bytes = info_.timestamps ? align8(4 * size_t(n)) : 0;
+        const size_t col_bytes = align8((info_.type == SAMPLE_I16 ? 2 : 4) * size_t(n));
+        if (bytes < time_bytes + ch * col_bytes) return false;
+        for (uint32_t i = 0; i < n; i++) {
+            times_[i] = info_.timestamps ? t0 + int64_t(load<uint32_t>(p + 4 * i)) * 1000
+                                         : frameTimeNs(first + i, info_.rate_hz);
+        }
+        p += time_bytes;
+        for (size_t k = 0; k < ch; k++, p += col_bytes) {
+            float* out = &samples_[k * stride];
+            if (info_.type == SAMPLE_I16) {
+                const int16_t* col = reinterpret_cast<const int16_t*>(p);
+                for (uint32_t i = 0; i < n; i++) out[i] = col[i];
+            } else {
+                std::memcpy(out, p, 4 * size_t(n));
+            }
+        }
+    } else if (codec == CODEC_RICE && info_.type == SAMPLE_I16) {
+        auto stream = [&](int raw_bits, auto&& put) -> bool {
+            if (end - p < 5) return false;
+            const int k = p[0];
+            const uint32_t len = load<uint32_t>(p + 1);
+            p += 5;
+            if (k > 15 || static_cast<size_t>(end - p) < len) return false;
+            WordBitReader br(p, len);
+            for (uint32_t i = 0; i < n; i++) put(i, br.rice(k, raw_bits));
+            p += len;
+            return !br.overrun();
+        };
+        if (info_.timestamps) {
+            uint32_t t = 0, dt = 0;
+            if (!stream(emg_codec::TIME_RAW_BITS, [&](uint32_t i, uint32_t v) {
+                    dt += static_cast<uint32_t>(emg_codec::unzigzag(v));
+                    t += dt;
+                    times_[i] = t0 + int64_t(t) * 1000;
+                })) {
+                return false;
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) times_[i] = frameTimeNs(first + i, info_.rate_hz);
+        }
+        for (size_t k = 0; k < ch; k++) {
+            float* out = &samples_[k * stride];
+            int32_t s = 0;
+            if (!stream(emg_codec::SAMPLE_RAW_BITS, [&](uint32_t i, uint32_t v) {
+                    s = static_cast<int16_t>(s + emg_codec::unzigzag(v));
+                    out[i] = static_cast<float>(s);
+                })) {
+                return false;
+            }
+        }
+    } else {
+        return false;
+    }
+    cached_ = c;
+    cached_frames_ = n;
+    return true;
+}
+
+size_t Recording::read(uint64_t first, size_t n, float* out, int64_t* t_ns) {
+    const size_t ch = static_cast<size_t>(info_.channels);
+    const size_t stride = info_.chunk_frames;
+    size_t done = 0;
+    while (done < n && first + done < frames_) {
+        const uint64_t f = first + done;
+        const size_t c = chunkOf(f);
+        if (!decodeChunk(c)) break;
+        const uint64_t chunk_first = load<uint64_t>(index_ + c * kIndexEntryBytes + 8);
+        const size_t i0 = static_cast<size_t>(f - chunk_first);
+        if (i0 >= cached_frames_) break;
+        const size_t take = std::min<size_t>(n - done, cached_frames_ - i0);
+        for (size_t i = 0; i < take; i++) {
+            float* o = out + (done + i) * ch;
+            for (size_t k = 0; k < ch; k++) o[k] = samples_[k * stride + i0 + i];
+        }
+        if (t_ns) std::copy(&times_[i0], &times_[i0] + take, t_ns + done);
+        done += take;
+    }
+    return done;
+}
+
+int64_t Recording::timeOf(uint64_t frame) {
+    if (!info_.timestamps) return frameTimeNs(frame, info_.rate_hz);
+    if (frame >= frames_ || frames_ == 0) return frames_ ? timeOf(frames_ - 1) : 0;
+    const size_t c = chunkOf(frame);
+    if (!decodeChunk(c)) return load<int64_t>(index_ + c * kIndexEntryBytes + 16);
+    return times_[frame - load<uint64_t>(index_ + c * kIndexEntryBytes + 8)];
+}
+
+uint64_t Recording::frameAt(int64_t t_ns) {
+    if (t_ns <= 0 || frames_ == 0) return 0;
+    if (!info_.timestamps) {
+        if (info_.rate_hz <= 0.0f) return 0;
+        auto f = static_cast<uint64_t>(std::ceil(static_cast<double>(t_ns) * info_.rate_hz / 1e9));
+        return std::min(f, frames_);
+    }
+    // Last chunk starting at or before t_ns, then search its decoded times
+    size_t lo = 0, hi = chunks_;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (load<int64_t>(index_ + mid * kIndexEntryBytes + 16) <= t_ns) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const uint64_t chunk_first = load<uint64_t>(index_ + lo * kIndexEntryBytes + 8);
+    if (!decodeChunk(lo)) return chunk_first;
+    const int64_t* t = times_.data();
+    const size_t i = static_cast<size_t>(std::lower_bound(t, t + cached_frames_, t_ns) - t);
+    return std::min(chunk_first + i, frames_);
+}
+
+const int16_t* Recording::rawColumn(size_t chunk, int ch) const {
+    if (chunk >= chunks_ || ch < 0 || ch >= info_.channels || info_.type != SAMPLE_I16) return nullptr;
+    const uint64_t offset = load<uint64_t>(index_ + chunk * kIndexEntryBytes);
+    if (offset > size_ || size_ - offset < kChunkHeaderBytes) return nullptr;
+    const uint8_t* hdr = map_ + offset;
+    const uint32_t n = load<uint32_t>(hdr);
+    if (hdr[4] != CODEC_RAW || n > info_.chunk_frames) return nullptr;
+    const size_t time_bytes = info_.timestamps ? align8(4 * size_t(n)) : 0;
+    const size_t at = time_bytes + static_cast<size_t>(ch) * align8(2 * size_t(n));
+    if (load<uint32_t>(hdr + 8) < at + 2 * size_t(n)) return nullptr;
+    return reinterpret_cast<const int16_t*>(hdr + kChunkHeaderBytes + at);
+}
+
+} // namespace recording
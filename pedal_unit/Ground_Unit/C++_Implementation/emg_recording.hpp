@@ -0,0 +1,256 @@
+#pragma once
+// Binary EMG recordings: chunked, columnar, mmap-able, seekable by time.
+//
+// Replaces CSV logs for offline work. A Recording maps the file and decodes
+// only the chunks a read touches. Raw chunks are aligned columns that can be
+// read straight out of the mapping. RecordingReplay feeds a recording into
+// the frame ring an IcaPipeline reads, either at the recorded pace or as
+// fast as the consumer takes frames. Converters from the existing CSV logs
+// and EMGCAP01 captures live in the emg_rec tool.
+//
+// Layout (little-endian, every chunk and the index 8-byte aligned):
+//   header   64 bytes
+//     0   char[8] magic "EMGREC01"
+//     8   u16  version (1)
+//     10  u16  channels
+//     12  u8   sample type (SampleType)
+//     13  u8   flags (bit0: per-frame timestamps)
+//     14  u16  header bytes (64 + 16 * channels)
+//     16  f32  nominal rate, Hz
+//     20  f32  gain, physical units per count (1 = counts)
+//     24  f32  offset, counts at zero input
+//     28  u32  frames per chunk (the last one may hold fewer)
+//     32  u64  frames
+//     40  u64  index offset
+//     48  u32  chunks
+//     52  u32  reserved
+//     56  i64  start time, Unix ns (0 = unknown)
+//   labels   char[16] per channel, NUL padded
+//   chunk    u32 frames, u8 codec (Codec), 3 reserved, u32 payload bytes,
+//            u32 reserved, then the payload:
+//     CODEC_RAW   [u32 time_us x frames] (with timestamps), then one column
+//                 per channel (int16 or f32 x frames), each 8-byte aligned
+//     CODEC_RICE  int16 only. Per stream (time if present, then each
+//                 channel): u8 k, u32 bytes, bits. Samples are Rice coded
+//                 first differences, time second differences, with the bit
+//                 layout and escape of emg_codec.hpp.
+//   index    per chunk: u64 file offset, u64 first frame, i64 first time ns
+//
+// Times are ns as given to the writer (the emg_rec converters start at 0).
+// Within a chunk they are stored as u32 us offsets from the chunk's first
+// frame. Without timestamps frame i is at i / rate.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace recording {
+
+enum SampleType : uint8_t { SAMPLE_I16 = 0, SAMPLE_F32 = 1 };
+enum Codec : uint8_t { CODEC_RAW = 0, CODEC_RICE = 1 };
+
+constexpr size_t kLabelBytes = 16;
+
+struct RecordingInfo {
+    int channels = 0;
+    SampleType type = SAMPLE_I16;
+    bool timestamps = false;
+    float rate_hz = 0.0f;
+    float gain = 1.0f;
+    float offset = 0.0f;
+    uint32_t chunk_frames = 4096;
+    int64_t start_unix_ns = 0;
+    std::vector<std::string> labels;     // optional, at most 15 characters each
+};
+
+// Writes a recording front to back. Frames are buffered one chunk at a time;
+// close() (or the destructor) writes the last chunk, the index and the final
+// header.
+class RecordingWriter {
+public:
+    // compress: Rice-code int16 chunks (falls back to raw for a chunk that
+    // would not shrink). Ignored for SAMPLE_F32.
+    RecordingWriter(const std::string& path, const RecordingInfo& info, bool compress);
+    ~RecordingWriter();
+    RecordingWriter(const RecordingWriter&) = delete;
+    RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+    bool ok() const { return f_ != nullptr; }
+    const std::string& error() const { return error_; }
+
+    // Append one frame (channels samples). t_ns is ignored without
+    // timestamps; it must not go backwards (earlier times are clamped).
+    bool append(const int16_t* frame, int64_t t_ns = 0);
+    bool append(const float* frame, int64_t t_ns = 0);
+
+    bool close();
+    uint64_t frames() const { return frames_; }
+    uint64_t bytes() const { return offset_; }
+
+private:
+    bool appendTime(int64_t t_ns);
+    bool flushChunk();
+    bool writeBytes(const void* data, size_t len);
+    bool pad8();
+    void fail(const std::string& what);
+
+    std::FILE* f_ = nullptr;
+    RecordingInfo info_;
+    bool compress_;
+    uint64_t offset_ = 0;
+    uint64_t frames_ = 0;
+    int64_t last_t_ = 0;
+    std::string error_;
+
+    // Chunk being filled, channel-major
+    uint32_t n_ = 0;
+    int64_t chunk_t0_ = 0;
+    std::vector<uint32_t> time_us_;
+    std::vector<int16_t> i16_;
+    std::vector<float> f32_;
+    std::vector<uint8_t> scratch_;
+
+    struct IndexEntry { uint64_t offset, first_frame; int64_t t_ns; };
+    std::vector<IndexEntry> index_;
+};
+
+// Read-only view of a recording. The file is mapped; reads decode into the
+// caller's buffer through a one-chunk cache, so one Recording must not be
+// read from two threads at once (open it twice instead).
+class Recording {
+public:
+    static std::unique_ptr<Recording> open(const std::string& path, std::string* error = nullptr);
+    ~Recording();
+    Recording(const Recording&) = delete;
+    Recording& operator=(const Recording&) = delete;
+
+    const RecordingInfo& info() const { return info_; }
+    uint64_t frames() const { return frames_; }
+    size_t chunks() const { return chunks_; }
+    size_t fileBytes() const { return size_; }
+
+    // Copy frames [first, first + n) as interleaved floats (frame x channels,
+    // in counts) into out, and their times into t_ns if given. Returns the
+    // number of frames read, fewer at the end of the recording, 0 if the file
+    // is damaged past this point.
+    size_t read(uint64_t first, size_t n, float* out, int64_t* t_ns = nullptr);
+
+    // Time of frame i, and the first frame at or after t_ns
+    int64_t timeOf(uint64_t frame);
+    uint64_t frameAt(int64_t t_ns);
+
+    // Zero-copy access to a raw int16 chunk: column ch of chunk c, or nullptr
+    // if the chunk is compressed or the samples are floats
+    const int16_t* rawColumn(size_t chunk, int ch) const;
+
+private:
+    struct IndexEntry { uint64_t offset, first_frame; int64_t t_ns; };
+
+    Recording() = default;
+    bool parseHeader(std::string* error);
+    bool decodeChunk(size_t c);
+    size_t chunkOf(uint64_t frame) const;
+
+    int fd_ = -1;
+    const uint8_t* map_ = nullptr;
+    size_t size_ = 0;
+    RecordingInfo info_;
+    uint64_t frames_ = 0;
+    size_t chunks_ = 0;
+    const uint8_t* index_ = nullptr;
+
+    // Decoded chunk cache, channel-major
+    size_t cached_ = SIZE_MAX;
+    uint32_t cached_frames_ = 0;
+    std::vector<float> samples_;
+    std::vector<int64_t> times_;
+};
+
+// Plays a recording into a SpscFrameRing<float, C, N> on its own thread.
+// speed 1 replays at the recorded pace, 2 twice as fast, and so on. Speed 0
+// runs as fast as the consumer takes frames: the replay waits for ring space
+// instead of dropping, so an offline run sees every frame. Frames are padded
+// or truncated to the ring's channel count like EmgIngest does.
+template <class Ring>
+class RecordingReplay {
+public:
+    RecordingReplay(Ring& ring, std::unique_ptr<Recording> rec, double speed)
+        : ring_(ring), rec_(std::move(rec)), speed_(speed) {}
+    ~RecordingReplay() { stop(); }
+    RecordingReplay(const RecordingReplay&) = delete;
+    RecordingReplay& operator=(const RecordingReplay&) = delete;
+
+    // Start at t_ns into the recording
+    void start(int64_t from_ns = 0) {
+        stop_.store(false);
+        first_ = rec_->frameAt(from_ns);
+        thread_ = std::thread(&RecordingReplay::run, this);
+    }
+
+    void stop() {
+        stop_.store(true);
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // True once every frame has been played (or stop() was called)
+    bool finished() const { return done_.load(std::memory_order_acquire); }
+    const std::atomic<bool>& finishedFlag() const { return done_; }
+
+    // Frames played so far; at speed > 0 some may have been dropped at the
+    // ring (ring.dropped())
+    uint64_t played() const { return played_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kBatch = 256;
+
+    void run() {
+        using Clock = std::chrono::steady_clock;
+        const size_t ch = static_cast<size_t>(rec_->info().channels);
+        std::vector<float> buf(kBatch * ch);
+        int64_t t[kBatch];
+        const int64_t t_first = rec_->timeOf(first_);
+        const auto wall0 = Clock::now();
+
+        for (uint64_t f = first_; f < rec_->frames() && !stop_.load(std::memory_order_relaxed);) {
+            size_t n = rec_->read(f, kBatch, buf.data(), t);
+            if (n == 0) break;
+            for (size_t i = 0; i < n && !stop_.load(std::memory_order_relaxed);) {
+                if (speed_ > 0.0) {
+                    auto due = wall0 + std::chrono::nanoseconds(
+                        static_cast<int64_t>((t[i] - t_first) / speed_));
+                    if (Clock::now() < due) std::this_thread::sleep_until(due);
+                } else if (ring_.writable() == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    continue;
+                }
+                float* slot = ring_.beginWrite();
+                if (slot) {
+                    const float* s = &buf[i * ch];
+                    size_t c = 0;
+                    for (; c < Ring::channels && c < ch; c++) slot[c] = s[c];
+                    for (; c < Ring::channels; c++) slot[c] = 0.0f;
+                    ring_.publish();
+                }
+                played_.fetch_add(1, std::memory_order_relaxed);
+                i++;
+            }
+            f += n;
+        }
+        done_.store(true, std::memory_order_release);
+    }
+
+    Ring& ring_;
+    std::unique_ptr<Recording> rec_;
+    double speed_;
+    uint64_t first_ = 0;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> done_{false};
+    std::atomic<uint64_t> played_{0};
+    std::thread thread_;
+};
+
+} // namespace recording
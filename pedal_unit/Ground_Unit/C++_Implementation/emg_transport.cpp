@@ -0,0 +1,485 @@
+#include "emg_transport.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef EMG_INGEST_HAVE_BLUEZ
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/l2cap.h>
+#endif
+
+namespace ingest {
+
+namespace {
+
+const char kCaptureMagic[8] = {'E', 'M', 'G', 'C', 'A', 'P', '0', '1'};
+
+uint64_t steadyNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void setError(std::string* error, const std::string& what) {
+    if (error) *error = what;
+}
+
+std::string errnoText(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+// "PORT" or "ADDR:PORT" -> IPv4 address
+bool parseInet(const std::string& s, const char* default_addr, sockaddr_in& out) {
+    std::string host = default_addr, port = s;
+    size_t colon = s.rfind(':');
+    if (colon != std::string::npos) {
+        host = s.substr(0, colon);
+        port = s.substr(colon + 1);
+    }
+    char* end = nullptr;
+    long p = std::strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || p <= 0 || p > 65535) return false;
+    out = sockaddr_in{};
+    out.sin_family = AF_INET;
+    out.sin_port = htons(static_cast<uint16_t>(p));
+    return ::inet_pton(AF_INET, host.c_str(), &out.sin_addr) == 1;
+}
+
+bool parseUnix(const std::string& path, sockaddr_un& out) {
+    out = sockaddr_un{};
+    if (path.empty() || path.size() >= sizeof(out.sun_path)) return false;
+    out.sun_family = AF_UNIX;
+    std::memcpy(out.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Datagram sockets: one payload per datagram, received straight into the
+// caller's buffer
+// -----------------------------------------------------------------------------
+class DatagramTransport : public Transport {
+public:
+    ~DatagramTransport() override {
+        if (fd_ >= 0) ::close(fd_);
+        if (!unlink_path_.empty()) ::unlink(unlink_path_.c_str());
+    }
+
+    int receive(uint8_t* buf, size_t cap, int timeout_ms) override {
+        pollfd pfd{fd_, POLLIN, 0};
+        int r = ::poll(&pfd, 1, timeout_ms);
+        if (r == 0 || (r < 0 && errno == EINTR)) return 0;
+        if (r < 0) return -1;
+        ssize_t n = ::recv(fd_, buf, cap, 0);
+        if (n < 0) return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+        return static_cast<int>(n);
+    }
+
+    std::string describe() const override { return desc_; }
+
+    // Bind a datagram socket; false (with error set) on failure
+    bool open(int family, const sockaddr* addr, socklen_t len, const std::string& desc, std::string* error) {
+        desc_ = desc;
+        fd_ = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            setError(error, errnoText("socket"));
+            return false;
+        }
+        // A burst must not overflow the kernel queue while the ring is busy
+        int rcvbuf = 1 << 20;
+        ::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        if (family == AF_UNIX) {
+            unlink_path_ = reinterpret_cast<const sockaddr_un*>(addr)->sun_path;
+            ::unlink(unlink_path_.c_str());
+        }
+        if (::bind(fd_, addr, len) < 0) {
+            setError(error, errnoText(("bind " + desc).c_str()));
+            unlink_path_.clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    std::string desc_;
+    std::string unlink_path_;
+};
+
+// -----------------------------------------------------------------------------
+// Capture file replay, paced by the recorded receive times
+// -----------------------------------------------------------------------------
+class ReplayTransport : public Transport {
+public:
+    ~ReplayTransport() override {
+        if (f_) std::fclose(f_);
+    }
+
+    bool open(const std::string& path, double speed, std::string* error) {
+        path_ = path;
+        speed_ = speed;
+        f_ = std::fopen(path.c_str(), "rb");
+        if (!f_) {
+            setError(error, errnoText(("open " + path).c_str()));
+            return false;
+        }
+        char magic[sizeof(kCaptureMagic)];
+        if (std::fread(magic, 1, sizeof(magic), f_) != sizeof(magic) ||
+            std::memcmp(magic, kCaptureMagic, sizeof(magic)) != 0) {
+            setError(error, path + ": not an EMG capture file");
+            return false;
+        }
+        return true;
+    }
+
+    int receive(uint8_t* buf, size_t cap, int timeout_ms) override {
+        uint8_t hdr[10];
+        if (!pending_) {
+            if (std::fread(hdr, 1, sizeof(hdr), f_) != sizeof(hdr)) return -1;
+            rx_ns_ = 0;
+            for (int i = 7; i >= 0; i--) rx_ns_ = (rx_ns_ << 8) | hdr[i];
+            len_ = static_cast<size_t>(hdr[8] | (hdr[9] << 8));
+            pending_ = true;
+        }
+
+        // Pace: payload k is due (rx_ns_k - rx_ns_0) / speed after the first
+        if (speed_ > 0.0) {
+            uint64_t now = steadyNs();
+            if (!started_) {
+                started_ = true;
+                first_rx_ns_ = rx_ns_;
+                start_ns_ = now;
+            }
+            uint64_t due = start_ns_ + static_cast<uint64_t>((rx_ns_ - first_rx_ns_) / speed_);
+            if (due > now) {
+                uint64_t wait = due - now;
+                if (wait > static_cast<uint64_t>(timeout_ms) * 1000000u) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+                    return 0;
+                }
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+            }
+        }
+
+        pending_ = false;
+        if (len_ > cap) {
+            std::fseek(f_, static_cast<long>(len_), SEEK_CUR);
+            return 0;
+        }
+        return std::fread(buf, 1, len_, f_) == len_ ? static_cast<int>(len_) : -1;
+    }
+
+    std::string describe() const override { return "replay:" + path_; }
+
+private:
+    std::FILE* f_ = nullptr;
+    std::string path_;
+    double   speed_ = 1.0;
+    bool     pending_ = false;
+    uint64_t rx_ns_ = 0;
+    size_t   len_ = 0;
+    bool     started_ = false;
+    uint64_t first_rx_ns_ = 0;
+    uint64_t start_ns_ = 0;
+};
+
+#ifdef EMG_INGEST_HAVE_BLUEZ
+// -----------------------------------------------------------------------------
+// BlueZ: ATT bearer on an L2CAP LE socket (fixed CID 4), no D-Bus. Finds the
+// data characteristic by UUID, enables notifications through its CCC (the
+// descriptor right after the value, as the firmware declares it) and hands
+// out notification payloads.
+// -----------------------------------------------------------------------------
+constexpr uint8_t ATT_ERROR_RSP         = 0x01;
+constexpr uint8_t ATT_EXCHANGE_MTU_REQ  = 0x02;
+constexpr uint8_t ATT_READ_BY_TYPE_REQ  = 0x08;
+constexpr uint8_t ATT_READ_BY_TYPE_RSP  = 0x09;
+constexpr uint8_t ATT_WRITE_REQ         = 0x12;
+constexpr uint8_t ATT_WRITE_RSP         = 0x13;
+constexpr uint8_t ATT_HANDLE_VALUE_NTF  = 0x1B;
+constexpr uint8_t ATT_HANDLE_VALUE_IND  = 0x1D;
+constexpr uint8_t ATT_HANDLE_VALUE_CFM  = 0x1E;
+constexpr uint16_t ATT_CID              = 4;
+constexpr uint16_t GATT_CHARACTERISTIC  = 0x2803;
+constexpr uint16_t kRxMtu               = 247;
+
+// 3F5B0002-D946-4844-B1CE-B29134DDEAF5, little-endian as on the wire
+const uint8_t kDataUuid[16] = {0xF5, 0xEA, 0xDD, 0x34, 0x91, 0xB2, 0xCE, 0xB1,
+                               0x44, 0x48, 0x46, 0xD9, 0x02, 0x00, 0x5B, 0x3F};
+
+bool parseBdaddr(const std::string& s, bdaddr_t& out) {
+    unsigned b[6];
+    if (s.size() != 17 ||
+        std::sscanf(s.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) out.b[i] = static_cast<uint8_t>(b[i]);
+    return true;
+}
+
+class BluezTransport : public Transport {
+public:
+    ~BluezTransport() override {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool open(const std::string& addr, std::string* error) {
+        addr_ = addr;
+        sockaddr_l2 remote{};
+        if (!parseBdaddr(addr, remote.l2_bdaddr)) {
+            setError(error, "bad Bluetooth address: " + addr);
+            return false;
+        }
+        fd_ = ::socket(AF_BLUETOOTH, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP);
+        if (fd_ < 0) {
+            setError(error, errnoText("bluetooth socket"));
+            return false;
+        }
+        sockaddr_l2 local{};
+        local.l2_family = AF_BLUETOOTH;
+        local.l2_cid = htobs(ATT_CID);
+        local.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+        if (::bind(fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+            setError(error, errnoText("bind ATT"));
+            return false;
+        }
+        remote.l2_family = AF_BLUETOOTH;
+        remote.l2_cid = htobs(ATT_CID);
+        remote.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+        if (::connect(fd_, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) < 0) {
+            // Zephyr peripherals usually advertise a static random address
+            ::close(fd_);
+            fd_ = ::socket(AF_BLUETOOTH, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP);
+            remote.l2_bdaddr_type = BDADDR_LE_RANDOM;
+            if (fd_ < 0 || ::bind(fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0 ||
+                ::connect(fd_, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) < 0) {
+                setError(error, errnoText(("connect " + addr).c_str()));
+                return false;
+            }
+        }
+
+        uint8_t pdu[kRxMtu];
+        const uint8_t mtu_req[3] = {ATT_EXCHANGE_MTU_REQ, kRxMtu & 0xFF, kRxMtu >> 8};
+        if (!request(mtu_req, sizeof(mtu_req), pdu, sizeof(pdu))) {
+            setError(error, "ATT MTU exchange failed");
+            return false;
+        }
+        if (!findDataHandle(pdu, sizeof(pdu))) {
+            setError(error, "EMG data characteristic not found on " + addr);
+            return false;
+        }
+        const uint16_t ccc = static_cast<uint16_t>(value_handle_ + 1);
+        const uint8_t wr[5] = {ATT_WRITE_REQ, static_cast<uint8_t>(ccc), static_cast<uint8_t>(ccc >> 8), 0x01, 0x00};
+        int n = request(wr, sizeof(wr), pdu, sizeof(pdu));
+        if (n < 1 || pdu[0] != ATT_WRITE_RSP) {
+            setError(error, "enabling notifications failed");
+            return false;
+        }
+        return true;
+    }
+
+    // Notification header into hdr, payload straight into buf
+    int receive(uint8_t* buf, size_t cap, int timeout_ms) override {
+        pollfd pfd{fd_, POLLIN, 0};
+        int r = ::poll(&pfd, 1, timeout_ms);
+        if (r == 0 || (r < 0 && errno == EINTR)) return 0;
+        if (r < 0 || (pfd.revents & (POLLHUP | POLLERR))) return -1;
+
+        uint8_t hdr[3];
+        iovec iov[2] = {{hdr, sizeof(hdr)}, {buf, cap}};
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        ssize_t n = ::recvmsg(fd_, &msg, 0);
+        if (n <= 0) return (n < 0 && errno == EINTR) ? 0 : -1;
+        if (hdr[0] == ATT_HANDLE_VALUE_IND) {
+            const uint8_t cfm = ATT_HANDLE_VALUE_CFM;
+            (void)::send(fd_, &cfm, 1, 0);
+        }
+        uint16_t handle = static_cast<uint16_t>(hdr[1] | (hdr[2] << 8));
+        if (n < 3 || (hdr[0] != ATT_HANDLE_VALUE_NTF && hdr[0] != ATT_HANDLE_VALUE_IND) ||
+            handle != value_handle_) {
+            return 0;
+        }
+        return static_cast<int>(n - 3);
+    }
+
+    std::string describe() const override { return "ble:" + addr_; }
+
+private:
+    // Send a request and wait (bounded) for its response, skipping any
+    // notifications that arrive first
+    int request(const uint8_t* req, size_t len, uint8_t* rsp, size_t cap) {
+        if (::send(fd_, req, len, 0) != static_cast<ssize_t>(len)) return -1;
+        for (int tries = 0; tries < 16; tries++) {
+            pollfd pfd{fd_, POLLIN, 0};
+            if (::poll(&pfd, 1, 5000) <= 0) return -1;
+            ssize_t n = ::recv(fd_, rsp, cap, 0);
+            if (n <= 0) return -1;
+            if (rsp[0] != ATT_HANDLE_VALUE_NTF && rsp[0] != ATT_HANDLE_VALUE_IND) return static_cast<int>(n);
+        }
+        return -1;
+    }
+
+    // Walk the characteristic declarations with Read By Type
+    bool findDataHandle(uint8_t* pdu, size_t cap) {
+        uint16_t start = 0x0001;
+        while (start != 0) {
+            const uint8_t req[7] = {ATT_READ_BY_TYPE_REQ,
+                                    static_cast<uint8_t>(start), static_cast<uint8_t>(start >> 8), 0xFF, 0xFF,
+                                    GATT_CHARACTERISTIC & 0xFF, GATT_CHARACTERISTIC >> 8};
+            int n = request(req, sizeof(req), pdu, cap);
+            if (n < 2 || pdu[0] == ATT_ERROR_RSP || pdu[0] != ATT_READ_BY_TYPE_RSP) return false;
+            size_t item = pdu[1];
+            if (item < 7) return false;
+            for (size_t off = 2; off + item <= static_cast<size_t>(n); off += item) {
+                const uint8_t* e = pdu + off;  // handle, properties, value handle, uuid
+                uint16_t decl = static_cast<uint16_t>(e[0] | (e[1] << 8));
+                if (item == 21 && std::memcmp(e + 5, kDataUuid, 16) == 0) {
+                    value_handle_ = static_cast<uint16_t>(e[3] | (e[4] << 8));
+                    return true;
+                }
+                start = static_cast<uint16_t>(decl + 1);
+            }
+        }
+        return false;
+    }
+
+    int fd_ = -1;
+    std::string addr_;
+    uint16_t value_handle_ = 0;
+};
+#endif // EMG_INGEST_HAVE_BLUEZ
+
+} // namespace
+
+std::unique_ptr<Transport> makeTransport(const std::string& spec, std::string* error) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+        setError(error, "transport spec must be kind:args, got " + spec);
+        return nullptr;
+    }
+    const std::string kind = spec.substr(0, colon);
+    const std::string arg = spec.substr(colon + 1);
+
+    if (kind == "udp") {
+        sockaddr_in a;
+        if (!parseInet(arg, "0.0.0.0", a)) {
+            setError(error, "bad udp address: " + arg);
+            return nullptr;
+        }
+        auto t = std::make_unique<DatagramTransport>();
+        if (!t->open(AF_INET, reinterpret_cast<sockaddr*>(&a), sizeof(a), spec, error)) return nullptr;
+        return t;
+    }
+    if (kind == "unix") {
+        sockaddr_un a;
+        if (!parseUnix(arg, a)) {
+            setError(error, "bad unix socket path: " + arg);
+            return nullptr;
+        }
+        auto t = std::make_unique<DatagramTransport>();
+        if (!t->open(AF_UNIX, reinterpret_cast<sockaddr*>(&a), sizeof(a), spec, error)) return nullptr;
+        return t;
+    }
+    if (kind == "replay") {
+        std::string path = arg;
+        double speed = 1.0;
+        size_t at = arg.rfind('@');
+        if (at != std::string::npos) {
+            path = arg.substr(0, at);
+            speed = std::atof(arg.c_str() + at + 1);
+        }
+        auto t = std::make_unique<ReplayTransport>();
+        if (!t->open(path, speed, error)) return nullptr;
+        return t;
+    }
+    if (kind == "ble") {
+#ifdef EMG_INGEST_HAVE_BLUEZ
+        auto t = std::make_unique<BluezTransport>();
+        if (!t->open(arg, error)) return nullptr;
+        return t;
+#else
+        setError(error, "built without BlueZ support (configure with -DEMG_INGEST_BLUEZ=ON)");
+        return nullptr;
+#endif
+    }
+    setError(error, "unknown transport: " + kind);
+    return nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// DatagramSender
+// -----------------------------------------------------------------------------
+DatagramSender::DatagramSender(const std::string& spec) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) return;
+    const std::string kind = spec.substr(0, colon);
+    const std::string arg = spec.substr(colon + 1);
+    sockaddr_storage ss{};
+    socklen_t len = 0;
+    int family = 0;
+    if (kind == "udp") {
+        sockaddr_in a;
+        if (!parseInet(arg, "127.0.0.1", a)) return;
+        std::memcpy(&ss, &a, sizeof(a));
+        len = sizeof(a);
+        family = AF_INET;
+    } else if (kind == "unix") {
+        sockaddr_un a;
+        if (!parseUnix(arg, a)) return;
+        std::memcpy(&ss, &a, sizeof(a));
+        len = sizeof(a);
+        family = AF_UNIX;
+    } else {
+        return;
+    }
+    fd_ = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ >= 0 && ::connect(fd_, reinterpret_cast<sockaddr*>(&ss), len) < 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+DatagramSender::~DatagramSender() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool DatagramSender::send(const uint8_t* data, size_t len) {
+    return fd_ >= 0 && ::send(fd_, data, len, 0) == static_cast<ssize_t>(len);
+}
+
+// -----------------------------------------------------------------------------
+// CaptureWriter
+// -----------------------------------------------------------------------------
+CaptureWriter::CaptureWriter(const std::string& path) {
+    f_ = std::fopen(path.c_str(), "wb");
+    if (f_ && std::fwrite(kCaptureMagic, 1, sizeof(kCaptureMagic), f_) != sizeof(kCaptureMagic)) {
+        std::fclose(f_);
+        f_ = nullptr;
+    }
+}
+
+CaptureWriter::~CaptureWriter() {
+    if (f_) std::fclose(f_);
+}
+
+bool CaptureWriter::write(uint64_t rx_ns, const uint8_t* data, size_t len) {
+    if (!f_ || len > 0xFFFF) return false;
+    uint8_t hdr[10];
+    for (int i = 0; i < 8; i++) hdr[i] = static_cast<uint8_t>(rx_ns >> (8 * i));
+    hdr[8] = static_cast<uint8_t>(len);
+    hdr[9] = static_cast<uint8_t>(len >> 8);
+    return std::fwrite(hdr, 1, sizeof(hdr), f_) == sizeof(hdr) && std::fwrite(data, 1, len, f_) == len;
+}
+
+} // namespace ingest
@@ -0,0 +1,81 @@
+#pragma once
+// Transports that deliver the headband's EMG data notifications (payloads of
+// characteristic 3F5B0002, one per receive) to the ground unit, plus the
+// capture file used to record and replay them. See emg_ingest.hpp for the
+// consumer side.
+//
+//   ble:AA:BB:CC:DD:EE:FF     BlueZ, ATT over an L2CAP LE socket (built with
+//                             EMG_INGEST_BLUEZ)
+//   udp:PORT                  one notification per datagram, bound on all
+//   udp:ADDR:PORT             interfaces or on ADDR
+//   unix:PATH                 one notification per Unix datagram
+//   replay:FILE[@SPEED]       capture file, paced at SPEED x the recorded
+//                             rate (default 1, 0 = as fast as possible)
+//
+// The socket transports are stand-ins for the radio: anything that can send
+// a datagram (a test rig, emg_headband/host tooling, a native_sim build
+// bridged to UDP) can feed the ground unit.
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace ingest {
+
+// Largest payload a transport hands out; BLE notifications are at most
+// EMG_BATCH_MAX_PAYLOAD bytes, the socket stand-ins may carry more
+constexpr size_t kMaxPayload = 2048;
+
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // Receive the next payload into buf. Returns its length, 0 if nothing
+    // arrived within timeout_ms, or -1 once the source is finished or broken
+    // (end of a replay, lost BLE link).
+    virtual int receive(uint8_t* buf, size_t cap, int timeout_ms) = 0;
+
+    virtual std::string describe() const = 0;
+};
+
+// Build a transport from a spec string (see above). On failure returns
+// nullptr and, if error is given, a reason.
+std::unique_ptr<Transport> makeTransport(const std::string& spec, std::string* error = nullptr);
+
+// Sends payloads to a udp:/unix: transport (test rigs and benchmarks).
+// udp:PORT sends to 127.0.0.1.
+class DatagramSender {
+public:
+    explicit DatagramSender(const std::string& spec);
+    ~DatagramSender();
+    DatagramSender(const DatagramSender&) = delete;
+    DatagramSender& operator=(const DatagramSender&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    bool send(const uint8_t* data, size_t len);
+
+private:
+    int fd_ = -1;
+};
+
+// -----------------------------------------------------------------------------
+// Capture file
+//   "EMGCAP01", then per notification: u64 rx_ns (steady clock of the
+//   recording host), u16 len, len payload bytes. Little-endian.
+// -----------------------------------------------------------------------------
+class CaptureWriter {
+public:
+    explicit CaptureWriter(const std::string& path);
+    ~CaptureWriter();
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    bool ok() const { return f_ != nullptr; }
+    bool write(uint64_t rx_ns, const uint8_t* data, size_t len);
+
+private:
+    std::FILE* f_ = nullptr;
+};
+
+} // namespace ingest
@@ -0,0 +1,298 @@
+#pragma once
+// Fixed-size matrices for the small dimensions of the engine.
+//
+// Channel counts (EMG_CH = 5, 8 on the wider boards) and component counts
+// (2 to 8) are tiny. Whatever is only C x C or k x C, such as the covariance
+// accumulators, the EVDs, the inverse square roots and symmetric
+// decorrelation, spends more time in Matrix's runtime-sized loops and the
+// packed GEMM's panel setup than in arithmetic. FixedMatrix<R, C> keeps its
+// elements inline (on the stack) with constexpr dimensions, so every loop
+// below has a constant trip count and unrolls completely.
+//
+// The kernels compute the same thing in the same order as their Matrix
+// counterparts in mainprocess_internal.cpp. The engine routes to them from
+// there whenever a size matches a compiled instantiation:
+//   EVD, inverse sqrt   n in [2, ICA_FIXED_MAX_N]
+//   covariance          n in [2, ICA_FIXED_COV_MAX_N]
+//   decorrelation       W shapes in FixedDecorrelationShapes
+// and falls back to the Matrix code otherwise.
+#include "mainprocess_internal.hpp"
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+constexpr int ICA_FIXED_MAX_N = 8;
+// Past 6 channels the covariance accumulators no longer fit in registers and
+// the packed GEMM is faster
+constexpr int ICA_FIXED_COV_MAX_N = 6;
+
+template <int R, int C>
+struct FixedMatrix {
+    static constexpr int rows = R;
+    static constexpr int cols = C;
+    float data[R * C];
+
+    float& operator()(int r, int c)       { return data[r * C + c]; }
+    float  operator()(int r, int c) const { return data[r * C + c]; }
+
+    void load(const float* src) {
+        for (int i = 0; i < R * C; i++) data[i] = src[i];
+    }
+    void store(float* dst) const {
+        for (int i = 0; i < R * C; i++) dst[i] = data[i];
+    }
+    void setIdentity() {
+        for (int r = 0; r < R; r++)
+            for (int c = 0; c < C; c++) (*this)(r, c) = (r == c) ? 1.0f : 0.0f;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Small products
+// -----------------------------------------------------------------------------
+
+// out = A * B
+template <int R, int K, int C>
+inline void gemmFixed(const FixedMatrix<R, K>& A, const FixedMatrix<K, C>& B, FixedMatrix<R, C>& out) {
+    for (int r = 0; r < R; r++) {
+        for (int c = 0; c < C; c++) {
+            float s = 0.0f;
+            for (int k = 0; k < K; k++) s += A(r, k) * B(k, c);
+            out(r, c) = s;
+        }
+    }
+}
+
+// out = A * A^T (symmetric; the lower triangle is mirrored)
+template <int R, int K>
+inline void gramFixed(const FixedMatrix<R, K>& A, FixedMatrix<R, R>& out) {
+    for (int r = 0; r < R; r++) {
+        for (int c = r; c < R; c++) {
+            float s = 0.0f;
+            for (int k = 0; k < K; k++) s += A(r, k) * A(c, k);
+            out(r, c) = s;
+            out(c, r) = s;
+        }
+    }
+}
+
+// Cov = (1/n) X^T X for X (n x C, row-major) already centered. Rows are
+// summed in blocks (like the GEMM's k panels) to keep float round-off down
+// on long windows.
+template <int C>
+inline void covarianceFixed(const float* X, int n, FixedMatrix<C, C>& Cov) {
+    constexpr int BLOCK = 128;
+    float acc[C][C] = {};
+    for (int i0 = 0; i0 < n; i0 += BLOCK) {
+        int i1 = (n - i0 < BLOCK) ? n : i0 + BLOCK;
+        float part[C][C] = {};
+        for (int i = i0; i < i1; i++) {
+            const float* x = X + static_cast<size_t>(i) * C;
+            for (int p = 0; p < C; p++)
+                for (int q = p; q < C; q++) part[p][q] += x[p] * x[q];
+        }
+        for (int p = 0; p < C; p++)
+            for (int q = p; q < C; q++) acc[p][q] += part[p][q];
+    }
+    const float inv = 1.0f / static_cast<float>(n);
+    for (int p = 0; p < C; p++) {
+        for (int q = p; q < C; q++) {
+            Cov(p, q) = acc[p][q] * inv;
+            Cov(q, p) = acc[p][q] * inv;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Symmetric EVD (cyclic threshold Jacobi)
+//
+// One Jacobi for both matrix types: jacobiEVD (Matrix, any n) and
+// jacobiEVDFixed (FixedMatrix) run these kernels through element accessors
+// D(r, c) and V(r, c) returning float&. With a FixedMatrix and n = N every
+// accessor inlines to a constant offset and the loops unroll.
+// -----------------------------------------------------------------------------
+
+// Each sweep visits every (p, q) pair once, skipping pairs below a threshold
+// on the first sweeps and flushing negligible ones to zero later. Converges
+// when the off-diagonal mass falls below tol relative to the diagonal.
+//   D: A on entry (only the upper triangle is used and kept up to date)
+//   V: identity on entry, the accumulated rotations on return
+//   d, b, z: n floats of scratch each; d holds the eigenvalues on return,
+//   unsorted
+template <typename DAt, typename VAt>
+inline EvdResult jacobiSweeps(int n, DAt&& D, VAt&& V, float* d, float* b, float* z,
+                              int maxSweeps, float tol) {
+    // d: running eigenvalues, b: value at start of sweep, z: accumulated shifts
+    for (int i = 0; i < n; i++) {
+        b[i] = d[i] = D(i, i);
+        z[i] = 0.0f;
+    }
+
+    EvdResult res{0, n < 2};
+    for (int sweep = 1; sweep <= maxSweeps && !res.converged; sweep++) {
+        float off = 0.0f, diag = 0.0f;
+        for (int p = 0; p < n; p++) {
+            diag += d[p] * d[p];
+            for (int q = p + 1; q < n; q++) off += std::fabs(D(p, q));
+        }
+        if (off <= tol * std::sqrt(diag) || off == 0.0f) {
+            res.converged = true;
+            break;
+        }
+        res.sweeps = sweep;
+
+        float thresh = (sweep < 4) ? 0.2f * off / (n * n) : 0.0f;
+        for (int p = 0; p < n - 1; p++) {
+            for (int q = p + 1; q < n; q++) {
+                float apq = D(p, q);
+                float g = 100.0f * std::fabs(apq);
+                if (sweep > 4 && std::fabs(d[p]) + g == std::fabs(d[p])
+                              && std::fabs(d[q]) + g == std::fabs(d[q])) {
+                    D(p, q) = 0.0f;
+                    continue;
+                }
+                if (std::fabs(apq) <= thresh) continue;
+
+                // Rotation angle, computed without trig (tan of the smaller root)
+                float h = d[q] - d[p];
+                float t;
+                if (std::fabs(h) + g == std::fabs(h)) {
+                    t = apq / h;
+                } else {
+                    float theta = 0.5f * h / apq;
+                    t = 1.0f / (std::fabs(theta) + std::sqrt(1.0f + theta * theta));
+                    if (theta < 0.0f) t = -t;
+                }
+                float c = 1.0f / std::sqrt(1.0f + t * t);
+                float s = t * c;
+                float tau = s / (1.0f + c);
+                h = t * apq;
+                res.rotations++;
+                z[p] -= h; z[q] += h;
+                d[p] -= h; d[q] += h;
+                D(p, q) = 0.0f;
+
+                auto rot = [&](float& x, float& y) {
+                    float gx = x, hy = y;
+                    x = gx - s * (hy + gx * tau);
+                    y = hy + s * (gx - hy * tau);
+                };
+                for (int j = 0; j < p; j++)      rot(D(j, p), D(j, q));
+                for (int j = p + 1; j < q; j++)  rot(D(p, j), D(j, q));
+                for (int j = q + 1; j < n; j++)  rot(D(p, j), D(q, j));
+                for (int j = 0; j < n; j++)      rot(V(j, p), V(j, q));
+            }
+        }
+        // Fold the accumulated shifts back in to limit round-off
+        for (int p = 0; p < n; p++) {
+            b[p] += z[p];
+            d[p] = b[p];
+            z[p] = 0.0f;
+        }
+    }
+    return res;
+}
+
+// Write eigenvalues d as a diagonal D, then sort eigenpairs by descending
+// eigenvalue. Selection sort: n is small and every swap moves a whole
+// eigenvector column.
+template <typename DAt, typename VAt>
+inline void sortEigenpairs(int n, const float* d, DAt&& D, VAt&& V) {
+    for (int r = 0; r < n; r++)
+        for (int c = 0; c < n; c++) D(r, c) = (r == c) ? d[r] : 0.0f;
+    for (int i = 0; i < n - 1; i++) {
+        int best = i;
+        for (int j = i + 1; j < n; j++) {
+            if (D(j, j) > D(best, best)) best = j;
+        }
+        if (best == i) continue;
+        std::swap(D(i, i), D(best, best));
+        for (int r = 0; r < n; r++) std::swap(V(r, i), V(r, best));
+    }
+}
+
+//   D holds A on entry and diag(eigenvalues) on return, sorted descending;
+//   V receives the matching eigenvectors in its columns.
+template <int N>
+inline EvdResult jacobiEVDFixed(FixedMatrix<N, N>& D, FixedMatrix<N, N>& V,
+                                int maxSweeps = 50, float tol = 1e-6f) {
+    V.setIdentity();
+    float d[N], b[N], z[N];
+    auto dAt = [&D](int r, int c) -> float& { return D(r, c); };
+    auto vAt = [&V](int r, int c) -> float& { return V(r, c); };
+    EvdResult res = jacobiSweeps(N, dAt, vAt, d, b, z, maxSweeps, tol);
+    sortEigenpairs(N, d, dAt, vAt);
+    return res;
+}
+
+// out = V * D^{-1/2} * V^T, scaledV = V * D^{-1/2} (zero eigenvalues map to
+// zero, as inverseSqrtFromEVD)
+template <int N>
+inline void inverseSqrtFixed(const FixedMatrix<N, N>& V, const FixedMatrix<N, N>& D,
+                             FixedMatrix<N, N>& scaledV, FixedMatrix<N, N>& out) {
+    for (int c = 0; c < N; c++) {
+        float d = D(c, c);
+        float s = (d > 0.0f) ? 1.0f / std::sqrt(d) : 0.0f;
+        for (int r = 0; r < N; r++) scaledV(r, c) = V(r, c) * s;
+    }
+    for (int r = 0; r < N; r++) {
+        for (int c = 0; c < N; c++) {
+            float acc = 0.0f;
+            for (int k = 0; k < N; k++) acc += scaledV(r, k) * V(c, k);
+            out(r, c) = acc;
+        }
+    }
+}
+
+// W_out = (W W^T)^{-1/2} * W. Returns the EVD's statistics.
+template <int K, int C>
+inline EvdResult symmetricDecorrelationFixed(const FixedMatrix<K, C>& W, FixedMatrix<K, C>& W_out) {
+    FixedMatrix<K, K> M, V, scaledV, M_inv_sqrt;
+    gramFixed(W, M);
+    EvdResult res = jacobiEVDFixed(M, V);
+    inverseSqrtFixed(V, M, scaledV, M_inv_sqrt);
+    gemmFixed(M_inv_sqrt, W, W_out);
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+// Dispatch helpers
+// -----------------------------------------------------------------------------
+
+// Call fn(std::integral_constant<int, n>) if Lo <= n <= Hi; false otherwise
+template <int Lo, int Hi, typename Fn>
+inline bool withFixedSize(int n, Fn&& fn) {
+    if constexpr (Lo > Hi) {
+        return false;
+    } else {
+        if (n == Lo) {
+            fn(std::integral_constant<int, Lo>{});
+            return true;
+        }
+        return withFixedSize<Lo + 1, Hi>(n, std::forward<Fn>(fn));
+    }
+}
+
+template <int K, int C> struct FixedShape {};
+template <typename... Shapes> struct FixedShapeList {};
+
+// Shapes of W with a compiled decorrelation kernel. Whitening keeps only the
+// k leading directions, so W is k x k: 2 to 8 components.
+using FixedDecorrelationShapes = FixedShapeList<
+    FixedShape<2, 2>, FixedShape<3, 3>, FixedShape<4, 4>, FixedShape<5, 5>,
+    FixedShape<6, 6>, FixedShape<7, 7>, FixedShape<8, 8>>;
+
+// Call fn(FixedShape<K, C>) for the listed shape matching (k, c); false if none does
+template <typename Fn>
+inline bool withFixedShape(FixedShapeList<>, int, int, Fn&&) {
+    return false;
+}
+template <int K, int C, typename... Rest, typename Fn>
+inline bool withFixedShape(FixedShapeList<FixedShape<K, C>, Rest...>, int k, int c, Fn&& fn) {
+    if (k == K && c == C) {
+        fn(FixedShape<K, C>{});
+        return true;
+    }
+    return withFixedShape(FixedShapeList<Rest...>{}, k, c, std::forward<Fn>(fn));
+}
@@ -0,0 +1,458 @@
+#include "gain_output.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/gpio.h>)
+#include <linux/gpio.h>
+#ifdef GPIO_V2_GET_LINE_IOCTL
+#define GAIN_OUTPUT_HAVE_GPIO_V2 1
+#endif
+#endif
+
+namespace output {
+
+namespace {
+
+uint64_t steadyNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void setError(std::string* error, const std::string& what) {
+    if (error) *error = what;
+}
+
+std::string errnoText(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+// "0,1,3" -> {0, 1, 3}; false on anything else
+bool parseIndexList(const std::string& s, std::vector<int>& out) {
+    out.clear();
+    std::stringstream list(s);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos) return false;
+        out.push_back(std::atoi(item.c_str()));
+    }
+    return !out.empty() && static_cast<int>(out.size()) <= kMaxGains;
+}
+
+// Whole-file write for sysfs attributes
+bool writeAttr(const std::string& path, const std::string& value, std::string* error) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        setError(error, errnoText("open " + path));
+        return false;
+    }
+    bool ok = ::write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size());
+    if (!ok) setError(error, errnoText("write " + path));
+    ::close(fd);
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// stdout / stderr: human-readable, throttled, only on a change
+// -----------------------------------------------------------------------------
+class TextSink : public Sink {
+public:
+    TextSink(std::FILE* f, const char* name, double hz)
+        : f_(f), name_(name), interval_ns_(hz > 0.0 ? static_cast<uint64_t>(1e9 / hz) : 0) {}
+
+    bool write(uint64_t t_ns, const std::string& port, const float* gains, int n) override {
+        if (printed_ && t_ns - last_ns_ < interval_ns_) return true;
+        int values[kMaxGains];
+        bool changed = !printed_;
+        for (int i = 0; i < n; i++) {
+            values[i] = static_cast<int>(std::lround(gains[i]));
+            changed = changed || values[i] != last_[i];
+        }
+        if (!changed) return true;
+
+        char line[32 + kMaxGains * 5];
+        int len = std::snprintf(line, sizeof(line), "%s:", port.c_str());
+        for (int i = 0; i < n && len < static_cast<int>(sizeof(line)); i++) {
+            len += std::snprintf(line + len, sizeof(line) - len, " %d", values[i]);
+            last_[i] = values[i];
+        }
+        printed_ = true;
+        last_ns_ = t_ns;
+        return std::fprintf(f_, "%s\n", line) >= 0 && std::fflush(f_) == 0;
+    }
+
+    std::string describe() const override {
+        return std::string(name_) + " (at most " +
+               std::to_string(interval_ns_ ? 1000000000 / interval_ns_ : 0) + " lines/s)";
+    }
+
+private:
+    std::FILE* f_;
+    const char* name_;
+    uint64_t interval_ns_;
+    bool printed_ = false;
+    uint64_t last_ns_ = 0;
+    int last_[kMaxGains] = {};
+};
+
+// -----------------------------------------------------------------------------
+// file: every tick as CSV
+// -----------------------------------------------------------------------------
+class FileSink : public Sink {
+public:
+    ~FileSink() override {
+        if (f_) std::fclose(f_);
+    }
+
+    bool open(const std::string& path, std::string* error) {
+        path_ = path;
+        f_ = std::fopen(path.c_str(), "w");
+        if (!f_) setError(error, errnoText("open " + path));
+        return f_ != nullptr;
+    }
+
+    bool write(uint64_t t_ns, const std::string&, const float* gains, int n) override {
+        if (!header_) {
+            std::fprintf(f_, "t_ns");
+            for (int i = 0; i < n; i++) std::fprintf(f_, ",g%d", i);
+            std::fprintf(f_, "\n");
+            header_ = true;
+        }
+        bool ok = std::fprintf(f_, "%llu", static_cast<unsigned long long>(t_ns)) >= 0;
+        for (int i = 0; i < n; i++) ok = ok && std::fprintf(f_, ",%.3f", gains[i]) >= 0;
+        return ok && std::fprintf(f_, "\n") >= 0;
+    }
+
+    std::string describe() const override { return "file " + path_; }
+
+private:
+    std::string path_;
+    std::FILE* f_ = nullptr;
+    bool header_ = false;
+};
+
+// -----------------------------------------------------------------------------
+// pwm: Linux sysfs PWM, duty cycle per gain. The duty_cycle attributes stay
+// open and are rewritten in place, only when the value changes.
+// -----------------------------------------------------------------------------
+class PwmSink : public Sink {
+public:
+    ~PwmSink() override {
+        for (int fd : duty_fd_) ::close(fd);
+    }
+
+    bool open(int chip, const std::vector<int>& channels, uint64_t period_ns, std::string* error) {
+        chip_dir_ = "/sys/class/pwm/pwmchip" + std::to_string(chip);
+        channels_ = channels;
+        period_ns_ = period_ns;
+        for (int ch : channels) {
+            const std::string dir = chip_dir_ + "/pwm" + std::to_string(ch);
+            if (::access(dir.c_str(), F_OK) != 0) {
+                if (!writeAttr(chip_dir_ + "/export", std::to_string(ch), error)) return false;
+                // The attributes appear (and get their permissions from
+                // udev) shortly after the export
+                for (int i = 0; i < 100 && ::access((dir + "/enable").c_str(), W_OK) != 0; i++) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            // duty_cycle may not exceed the period, so clear it first
+            if (!writeAttr(dir + "/duty_cycle", "0", error) ||
+                !writeAttr(dir + "/period", std::to_string(period_ns), error) ||
+                !writeAttr(dir + "/enable", "1", error)) {
+                return false;
+            }
+            int fd = ::open((dir + "/duty_cycle").c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0) {
+                setError(error, errnoText("open " + dir + "/duty_cycle"));
+                return false;
+            }
+            duty_fd_.push_back(fd);
+            last_duty_.push_back(0);
+        }
+        return true;
+    }
+
+    bool write(uint64_t, const std::string&, const float* gains, int n) override {
+        bool ok = true;
+        for (size_t i = 0; i < duty_fd_.size() && static_cast<int>(i) < n; i++) {
+            const uint64_t duty = static_cast<uint64_t>(std::llround(gains[i] / 255.0 * period_ns_));
+            if (duty == last_duty_[i]) continue;
+            char buf[24];
+            int len = std::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(duty));
+            if (::pwrite(duty_fd_[i], buf, len, 0) == len) {
+                last_duty_[i] = duty;
+            } else {
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    std::string describe() const override {
+        std::string s = "pwm " + chip_dir_ + " channels";
+        for (size_t i = 0; i < channels_.size(); i++) s += (i ? "," : " ") + std::to_string(channels_[i]);
+        return s + ", period " + std::to_string(period_ns_) + " ns";
+    }
+
+private:
+    std::string chip_dir_;
+    std::vector<int> channels_;
+    uint64_t period_ns_ = 0;
+    std::vector<int> duty_fd_;
+    std::vector<uint64_t> last_duty_;
+};
+
+#ifdef GAIN_OUTPUT_HAVE_GPIO_V2
+// -----------------------------------------------------------------------------
+// gpio: character device lines, one first-order sigma-delta per gain. The
+// lines are set together in one ioctl, only when a bit changes.
+// -----------------------------------------------------------------------------
+class GpioSink : public Sink {
+public:
+    ~GpioSink() override {
+        if (line_fd_ >= 0) ::close(line_fd_);
+    }
+
+    bool open(const std::string& dev, const std::vector<int>& lines, std::string* error) {
+        dev_ = dev;
+        lines_ = lines;
+        int chip = ::open(dev.c_str(), O_RDWR | O_CLOEXEC);
+        if (chip < 0) {
+            setError(error, errnoText("open " + dev));
+            return false;
+        }
+        gpio_v2_line_request req;
+        std::memset(&req, 0, sizeof(req));
+        for (size_t i = 0; i < lines.size(); i++) req.offsets[i] = static_cast<uint32_t>(lines[i]);
+        req.num_lines = static_cast<uint32_t>(lines.size());
+        std::snprintf(req.consumer, sizeof(req.consumer), "ica-gain");
+        req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+        int rc = ::ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+        if (rc < 0) setError(error, errnoText("request lines on " + dev));
+        ::close(chip);
+        line_fd_ = (rc < 0) ? -1 : req.fd;
+        return line_fd_ >= 0;
+    }
+
+    bool write(uint64_t, const std::string&, const float* gains, int n) override {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < lines_.size() && static_cast<int>(i) < n; i++) {
+            acc_[i] += gains[i] / 255.0f;
+            if (acc_[i] >= 1.0f) {
+                acc_[i] -= 1.0f;
+                bits |= uint64_t(1) << i;
+            }
+        }
+        if (have_bits_ && bits == last_bits_) return true;
+        gpio_v2_line_values values;
+        values.bits = bits;
+        values.mask = (uint64_t(1) << lines_.size()) - 1;
+        if (::ioctl(line_fd_, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) return false;
+        last_bits_ = bits;
+        have_bits_ = true;
+        return true;
+    }
+
+    std::string describe() const override {
+        std::string s = "gpio " + dev_ + " lines";
+        for (size_t i = 0; i < lines_.size(); i++) s += (i ? "," : " ") + std::to_string(lines_[i]);
+        return s + " (sigma-delta at the tick rate)";
+    }
+
+private:
+    std::string dev_;
+    std::vector<int> lines_;
+    int line_fd_ = -1;
+    float acc_[kMaxGains] = {};
+    uint64_t last_bits_ = 0;
+    bool have_bits_ = false;
+};
+#endif // GAIN_OUTPUT_HAVE_GPIO_V2
+
+} // namespace
+
+std::unique_ptr<Sink> makeSink(const std::string& spec, std::string* error) {
+    const size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    const std::string arg = (colon == std::string::npos) ? std::string() : spec.substr(colon + 1);
+
+    if (colon == std::string::npos) {
+        // stdout[@HZ], stderr[@HZ]
+        double hz = 10.0;
+        size_t at = kind.find('@');
+        if (at != std::string::npos) {
+            hz = std::atof(kind.c_str() + at + 1);
+            kind.resize(at);
+        }
+        if (kind == "stdout") return std::make_unique<TextSink>(stdout, "stdout", hz);
+        if (kind == "stderr") return std::make_unique<TextSink>(stderr, "stderr", hz);
+        setError(error, "sink spec must be stdout, stderr or kind:args, got " + spec);
+        return nullptr;
+    }
+    if (kind == "file") {
+        auto s = std::make_unique<FileSink>();
+        if (!s->open(arg, error)) return nullptr;
+        return s;
+    }
+    if (kind == "pwm") {
+        // CHIP:CH[,CH...][@PERIOD_NS]
+        std::string rest = arg;
+        uint64_t period_ns = 1000000;
+        size_t at = rest.rfind('@');
+        if (at != std::string::npos) {
+            period_ns = std::strtoull(rest.c_str() + at + 1, nullptr, 10);
+            rest.resize(at);
+        }
+        size_t sep = rest.find(':');
+        std::vector<int> channels;
+        if (sep == std::string::npos || sep == 0 || period_ns == 0 ||
+            rest.find_first_not_of("0123456789") != sep || !parseIndexList(rest.substr(sep + 1), channels)) {
+            setError(error, "pwm sink spec is pwm:CHIP:CH[,CH...][@PERIOD_NS], got " + spec);
+            return nullptr;
+        }
+        auto s = std::make_unique<PwmSink>();
+        if (!s->open(std::atoi(rest.c_str()), channels, period_ns, error)) return nullptr;
+        return s;
+    }
+    if (kind == "gpio") {
+        // DEV:LINE[,LINE...]
+        size_t sep = arg.rfind(':');
+        std::vector<int> lines;
+        if (sep == std::string::npos || sep == 0 || !parseIndexList(arg.substr(sep + 1), lines)) {
+            setError(error, "gpio sink spec is gpio:DEV:LINE[,LINE...], got " + spec);
+            return nullptr;
+        }
+        std::string dev = arg.substr(0, sep);
+        if (dev.find('/') == std::string::npos) dev = "/dev/" + dev;
+#ifdef GAIN_OUTPUT_HAVE_GPIO_V2
+        auto s = std::make_unique<GpioSink>();
+        if (!s->open(dev, lines, error)) return nullptr;
+        return s;
+#else
+        setError(error, "built without GPIO character device (uAPI v2) support");
+        return nullptr;
+#endif
+    }
+    setError(error, "unknown sink: " + kind);
+    return nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// GainPort
+// -----------------------------------------------------------------------------
+GainPort::GainPort(std::string name, int n, std::vector<std::unique_ptr<Sink>> sinks)
+    : name_(std::move(name)), n_(n), sinks_(std::move(sinks)) {}
+
+void GainPort::publish(const float* gains, int n) {
+    // A NaN would get through the clamp below and stick in current_ for good
+    // (every later ramp starts from it), so the whole target is dropped
+    for (int i = 0; i < n_ && i < n; i++) {
+        if (!std::isfinite(gains[i])) {
+            rejected_++;
+            return;
+        }
+    }
+    Target& t = mailbox_.write();
+    t.t_ns = steadyNs();
+    for (int i = 0; i < n_; i++) t.gains[i] = (i < n) ? std::min(std::max(gains[i], 0.0f), 255.0f) : 0.0f;
+    if (!mailbox_.publish()) superseded_++;
+}
+
+void GainPort::tick(uint64_t t_ns, float max_step) {
+    if (mailbox_.update()) {
+        // Ramp from where the gains are now to the new target over the mean
+        // interval between targets (a 1/8 running mean)
+        const uint64_t target_ns = mailbox_.read().t_ns;
+        if (last_target_ns_ != 0 && target_ns > last_target_ns_) {
+            const int64_t interval = static_cast<int64_t>(target_ns - last_target_ns_);
+            const int64_t mean = static_cast<int64_t>(ramp_ns_);
+            ramp_ns_ = static_cast<uint64_t>(ramp_ns_ ? mean + (interval - mean) / 8 : interval);
+        }
+        last_target_ns_ = target_ns;
+        std::copy(current_, current_ + n_, from_);
+        ramp_start_ns_ = t_ns;
+        have_target_ = true;
+    }
+    if (!have_target_) return;
+
+    const float* target = mailbox_.read().gains;
+    const uint64_t since = t_ns - ramp_start_ns_;
+    const float alpha = (ramp_ns_ > since) ? static_cast<float>(since) / static_cast<float>(ramp_ns_) : 1.0f;
+    for (int i = 0; i < n_; i++) {
+        const float want = from_[i] + alpha * (target[i] - from_[i]);
+        current_[i] += std::min(std::max(want - current_[i], -max_step), max_step);
+    }
+    for (auto& sink : sinks_) {
+        if (!sink->write(t_ns, name_, current_, n_)) sink_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// GainStage
+// -----------------------------------------------------------------------------
+GainStage::GainStage(const StageOptions& opt) : opt_(opt) {}
+
+GainStage::~GainStage() {
+    stop();
+}
+
+GainPort& GainStage::addPort(const std::string& name, int n, std::vector<std::unique_ptr<Sink>> sinks) {
+    if (thread_.joinable()) {
+        throw std::runtime_error("GainStage: addPort() after start()");
+    }
+    if (n <= 0 || n > kMaxGains) {
+        throw std::runtime_error("GainStage: a port has 1 to kMaxGains gains");
+    }
+    ports_.push_back(std::unique_ptr<GainPort>(new GainPort(name, n, std::move(sinks))));
+    return *ports_.back();
+}
+
+void GainStage::start() {
+    if (thread_.joinable()) return;
+    stop_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread(&GainStage::run, this);
+}
+
+void GainStage::stop() {
+    stop_.store(true, std::memory_order_release);
+    if (thread_.joinable()) thread_.join();
+}
+
+// Fixed-rate ticks on the steady clock. A tick that wakes up more than a
+// period late drops the ticks it overslept (no burst to catch up); the slew
+// limit scales with the actual time since the previous tick.
+void GainStage::run() {
+    using Clock = std::chrono::steady_clock;
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / std::max(opt_.rate_hz, 1.0)));
+    Clock::time_point next = Clock::now();
+    uint64_t last_ns = 0;
+    while (!stop_.load(std::memory_order_acquire)) {
+        next += period;
+        const Clock::time_point now = Clock::now();
+        if (now > next + period) {
+            const auto behind = (now - next) / period;
+            skipped_.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+            next += behind * period;
+        }
+        std::this_thread::sleep_until(next);
+
+        const uint64_t t_ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count());
+        const double dt = last_ns ? (t_ns - last_ns) * 1e-9 : 1.0 / opt_.rate_hz;
+        last_ns = t_ns;
+        const float max_step = static_cast<float>(opt_.slew_per_s * dt);
+        for (auto& port : ports_) port->tick(t_ns, max_step);
+        ticks_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace output
@@ -0,0 +1,146 @@
+#pragma once
+// Control output: gain targets from the ICA pipelines to the pedal's pins.
+//
+// The compute side publish()es each window's target gains into its port's
+// mailbox (a TripleBuffer: wait-free, no allocation, no system call) and
+// goes on. One output thread runs at its own, higher rate: every tick it
+// takes each port's newest target, moves the port's gains towards it and
+// writes them to the port's sinks. Blocking I/O (a terminal, sysfs, an
+// ioctl, a file) therefore only ever stalls the output thread.
+//
+// Targets arrive at the ICA cadence (a hop, or a window in the legacy
+// loops), so the thread interpolates: a new target starts a linear ramp
+// from the current gains that spans the mean interval between targets, and
+// each tick's step is clamped to slew_per_s. The pins see a smooth,
+// rate-limited trajectory instead of a jump per window.
+//
+// Sinks, built from a spec string like the ingest transports:
+//
+//   stdout[@HZ]               text lines "name: g0 g1 ...", at most HZ per
+//                             second (default 10) and only on a change
+//   file:PATH                 CSV "t_ns,g0,g1,..." every tick (tests, plots)
+//   pwm:CHIP:CH[,CH...][@NS]  Linux sysfs PWM, /sys/class/pwm/pwmchipCHIP,
+//                             one channel per gain, period NS (default
+//                             1000000); duty = gain / 255 * period
+//   gpio:DEV:LINE[,LINE...]   GPIO character device (uAPI v2), one line per
+//                             gain. A line is one bit, so each gain drives
+//                             a first-order sigma-delta at the tick rate:
+//                             the line's mean level is gain / 255 (follow it
+//                             with an RC filter for an analog level)
+#include "triple_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace output {
+
+// Gains per port; they live inline in the mailbox slots
+constexpr int kMaxGains = 8;
+
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    // Called on the output thread every tick with the port's gains, each in
+    // [0, 255]; t_ns is the tick time (steady clock). Returns false on an
+    // I/O error (counted, and the sink keeps being called).
+    virtual bool write(uint64_t t_ns, const std::string& port, const float* gains, int n) = 0;
+
+    virtual std::string describe() const = 0;
+};
+
+// Build a sink from a spec string (see above). On failure returns nullptr
+// and, if error is given, a reason.
+std::unique_ptr<Sink> makeSink(const std::string& spec, std::string* error = nullptr);
+
+struct StageOptions {
+    double rate_hz   = 1000.0;     // output ticks per second
+    float slew_per_s = 1020.0f;    // max gain change per second (full scale in 250 ms)
+};
+
+// One set of gains (a stream's pins): its mailbox and output state
+class GainPort {
+public:
+    // Compute side, one thread at a time: the newest target gains (the
+    // first `gains()` of them are used). Never blocks. A target with a
+    // non-finite gain is dropped and the port keeps its previous one.
+    void publish(const float* gains, int n);
+
+    const std::string& name() const { return name_; }
+    int gains() const { return n_; }
+
+    // Targets the output thread never took because a newer one replaced them
+    uint64_t superseded() const { return superseded_; }
+    // Targets dropped by publish() for a NaN or infinite gain
+    uint64_t rejected() const { return rejected_; }
+    uint64_t sinkErrors() const { return sink_errors_.load(std::memory_order_relaxed); }
+
+private:
+    friend class GainStage;
+
+    struct Target {
+        uint64_t t_ns = 0;
+        float gains[kMaxGains] = {};
+    };
+
+    GainPort(std::string name, int n, std::vector<std::unique_ptr<Sink>> sinks);
+
+    // Output thread: take a new target, if any, then advance one tick
+    void tick(uint64_t t_ns, float max_step);
+
+    const std::string name_;
+    const int n_;
+    std::vector<std::unique_ptr<Sink>> sinks_;
+
+    // Compute side
+    TripleBuffer<Target> mailbox_;
+    uint64_t superseded_ = 0;
+    uint64_t rejected_ = 0;
+
+    // Output thread
+    bool have_target_ = false;
+    float current_[kMaxGains] = {};
+    float from_[kMaxGains] = {};
+    uint64_t ramp_start_ns_ = 0;
+    uint64_t ramp_ns_ = 0;          // mean interval between targets
+    uint64_t last_target_ns_ = 0;
+    std::atomic<uint64_t> sink_errors_{0};
+};
+
+class GainStage {
+public:
+    explicit GainStage(const StageOptions& opt = StageOptions());
+    ~GainStage();
+    GainStage(const GainStage&) = delete;
+    GainStage& operator=(const GainStage&) = delete;
+
+    // Register a port with n gains (at most kMaxGains) and its sinks, before
+    // start(). The port lives as long as the stage.
+    GainPort& addPort(const std::string& name, int n, std::vector<std::unique_ptr<Sink>> sinks);
+
+    void start();
+    void stop();
+
+    const StageOptions& options() const { return opt_; }
+    uint64_t ticks() const { return ticks_.load(std::memory_order_relaxed); }
+    // Ticks skipped because the thread woke up more than a period late
+    uint64_t ticksSkipped() const { return skipped_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+
+    const StageOptions opt_;
+    std::vector<std::unique_ptr<GainPort>> ports_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> ticks_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::thread thread_;
+};
+
+} // namespace output
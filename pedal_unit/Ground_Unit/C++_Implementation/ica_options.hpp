@@ -0,0 +1,54 @@
+#pragma once
+// Solver options shared by the internal engine (mainprocess_internal.hpp)
+// and the Eigen engine (mainprocess.hpp).
+#include <chrono>
+
+// How FastICA estimates its components.
+//
+//   Symmetric  all k rows of W updated together, then W <- (W W^T)^{-1/2} W
+//              every iteration (an EVD of W W^T). Iterates until the slowest
+//              component has converged.
+//   Deflation  one unit at a time: w <- E{z g(w^T z)} - E{g'(w^T z)} w, then
+//              Gram-Schmidt against the components already found and
+//              normalise. Vector-only work, each component stops as soon as
+//              it has converged itself, and once the whitened space has a
+//              single direction left the last component needs no iteration.
+//              Errors in early components carry into later ones, so prefer
+//              Symmetric when k is close to the channel count.
+enum class IcaMode { Symmetric, Deflation };
+
+// Budget for one solve: at most max_iter iterations and, if a deadline is
+// set, no iteration that would end past it (judged by the mean iteration time
+// of the solve so far). In Deflation mode max_iter caps each component's
+// iterations separately, as in the reference FastICA, so a solve of k
+// components runs up to k * max_iter in total; the deadline covers them all.
+// A solve that runs out of either keeps the last complete estimate of W,
+// which is already decorrelated, so the caller always gets a usable
+// unmixing. The deadline covers the iterations only; leave room after it
+// for S = W X and whatever follows.
+struct IcaBudget {
+    using Clock = std::chrono::steady_clock;
+
+    int max_iter = 1000;
+    Clock::time_point deadline = Clock::time_point::max();
+
+    IcaBudget() = default;
+    explicit IcaBudget(int iterations, Clock::time_point until = Clock::time_point::max())
+        : max_iter(iterations), deadline(until) {}
+
+    // At most `time` from now
+    static IcaBudget within(std::chrono::nanoseconds time, int iterations = 1000) {
+        return IcaBudget(iterations, Clock::now() + time);
+    }
+
+    bool timed() const { return deadline != Clock::time_point::max(); }
+
+    // One more iteration ends by the deadline, `done` iterations having run
+    // since `start`
+    bool fits(int done, Clock::time_point start) const {
+        if (!timed()) return true;
+        const Clock::time_point now = Clock::now();
+        const Clock::duration mean = (done > 0) ? (now - start) / done : Clock::duration::zero();
+        return now + mean <= deadline;
+    }
+};
@@ -0,0 +1,402 @@
+#include "ica_pipeline.hpp"
+#include "ica_profile.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Rows given in channel space (rows x channels) -> the same rows in the
+// coordinates `whitening` (dims x channels) maps to. Rows of the whitening
+// matrix are d_i^{-1/2} v_i^T, so its pseudo-inverse has columns
+// w_i^T / |w_i|^2.
+static void toWhitenedBasis(const Matrix& rows, const Matrix& whitening, Matrix& out) {
+    reshape(out, rows.rows, whitening.rows);
+    for (int i = 0; i < whitening.rows; i++) {
+        float n2 = 0.0f;
+        for (int c = 0; c < whitening.cols; c++) n2 += at(whitening, i, c) * at(whitening, i, c);
+        const float inv = (n2 > 0.0f) ? 1.0f / n2 : 0.0f;
+        for (int r = 0; r < rows.rows; r++) {
+            float acc = 0.0f;
+            for (int c = 0; c < whitening.cols; c++) acc += at(rows, r, c) * at(whitening, i, c);
+            at(out, r, i) = acc * inv;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// IcaPipeline
+// -----------------------------------------------------------------------------
+IcaPipeline::IcaPipeline(const PipelineConfig& cfg, FrameSource& source, GainSink sink)
+    : cfg_(cfg), source_(source), sink_(std::move(sink)),
+      whitener_(cfg.window, source.channels(), cfg.components),
+      ws_(cfg.window, source.channels(), cfg.components),
+      tracker_(cfg.components, source.channels()),
+      W_channels_(cfg.components, source.channels()),
+      W_init_(cfg.components, cfg.components),
+      gains_(cfg.components, 0.0f) {
+    if (cfg.components <= 0 || cfg.components > source.channels()) {
+        throw std::runtime_error("IcaPipeline: components must be in [1, channels]");
+    }
+    if (cfg.hop <= 0) {
+        throw std::runtime_error("IcaPipeline: hop must be positive");
+    }
+    if (cfg.calibration_window > 0) {
+        if (cfg.calibration_window < source.channels() || cfg.recalibrate_every <= 0) {
+            throw std::runtime_error("IcaPipeline: calibration_window must cover the channels "
+                                     "and recalibrate_every be positive");
+        }
+        estimator_ = std::make_unique<UnmixingEstimator>(cfg, source.channels());
+        recent_.assign(static_cast<size_t>(cfg.window) * source.channels(), 0.0f);
+        unmixed_.assign(static_cast<size_t>(cfg.components) * cfg.window, 0.0f);
+    }
+}
+
+bool IcaPipeline::ready() const {
+    size_t n = source_.readable();
+    return n >= static_cast<size_t>(cfg_.hop) || (n > 0 && source_.finished());
+}
+
+bool IcaPipeline::done() const {
+    return source_.finished() && source_.readable() == 0;
+}
+
+bool IcaPipeline::step(std::chrono::steady_clock::time_point due) {
+    if (due == std::chrono::steady_clock::time_point{}) due = std::chrono::steady_clock::now();
+    size_t take = source_.readable();
+    if (!cfg_.drain) take = std::min(take, static_cast<size_t>(cfg_.hop));
+    if (take == 0) {
+        return false;
+    }
+
+    // Feed the hop straight from the source (at most two spans across the
+    // wrap), then release it
+    FrameSpans hop = source_.window(take);
+    if (estimator_) {
+        stepUnmixing(hop);
+        source_.consume(hop.frames());
+        return true;
+    }
+    whitener_.push(hop.first, static_cast<int>(hop.first_frames));
+    whitener_.push(hop.second, static_cast<int>(hop.second_frames));
+    source_.consume(hop.frames());
+    if (!whitener_.ready()) {
+        return true;
+    }
+
+    ICA_PROFILE_SCOPE_BUDGET(Window, cfg_.deadline_ns);
+    ICA_PROFILE_COUNT(Windows, 1);
+
+    // Re-derive whitening only if the covariance drifted, then hand the
+    // whitened window straight to the solver. A new whitening is a new
+    // basis: carry the previous W over through channel space (W * K_old,
+    // then the new K's pseudo-inverse) and re-decorrelate it, or the warm
+    // start would be a rotation of the wrong coordinates.
+    {
+        ICA_PROFILE_SCOPE(Whiten);
+        if (have_W_) gemm(ws_.W, Trans::No, whitener_.whiteningMatrix(), Trans::No, W_channels_);
+        if (whitener_.updateWhitening()) {
+            ICA_PROFILE_COUNT(WhiteningUpdates, 1);
+            if (have_W_) {
+                toWhitenedBasis(W_channels_, whitener_.whiteningMatrix(), W_init_);
+                symmetricDecorrelationInto(W_init_, ws_.W, ws_);
+            }
+        }
+        whitener_.whitenedWindow(ws_.whitened);
+    }
+
+    // Warm-start from the previous window's W, iterate for whatever the
+    // deadline leaves after the output reserve, then keep component
+    // order/sign stable across windows
+    IcaBudget budget(cfg_.max_iter);
+    if (cfg_.deadline_ns > 0) {
+        const uint64_t solve_ns = cfg_.deadline_ns - std::min(cfg_.deadline_ns, cfg_.output_reserve_ns);
+        budget.deadline = due + std::chrono::nanoseconds(solve_ns);
+    }
+    const Matrix& S = fastICAWhitened(ws_, budget, cfg_.tol, have_W_ ? &ws_.W : nullptr,
+                                      cfg_.contrast, cfg_.mode);
+    if (ws_.out_of_time) out_of_time_++;
+    {
+        ICA_PROFILE_SCOPE(Track);
+        tracker_.align(ws_, whitener_.whiteningMatrix());
+    }
+    have_W_ = true;
+    windows_++;
+
+    emitGains(S.data.data(), S.rows, S.cols, S.cols);
+    return true;
+}
+
+// Two-rate step: apply the newest published unmixing to every frame of the
+// hop and hand the frames on to the estimator. Gains come out once a model
+// exists and the window is full.
+void IcaPipeline::stepUnmixing(const FrameSpans& hop) {
+    const int channels = source_.channels();
+    bool have_model;
+    {
+        ICA_PROFILE_SCOPE(Apply);
+
+        // A new model re-unmixes the frames already in the window, so the
+        // gains never mix outputs of two models
+        const bool swapped = estimator_->update();
+        have_model = estimator_->model().version != 0;
+        if (swapped) {
+            ICA_PROFILE_COUNT(UnmixingSwaps, 1);
+            for (int s = 0; s < recent_count_; s++) {
+                unmixFrame(&recent_[static_cast<size_t>(s) * channels], s);
+            }
+        }
+
+        auto feed = [&](const float* frames, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                const float* x = frames + i * channels;
+                estimator_->push(x);
+                float* slot = &recent_[static_cast<size_t>(recent_head_) * channels];
+                std::copy(x, x + channels, slot);
+                if (have_model) unmixFrame(slot, recent_head_);
+                recent_head_ = (recent_head_ + 1) % cfg_.window;
+                recent_count_ = std::min(recent_count_ + 1, cfg_.window);
+            }
+        };
+        feed(hop.first, hop.first_frames);
+        feed(hop.second, hop.second_frames);
+    }
+    if (!have_model || recent_count_ < cfg_.window) {
+        return;
+    }
+
+    ICA_PROFILE_COUNT(Windows, 1);
+    windows_++;
+    emitGains(unmixed_.data(), cfg_.components, recent_count_, cfg_.window);
+}
+
+// unmixed_[:, slot] = M (x - mean)
+void IcaPipeline::unmixFrame(const float* x, int slot) {
+    const UnmixingModel& m = estimator_->model();
+    for (int r = 0; r < m.components; r++) {
+        const float* row = &m.M[static_cast<size_t>(r) * m.channels];
+        float acc = 0.0f;
+        for (int c = 0; c < m.channels; c++) acc += row[c] * (x[c] - m.mean[c]);
+        unmixed_[static_cast<size_t>(r) * cfg_.window + slot] = acc;
+    }
+}
+
+// Gain per component: the window mean normalised to [0..255] by the window's
+// min and max, taken straight off the rows of S (rows x cols, row stride
+// `stride`), then handed to the sink
+void IcaPipeline::emitGains(const float* S, int rows, int cols, int stride) {
+    ICA_PROFILE_SCOPE(Output);
+    for (int r = 0; r < rows; r++) {
+        const float* v = S + static_cast<size_t>(r) * stride;
+        float lo = v[0], hi = v[0], sum = 0.0f;
+        for (int c = 0; c < cols; c++) {
+            lo = std::min(lo, v[c]);
+            hi = std::max(hi, v[c]);
+            sum += v[c];
+        }
+        float mean = sum / cols;
+        gains_[r] = (hi > lo) ? (mean - lo) / (hi - lo) * 255.0f : 0.0f;
+    }
+    if (sink_) sink_(gains_.data(), static_cast<int>(gains_.size()));
+}
+
+// -----------------------------------------------------------------------------
+// UnmixingEstimator
+// -----------------------------------------------------------------------------
+UnmixingEstimator::UnmixingEstimator(const PipelineConfig& cfg, int channels,
+                                     std::chrono::microseconds poll)
+    : cfg_(cfg), channels_(channels), poll_(poll),
+      blocks_(std::vector<float>(static_cast<size_t>(cfg.recalibrate_every) * channels, 0.0f)),
+      history_(cfg.calibration_window, channels),
+      tracker_(cfg.components, channels) {
+    thread_ = std::thread(&UnmixingEstimator::run, this);
+}
+
+UnmixingEstimator::~UnmixingEstimator() {
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+}
+
+void UnmixingEstimator::push(const float* frame) {
+    std::vector<float>& block = blocks_.write();
+    std::copy(frame, frame + channels_, &block[static_cast<size_t>(block_fill_) * channels_]);
+    if (++block_fill_ == cfg_.recalibrate_every) {
+        if (!blocks_.publish()) blocks_dropped_++;
+        block_fill_ = 0;
+    }
+}
+
+// Wait for blocks (polling: the fast path never signals, so it never makes a
+// system call), keep the newest calibration_window frames and re-estimate
+// once that many have arrived
+void UnmixingEstimator::run() {
+    while (!stop_.load(std::memory_order_acquire)) {
+        if (!blocks_.update()) {
+            std::this_thread::sleep_for(poll_);
+            continue;
+        }
+        const std::vector<float>& block = blocks_.read();
+        for (int i = 0; i < cfg_.recalibrate_every; i++) {
+            std::copy(&block[static_cast<size_t>(i) * channels_], &block[static_cast<size_t>(i + 1) * channels_],
+                      &history_.data[static_cast<size_t>(history_head_) * channels_]);
+            history_head_ = (history_head_ + 1) % cfg_.calibration_window;
+            history_count_ = std::min(history_count_ + 1, cfg_.calibration_window);
+        }
+        if (history_count_ == cfg_.calibration_window) estimate();
+    }
+}
+
+void UnmixingEstimator::estimate() {
+    ICA_PROFILE_SCOPE(Calibrate);
+    const int k = cfg_.components;
+
+    // The ring's row order does not matter to ICA: solve on it as it is
+    ws_.prepare(history_.rows, channels_, k);
+    centerDataInto(history_, ws_.mean, ws_.centered);
+    whitenDataInto(ws_);
+
+    // Warm start: the last estimate's rows (channel space) in the new
+    // whitened coordinates
+    const Matrix* init = nullptr;
+    if (estimates() > 0) {
+        toWhitenedBasis(unmixing_, ws_.whiteningMat, W_init_);
+        init = &W_init_;
+    }
+    fastICAWhitened(ws_, IcaBudget(cfg_.max_iter), cfg_.tol, init, cfg_.contrast, cfg_.mode);
+    {
+        ICA_PROFILE_SCOPE(Track);
+        tracker_.align(ws_, ws_.whiteningMat);
+    }
+
+    // M = W * whitening
+    reshape(unmixing_, k, channels_);
+    gemm(ws_.W, Trans::No, ws_.whiteningMat, Trans::No, unmixing_);
+
+    UnmixingModel& m = models_.write();
+    m.version = estimates() + 1;
+    m.channels = channels_;
+    m.components = k;
+    m.mean.assign(ws_.mean.data.begin(), ws_.mean.data.end());
+    m.M.assign(unmixing_.data.begin(), unmixing_.data.end());
+    m.iterations = ws_.iterations;
+    m.converged = ws_.converged;
+    models_.publish();
+    estimates_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// PipelineScheduler
+// -----------------------------------------------------------------------------
+PipelineScheduler::PipelineScheduler(int workers, std::chrono::microseconds poll)
+    : workers_(std::max(1, workers)), poll_(poll) {}
+
+PipelineScheduler::~PipelineScheduler() {
+    stop();
+}
+
+int PipelineScheduler::add(IcaPipeline& pipeline) {
+    if (!threads_.empty()) {
+        throw std::runtime_error("PipelineScheduler: add() after start()");
+    }
+    Entry e;
+    e.pipeline = &pipeline;
+    entries_.push_back(e);
+    return static_cast<int>(entries_.size()) - 1;
+}
+
+void PipelineScheduler::start() {
+    if (!threads_.empty()) return;
+    stop_ = false;
+    for (int i = 0; i < workers_; i++) threads_.emplace_back(&PipelineScheduler::workerLoop, this);
+}
+
+void PipelineScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) t.join();
+    threads_.clear();
+}
+
+bool PipelineScheduler::allDone() const {
+    std::lock_guard<std::mutex> lk(m_);
+    for (const auto& e : entries_) {
+        if (e.busy || !e.pipeline->done()) return false;
+    }
+    return true;
+}
+
+PipelineStats PipelineScheduler::stats(int id) const {
+    std::lock_guard<std::mutex> lk(m_);
+    return entries_.at(id).stats;
+}
+
+// Highest priority first, earliest deadline within a priority. Stamps the
+// due time of hops seen for the first time. Called with m_ held.
+PipelineScheduler::Entry* PipelineScheduler::pickDue(Clock::time_point now) {
+    Entry* best = nullptr;
+    Clock::time_point best_deadline{};
+    for (auto& e : entries_) {
+        if (e.busy) continue;
+        if (!e.pipeline->ready()) {
+            e.due = Clock::time_point{};
+            continue;
+        }
+        if (e.due == Clock::time_point{}) e.due = now;
+        const PipelineConfig& cfg = e.pipeline->config();
+        // No deadline (0) sorts after every real one
+        auto deadline = cfg.deadline_ns > 0 ? e.due + std::chrono::nanoseconds(cfg.deadline_ns)
+                                            : Clock::time_point::max();
+        if (!best || cfg.priority > best->pipeline->config().priority ||
+            (cfg.priority == best->pipeline->config().priority && deadline < best_deadline)) {
+            best = &e;
+            best_deadline = deadline;
+        }
+    }
+    return best;
+}
+
+void PipelineScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lk(m_);
+    while (!stop_) {
+        auto now = Clock::now();
+        Entry* e = pickDue(now);
+        if (!e) {
+            // One idle worker polls the sources; the rest sleep until it
+            // finds work for them
+            if (!polling_) {
+                polling_ = true;
+                cv_.wait_for(lk, poll_);
+                polling_ = false;
+            } else {
+                cv_.wait(lk);
+            }
+            continue;
+        }
+
+        e->busy = true;
+        const auto due = e->due;
+        lk.unlock();
+        cv_.notify_one();      // hand polling (or the next due pipeline) to an idle worker
+
+        const auto t0 = Clock::now();
+        e->pipeline->step(due);
+        const auto t1 = Clock::now();
+
+        const uint64_t run_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - due).count();
+        if (observer_) observer_(static_cast<int>(e - entries_.data()), latency_ns, run_ns);
+
+        lk.lock();
+        e->busy = false;
+        e->due = Clock::time_point{};
+        PipelineStats& s = e->stats;
+        s.hops++;
+        s.latency_sum_ns += latency_ns;
+        s.latency_max_ns = std::max(s.latency_max_ns, latency_ns);
+        s.run_sum_ns += run_ns;
+        s.run_max_ns = std::max(s.run_max_ns, run_ns);
+        const uint64_t deadline_ns = e->pipeline->config().deadline_ns;
+        if (deadline_ns > 0 && latency_ns > deadline_ns) s.deadline_misses++;
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+// Per-stream ICA pipelines and the scheduler that runs many of them.
+//
+// An IcaPipeline is one stream's processing chain: it takes hops of frames
+// from a FrameSource (normally the SpscFrameRing an EmgIngest or
+// RecordingReplay fills), keeps the sliding-window whitening, solver
+// workspace and component tracker of that stream, and hands the gains of
+// every window to its sink. step() processes one hop and never blocks.
+//
+// PipelineScheduler multiplexes any number of pipelines over a fixed set of
+// worker threads. A pipeline is due once a hop is readable; among the due
+// ones a free worker takes the highest priority first and, within a
+// priority, the one whose deadline (due time + deadline_ns) comes first. A
+// pipeline never runs on two workers at once, so its state needs no locking.
+// Idle workers do not spin: one of them polls the sources every poll period
+// and the others sleep until there is more than one due pipeline.
+//
+// Latency is accounted per hop from the moment the scheduler first sees the
+// hop readable to the moment the sink has been called. The sources do not
+// signal arrivals, so this lags the true arrival by up to one poll period.
+//
+// Two-rate mode (PipelineConfig::calibration_window > 0) takes the solve off
+// the hop path. The unmixing changes slowly over a session, so a background
+// UnmixingEstimator re-solves on a longer window every recalibrate_every
+// frames and publishes y = M (x - mean), M being the unmixing composed with
+// the whitening (components x channels). step() then only applies the
+// newest M to each frame, a components x channels mat-vec, and emits gains
+// from the last `window` outputs. Frames go to the estimator and models come
+// back through TripleBuffers, so the hop path takes no locks and never waits
+// for a solve.
+#include "mainprocess_internal.hpp"
+#include "triple_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Up to two row-major spans of frames (before and after a ring wrap)
+struct FrameSpans {
+    const float* first = nullptr;
+    size_t first_frames = 0;
+    const float* second = nullptr;
+    size_t second_frames = 0;
+
+    size_t frames() const { return first_frames + second_frames; }
+};
+
+// Consumer side of a frame stream
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual int channels() const = 0;
+    virtual size_t readable() const = 0;
+    // The oldest n unreleased frames; valid until consume()
+    virtual FrameSpans window(size_t n) const = 0;
+    virtual void consume(size_t n) = 0;
+    // True once the producer will publish no more frames
+    virtual bool finished() const { return false; }
+};
+
+// FrameSource over a SpscFrameRing<float, C, N>. finished, if given, is the
+// producer's end-of-stream flag (e.g. RecordingReplay::finishedFlag()).
+template <class Ring>
+class RingSource : public FrameSource {
+public:
+    explicit RingSource(Ring& ring, const std::atomic<bool>* finished = nullptr)
+        : ring_(ring), finished_(finished) {}
+
+    int channels() const override { return static_cast<int>(Ring::channels); }
+    size_t readable() const override { return ring_.readable(); }
+    FrameSpans window(size_t n) const override {
+        auto w = ring_.window(n);
+        return FrameSpans{w.first, w.first_frames, w.second, w.second_frames};
+    }
+    void consume(size_t n) override { ring_.consume(n); }
+    bool finished() const override {
+        return finished_ && finished_->load(std::memory_order_acquire);
+    }
+
+private:
+    Ring& ring_;
+    const std::atomic<bool>* finished_;
+};
+
+struct PipelineConfig {
+    std::string name;
+    int window     = 100;          // samples per ICA window
+    int components = 2;
+    int hop        = 10;           // frames that make a pipeline due
+    // true: a step takes everything readable and solves on the newest window
+    // (live, catches up after a stall). false: exactly one hop per step, so
+    // every hop of a faster-than-real-time replay is solved.
+    bool drain     = true;
+    int max_iter   = 1000;
+    float tol      = 1e-5f;
+    ContrastOptions contrast;
+    IcaMode mode   = IcaMode::Symmetric;
+    int priority   = 0;            // higher runs first
+    uint64_t deadline_ns = 10000000; // due -> gains out (0: none)
+    // Part of deadline_ns kept back for tracking and output: the solve stops
+    // (with the best W so far) once the rest has run out
+    uint64_t output_reserve_ns = 500000;
+    // Two-rate mode: frames per background re-estimate (0: solve every
+    // window inside step()), and frames between re-estimates
+    int calibration_window = 0;
+    int recalibrate_every  = 500;
+};
+
+// Unmixing as the two-rate fast path applies it: y = M (x - mean)
+struct UnmixingModel {
+    uint64_t version = 0;          // 1, 2, ... per estimate; 0: none yet
+    int channels   = 0;
+    int components = 0;
+    std::vector<float> mean;       // channels
+    std::vector<float> M;          // components x channels, row-major
+    int iterations = 0;            // of the solve that produced it
+    bool converged = false;
+};
+
+// Background re-estimation for the two-rate mode. The fast path (one
+// thread) push()es every frame; they are handed over a block of
+// recalibrate_every frames at a time. The estimator thread keeps the last
+// calibration_window frames, solves on them (warm-started from the previous
+// unmixing, mapped into the new whitening), aligns component order and sign
+// to the previous estimate, and publishes the result for update()/model().
+// If the thread falls behind, the blocks it missed are dropped rather than
+// queued: the next estimate just sees fresher frames.
+class UnmixingEstimator {
+public:
+    UnmixingEstimator(const PipelineConfig& cfg, int channels,
+                      std::chrono::microseconds poll = std::chrono::microseconds(1000));
+    ~UnmixingEstimator();
+    UnmixingEstimator(const UnmixingEstimator&) = delete;
+    UnmixingEstimator& operator=(const UnmixingEstimator&) = delete;
+
+    // Fast-path side; never blocks
+    void push(const float* frame);
+    // Take the newest estimate, if any; true if model() changed
+    bool update() { return models_.update(); }
+    const UnmixingModel& model() const { return models_.read(); }
+
+    // Estimates published so far (any thread)
+    uint64_t estimates() const { return estimates_.load(std::memory_order_relaxed); }
+    // Blocks the estimator never saw because a newer one replaced them
+    uint64_t blocksDropped() const { return blocks_dropped_; }
+
+private:
+    void run();
+    void estimate();
+
+    const PipelineConfig cfg_;
+    const int channels_;
+    const std::chrono::microseconds poll_;
+
+    // Fast path -> estimator
+    TripleBuffer<std::vector<float>> blocks_;   // recalibrate_every x channels
+    int block_fill_ = 0;
+    uint64_t blocks_dropped_ = 0;
+
+    // Estimator -> fast path
+    TripleBuffer<UnmixingModel> models_;
+    std::atomic<uint64_t> estimates_{0};
+
+    // Estimator thread only
+    Matrix history_{0, 0};                      // calibration_window x channels ring
+    int history_head_ = 0;
+    int history_count_ = 0;
+    IcaWorkspace ws_;
+    ComponentTracker tracker_;
+    Matrix W_init_{0, 0};
+    Matrix unmixing_{0, 0};                           // components x channels, last estimate
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+class IcaPipeline {
+public:
+    // gains: one value in [0, 255] per component
+    using GainSink = std::function<void(const float* gains, int components)>;
+
+    IcaPipeline(const PipelineConfig& cfg, FrameSource& source, GainSink sink);
+    IcaPipeline(const IcaPipeline&) = delete;
+    IcaPipeline& operator=(const IcaPipeline&) = delete;
+
+    const PipelineConfig& config() const { return cfg_; }
+    FrameSource& source() { return source_; }
+
+    // A hop is waiting (or the source finished with frames left)
+    bool ready() const;
+    // The source finished and every frame has been processed
+    bool done() const;
+
+    // Process one hop: feed it to the whitener and, once the window is full,
+    // solve, align and emit gains. due is when the hop became ready (default:
+    // now); the solve's deadline counts from it. In two-rate mode: apply the
+    // newest unmixing to the hop and emit gains once there is one. Returns
+    // false if nothing was readable.
+    bool step(std::chrono::steady_clock::time_point due = {});
+
+    // Windows whose gains were emitted (two-rate: hops)
+    uint64_t windows() const { return windows_; }
+    // Windows whose solve was stopped by the deadline
+    uint64_t windowsOutOfTime() const { return out_of_time_; }
+    const std::vector<float>& gains() const { return gains_; }
+    const IcaWorkspace& workspace() const { return ws_; }
+    // Two-rate mode only (nullptr otherwise)
+    const UnmixingEstimator* estimator() const { return estimator_.get(); }
+
+private:
+    void stepUnmixing(const FrameSpans& hop);
+    void unmixFrame(const float* frame, int slot);
+    void emitGains(const float* S, int rows, int cols, int stride);
+
+    PipelineConfig cfg_;
+    FrameSource& source_;
+    GainSink sink_;
+    StreamingWhitener whitener_;
+    IcaWorkspace ws_;
+    ComponentTracker tracker_;
+    Matrix W_channels_;                // previous W * its whitening (components x channels)
+    Matrix W_init_;                    // ... in the new whitened basis
+    bool have_W_ = false;
+    uint64_t windows_ = 0;
+    uint64_t out_of_time_ = 0;
+    std::vector<float> gains_;
+
+    // Two-rate fast path
+    std::unique_ptr<UnmixingEstimator> estimator_;
+    std::vector<float> recent_;        // last `window` frames, ring (window x channels)
+    std::vector<float> unmixed_;       // their outputs, ring (components x window)
+    int recent_head_ = 0;
+    int recent_count_ = 0;
+};
+
+struct PipelineStats {
+    uint64_t hops = 0;             // steps run
+    uint64_t deadline_misses = 0;
+    uint64_t latency_sum_ns = 0;   // due -> step finished
+    uint64_t latency_max_ns = 0;
+    uint64_t run_sum_ns = 0;       // inside step()
+    uint64_t run_max_ns = 0;
+};
+
+class PipelineScheduler {
+public:
+    // Called on the worker after every step: pipeline id, latency, run time
+    using HopObserver = std::function<void(int id, uint64_t latency_ns, uint64_t run_ns)>;
+
+    explicit PipelineScheduler(int workers = 1,
+                               std::chrono::microseconds poll = std::chrono::microseconds(250));
+    ~PipelineScheduler();
+    PipelineScheduler(const PipelineScheduler&) = delete;
+    PipelineScheduler& operator=(const PipelineScheduler&) = delete;
+
+    // Register a pipeline (before start()); it must outlive the scheduler's
+    // run. Returns its id.
+    int add(IcaPipeline& pipeline);
+    void setObserver(HopObserver observer) { observer_ = std::move(observer); }
+
+    void start();
+    void stop();
+
+    // Every pipeline is done() and idle
+    bool allDone() const;
+    int workers() const { return workers_; }
+    size_t size() const { return entries_.size(); }
+    PipelineStats stats(int id) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        IcaPipeline* pipeline = nullptr;
+        bool busy = false;
+        Clock::time_point due{};       // when the current hop was first seen, or epoch
+        PipelineStats stats;
+    };
+
+    Entry* pickDue(Clock::time_point now);
+    void workerLoop();
+
+    const int workers_;
+    const std::chrono::microseconds poll_;
+    std::vector<Entry> entries_;
+    HopObserver observer_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex m_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    bool polling_ = false;             // a worker is waiting out the poll period
+};
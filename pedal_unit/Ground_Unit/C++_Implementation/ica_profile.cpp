@@ -0,0 +1,248 @@
+#include "ica_profile.hpp"
+
+#ifdef ICA_PROFILE
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define ICA_PROFILE_HAVE_UNIX_SOCKET 1
+#endif
+
+namespace profile {
+
+// -----------------------------------------------------------------------------
+// Names
+// -----------------------------------------------------------------------------
+const char* stageName(Stage s) {
+    switch (s) {
+        case Stage::Window:      return "window";
+        case Stage::Center:      return "center";
+        case Stage::Whiten:      return "whiten";
+        case Stage::Evd:         return "evd";
+        case Stage::Solve:       return "solve";
+        case Stage::Contrast:    return "contrast";
+        case Stage::Decorrelate: return "decorrelate";
+        case Stage::Track:       return "track";
+        case Stage::Output:      return "output";
+        case Stage::Apply:       return "apply";
+        case Stage::Calibrate:   return "calibrate";
+        default:                 return "?";
+    }
+}
+
+const char* counterName(Counter c) {
+    switch (c) {
+        case Counter::Windows:          return "windows";
+        case Counter::Iterations:       return "ica_iterations";
+        case Counter::Solves:           return "ica_solves";
+        case Counter::NotConverged:     return "ica_not_converged";
+        case Counter::OutOfTime:        return "ica_out_of_time";
+        case Counter::EvdCalls:         return "evd_calls";
+        case Counter::EvdSweeps:        return "evd_sweeps";
+        case Counter::JacobiRotations:  return "jacobi_rotations";
+        case Counter::WhiteningUpdates: return "whitening_updates";
+        case Counter::DeadlineOverruns: return "deadline_overruns";
+        case Counter::UnmixingSwaps:    return "unmixing_swaps";
+        default:                        return "?";
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Snapshots
+// -----------------------------------------------------------------------------
+namespace {
+std::atomic<uint64_t> g_epoch_ns{nowNs()};
+std::atomic<uint64_t> g_last_dump_ns{0};
+}
+
+uint64_t StageSnapshot::quantileNs(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            uint64_t v = Histogram::bucketUpper(static_cast<int>(b));
+            return v < max_ns ? v : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+Snapshot snapshot() {
+    Snapshot s;
+    s.elapsed_s = static_cast<double>(nowNs() - g_epoch_ns.load(std::memory_order_relaxed)) * 1e-9;
+    for (int i = 0; i < static_cast<int>(Stage::Count); i++) {
+        const Histogram& h = g_registry.stages[i];
+        StageSnapshot& out = s.stages[i];
+        out.buckets.resize(Histogram::kBuckets);
+        // Buckets are read one by one while writers may still be adding, so
+        // take count from the buckets themselves to keep quantiles consistent
+        out.count = 0;
+        for (int b = 0; b < Histogram::kBuckets; b++) {
+            out.buckets[b] = h.count(b);
+            out.count += out.buckets[b];
+        }
+        out.sum_ns = h.sum();
+        out.max_ns = h.max();
+    }
+    for (int i = 0; i < static_cast<int>(Counter::Count); i++) {
+        s.counters[i] = g_registry.counters[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void reset() {
+    for (auto& h : g_registry.stages) h.reset();
+    for (auto& c : g_registry.counters) c.store(0, std::memory_order_relaxed);
+    g_epoch_ns.store(nowNs(), std::memory_order_relaxed);
+}
+
+void dump(std::ostream& os, const Snapshot& s) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "ica profile: %.1f s\n%-12s %10s %10s %10s %10s %10s %10s %10s\n",
+                  s.elapsed_s, "stage", "count", "mean_us", "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us");
+    os << line;
+    for (int i = 0; i < static_cast<int>(Stage::Count); i++) {
+        const StageSnapshot& st = s.stages[i];
+        if (st.count == 0) continue;
+        std::snprintf(line, sizeof(line), "%-12s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                      stageName(static_cast<Stage>(i)), static_cast<unsigned long long>(st.count),
+                      st.meanNs() * 1e-3, st.quantileNs(0.50) * 1e-3, st.quantileNs(0.90) * 1e-3,
+                      st.quantileNs(0.99) * 1e-3, st.quantileNs(0.999) * 1e-3, st.max_ns * 1e-3);
+        os << line;
+    }
+    for (int i = 0; i < static_cast<int>(Counter::Count); i++) {
+        std::snprintf(line, sizeof(line), "%-18s %llu\n", counterName(static_cast<Counter>(i)),
+                      static_cast<unsigned long long>(s.counters[i]));
+        os << line;
+    }
+    os.flush();
+}
+
+void dump(std::ostream& os) {
+    dump(os, snapshot());
+}
+
+bool dumpIfDue(std::ostream& os, std::chrono::milliseconds interval) {
+    uint64_t now = nowNs();
+    uint64_t last = g_last_dump_ns.load(std::memory_order_relaxed);
+    if (last == 0) {
+        // First call only arms the timer
+        g_last_dump_ns.compare_exchange_strong(last, now, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t interval_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count());
+    if (now - last < interval_ns) return false;
+    if (!g_last_dump_ns.compare_exchange_strong(last, now, std::memory_order_relaxed)) return false;
+    dump(os);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Unix socket query endpoint
+// -----------------------------------------------------------------------------
+#ifdef ICA_PROFILE_HAVE_UNIX_SOCKET
+
+QueryServer::QueryServer(const std::string& path) : path_(path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "profile::QueryServer: socket path too long: %s\n", path.c_str());
+        return;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::perror("profile::QueryServer: socket");
+        return;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, 4) < 0) {
+        std::perror("profile::QueryServer: bind/listen");
+        ::close(fd);
+        return;
+    }
+    fd_ = fd;
+    thread_ = std::thread(&QueryServer::serve, this);
+}
+
+QueryServer::~QueryServer() {
+    stop_.store(true);
+    if (thread_.joinable()) thread_.join();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        ::unlink(path_.c_str());
+    }
+}
+
+void QueryServer::serve() {
+    while (!stop_.load()) {
+        pollfd pfd{fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+        int client = ::accept(fd_, nullptr, nullptr);
+        if (client < 0) continue;
+
+        // Optional one-line command; a client that sends nothing gets a dump
+        char cmd[32] = {0};
+        pollfd cpfd{client, POLLIN, 0};
+        if (::poll(&cpfd, 1, 50) > 0) {
+            ssize_t n = ::read(client, cmd, sizeof(cmd) - 1);
+            cmd[n > 0 ? n : 0] = '\0';
+        }
+
+        std::string reply;
+        if (std::strncmp(cmd, "reset", 5) == 0) {
+            reset();
+            reply = "ok\n";
+        } else {
+            std::ostringstream os;
+            dump(os);
+            reply = os.str();
+        }
+        // A client gone before the end of the reply must not take the
+        // process down with SIGPIPE
+#ifdef MSG_NOSIGNAL
+        const int send_flags = MSG_NOSIGNAL;
+#else
+        const int send_flags = 0;
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        ::setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+#endif
+        const char* p = reply.data();
+        size_t left = reply.size();
+        while (left > 0) {
+            ssize_t n = ::send(client, p, left, send_flags);
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        ::close(client);
+    }
+}
+
+#else
+
+QueryServer::QueryServer(const std::string& path) : path_(path) {
+    std::fprintf(stderr, "profile::QueryServer: Unix sockets not available on this platform\n");
+}
+
+QueryServer::~QueryServer() {}
+
+void QueryServer::serve() {}
+
+#endif // ICA_PROFILE_HAVE_UNIX_SOCKET
+
+} // namespace profile
+
+#endif // ICA_PROFILE
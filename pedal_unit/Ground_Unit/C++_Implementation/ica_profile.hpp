@@ -0,0 +1,223 @@
+#pragma once
+// Per-stage latency instrumentation for the ICA processing loop.
+//
+// Built only when ICA_PROFILE is defined (CMake option ICA_PROFILE, off by
+// default). Without it the ICA_PROFILE_* macros below compile to no-ops and
+// none of the code in this header or ica_profile.cpp is compiled.
+//
+// Each stage feeds a log-linear (HDR-style) latency histogram; recording is a
+// couple of relaxed atomic adds, so the hot path takes no locks and never
+// allocates. Snapshots are read off the hot path by dump(), dumpIfDue() and
+// the QueryServer Unix socket (see ica_profile.cpp).
+//
+// Stages nest: Whiten includes its Evd, Solve includes Contrast and
+// Decorrelate (and their Evd calls), Window covers one whole hop and
+// Calibrate one whole background re-estimate.
+
+#ifdef ICA_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace profile {
+
+enum class Stage : int {
+    Window,       // one solved hop of an IcaPipeline, end to end
+    Center,       // column means + centering
+    Whiten,       // covariance + EVD + applying the whitening matrix
+    Evd,          // every symmetric EVD (whitening and decorrelation)
+    Solve,        // FastICA fixed-point iteration, all iterations
+    Contrast,     // fused g(WX) / g'(WX) / product pass, per iteration
+    Decorrelate,  // symmetric decorrelation, per iteration
+    Track,        // component order/sign alignment
+    Output,       // gain computation + hand-off to the sink
+    Apply,        // two-rate fast path: unmixing applied to one hop
+    Calibrate,    // two-rate background re-estimate, end to end
+    Count
+};
+
+enum class Counter : int {
+    Windows,           // hops processed
+    Iterations,        // FastICA iterations, summed over solves
+    Solves,            // FastICA solves
+    NotConverged,      // solves that stopped unconverged (max_iter or deadline)
+    OutOfTime,         // solves stopped by their IcaBudget deadline
+    EvdCalls,
+    EvdSweeps,         // Jacobi sweeps / QL iterations, summed
+    JacobiRotations,   // Jacobi rotations applied, summed
+    WhiteningUpdates,  // streaming whitener re-derivations
+    DeadlineOverruns,  // scopes that exceeded their budget
+    UnmixingSwaps,     // two-rate: new unmixing taken up by the fast path
+    Count
+};
+
+const char* stageName(Stage s);
+const char* counterName(Counter c);
+
+// Latency histogram over nanoseconds. Values below 2^kSubBits get a bucket
+// each; every power of two above that is split into 2^kSubBits buckets
+// (~6% relative resolution) up to 2^kMaxBits ns (~18 minutes).
+class Histogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSub     = 1 << kSubBits;
+    static constexpr int kMaxBits = 40;
+    static constexpr int kBuckets = (kMaxBits - kSubBits + 1) * kSub;
+
+    void record(uint64_t ns) {
+        counts_[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t m = max_.load(std::memory_order_relaxed);
+        while (ns > m && !max_.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+    }
+
+    static int bucketOf(uint64_t v) {
+        if (v < static_cast<uint64_t>(kSub)) return static_cast<int>(v);
+        int msb = 63 - __builtin_clzll(v);
+        if (msb >= kMaxBits) return kBuckets - 1;
+        int shift = msb - kSubBits;
+        return (shift + 1) * kSub + static_cast<int>((v >> shift) & (kSub - 1));
+    }
+
+    // Largest value that lands in bucket b
+    static uint64_t bucketUpper(int b) {
+        if (b < kSub) return static_cast<uint64_t>(b);
+        int shift = b / kSub - 1;
+        uint64_t lower = static_cast<uint64_t>(kSub + b % kSub) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    void reset() {
+        for (auto& c : counts_) c.store(0, std::memory_order_relaxed);
+        total_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count(int b) const { return counts_[b].load(std::memory_order_relaxed); }
+    uint64_t total() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t sum() const   { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const   { return max_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+// All instrumentation state; zero-initialised static storage, no constructor
+// runs before first use.
+struct Registry {
+    Histogram stages[static_cast<int>(Stage::Count)];
+    std::atomic<uint64_t> counters[static_cast<int>(Counter::Count)];
+};
+
+inline Registry g_registry;
+
+inline uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline void record(Stage s, uint64_t ns) {
+    g_registry.stages[static_cast<int>(s)].record(ns);
+}
+
+inline void add(Counter c, uint64_t n) {
+    g_registry.counters[static_cast<int>(c)].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Times its enclosing scope into a stage histogram. With a non-zero budget,
+// also counts a DeadlineOverrun when the scope runs longer than budget_ns.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage s, uint64_t budget_ns = 0)
+        : stage_(s), budget_ns_(budget_ns), t0_(nowNs()) {}
+    ~ScopedTimer() {
+        uint64_t dt = nowNs() - t0_;
+        record(stage_, dt);
+        if (budget_ns_ && dt > budget_ns_) add(Counter::DeadlineOverruns, 1);
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage    stage_;
+    uint64_t budget_ns_;
+    uint64_t t0_;
+};
+
+// Point-in-time copy of one stage histogram, with quantiles in nanoseconds
+struct StageSnapshot {
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::vector<uint64_t> buckets;
+
+    double   meanNs() const { return count ? static_cast<double>(sum_ns) / count : 0.0; }
+    uint64_t quantileNs(double q) const;
+};
+
+struct Snapshot {
+    double elapsed_s = 0.0;  // since the last reset (or process start)
+    StageSnapshot stages[static_cast<int>(Stage::Count)];
+    uint64_t counters[static_cast<int>(Counter::Count)] = {};
+};
+
+Snapshot snapshot();
+void reset();
+
+// Human-readable table (one row per stage that has samples, then counters)
+void dump(std::ostream& os, const Snapshot& s);
+void dump(std::ostream& os);
+
+// Dump to os if at least `interval` has passed since the previous call that
+// dumped. Cheap enough to call once per hop.
+bool dumpIfDue(std::ostream& os, std::chrono::milliseconds interval);
+
+// Serves snapshots on a Unix stream socket. A client connects, optionally
+// writes a command line ("dump" (default) or "reset"), and reads the reply
+// until the server closes the connection, e.g.
+//     nc -U /tmp/ica_profile.sock < /dev/null
+class QueryServer {
+public:
+    explicit QueryServer(const std::string& path);
+    ~QueryServer();
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    bool running() const { return fd_ >= 0; }
+
+private:
+    void serve();
+
+    std::string       path_;
+    int               fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread       thread_;
+};
+
+} // namespace profile
+
+#define ICA_PROFILE_CONCAT2(a, b) a##b
+#define ICA_PROFILE_CONCAT(a, b)  ICA_PROFILE_CONCAT2(a, b)
+#define ICA_PROFILE_SCOPE(stage) \
+    ::profile::ScopedTimer ICA_PROFILE_CONCAT(ica_profile_scope_, __LINE__)(::profile::Stage::stage)
+#define ICA_PROFILE_SCOPE_BUDGET(stage, budget_ns) \
+    ::profile::ScopedTimer ICA_PROFILE_CONCAT(ica_profile_scope_, __LINE__)(::profile::Stage::stage, (budget_ns))
+#define ICA_PROFILE_COUNT(counter, n) ::profile::add(::profile::Counter::counter, static_cast<uint64_t>(n))
+
+#else // !ICA_PROFILE
+
+#define ICA_PROFILE_SCOPE(stage)                   ((void)0)
+#define ICA_PROFILE_SCOPE_BUDGET(stage, budget_ns) ((void)0)
+#define ICA_PROFILE_COUNT(counter, n)              ((void)sizeof(n))
+
+#endif // ICA_PROFILE
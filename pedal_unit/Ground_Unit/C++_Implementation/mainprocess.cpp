@@ -1,78 +1,246 @@
-#include <Eigen/Dense>
+#include "mainprocess.hpp"
+#include "ica_profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
 #include <thread>
-#include <chrono>
+#include <vector>
 
 // extract Eigen library: https://eigen.tuxfamily.org/dox/GettingStarted.html
 // sudo apt-get install libeigen3-dev
-// g++ -I /usr/include/eigen3 main.cpp -o main
-
-
-// Define the pins for gain control (simulated as variables)
-int GAIN_PIN_1 = 0;
-int GAIN_PIN_2 = 0;
+// Build with CMake (see CMakeLists.txt), or standalone:
+// g++ -O2 -I /usr/include/eigen3 mainprocess.cpp -o mainprocess
 
 using namespace Eigen;
 
 // Function to center the data (subtract mean from each feature)
 MatrixXf centerData(const MatrixXf& data) {
+    ICA_PROFILE_SCOPE(Center);
     MatrixXf centered = data.rowwise() - data.colwise().mean();
     return centered;
 }
 
-// Function to whiten the data using Singular Value Decomposition (SVD)
-MatrixXf whitenData(const MatrixXf& data) {
-    JacobiSVD<MatrixXf> svd(data, ComputeThinU | ComputeThinV);
-    MatrixXf S_inv = svd.singularValues().asDiagonal().inverse();
-    MatrixXf whitened = svd.matrixU() * S_inv * svd.matrixU().transpose() * data;
-    return whitened;
+// Leading k eigenpairs of a symmetric matrix, descending: V (n x k), d (k).
+// Small matrices get the full solver; wider ones run subspace iteration with
+// a Rayleigh-Ritz step per pass, seeded from the k columns of A with the
+// largest diagonal, so the cost per pass is O(n^2 k) instead of an O(n^3) EVD.
+static void leadingEigenpairs(const MatrixXf& A, int k, MatrixXf& V, VectorXf& d,
+                              int max_iter = 100, float tol = 1e-5f) {
+    const int n = A.rows();
+    if (k >= n || n <= 8) {
+        SelfAdjointEigenSolver<MatrixXf> es(A);    // ascending
+        V = es.eigenvectors().rightCols(k).rowwise().reverse();
+        d = es.eigenvalues().tail(k).reverse();
+        return;
+    }
+
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return A(a, a) > A(b, b); });
+    MatrixXf Q(n, k);
+    for (int j = 0; j < k; j++) Q.col(j) = A.col(order[j]);
+    Q = HouseholderQR<MatrixXf>(Q).householderQ() * MatrixXf::Identity(n, k);
+
+    for (int iter = 0; iter < max_iter; iter++) {
+        MatrixXf AQ = A * Q;
+        SelfAdjointEigenSolver<MatrixXf> es(Q.transpose() * AQ);
+        MatrixXf R = es.eigenvectors().rowwise().reverse();
+        d = es.eigenvalues().reverse();
+        Q = Q * R;
+        AQ = AQ * R;
+        float residual = (AQ - Q * d.asDiagonal()).colwise().norm().maxCoeff();
+        if (residual <= tol * std::max(d(0), 0.0f) || iter + 1 == max_iter) break;
+        Q = HouseholderQR<MatrixXf>(AQ).householderQ() * MatrixXf::Identity(n, k);
+    }
+    V = Q;
 }
 
-// Function for the FastICA fixed-point iteration
-MatrixXf fastICA(const MatrixXf& data, int num_components, int max_iter = 1000, float tol = 1e-5) {
-    int n_samples = data.rows();
-    int n_features = data.cols();
+// Function to whiten the data: PCA on the covariance, keeping the leading
+// num_components directions (all features if 0). Returns (n_samples x k)
+// with unit variance per column.
+MatrixXf whitenData(const MatrixXf& data, int num_components) {
+    ICA_PROFILE_SCOPE(Whiten);
+    const int n_features = data.cols();
+    const int k = (num_components > 0) ? std::min(num_components, n_features) : n_features;
 
-    // Step 1: Center and whiten the data
-    MatrixXf centered_data = centerData(data);
-    MatrixXf whitened_data = whitenData(centered_data);
+    // Covariance is n_features x n_features; the window itself is never decomposed
+    MatrixXf cov = (data.transpose() * data) / static_cast<float>(data.rows());
+    MatrixXf V;
+    VectorXf d;
+    leadingEigenpairs(cov, k, V, d);
+    VectorXf inv_sqrt = d.unaryExpr([](float x) { return x > 0.0f ? 1.0f / std::sqrt(x) : 0.0f; });
+    MatrixXf whitened = data * (V * inv_sqrt.asDiagonal());
+    return whitened;
+}
 
-    // Step 2: Initialize random weights
-    MatrixXf W = MatrixXf::Random(num_components, n_features);
+// Symmetric mode: all rows of W updated together, then decorrelated.
+// Returns the iterations run.
+static int symmetricIteration(const MatrixXf& whitened_data, MatrixXf& W, const IcaBudget& budget,
+                              float tol, IcaSolveInfo& info) {
+    const int n_samples = whitened_data.rows();
+    const IcaBudget::Clock::time_point start = IcaBudget::Clock::now();
 
-    for (int iter = 0; iter < max_iter; iter++) {
+    // Decorrelated start, so a solve stopped before its first iteration
+    // still has a usable W
+    {
+        JacobiSVD<MatrixXf> svd(W, ComputeThinU | ComputeThinV);
+        W = svd.matrixU() * svd.matrixV().transpose();
+    }
+
+    int iter = 0;
+    for (; iter < budget.max_iter; iter++) {
+        if (!budget.fits(iter, start)) {
+            info.out_of_time = true;
+            break;
+        }
         MatrixXf W_last = W;
 
         // Step 3: Fixed-point iteration for maximizing non-Gaussianity
-        // Compute the dot product and apply nonlinearity (g(x) = tanh(x) for FastICA)
-        MatrixXf WX = W * whitened_data.transpose();
-        MatrixXf gWX = WX.unaryExpr([](float x) { return std::tanh(x); });   // Nonlinear function g(x)
-        MatrixXf gWX_prime = WX.unaryExpr([](float x) { return 1.0 - std::tanh(x) * std::tanh(x); }); // g'(x)
+        // Compute the dot product and apply nonlinearity (g(x) = tanh(x) for FastICA).
+        // tanh is evaluated once, through Eigen's vectorized array path, and g'(x)
+        // is derived from it as 1 - g(x)^2 while the values are still in cache.
+        MatrixXf W_new;
+        {
+            ICA_PROFILE_SCOPE(Contrast);
+            MatrixXf WX = W * whitened_data.transpose();                          // (k x n_samples)
+            MatrixXf gWX = WX.array().tanh().matrix();                            // Nonlinear function g(x)
+            VectorXf gWX_prime_mean = (1.0f - gWX.array().square()).rowwise().mean(); // mean g'(x) per row
 
-        // Update the weights W
-        MatrixXf W_new = (gWX * whitened_data / n_samples).transpose() - gWX_prime.rowwise().mean().asDiagonal() * W;
+            // Update the weights W: (k x n_samples) * (n_samples x k) => (k x k)
+            W_new = (gWX * whitened_data) / (float)n_samples - gWX_prime_mean.asDiagonal() * W;
+        }
 
         // Decorrelate the weight matrix (symmetrical decorrelation)
-        JacobiSVD<MatrixXf> svd(W_new, ComputeThinU | ComputeThinV);
-        W = svd.matrixU() * svd.matrixV().transpose();
+        {
+            ICA_PROFILE_SCOPE(Decorrelate);
+            JacobiSVD<MatrixXf> svd(W_new, ComputeThinU | ComputeThinV);
+            W = svd.matrixU() * svd.matrixV().transpose();
+        }
 
-        // Check for convergence
-        if ((W - W_last).norm() < tol) {
+        // Check for convergence: max | |cos(w_i, w_last_i)| - 1 |, blind to sign
+        // flips and to the round-off in the rows' unit norms
+        ArrayXf cosines = (W * W_last.transpose()).diagonal().array()
+                          / (W.rowwise().norm().array() * W_last.rowwise().norm().array());
+        if ((cosines.abs() - 1.0f).abs().maxCoeff() < tol) {
+            iter++;
+            info.converged = true;
             break;
         }
     }
+    return iter;
+}
+
+// Deflation mode: one row of W at a time, Gram-Schmidt against the rows
+// already found, each stopping on its own | |w . w_last| - 1 | < tol.
+// Returns the iterations summed over the components.
+static int deflationIteration(const MatrixXf& whitened_data, MatrixXf& W, const IcaBudget& budget,
+                              float tol, IcaSolveInfo& info) {
+    const int n_samples = whitened_data.rows();
+    const int k = W.rows(), dims = W.cols();
+    const IcaBudget::Clock::time_point start = IcaBudget::Clock::now();
+    info.converged = true;
+    int total = 0;
+    for (int p = 0; p < k; p++) {
+        VectorXf w = W.row(p).transpose();
+        w -= W.topRows(p).transpose() * (W.topRows(p) * w);
+        if (w.norm() <= 1e-6f) {
+            // Start lies in the span already found: take a unit vector outside it
+            for (int e = 0; e < dims; e++) {
+                w = VectorXf::Unit(dims, e);
+                w -= W.topRows(p).transpose() * (W.topRows(p) * w);
+                if (w.norm() > 0.5f) break;
+            }
+        }
+        w.normalize();
+
+        // With one whitened direction left, orthogonality alone fixes w
+        int it = 0;
+        bool done = (p == dims - 1);
+        while (!done && it < budget.max_iter && !info.out_of_time) {
+            if (!budget.fits(total + it, start)) {
+                info.out_of_time = true;
+                break;
+            }
+            it++;
+            VectorXf w_new;
+            {
+                ICA_PROFILE_SCOPE(Contrast);
+                VectorXf g = (whitened_data * w).array().tanh().matrix();       // (n_samples)
+                float gprime_mean = (1.0f - g.array().square()).mean();
+                w_new = whitened_data.transpose() * g / (float)n_samples - gprime_mean * w;
+            }
+            {
+                ICA_PROFILE_SCOPE(Decorrelate);
+                w_new -= W.topRows(p).transpose() * (W.topRows(p) * w_new);
+                float len = w_new.norm();
+                if (len == 0.0f) break;
+                w_new /= len;
+            }
+            done = std::fabs(std::fabs(w_new.dot(w)) - 1.0f) < tol;
+            w = w_new;
+        }
+        W.row(p) = w.transpose();
+        total += it;
+        if (!done) info.converged = false;
+    }
+    return total;
+}
 
-    return W * whitened_data.transpose();
+// Function for the FastICA fixed-point iteration
+MatrixXf fastICA(const MatrixXf& data, int num_components, int max_iter, float tol, int* iterations_out,
+                 IcaMode mode) {
+    IcaSolveInfo info;
+    MatrixXf S = fastICA(data, num_components, IcaBudget(max_iter), tol, &info, mode);
+    if (iterations_out) {
+        *iterations_out = info.iterations;
+    }
+    return S;
 }
 
-// Placeholder function to simulate analogWrite
-void analogWrite(int& pin, int value) {
-    pin = value;
-    std::cout << "Pin " << &pin << " set to " << value << std::endl;
+MatrixXf fastICA(const MatrixXf& data, int num_components, const IcaBudget& budget, float tol,
+                 IcaSolveInfo* info_out, IcaMode mode) {
+    // Same rule as the internal engine's IcaWorkspace::prepare
+    if (num_components < 0 || num_components > data.cols()) {
+        throw std::runtime_error("fastICA: components must be in [0, features]");
+    }
+
+    // Step 1: Center and whiten the data
+    MatrixXf centered_data = centerData(data);
+    MatrixXf whitened_data = whitenData(centered_data, num_components);   // (n_samples x k)
+
+    // Step 2: Initialize random weights (k x k over the whitened directions)
+    MatrixXf W = MatrixXf::Random(num_components, whitened_data.cols());
+
+    ICA_PROFILE_SCOPE(Solve);
+    IcaSolveInfo info;
+    info.iterations = (mode == IcaMode::Deflation)
+                          ? deflationIteration(whitened_data, W, budget, tol, info)
+                          : symmetricIteration(whitened_data, W, budget, tol, info);
+    ICA_PROFILE_COUNT(Solves, 1);
+    ICA_PROFILE_COUNT(Iterations, info.iterations);
+    ICA_PROFILE_COUNT(NotConverged, info.converged ? 0 : 1);
+    ICA_PROFILE_COUNT(OutOfTime, info.out_of_time ? 1 : 0);
+    if (info_out) {
+        *info_out = info;
+    }
+
+    return W * whitened_data.transpose();
 }
 
-// Task for ICA processing and gain output
-void ICAProcessingTask() {
+#ifndef ICA_ENGINE_LIBRARY
+// Demo task and entry point below are left out when this file is built as
+// the ica_engine_eigen library.
+#include "gain_output.hpp"
+
+#include <memory>
+
+// Task for ICA processing and gain output. The gains go to the output
+// stage's port (gain_output.hpp), which smooths them and writes the pins
+// from its own thread.
+void ICAProcessingTask(output::GainPort& gain_port) {
     const int num_samples = 100; // Example value
     const int num_channels = 8;  // Example value
     float eeg_data_buffer[num_samples][num_channels]; // Example buffer
@@ -96,14 +264,17 @@ void ICAProcessingTask() {
         VectorXf component_1 = ica_components.col(0);
         VectorXf component_2 = ica_components.col(1);
 
-        float gain_1 = (component_1.mean() - component_1.minCoeff()) / 
-                       (component_1.maxCoeff() - component_1.minCoeff()) * 255;
-        float gain_2 = (component_2.mean() - component_2.minCoeff()) / 
-                       (component_2.maxCoeff() - component_2.minCoeff()) * 255;
+        // A flat component has no range; leave its gain at 0 rather than 0/0
+        auto normalizedGain = [](const VectorXf& c) {
+            const float lo = c.minCoeff(), hi = c.maxCoeff();
+            return hi > lo ? (c.mean() - lo) / (hi - lo) * 255 : 0.0f;
+        };
+        float gain_1 = normalizedGain(component_1);
+        float gain_2 = normalizedGain(component_2);
 
-        // Output the gains to the simulated GPIO pins
-        analogWrite(GAIN_PIN_1, (int)gain_1);
-        analogWrite(GAIN_PIN_2, (int)gain_2);
+        // Publish the target gains; never blocks
+        const float gains[2] = {gain_1, gain_2};
+        gain_port.publish(gains, 2);
 
         // Short delay for real-time performance
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -111,7 +282,15 @@ void ICAProcessingTask() {
 }
 
 int main() {
+    // Pins simulated on stdout
+    output::GainStage gain_stage;
+    std::vector<std::unique_ptr<output::Sink>> sinks;
+    sinks.push_back(output::makeSink("stdout"));
+    output::GainPort& gain_port = gain_stage.addPort("pins", 2, std::move(sinks));
+    gain_stage.start();
+
     // Start the ICA processing task
-    ICAProcessingTask();
+    ICAProcessingTask(gain_port);
     return 0;
 }
+#endif // ICA_ENGINE_LIBRARY
@@ -0,0 +1,34 @@
+#pragma once
+// Eigen-based FastICA engine for the ground unit. Implementation in mainprocess.cpp.
+#include <Eigen/Dense>
+
+#include "ica_options.hpp"
+
+// Subtract the mean of each feature (column)
+Eigen::MatrixXf centerData(const Eigen::MatrixXf& data);
+
+// Whiten centered data (n_samples x n_features) onto its leading
+// num_components principal directions (all if 0); returns (n_samples x k)
+Eigen::MatrixXf whitenData(const Eigen::MatrixXf& data, int num_components = 0);
+
+// FastICA on data (n_samples x n_features); returns (num_components x n_samples).
+// Throws std::runtime_error if num_components is negative or exceeds n_features.
+// Converged once max | |diag(W W_last^T)| - 1 | < tol.
+// iterations_out, if given, receives the number of fixed-point iterations run
+// (in deflation mode, summed over the components). mode: see ica_options.hpp.
+Eigen::MatrixXf fastICA(const Eigen::MatrixXf& data, int num_components, int max_iter = 1000,
+                        float tol = 1e-5, int* iterations_out = nullptr,
+                        IcaMode mode = IcaMode::Symmetric);
+
+// How a budgeted solve ended
+struct IcaSolveInfo {
+    int  iterations  = 0;
+    bool converged   = false;
+    bool out_of_time = false;   // stopped at the budget's deadline
+};
+
+// Anytime variant: stops at the budget (see IcaBudget) and unmixes with the
+// best W so far; info, if given, says how the solve ended
+Eigen::MatrixXf fastICA(const Eigen::MatrixXf& data, int num_components, const IcaBudget& budget,
+                        float tol = 1e-5, IcaSolveInfo* info = nullptr,
+                        IcaMode mode = IcaMode::Symmetric);
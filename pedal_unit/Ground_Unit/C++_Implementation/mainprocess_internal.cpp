@@ -1,43 +1,52 @@
+#include "mainprocess_internal.hpp"
+#include "fixed_matrix.hpp"
+#include "ica_profile.hpp"
+#include "spsc_ring.hpp"
+#include "thread_pool.hpp"
+#ifndef ICA_ENGINE_LIBRARY
+#include "emg_ingest.hpp"
+#include "emg_recording.hpp"
+#include "gain_output.hpp"
+#include "ica_pipeline.hpp"
+#endif
+
 #include <iostream>
-#include <vector>
-#include <cmath>
 #include <random>
 #include <chrono>
 #include <thread>
+#include <iterator>
 
 // -----------------------------------------------------------------------------
 // Basic Matrix structure and utility functions
 // -----------------------------------------------------------------------------
-struct Matrix {
-    int rows;
-    int cols;
-    std::vector<float> data; // row-major
-
-    Matrix(int r, int c) : rows(r), cols(c), data(r * c, 0.0f) {}
-};
-
-float& at(Matrix& M, int r, int c) {
-    return M.data[r * M.cols + c];
-}
 
-float  at(const Matrix& M, int r, int c) {
-    return M.data[r * M.cols + c];
+// Change the shape of M in place. Storage is only reallocated when it grows
+// past the current capacity, so reshaping a warmed-up buffer never allocates.
+void reshape(Matrix& M, int rows, int cols) {
+    M.rows = rows;
+    M.cols = cols;
+    M.data.resize(static_cast<size_t>(rows) * cols);
 }
 
-// Create a random matrix of size (rows x cols)
-Matrix randomMatrix(int rows, int cols, float min_val = -1.0f, float max_val = 1.0f) {
+// Fill an existing matrix with uniform random values
+void fillRandom(Matrix& M, float min_val, float max_val) {
     static std::mt19937 rng(std::random_device{}());
     std::uniform_real_distribution<float> dist(min_val, max_val);
 
-    Matrix mat(rows, cols);
-    for (int i = 0; i < rows * cols; i++) {
-        mat.data[i] = dist(rng);
+    for (int i = 0; i < M.rows * M.cols; i++) {
+        M.data[i] = dist(rng);
     }
+}
+
+// Create a random matrix of size (rows x cols)
+Matrix randomMatrix(int rows, int cols, float min_val, float max_val) {
+    Matrix mat(rows, cols);
+    fillRandom(mat, min_val, max_val);
     return mat;
 }
 
 // Print matrix (for debugging)
-void printMatrix(const Matrix& M, const std::string& name = "Matrix") {
+void printMatrix(const Matrix& M, const std::string& name) {
     std::cout << name << " (" << M.rows << "x" << M.cols << "):\n";
     for (int r = 0; r < M.rows; r++) {
         for (int c = 0; c < M.cols; c++) {
@@ -63,6 +72,326 @@ Matrix transpose(const Matrix& A) {
     return T;
 }
 
+// -----------------------------------------------------------------------------
+// Blocked GEMM
+//   C = alpha * op(A) * op(B), where op() is either identity or transpose.
+//   Transposed operands are read in place (never copied), so A*B^T and A^T*B
+//   cost the same as A*B. Two kernels:
+//     - packed:  BLIS-style MC/KC/NC cache blocking, operands packed into
+//                MR x KC / KC x NR panels, MR x NR register-tiled micro-kernel
+//     - dot:     for A * B^T with a long shared dimension (e.g. gWX * X^T),
+//                where both operands are already contiguous along k
+//   C must be pre-sized and must not alias A or B.
+// -----------------------------------------------------------------------------
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+namespace simd {
+using vf = __m256;
+constexpr int W = 8;
+inline vf load(const float* p)           { return _mm256_loadu_ps(p); }
+inline void store(float* p, vf v)        { _mm256_storeu_ps(p, v); }
+inline vf set1(float x)                  { return _mm256_set1_ps(x); }
+inline vf zero()                         { return _mm256_setzero_ps(); }
+inline vf fma(vf a, vf b, vf c)          { return _mm256_fmadd_ps(a, b, c); } // a*b + c
+inline vf mul(vf a, vf b)                { return _mm256_mul_ps(a, b); }
+inline vf add(vf a, vf b)                { return _mm256_add_ps(a, b); }
+inline vf sub(vf a, vf b)                { return _mm256_sub_ps(a, b); }
+inline vf div(vf a, vf b)                { return _mm256_div_ps(a, b); }
+inline vf min(vf a, vf b)                { return _mm256_min_ps(a, b); }
+inline vf max(vf a, vf b)                { return _mm256_max_ps(a, b); }
+inline vf floor(vf a)                    { return _mm256_floor_ps(a); }
+// 2^n for integral-valued n in [-126, 127]
+inline vf pow2n(vf n) {
+    __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+}
+inline float hsum(vf v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+    return _mm_cvtss_f32(s);
+}
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+namespace simd {
+using vf = float32x4_t;
+constexpr int W = 4;
+inline vf load(const float* p)           { return vld1q_f32(p); }
+inline void store(float* p, vf v)        { vst1q_f32(p, v); }
+inline vf set1(float x)                  { return vdupq_n_f32(x); }
+inline vf zero()                         { return vdupq_n_f32(0.0f); }
+inline vf mul(vf a, vf b)                { return vmulq_f32(a, b); }
+inline vf add(vf a, vf b)                { return vaddq_f32(a, b); }
+inline vf sub(vf a, vf b)                { return vsubq_f32(a, b); }
+inline vf min(vf a, vf b)                { return vminq_f32(a, b); }
+inline vf max(vf a, vf b)                { return vmaxq_f32(a, b); }
+inline vf pow2n(vf n) {
+    int32x4_t e = vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127));
+    return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+}
+#if defined(__aarch64__)
+inline vf fma(vf a, vf b, vf c)          { return vfmaq_f32(c, a, b); }
+inline vf div(vf a, vf b)                { return vdivq_f32(a, b); }
+inline vf floor(vf a)                    { return vrndmq_f32(a); }
+inline float hsum(vf v)                  { return vaddvq_f32(v); }
+#else
+inline vf fma(vf a, vf b, vf c)          { return vmlaq_f32(c, a, b); }
+inline vf div(vf a, vf b) {
+    // Reciprocal estimate plus two Newton steps (ARMv7 has no vector divide)
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+}
+inline vf floor(vf a) {
+    float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+    return vsubq_f32(t, vbslq_f32(vcgtq_f32(t, a), vdupq_n_f32(1.0f), vdupq_n_f32(0.0f)));
+}
+inline float hsum(vf v) {
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+#endif
+}
+#else
+namespace simd {
+using vf = float;
+constexpr int W = 1;
+inline vf load(const float* p)           { return *p; }
+inline void store(float* p, vf v)        { *p = v; }
+inline vf set1(float x)                  { return x; }
+inline vf zero()                         { return 0.0f; }
+inline vf fma(vf a, vf b, vf c)          { return a * b + c; }
+inline vf mul(vf a, vf b)                { return a * b; }
+inline vf add(vf a, vf b)                { return a + b; }
+inline vf sub(vf a, vf b)                { return a - b; }
+inline vf div(vf a, vf b)                { return a / b; }
+inline vf min(vf a, vf b)                { return std::min(a, b); }
+inline vf max(vf a, vf b)                { return std::max(a, b); }
+inline vf floor(vf a)                    { return std::floor(a); }
+inline vf pow2n(vf n)                    { return std::ldexp(1.0f, static_cast<int>(n)); }
+inline float hsum(vf v)                  { return v; }
+}
+#endif
+
+namespace gemm_detail {
+
+// Register tile of the packed micro-kernel: MR rows x (2 SIMD vectors) cols
+constexpr int MR = 4;
+constexpr int NR = 2 * simd::W;
+// Cache blocking (floats). KC*NR panel of B stays in L1, MC*KC block of A in L2.
+constexpr int MC = 64;
+constexpr int KC = 128;
+constexpr int NC = 256;
+// Dot kernel k-chunk: 4 rows of A + 2 rows of B (~12 KB) stay in L1
+constexpr int KC_DOT = 512;
+
+static_assert(MC % MR == 0 && NC % NR == 0, "block sizes must be multiples of the register tile");
+
+// Packing buffers are per-thread and static so steady-state GEMM never allocates
+alignas(64) static thread_local float packA[MC * KC];
+alignas(64) static thread_local float packB[KC * NC];
+
+// Element (r, c) of op(M), where M is row-major with leading dimension ld
+inline float opAt(const float* M, int ld, Trans t, int r, int c) {
+    return (t == Trans::No) ? M[r * ld + c] : M[c * ld + r];
+}
+
+// Pack an (mc x kc) block of op(A) into MR-row panels, zero-padding the last panel
+static void packPanelsA(const float* A, int lda, Trans ta, int i0, int p0, int mc, int kc, float* dst) {
+    for (int ir = 0; ir < mc; ir += MR) {
+        int mr = std::min(MR, mc - ir);
+        for (int p = 0; p < kc; p++) {
+            for (int i = 0; i < mr; i++) dst[i] = opAt(A, lda, ta, i0 + ir + i, p0 + p);
+            for (int i = mr; i < MR; i++) dst[i] = 0.0f;
+            dst += MR;
+        }
+    }
+}
+
+// Pack a (kc x nc) block of op(B) into NR-column panels, zero-padding the last panel
+static void packPanelsB(const float* B, int ldb, Trans tb, int p0, int j0, int kc, int nc, float* dst) {
+    for (int jr = 0; jr < nc; jr += NR) {
+        int nr = std::min(NR, nc - jr);
+        if (tb == Trans::No && nr == NR) {
+            for (int p = 0; p < kc; p++) {
+                const float* src = B + (p0 + p) * ldb + j0 + jr;
+                for (int j = 0; j < NR; j++) dst[j] = src[j];
+                dst += NR;
+            }
+        } else {
+            for (int p = 0; p < kc; p++) {
+                for (int j = 0; j < nr; j++) dst[j] = opAt(B, ldb, tb, p0 + p, j0 + jr + j);
+                for (int j = nr; j < NR; j++) dst[j] = 0.0f;
+                dst += NR;
+            }
+        }
+    }
+}
+
+// MR x NR micro-kernel: C[0:mr, 0:nr] = (accumulate ? C : 0) + alpha * Ap * Bp
+static void microKernel(int kc, const float* Ap, const float* Bp, float* C, int ldc,
+                        int mr, int nr, float alpha, bool accumulate) {
+    simd::vf c00 = simd::zero(), c01 = simd::zero();
+    simd::vf c10 = simd::zero(), c11 = simd::zero();
+    simd::vf c20 = simd::zero(), c21 = simd::zero();
+    simd::vf c30 = simd::zero(), c31 = simd::zero();
+    for (int p = 0; p < kc; p++) {
+        simd::vf b0 = simd::load(Bp);
+        simd::vf b1 = simd::load(Bp + simd::W);
+        simd::vf a;
+        a = simd::set1(Ap[0]); c00 = simd::fma(a, b0, c00); c01 = simd::fma(a, b1, c01);
+        a = simd::set1(Ap[1]); c10 = simd::fma(a, b0, c10); c11 = simd::fma(a, b1, c11);
+        a = simd::set1(Ap[2]); c20 = simd::fma(a, b0, c20); c21 = simd::fma(a, b1, c21);
+        a = simd::set1(Ap[3]); c30 = simd::fma(a, b0, c30); c31 = simd::fma(a, b1, c31);
+        Ap += MR;
+        Bp += NR;
+    }
+
+    alignas(64) float tile[MR * NR];
+    simd::vf va = simd::set1(alpha);
+    simd::store(tile + 0 * NR, simd::mul(va, c00)); simd::store(tile + 0 * NR + simd::W, simd::mul(va, c01));
+    simd::store(tile + 1 * NR, simd::mul(va, c10)); simd::store(tile + 1 * NR + simd::W, simd::mul(va, c11));
+    simd::store(tile + 2 * NR, simd::mul(va, c20)); simd::store(tile + 2 * NR + simd::W, simd::mul(va, c21));
+    simd::store(tile + 3 * NR, simd::mul(va, c30)); simd::store(tile + 3 * NR + simd::W, simd::mul(va, c31));
+
+    for (int i = 0; i < mr; i++) {
+        float* crow = C + i * ldc;
+        const float* trow = tile + i * NR;
+        if (accumulate) {
+            for (int j = 0; j < nr; j++) crow[j] += trow[j];
+        } else {
+            for (int j = 0; j < nr; j++) crow[j] = trow[j];
+        }
+    }
+}
+
+static void gemmPacked(const float* A, int lda, Trans ta, const float* B, int ldb, Trans tb,
+                       float* C, int ldc, int m, int n, int k, float alpha) {
+    for (int jc = 0; jc < n; jc += NC) {
+        int nc = std::min(NC, n - jc);
+        for (int pc = 0; pc < k; pc += KC) {
+            int kc = std::min(KC, k - pc);
+            packPanelsB(B, ldb, tb, pc, jc, kc, nc, packB);
+            for (int ic = 0; ic < m; ic += MC) {
+                int mc = std::min(MC, m - ic);
+                packPanelsA(A, lda, ta, ic, pc, mc, kc, packA);
+                for (int jr = 0; jr < nc; jr += NR) {
+                    for (int ir = 0; ir < mc; ir += MR) {
+                        microKernel(kc, packA + ir * kc, packB + jr * kc,
+                                    C + (ic + ir) * ldc + jc + jr, ldc,
+                                    std::min(MR, mc - ir), std::min(NR, nc - jr),
+                                    alpha, pc > 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Single SIMD dot product of two contiguous vectors
+inline float dot(const float* a, const float* b, int k) {
+    simd::vf acc0 = simd::zero(), acc1 = simd::zero();
+    int p = 0;
+    for (; p + 2 * simd::W <= k; p += 2 * simd::W) {
+        acc0 = simd::fma(simd::load(a + p), simd::load(b + p), acc0);
+        acc1 = simd::fma(simd::load(a + p + simd::W), simd::load(b + p + simd::W), acc1);
+    }
+    float s = simd::hsum(simd::add(acc0, acc1));
+    for (; p < k; p++) s += a[p] * b[p];
+    return s;
+}
+
+// C = alpha * A * B^T with A (m x k) and B (n x k) both row-major: every C(i,j)
+// is a dot product of two contiguous rows. 4x2 tiles of dot products share loads.
+static void gemmDotNT(const float* A, int lda, const float* B, int ldb,
+                      float* C, int ldc, int m, int n, int k, float alpha) {
+    for (int p0 = 0; p0 < k; p0 += KC_DOT) {
+        int kc = std::min(KC_DOT, k - p0);
+        bool accumulate = p0 > 0;
+        auto emit = [&](int i, int j, float s) {
+            float& c = C[i * ldc + j];
+            c = accumulate ? c + alpha * s : alpha * s;
+        };
+        int i = 0;
+        for (; i + 4 <= m; i += 4) {
+            const float* a0 = A + (i + 0) * lda + p0;
+            const float* a1 = A + (i + 1) * lda + p0;
+            const float* a2 = A + (i + 2) * lda + p0;
+            const float* a3 = A + (i + 3) * lda + p0;
+            int j = 0;
+            for (; j + 2 <= n; j += 2) {
+                const float* b0 = B + (j + 0) * ldb + p0;
+                const float* b1 = B + (j + 1) * ldb + p0;
+                simd::vf s00 = simd::zero(), s01 = simd::zero();
+                simd::vf s10 = simd::zero(), s11 = simd::zero();
+                simd::vf s20 = simd::zero(), s21 = simd::zero();
+                simd::vf s30 = simd::zero(), s31 = simd::zero();
+                int p = 0;
+                for (; p + simd::W <= kc; p += simd::W) {
+                    simd::vf vb0 = simd::load(b0 + p), vb1 = simd::load(b1 + p);
+                    simd::vf va;
+                    va = simd::load(a0 + p); s00 = simd::fma(va, vb0, s00); s01 = simd::fma(va, vb1, s01);
+                    va = simd::load(a1 + p); s10 = simd::fma(va, vb0, s10); s11 = simd::fma(va, vb1, s11);
+                    va = simd::load(a2 + p); s20 = simd::fma(va, vb0, s20); s21 = simd::fma(va, vb1, s21);
+                    va = simd::load(a3 + p); s30 = simd::fma(va, vb0, s30); s31 = simd::fma(va, vb1, s31);
+                }
+                float r[8] = { simd::hsum(s00), simd::hsum(s01), simd::hsum(s10), simd::hsum(s11),
+                               simd::hsum(s20), simd::hsum(s21), simd::hsum(s30), simd::hsum(s31) };
+                for (; p < kc; p++) {
+                    r[0] += a0[p] * b0[p]; r[1] += a0[p] * b1[p];
+                    r[2] += a1[p] * b0[p]; r[3] += a1[p] * b1[p];
+                    r[4] += a2[p] * b0[p]; r[5] += a2[p] * b1[p];
+                    r[6] += a3[p] * b0[p]; r[7] += a3[p] * b1[p];
+                }
+                for (int t = 0; t < 4; t++) {
+                    emit(i + t, j, r[2 * t]);
+                    emit(i + t, j + 1, r[2 * t + 1]);
+                }
+            }
+            for (; j < n; j++) {
+                const float* b = B + j * ldb + p0;
+                for (int t = 0; t < 4; t++) emit(i + t, j, dot(A + (i + t) * lda + p0, b, kc));
+            }
+        }
+        for (; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                emit(i, j, dot(A + i * lda + p0, B + j * ldb + p0, kc));
+            }
+        }
+    }
+}
+
+} // namespace gemm_detail
+
+// C = alpha * op(A) * op(B). C must already have the result shape.
+void gemm(const Matrix& A, Trans ta, const Matrix& B, Trans tb, Matrix& C, float alpha) {
+    int m  = (ta == Trans::No) ? A.rows : A.cols;
+    int k  = (ta == Trans::No) ? A.cols : A.rows;
+    int kb = (tb == Trans::No) ? B.rows : B.cols;
+    int n  = (tb == Trans::No) ? B.cols : B.rows;
+    if (k != kb) {
+        throw std::runtime_error("gemm: dimension mismatch");
+    }
+    if (C.rows != m || C.cols != n) {
+        throw std::runtime_error("gemm: output has wrong shape");
+    }
+    if (m == 0 || n == 0) return;
+    if (k == 0) {
+        std::fill(C.data.begin(), C.data.end(), 0.0f);
+        return;
+    }
+    // Both operands contiguous along a long k: dot-product form avoids packing
+    if (ta == Trans::No && tb == Trans::Yes && k >= gemm_detail::KC_DOT / 8) {
+        gemm_detail::gemmDotNT(A.data.data(), A.cols, B.data.data(), B.cols,
+                               C.data.data(), C.cols, m, n, k, alpha);
+        return;
+    }
+    gemm_detail::gemmPacked(A.data.data(), A.cols, ta, B.data.data(), B.cols, tb,
+                            C.data.data(), C.cols, m, n, k, alpha);
+}
+
 // Matrix multiplication: C = A * B
 Matrix matMul(const Matrix& A, const Matrix& B) {
     // A: (m x n), B: (n x p) -> C: (m x p)
@@ -70,16 +399,206 @@ Matrix matMul(const Matrix& A, const Matrix& B) {
         throw std::runtime_error("matMul: dimension mismatch");
     }
     Matrix C(A.rows, B.cols);
-    for (int i = 0; i < A.rows; i++) {
-        for (int j = 0; j < B.cols; j++) {
-            float sum = 0.0f;
-            for (int k = 0; k < A.cols; k++) {
-                sum += at(A, i, k) * at(B, k, j);
+    gemm(A, Trans::No, B, Trans::No, C);
+    return C;
+}
+
+// C = A * B^T without forming B^T. A: (m x n), B: (p x n) -> C: (m x p)
+Matrix matMulABt(const Matrix& A, const Matrix& B) {
+    if (A.cols != B.cols) {
+        throw std::runtime_error("matMulABt: dimension mismatch");
+    }
+    Matrix C(A.rows, B.rows);
+    gemm(A, Trans::No, B, Trans::Yes, C);
+    return C;
+}
+
+// C = A^T * B without forming A^T. A: (n x m), B: (n x p) -> C: (m x p)
+Matrix matMulAtB(const Matrix& A, const Matrix& B) {
+    if (A.rows != B.rows) {
+        throw std::runtime_error("matMulAtB: dimension mismatch");
+    }
+    Matrix C(A.cols, B.cols);
+    gemm(A, Trans::Yes, B, Trans::No, C);
+    return C;
+}
+
+// -----------------------------------------------------------------------------
+// FastICA contrast functions (see ContrastOptions in the header for the menu
+// and accuracy bounds)
+// -----------------------------------------------------------------------------
+namespace contrast_detail {
+
+// Chunk of samples processed per row before its g-values are consumed (stays in L1)
+constexpr int CHUNK = 256;
+
+inline simd::vf clamp(simd::vf x, float lim) {
+    return simd::min(simd::max(x, simd::set1(-lim)), simd::set1(lim));
+}
+
+inline simd::vf tanhPrecise(simd::vf x) {
+    x = clamp(x, 7.90531110763549805f);
+    simd::vf x2 = simd::mul(x, x);
+    simd::vf p = simd::set1(-2.76076847742355e-16f);
+    p = simd::fma(p, x2, simd::set1(2.00018790482477e-13f));
+    p = simd::fma(p, x2, simd::set1(-8.60467152213735e-11f));
+    p = simd::fma(p, x2, simd::set1(5.12229709037114e-08f));
+    p = simd::fma(p, x2, simd::set1(1.48572235717979e-05f));
+    p = simd::fma(p, x2, simd::set1(6.37261928875436e-04f));
+    p = simd::fma(p, x2, simd::set1(4.89352455891786e-03f));
+    p = simd::mul(p, x);
+    simd::vf q = simd::set1(1.19825839466702e-06f);
+    q = simd::fma(q, x2, simd::set1(1.18534705686654e-04f));
+    q = simd::fma(q, x2, simd::set1(2.26843463243900e-03f));
+    q = simd::fma(q, x2, simd::set1(4.89352518554385e-03f));
+    return simd::div(p, q);
+}
+
+inline simd::vf tanhMedium(simd::vf x) {
+    x = clamp(x, 4.97f);
+    simd::vf x2 = simd::mul(x, x);
+    simd::vf p = simd::fma(simd::add(x2, simd::set1(378.0f)), x2, simd::set1(17325.0f));
+    p = simd::mul(simd::fma(p, x2, simd::set1(135135.0f)), x);
+    simd::vf q = simd::fma(simd::set1(28.0f), x2, simd::set1(3150.0f));
+    q = simd::fma(q, x2, simd::set1(62370.0f));
+    q = simd::fma(q, x2, simd::set1(135135.0f));
+    return clamp(simd::div(p, q), 1.0f);
+}
+
+inline simd::vf tanhFast(simd::vf x) {
+    x = clamp(x, 3.0f);
+    simd::vf x2 = simd::mul(x, x);
+    simd::vf p = simd::mul(x, simd::add(x2, simd::set1(27.0f)));
+    simd::vf q = simd::fma(simd::set1(9.0f), x2, simd::set1(27.0f));
+    return simd::div(p, q);
+}
+
+// exp(y) for y <= 0 (Cody-Waite range reduction + degree-5 polynomial, ~2 ulp)
+inline simd::vf expNonPositive(simd::vf y) {
+    y = simd::max(y, simd::set1(-87.0f));
+    simd::vf n = simd::floor(simd::fma(y, simd::set1(1.44269504088896341f), simd::set1(0.5f)));
+    simd::vf r = simd::sub(y, simd::mul(n, simd::set1(0.693359375f)));
+    r = simd::sub(r, simd::mul(n, simd::set1(-2.12194440e-4f)));
+    simd::vf p = simd::set1(1.9875691500e-4f);
+    p = simd::fma(p, r, simd::set1(1.3981999507e-3f));
+    p = simd::fma(p, r, simd::set1(8.3334519073e-3f));
+    p = simd::fma(p, r, simd::set1(4.1665795894e-2f));
+    p = simd::fma(p, r, simd::set1(1.6666665459e-1f));
+    p = simd::fma(p, r, simd::set1(5.0000001201e-1f));
+    p = simd::add(simd::fma(p, simd::mul(r, r), r), simd::set1(1.0f));
+    return simd::mul(p, simd::pow2n(n));
+}
+
+// Apply g in place to x[0:n) and return sum of g'(x)
+template <typename ApplyFn>
+inline float applyChunk(float* x, int n, ApplyFn fn) {
+    simd::vf acc = simd::zero();
+    int i = 0;
+    for (; i + simd::W <= n; i += simd::W) {
+        simd::vf g, gp;
+        fn(simd::load(x + i), g, gp);
+        simd::store(x + i, g);
+        acc = simd::add(acc, gp);
+    }
+    float sum = simd::hsum(acc);
+    if (i < n) {
+        // Tail through a zero-padded vector so scalar and SIMD paths agree
+        alignas(64) float tail[simd::W] = {};
+        alignas(64) float tail_gp[simd::W];
+        for (int t = 0; t < n - i; t++) tail[t] = x[i + t];
+        simd::vf g, gp;
+        fn(simd::load(tail), g, gp);
+        simd::store(tail, g);
+        simd::store(tail_gp, gp);
+        for (int t = 0; t < n - i; t++) {
+            x[i + t] = tail[t];
+            sum += tail_gp[t];
+        }
+    }
+    return sum;
+}
+
+// Contrast pass over samples [n0, n1) of WX, adding sum g'(WX[r, :]) to
+// gprime_sum[r] and g(WX) * X^T to gx (k x C)
+template <typename ApplyFn>
+void fusedRange(Matrix& WX, const Matrix& X, int n0, int n1, float* gprime_sum, float* gx, ApplyFn fn) {
+    int k = WX.rows, n = WX.cols, c_dim = X.rows;
+    for (int j0 = n0; j0 < n1; j0 += CHUNK) {
+        int nc = std::min(CHUNK, n1 - j0);
+        for (int r = 0; r < k; r++) {
+            float* g = &WX.data[static_cast<size_t>(r) * n + j0];
+            gprime_sum[r] += applyChunk(g, nc, fn);
+            // g-values are hot in L1: fold them into row r of g(WX) * X^T now
+            float* gx_row = gx + static_cast<size_t>(r) * c_dim;
+            for (int c = 0; c < c_dim; c++) {
+                gx_row[c] += gemm_detail::dot(g, &X.data[static_cast<size_t>(c) * n + j0], nc);
             }
-            at(C, i, j) = sum;
         }
     }
-    return C;
+}
+
+template <typename ApplyFn>
+void fusedPass(Matrix& WX, const Matrix& X, float* gprime_mean, Matrix& GX, float scale, ApplyFn fn) {
+    int k = WX.rows, n = WX.cols;
+    std::fill(GX.data.begin(), GX.data.end(), 0.0f);
+    for (int r = 0; r < k; r++) gprime_mean[r] = 0.0f;
+    fusedRange(WX, X, 0, n, gprime_mean, GX.data.data(), fn);
+    for (int r = 0; r < k; r++) gprime_mean[r] /= n;
+    for (auto& v : GX.data) v *= scale;
+}
+
+// Call body(fn) with the (g, g') functor opt selects
+template <typename Body>
+void withContrast(const ContrastOptions& opt, Body&& body) {
+    switch (opt.contrast) {
+    case Contrast::Cube:
+        body([](simd::vf x, simd::vf& g, simd::vf& gp) {
+            simd::vf x2 = simd::mul(x, x);
+            g  = simd::mul(x2, x);
+            gp = simd::mul(simd::set1(3.0f), x2);
+        });
+        break;
+    case Contrast::Gauss:
+        body([](simd::vf x, simd::vf& g, simd::vf& gp) {
+            simd::vf x2 = simd::mul(x, x);
+            simd::vf e  = expNonPositive(simd::mul(simd::set1(-0.5f), x2));
+            g  = simd::mul(x, e);
+            gp = simd::mul(simd::sub(simd::set1(1.0f), x2), e);
+        });
+        break;
+    case Contrast::LogCosh:
+    default: {
+        simd::vf a = simd::set1(opt.alpha);
+        auto logcosh = [a](auto tanhFn) {
+            return [a, tanhFn](simd::vf x, simd::vf& g, simd::vf& gp) {
+                g  = tanhFn(simd::mul(a, x));
+                gp = simd::mul(a, simd::sub(simd::set1(1.0f), simd::mul(g, g)));
+            };
+        };
+        switch (opt.accuracy) {
+        case TanhAccuracy::Fast:   body(logcosh(tanhFast));   break;
+        case TanhAccuracy::Medium: body(logcosh(tanhMedium)); break;
+        default:                   body(logcosh(tanhPrecise)); break;
+        }
+        break;
+    }
+    }
+}
+
+} // namespace contrast_detail
+
+// Fused contrast pass. One sweep over WX (k x N) against X (C x N) that
+//   - overwrites WX with g(WX),
+//   - writes gprime_mean[r] = mean over samples of g'(WX[r, :]),
+//   - writes GX (k x C) = scale * g(WX) * X^T.
+void contrastKernel(Matrix& WX, const Matrix& X, const ContrastOptions& opt,
+                    float* gprime_mean, Matrix& GX, float scale) {
+    using namespace contrast_detail;
+    if (X.cols != WX.cols) {
+        throw std::runtime_error("contrastKernel: sample count mismatch");
+    }
+    reshape(GX, WX.rows, X.rows);
+    withContrast(opt, [&](auto fn) { fusedPass(WX, X, gprime_mean, GX, scale, fn); });
 }
 
 // Scalar divide a matrix (element-wise)
@@ -115,12 +634,19 @@ Matrix matAdd(const Matrix& A, const Matrix& B) {
     return R;
 }
 
+// Overwrite M with the (size x size) identity, reusing its storage
+void setIdentity(Matrix& M, int size) {
+    reshape(M, size, size);
+    std::fill(M.data.begin(), M.data.end(), 0.0f);
+    for (int i = 0; i < size; i++) {
+        at(M, i, i) = 1.0f;
+    }
+}
+
 // Create an Identity matrix
 Matrix identity(int size) {
     Matrix I(size, size);
-    for (int i = 0; i < size; i++) {
-        at(I, i, i) = 1.0f;
-    }
+    setIdentity(I, size);
     return I;
 }
 
@@ -137,122 +663,271 @@ float frobeniusNorm(const Matrix& A) {
 // Mean / Centering / Covariance
 // -----------------------------------------------------------------------------
 
+// Compute the mean of each column into mean (1 x cols). Rows are walked in
+// storage order so the whole pass is sequential.
+void columnMeanInto(const Matrix& data, Matrix& mean) {
+    reshape(mean, 1, data.cols);
+    std::fill(mean.data.begin(), mean.data.end(), 0.0f);
+    for (int r = 0; r < data.rows; r++) {
+        for (int c = 0; c < data.cols; c++) {
+            mean.data[c] += at(data, r, c);
+        }
+    }
+    for (int c = 0; c < data.cols; c++) {
+        mean.data[c] /= data.rows;
+    }
+}
+
 // Compute the mean of each column (returns 1 x cols)
 Matrix columnMean(const Matrix& data) {
     Matrix mean(1, data.cols);
-    for (int c = 0; c < data.cols; c++) {
-        float sum = 0.0f;
-        for (int r = 0; r < data.rows; r++) {
-            sum += at(data, r, c);
-        }
-        at(mean, 0, c) = sum / data.rows;
-    }
+    columnMeanInto(data, mean);
     return mean;
 }
 
-// Center the data (subtract column-wise mean)
-Matrix centerData(const Matrix& data) {
-    Matrix centered(data.rows, data.cols);
-    Matrix colMean = columnMean(data);
+// Center the data into centered, leaving the column means in mean
+void centerDataInto(const Matrix& data, Matrix& mean, Matrix& centered) {
+    ICA_PROFILE_SCOPE(Center);
+    columnMeanInto(data, mean);
+    reshape(centered, data.rows, data.cols);
     for (int r = 0; r < data.rows; r++) {
         for (int c = 0; c < data.cols; c++) {
-            at(centered, r, c) = at(data, r, c) - at(colMean, 0, c);
+            at(centered, r, c) = at(data, r, c) - mean.data[c];
         }
     }
+}
+
+// Center the data (subtract column-wise mean)
+Matrix centerData(const Matrix& data) {
+    Matrix centered(data.rows, data.cols);
+    Matrix colMean(1, data.cols);
+    centerDataInto(data, colMean, centered);
     return centered;
 }
 
+// Covariance into a preallocated Cov (n_features x n_features)
+void covarianceInto(const Matrix& X, Matrix& Cov) {
+    reshape(Cov, X.cols, X.cols);
+    // The usual channel counts: fixed-size accumulators instead of GEMM panels
+    // that would be mostly padding
+    bool fixed = X.rows > 0 && withFixedSize<2, ICA_FIXED_COV_MAX_N>(X.cols, [&](auto n) {
+        FixedMatrix<decltype(n)::value, decltype(n)::value> cov;
+        covarianceFixed(X.data.data(), X.rows, cov);
+        cov.store(Cov.data.data());
+    });
+    if (fixed) return;
+    gemm(X, Trans::Yes, X, Trans::No, Cov, 1.0f / static_cast<float>(X.rows));
+}
+
 // Compute covariance matrix = (1/N) * (X^T * X), assuming X is already centered
 Matrix covariance(const Matrix& X) {
     // X: (n_samples x n_features)
     // Cov: (n_features x n_features) = (1/n_samples) * (X^T * X)
-    Matrix Xt = transpose(X);
-    Matrix XtX = matMul(Xt, X);
-    Matrix Cov = matDiv(XtX, static_cast<float>(X.rows));
+    Matrix Cov(X.cols, X.cols);
+    covarianceInto(X, Cov);
     return Cov;
 }
 
 // -----------------------------------------------------------------------------
-// Jacobi EVD for Symmetric Matrices
+// Symmetric EVD
 //   We use it for (symmetric) covariance or (symmetric) W*W^T, etc.
-//   This finds A = V * D * V^T
+//   This finds A = V * D * V^T with the eigenvalues on the diagonal of D
+//   (off-diagonals zeroed) sorted in descending order, and the matching
+//   eigenvectors in the columns of V.
+//
+//   symmetricEVD() picks the solver by size:
+//     n <= EVD_JACOBI_MAX_N : cyclic threshold Jacobi (few sweeps, very
+//                             accurate on the small matrices we usually see)
+//     larger                : Householder tridiagonalisation + implicit QL
+//   Both reuse V/D storage and a per-thread scratch vector, so they do not
+//   allocate once warmed up.
 // -----------------------------------------------------------------------------
-void jacobiEVD(const Matrix& A, Matrix& V, Matrix& D, int maxIter = 100, float tol = 1e-6f) {
-    // Check square
+namespace evd_detail {
+
+// Per-thread scratch for d/e/b/z vectors (grows once, then reused)
+inline float* scratch(size_t n) {
+    static thread_local std::vector<float> buf;
+    if (buf.size() < n) buf.resize(n);
+    return buf.data();
+}
+
+inline void prepareOutputs(const Matrix& A, Matrix& V, Matrix& D, const char* who) {
     if (A.rows != A.cols) {
-        throw std::runtime_error("jacobiEVD: A must be square");
+        throw std::runtime_error(std::string(who) + ": A must be square");
     }
+    setIdentity(V, A.rows);
+    // D may alias A (in-place decomposition)
+    if (&D != &A) {
+        reshape(D, A.rows, A.cols);
+        std::copy(A.data.begin(), A.data.end(), D.data.begin());
+    }
+}
+
+// Write eigenvalues d as a diagonal D, then sort eigenpairs by descending eigenvalue
+inline void finish(const float* d, Matrix& V, Matrix& D) {
+    sortEigenpairs(D.rows, d, [&D](int r, int c) -> float& { return at(D, r, c); },
+                   [&V](int r, int c) -> float& { return at(V, r, c); });
+}
+
+} // namespace evd_detail
+
+// Cyclic threshold Jacobi (jacobiSweeps in fixed_matrix.hpp, shared with
+// jacobiEVDFixed). Typically 5-8 sweeps regardless of n.
+EvdResult jacobiEVD(const Matrix& A, Matrix& V, Matrix& D, int maxSweeps, float tol) {
+    evd_detail::prepareOutputs(A, V, D, "jacobiEVD");
     int n = A.rows;
-    V = identity(n);
-
-    // Copy A into D initially (we'll turn D into the diagonal of eigenvalues).
-    D = A; // We'll transform D into the diagonal form via Jacobi rotations.
-
-    for (int iter = 0; iter < maxIter; iter++) {
-        // 1. Find the largest off-diagonal element in D
-        float maxVal = 0.0f;
-        int p = 0, q = 0;
-        for (int i = 0; i < n; i++) {
-            for (int j = i + 1; j < n; j++) {
-                float val = std::fabs(at(D, i, j));
-                if (val > maxVal) {
-                    maxVal = val;
-                    p = i;
-                    q = j;
+    float* d = evd_detail::scratch(3 * static_cast<size_t>(n));
+    EvdResult res = jacobiSweeps(n, [&D](int r, int c) -> float& { return at(D, r, c); },
+                                 [&V](int r, int c) -> float& { return at(V, r, c); },
+                                 d, d + n, d + 2 * n, maxSweeps, tol);
+    evd_detail::finish(d, V, D);
+    return res;
+}
+
+// Householder tridiagonalisation followed by implicit-shift QL. O(n^3) with a
+// small constant and no dependence on pivot search; used for the wider
+// channel counts (16-64) where Jacobi sweeps get expensive.
+EvdResult tridiagonalQLEVD(const Matrix& A, Matrix& V, Matrix& D, int maxIterPerEig) {
+    evd_detail::prepareOutputs(A, V, D, "tridiagonalQLEVD");
+    int n = A.rows;
+    Matrix& a = V; // reduced in place; ends up holding the eigenvectors
+    std::copy(D.data.begin(), D.data.end(), a.data.begin());
+
+    float* d = evd_detail::scratch(2 * static_cast<size_t>(n));
+    float* e = d + n;
+
+    // 1. Householder reduction to tridiagonal form, accumulating Q in a
+    for (int i = n - 1; i > 0; i--) {
+        int l = i - 1;
+        float h = 0.0f, scale = 0.0f;
+        if (l > 0) {
+            for (int k = 0; k < i; k++) scale += std::fabs(at(a, i, k));
+            if (scale == 0.0f) {
+                e[i] = at(a, i, l);
+            } else {
+                for (int k = 0; k < i; k++) {
+                    at(a, i, k) /= scale;
+                    h += at(a, i, k) * at(a, i, k);
+                }
+                float f = at(a, i, l);
+                float g = (f >= 0.0f) ? -std::sqrt(h) : std::sqrt(h);
+                e[i] = scale * g;
+                h -= f * g;
+                at(a, i, l) = f - g;
+                f = 0.0f;
+                for (int j = 0; j < i; j++) {
+                    at(a, j, i) = at(a, i, j) / h;
+                    g = 0.0f;
+                    for (int k = 0; k < j + 1; k++) g += at(a, j, k) * at(a, i, k);
+                    for (int k = j + 1; k < i; k++) g += at(a, k, j) * at(a, i, k);
+                    e[j] = g / h;
+                    f += e[j] * at(a, i, j);
+                }
+                float hh = f / (h + h);
+                for (int j = 0; j < i; j++) {
+                    f = at(a, i, j);
+                    e[j] = g = e[j] - hh * f;
+                    for (int k = 0; k < j + 1; k++) at(a, j, k) -= (f * e[k] + g * at(a, i, k));
                 }
             }
+        } else {
+            e[i] = at(a, i, l);
         }
-        // Check convergence
-        if (maxVal < tol) {
-            break;
-        }
-
-        float app = at(D, p, p);
-        float aqq = at(D, q, q);
-        float apq = at(D, p, q);
-
-        // 2. Compute the angle theta
-        float theta = 0.0f;
-        if (std::fabs(apq) > 1e-12f) {
-            theta = 0.5f * std::atan2(2.0f * apq, (app - aqq));
+        d[i] = h;
+    }
+    d[0] = 0.0f;
+    e[0] = 0.0f;
+    for (int i = 0; i < n; i++) {
+        if (d[i] != 0.0f) {
+            for (int j = 0; j < i; j++) {
+                float g = 0.0f;
+                for (int k = 0; k < i; k++) g += at(a, i, k) * at(a, k, j);
+                for (int k = 0; k < i; k++) at(a, k, j) -= g * at(a, k, i);
+            }
         }
+        d[i] = at(a, i, i);
+        at(a, i, i) = 1.0f;
+        for (int j = 0; j < i; j++) at(a, j, i) = at(a, i, j) = 0.0f;
+    }
 
-        float c = std::cos(theta);
-        float s = std::sin(theta);
-
-        // 3. Update matrix D with rotation
-        // We'll rotate p,q rows and columns
-        float app_new = c*c*app - 2.0f*c*s*apq + s*s*aqq;
-        float aqq_new = s*s*app + 2.0f*c*s*apq + c*c*aqq;
-        at(D, p, p) = app_new;
-        at(D, q, q) = aqq_new;
-        at(D, p, q) = 0.0f;
-        at(D, q, p) = 0.0f;
+    // 2. Implicit QL on the tridiagonal (d, e), rotating the columns of a
+    EvdResult res{0, true};
+    for (int i = 1; i < n; i++) e[i - 1] = e[i];
+    if (n > 0) e[n - 1] = 0.0f;
+    const float eps = std::numeric_limits<float>::epsilon();
+    for (int l = 0; l < n && res.converged; l++) {
+        int iter = 0;
+        int m;
+        do {
+            for (m = l; m < n - 1; m++) {
+                float dd = std::fabs(d[m]) + std::fabs(d[m + 1]);
+                if (std::fabs(e[m]) <= eps * dd) break;
+            }
+            if (m == l) break;
+            if (iter++ == maxIterPerEig) {
+                res.converged = false;
+                break;
+            }
+            res.sweeps++;
+            float g = (d[l + 1] - d[l]) / (2.0f * e[l]);
+            float r = std::hypot(g, 1.0f);
+            g = d[m] - d[l] + e[l] / (g + (g >= 0.0f ? r : -r));
+            float s = 1.0f, c = 1.0f, p = 0.0f;
+            int i;
+            for (i = m - 1; i >= l; i--) {
+                float f = s * e[i];
+                float b = c * e[i];
+                e[i + 1] = (r = std::hypot(f, g));
+                if (r == 0.0f) {
+                    d[i + 1] -= p;
+                    e[m] = 0.0f;
+                    break;
+                }
+                s = f / r;
+                c = g / r;
+                g = d[i + 1] - p;
+                r = (d[i] - g) * s + 2.0f * c * b;
+                d[i + 1] = g + (p = s * r);
+                g = c * r - b;
+                for (int k = 0; k < n; k++) {
+                    f = at(a, k, i + 1);
+                    at(a, k, i + 1) = s * at(a, k, i) + c * f;
+                    at(a, k, i)     = c * at(a, k, i) - s * f;
+                }
+            }
+            if (r == 0.0f && i >= l) continue;
+            d[l] -= p;
+            e[l] = g;
+            e[m] = 0.0f;
+        } while (m != l);
+    }
 
-        for (int i = 0; i < n; i++) {
-            if (i == p || i == q) continue;
-            float aip = at(D, i, p);
-            float aiq = at(D, i, q);
-            float dip = c*aip - s*aiq;
-            float diq = s*aip + c*aiq;
-            at(D, i, p) = dip;
-            at(D, p, i) = dip;
-            at(D, i, q) = diq;
-            at(D, q, i) = diq;
-        }
+    evd_detail::finish(d, V, D);
+    return res;
+}
 
-        // 4. Update eigenvector matrix V
-        for (int i = 0; i < n; i++) {
-            float vip = at(V, i, p);
-            float viq = at(V, i, q);
-            at(V, i, p) = c*vip - s*viq;
-            at(V, i, q) = s*vip + c*viq;
-        }
+// Size-dispatched symmetric EVD; see the section header.
+//   Sizes up to ICA_FIXED_MAX_N run the same Jacobi on a FixedMatrix.
+EvdResult symmetricEVD(const Matrix& A, Matrix& V, Matrix& D) {
+    ICA_PROFILE_SCOPE(Evd);
+    EvdResult res{0, false};
+    bool fixed = A.rows == A.cols && withFixedSize<2, ICA_FIXED_MAX_N>(A.rows, [&](auto n) {
+        constexpr int N = decltype(n)::value;
+        FixedMatrix<N, N> d, v;
+        d.load(A.data.data());
+        res = jacobiEVDFixed(d, v);
+        reshape(V, N, N);
+        reshape(D, N, N);
+        v.store(V.data.data());
+        d.store(D.data.data());
+    });
+    if (!fixed) {
+        res = (A.rows <= EVD_JACOBI_MAX_N) ? jacobiEVD(A, V, D) : tridiagonalQLEVD(A, V, D);
     }
-
-    // After convergence, D is symmetrical. The diagonal elements of D are eigenvalues.
-    // The columns of V are the eigenvectors. 
-    // We usually want D as diagonal only, but it's already mostly diagonal. We'll keep as is.
+    ICA_PROFILE_COUNT(EvdCalls, 1);
+    ICA_PROFILE_COUNT(EvdSweeps, res.sweeps);
+    ICA_PROFILE_COUNT(JacobiRotations, res.rotations);
+    return res;
 }
 
 // Extract diagonal as a vector (nx1) from a square matrix
@@ -291,253 +966,770 @@ Matrix invVector(const Matrix& vec) {
     return out;
 }
 
+// out = V * D^{-1/2} * V^T from an EVD (V, D). scaledV receives V * D^{-1/2}.
+// Zero eigenvalues map to zero, matching invVector().
+void inverseSqrtFromEVD(const Matrix& V, const Matrix& D, Matrix& scaledV, Matrix& out) {
+    int n = V.rows;
+    reshape(scaledV, n, n);
+    reshape(out, n, n);
+    bool fixed = withFixedSize<2, ICA_FIXED_MAX_N>(n, [&](auto size) {
+        constexpr int N = decltype(size)::value;
+        FixedMatrix<N, N> v, d, sv, o;
+        v.load(V.data.data());
+        d.load(D.data.data());
+        inverseSqrtFixed(v, d, sv, o);
+        sv.store(scaledV.data.data());
+        o.store(out.data.data());
+    });
+    if (fixed) return;
+    for (int c = 0; c < n; c++) {
+        float d = at(D, c, c);
+        float s = (d > 0.0f) ? 1.0f / std::sqrt(d) : 0.0f;
+        for (int r = 0; r < n; r++) {
+            at(scaledV, r, c) = at(V, r, c) * s;
+        }
+    }
+    gemm(scaledV, Trans::No, V, Trans::Yes, out);
+}
+
 // -----------------------------------------------------------------------------
-// Whitening via EVD of covariance
-//   whitened = E * D^{-1/2} * E^T * centered_data
+// Top-k eigenpairs (subspace iteration with Rayleigh-Ritz)
 // -----------------------------------------------------------------------------
-Matrix whitenData(const Matrix& data_centered) {
+
+// Modified Gram-Schmidt on the columns of Q (two passes per column). A column
+// that collapses (A has lower rank than Q has columns) is replaced by the
+// first unit vector not already in the span.
+static void orthonormalizeColumns(Matrix& Q) {
+    const int n = Q.rows, k = Q.cols;
+    auto project = [&](int j) {
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < j; i++) {
+                float dot = 0.0f;
+                for (int r = 0; r < n; r++) dot += at(Q, r, i) * at(Q, r, j);
+                for (int r = 0; r < n; r++) at(Q, r, j) -= dot * at(Q, r, i);
+            }
+        }
+    };
+    auto norm = [&](int j) {
+        float s = 0.0f;
+        for (int r = 0; r < n; r++) s += at(Q, r, j) * at(Q, r, j);
+        return std::sqrt(s);
+    };
+    for (int j = 0; j < k; j++) {
+        const float before = norm(j);
+        project(j);
+        float len = norm(j);
+        if (len == 0.0f || len <= 1e-6f * before) {
+            len = 0.0f;
+            for (int e = 0; e < n && len == 0.0f; e++) {
+                for (int r = 0; r < n; r++) at(Q, r, j) = (r == e) ? 1.0f : 0.0f;
+                project(j);
+                float l = norm(j);
+                if (l > 0.5f) len = l;
+            }
+        }
+        const float inv = (len > 0.0f) ? 1.0f / len : 0.0f;
+        for (int r = 0; r < n; r++) at(Q, r, j) *= inv;
+    }
+}
+
+EvdResult topEigenpairs(const Matrix& A, int k, Matrix& V, Matrix& D, SubspaceScratch& s,
+                        bool warm_start, int maxIter, float tol) {
+    const int n = A.rows;
+    k = std::min(k, n);
+    EvdResult res{0, false};
+
+    // Q (kept in V): the previous basis, or the columns of A with the
+    // largest diagonal (one power step from those unit vectors)
+    if (!warm_start || V.rows != n || V.cols != k) {
+        reshape(V, n, k);
+        float prev = std::numeric_limits<float>::infinity();
+        int prev_idx = -1;
+        for (int j = 0; j < k; j++) {
+            // next column in (diagonal descending, index ascending) order
+            int best = -1;
+            for (int i = 0; i < n; i++) {
+                float d = at(A, i, i);
+                bool after = d < prev || (d == prev && i > prev_idx);
+                if (after && (best < 0 || d > at(A, best, best))) best = i;
+            }
+            for (int r = 0; r < n; r++) at(V, r, j) = at(A, r, best);
+            prev = at(A, best, best);
+            prev_idx = best;
+        }
+    }
+    orthonormalizeColumns(V);
+    reshape(s.AQ, n, k);
+    reshape(s.rotated, n, k);
+    reshape(s.T, k, k);
+    gemm(A, Trans::No, V, Trans::No, s.AQ);
+
+    for (int iter = 1; iter <= maxIter; iter++) {
+        res.sweeps = iter;
+
+        // Rayleigh-Ritz: rotate Q (and A Q) onto the eigenvectors of Q^T A Q
+        gemm(V, Trans::Yes, s.AQ, Trans::No, s.T);
+        for (int r = 0; r < k; r++) {
+            for (int c = r + 1; c < k; c++) {
+                float m = 0.5f * (at(s.T, r, c) + at(s.T, c, r));
+                at(s.T, r, c) = at(s.T, c, r) = m;
+            }
+        }
+        symmetricEVD(s.T, s.TV, s.TD);
+        gemm(V, Trans::No, s.TV, Trans::No, s.rotated);
+        std::copy(s.rotated.data.begin(), s.rotated.data.end(), V.data.begin());
+        gemm(s.AQ, Trans::No, s.TV, Trans::No, s.rotated);
+        std::copy(s.rotated.data.begin(), s.rotated.data.end(), s.AQ.data.begin());
+
+        // Residuals ||A q_i - lambda_i q_i||
+        const float scale = tol * std::max(at(s.TD, 0, 0), 0.0f);
+        bool done = true;
+        for (int i = 0; i < k && done; i++) {
+            const float lambda = at(s.TD, i, i);
+            float r2 = 0.0f;
+            for (int r = 0; r < n; r++) {
+                float d = at(s.AQ, r, i) - lambda * at(V, r, i);
+                r2 += d * d;
+            }
+            done = std::sqrt(r2) <= scale;
+        }
+        if (done) {
+            res.converged = true;
+            break;
+        }
+        if (iter == maxIter) break;
+
+        // Power step
+        std::copy(s.AQ.data.begin(), s.AQ.data.end(), V.data.begin());
+        orthonormalizeColumns(V);
+        gemm(A, Trans::No, V, Trans::No, s.AQ);
+    }
+
+    reshape(D, k, k);
+    std::fill(D.data.begin(), D.data.end(), 0.0f);
+    for (int i = 0; i < k; i++) at(D, i, i) = at(s.TD, i, i);
+    return res;
+}
+
+EvdResult leadingEigenpairs(const Matrix& A, int k, Matrix& V, Matrix& D, SubspaceScratch& scratch,
+                            bool warm_start) {
+    // Up to the stack-sized Jacobi the full EVD is cheaper than iterating
+    if (k < A.rows && A.rows > ICA_FIXED_MAX_N) {
+        return topEigenpairs(A, k, V, D, scratch, warm_start);
+    }
+    return symmetricEVD(A, V, D);
+}
+
+void whiteningFromEVD(const Matrix& V, const Matrix& D, int k, Matrix& out) {
+    const int n = V.rows;
+    reshape(out, k, n);
+    for (int i = 0; i < k; i++) {
+        float d = at(D, i, i);
+        float s = (d > 0.0f) ? 1.0f / std::sqrt(d) : 0.0f;
+        for (int c = 0; c < n; c++) at(out, i, c) = at(V, c, i) * s;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// PCA whitening via EVD of covariance, keeping the leading whitened_dims
+// directions
+//   whitened = D_k^{-1/2} * E_k^T * centered_data^T
+// -----------------------------------------------------------------------------
+
+// In-place whitening: reads ws.centered, writes ws.whiteningMat and ws.whitened
+void whitenDataInto(IcaWorkspace& ws) {
+    ICA_PROFILE_SCOPE(Whiten);
+    const int k = ws.whitened_dims;
+
     // 1. Covariance
-    Matrix Cov = covariance(data_centered);  // shape: (n_features x n_features)
+    covarianceInto(ws.centered, ws.cov);  // shape: (n_features x n_features)
 
-    // 2. EVD on Cov => Cov = V * D * V^T
-    Matrix V(0,0), D(0,0);
-    jacobiEVD(Cov, V, D);
+    // 2. Leading k eigenpairs of Cov
+    leadingEigenpairs(ws.cov, k, ws.evdV, ws.evdD, ws.subspace);
 
-    // 3. D^{-1/2}
-    Matrix diagVals = diagVector(D);    // n_features x 1
-    Matrix sqrtVals = sqrtVector(diagVals); // sqrt of eigenvalues
-    Matrix invSqrtVals = invVector(sqrtVals); // 1 / sqrt(eigenvalues)
-    Matrix D_inv_sqrt = diagMatrix(invSqrtVals); // n_features x n_features
+    // 3. Whitening matrix D_k^{-1/2} * V_k^T  (k x n_features)
+    whiteningFromEVD(ws.evdV, ws.evdD, k, ws.whiteningMat);
 
-    // 4. Whiten: X_whiten = V * D^{-1/2} * V^T * X_centered^T
-    Matrix Vt = transpose(V);
-    Matrix temp = matMul(V, D_inv_sqrt);
-    Matrix whiteningMat = matMul(temp, Vt); // (n_features x n_features)
+    // 4. whitened = whiteningMat * centered^T  (k x n_samples)
+    gemm(ws.whiteningMat, Trans::No, ws.centered, Trans::Yes, ws.whitened);
+}
 
-    // Now, data_centered is (n_samples x n_features).
-    // We want the whitened data in shape (n_features x n_samples) typically for ICA.
-    // Let's do: whitened = whiteningMat * data_centered^T
-    Matrix dataT = transpose(data_centered);  // (n_features x n_samples)
-    Matrix whitened = matMul(whiteningMat, dataT);  // (n_features x n_samples)
-    return whitened;
+Matrix whitenData(const Matrix& data_centered) {
+    IcaWorkspace ws(data_centered.rows, data_centered.cols, 0);
+    std::copy(data_centered.data.begin(), data_centered.data.end(), ws.centered.data.begin());
+    whitenDataInto(ws);
+    return ws.whitened; // (n_features x n_samples)
 }
 
 // -----------------------------------------------------------------------------
 // Symmetric Decorrelation for W (like the "symmetric decorrelation" in FastICA)
-//   W -> W * (W^T W)^{-1/2}
+//   W -> (W W^T)^{-1/2} * W
 // -----------------------------------------------------------------------------
+
+template <int K, int C>
+static void decorrelateFixed(FixedShape<K, C>, const Matrix& W_in, Matrix& W_out) {
+    FixedMatrix<K, C> w, out;
+    w.load(W_in.data.data());
+    EvdResult res = symmetricDecorrelationFixed(w, out);
+    ICA_PROFILE_COUNT(EvdCalls, 1);
+    ICA_PROFILE_COUNT(EvdSweeps, res.sweeps);
+    ICA_PROFILE_COUNT(JacobiRotations, res.rotations);
+    reshape(W_out, K, C);
+    out.store(W_out.data.data());
+}
+
+// W_out = (W_in W_in^T)^{-1/2} * W_in using workspace scratch. W_out must not alias W_in.
+// Shapes in FixedDecorrelationShapes run entirely on the stack.
+void symmetricDecorrelationInto(const Matrix& W_in, Matrix& W_out, IcaWorkspace& ws) {
+    bool fixed = withFixedShape(FixedDecorrelationShapes{}, W_in.rows, W_in.cols, [&](auto shape) {
+        decorrelateFixed(shape, W_in, W_out);
+    });
+    if (fixed) return;
+
+    // M = W_in * W_in^T (symmetric, num_components x num_components)
+    reshape(ws.M, W_in.rows, W_in.rows);
+    gemm(W_in, Trans::No, W_in, Trans::Yes, ws.M);
+
+    // EVD: M = V * D * V^T, then M^{-1/2} = V * D^{-1/2} * V^T
+    symmetricEVD(ws.M, ws.evdV, ws.evdD);
+    inverseSqrtFromEVD(ws.evdV, ws.evdD, ws.scaledV, ws.M_inv_sqrt);
+
+    // W_out = M^{-1/2} * W_in
+    reshape(W_out, W_in.rows, W_in.cols);
+    gemm(ws.M_inv_sqrt, Trans::No, W_in, Trans::No, W_out);
+}
+
 Matrix symmetricDecorrelation(const Matrix& W_in) {
-    // M = W_in * W_in^T (symmetric)
-    Matrix Wt = transpose(W_in);
-    Matrix M  = matMul(W_in, Wt);
-
-    // EVD: M = V * D * V^T
-    Matrix V(0,0), D(0,0);
-    jacobiEVD(M, V, D);
-
-    // M^{-1/2} = V * D^{-1/2} * V^T
-    Matrix diagVals = diagVector(D);
-    Matrix sqrtVals = sqrtVector(diagVals);
-    Matrix invSqrtVals = invVector(sqrtVals);
-    Matrix D_inv_sqrt = diagMatrix(invSqrtVals);
-
-    Matrix Vt = transpose(V);
-    Matrix temp = matMul(V, D_inv_sqrt);
-    Matrix M_inv_sqrt = matMul(temp, Vt);
-
-    // W_out = W_in * M^{-1/2}
-    Matrix W_out = matMul(W_in, M_inv_sqrt);
+    IcaWorkspace ws(0, W_in.cols, W_in.rows);
+    Matrix W_out(W_in.rows, W_in.cols);
+    symmetricDecorrelationInto(W_in, W_out, ws);
     return W_out;
 }
 
 // -----------------------------------------------------------------------------
-// FastICA (tanh non-linearity)
-//   data: (n_samples x n_features)
-//   Returns: (num_components x n_samples) => the independent components
+// Sample-block parallel kernels (IcaWorkspace::pool)
+//   Each block of ICA_PARALLEL_BLOCK samples computes its columns of W * X,
+//   runs the contrast on them while they are still in cache and leaves its g'
+//   sums and g(WX) * X^T partial in ws.block_partials. The partials are then
+//   added in block order on the calling thread: one pool job per iteration.
 // -----------------------------------------------------------------------------
-Matrix fastICA(const Matrix& data, int num_components, int max_iter = 1000, float tol = 1e-5) {
-    int n_samples  = data.rows;
-    int n_features = data.cols;
+static bool useParallel(const IcaWorkspace& ws) {
+    return ws.pool && ws.n_samples >= ICA_PARALLEL_MIN_SAMPLES;
+}
 
-    // 1. Center and whiten
-    Matrix centered_data = centerData(data);              // (n_samples x n_features)
-    Matrix whitened_data = whitenData(centered_data);     // (n_features x n_samples)
+// Columns [n0, n1) of out = W * X
+static void gemmColumns(const Matrix& W, const Matrix& X, Matrix& out, int n0, int n1) {
+    gemm_detail::gemmPacked(W.data.data(), W.cols, Trans::No, X.data.data() + n0, X.cols, Trans::No,
+                            out.data.data() + n0, out.cols, W.rows, n1 - n0, W.cols, 1.0f);
+}
 
-    // 2. Initialize random W: shape (num_components x n_features)
-    Matrix W = randomMatrix(num_components, n_features);
+// ws.WX = g(W * whitened), ws.mean_gprime = mean g'(W * whitened),
+// ws.W_new = scale * g(W * whitened) * whitened^T
+static void fusedIterationParallel(IcaWorkspace& ws, const ContrastOptions& opt, float scale) {
+    using namespace contrast_detail;
+    const int n = ws.n_samples, k = ws.num_components;
+    const int blocks = (n + ICA_PARALLEL_BLOCK - 1) / ICA_PARALLEL_BLOCK;
+    const size_t gx_size = static_cast<size_t>(k) * ws.whitened_dims;
+    const size_t stride = k + gx_size;
+
+    withContrast(opt, [&](auto fn) {
+        ws.pool->run(blocks, [&](int b) {
+            int n0 = b * ICA_PARALLEL_BLOCK;
+            int n1 = std::min(n, n0 + ICA_PARALLEL_BLOCK);
+            float* part = &ws.block_partials[b * stride];
+            std::fill(part, part + stride, 0.0f);
+            gemmColumns(ws.W, ws.whitened, ws.WX, n0, n1);
+            fusedRange(ws.WX, ws.whitened, n0, n1, part, part + k, fn);
+        });
+    });
+
+    float* gprime = ws.mean_gprime.data();
+    float* gx = ws.W_new.data.data();
+    std::fill(gprime, gprime + k, 0.0f);
+    std::fill(gx, gx + gx_size, 0.0f);
+    for (int b = 0; b < blocks; b++) {
+        const float* part = &ws.block_partials[b * stride];
+        for (int r = 0; r < k; r++) gprime[r] += part[r];
+        for (size_t i = 0; i < gx_size; i++) gx[i] += part[k + i];
+    }
+    for (int r = 0; r < k; r++) gprime[r] /= n;
+    for (size_t i = 0; i < gx_size; i++) gx[i] *= scale;
+}
+
+// ws.S = W * whitened
+static void unmixParallel(IcaWorkspace& ws) {
+    const int n = ws.n_samples;
+    const int blocks = (n + ICA_PARALLEL_BLOCK - 1) / ICA_PARALLEL_BLOCK;
+    ws.pool->run(blocks, [&](int b) {
+        int n0 = b * ICA_PARALLEL_BLOCK;
+        gemmColumns(ws.W, ws.whitened, ws.S, n0, std::min(n, n0 + ICA_PARALLEL_BLOCK));
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Symmetric mode: every row of W updated at once, then decorrelated together
+// -----------------------------------------------------------------------------
+static void symmetricIteration(IcaWorkspace& ws, const IcaBudget& budget, float tol, const Matrix* W_init,
+                               const ContrastOptions& contrast, bool parallel) {
+    int n_samples = ws.n_samples;
+    const IcaBudget::Clock::time_point start = IcaBudget::Clock::now();
+
+    // 2. Initialize W: shape (num_components x whitened_dims), decorrelated
+    //    so that even a solve stopped before its first iteration has a usable W
+    if (W_init && W_init->rows == ws.W.rows && W_init->cols == ws.W.cols) {
+        std::copy(W_init->data.begin(), W_init->data.end(), ws.W_new.data.begin());
+    } else {
+        fillRandom(ws.W_new);
+    }
+    symmetricDecorrelationInto(ws.W_new, ws.W, ws);
+    ws.iterations = 0;
+    ws.converged  = false;
+    ws.out_of_time = false;
 
     // 3. Iteration
-    for (int iter = 0; iter < max_iter; iter++) {
+    for (int iter = 0; iter < budget.max_iter; iter++) {
+        if (!budget.fits(iter, start)) {
+            ws.out_of_time = true;
+            break;
+        }
+        ws.iterations = iter + 1;
+
         // Save old W
-        Matrix W_last = W;
+        std::copy(ws.W.data.begin(), ws.W.data.end(), ws.W_last.data.begin());
 
         // WX = W * whitened_data ( shape: (num_components x n_samples) )
-        Matrix WX = matMul(W, whitened_data);
-
-        // Apply g(x) = tanh(x) element-wise
-        Matrix gWX(WX.rows, WX.cols);
-        Matrix gWXprime(WX.rows, WX.cols);
-        for (int r = 0; r < WX.rows; r++) {
-            for (int c = 0; c < WX.cols; c++) {
-                float val = at(WX, r, c);
-                float t   = std::tanh(val);
-                at(gWX, r, c)      = t;
-                at(gWXprime, r, c) = 1.0f - t*t; // derivative of tanh
-            }
-        }
+        // (the parallel pass computes it block by block inside the contrast job)
+        if (!parallel) gemm(ws.W, Trans::No, ws.whitened, Trans::No, ws.WX);
 
         // Compute W_new:
         //   W_new = (gWX * whitened_data^T)/n_samples - diag(mean(g'(WX), axis=1)) * W
-        // First part: gWX * whitened_data^T
-        Matrix whitened_data_T = transpose(whitened_data); // (n_samples x n_features)
-        Matrix gWX_whitened = matMul(gWX, whitened_data_T); // (num_components x n_features)
-        Matrix firstPart = matDiv(gWX_whitened, (float)n_samples);
-
-        // We also need mean of g'(WX) row-wise => shape (num_components)
-        std::vector<float> mean_gWXprime(gWX.rows, 0.0f);
-        for (int r = 0; r < gWX.rows; r++) {
-            float sum = 0.0f;
-            for (int c = 0; c < gWX.cols; c++) {
-                sum += at(gWXprime, r, c);
+        // g(WX), mean g'(WX) and the first product come out of one fused pass
+        {
+            ICA_PROFILE_SCOPE(Contrast);
+            if (parallel) {
+                fusedIterationParallel(ws, contrast, 1.0f / (float)n_samples);
+            } else {
+                contrastKernel(ws.WX, ws.whitened, contrast, ws.mean_gprime.data(), ws.W_new,
+                               1.0f / (float)n_samples);
             }
-            mean_gWXprime[r] = sum / gWX.cols;
-        }
-
-        // Subtract diag(...) * W
-        Matrix secondPart = W; // we'll scale row i by mean_gWXprime[i]
-        for (int r = 0; r < secondPart.rows; r++) {
-            for (int c = 0; c < secondPart.cols; c++) {
-                at(secondPart, r, c) *= mean_gWXprime[r];
+            for (int r = 0; r < ws.W_new.rows; r++) {
+                for (int c = 0; c < ws.W_new.cols; c++) {
+                    at(ws.W_new, r, c) -= ws.mean_gprime[r] * at(ws.W, r, c);
+                }
             }
         }
 
-        Matrix W_new = matSub(firstPart, secondPart);
-
         // Symmetric decorrelation
-        W = symmetricDecorrelation(W_new);
+        {
+            ICA_PROFILE_SCOPE(Decorrelate);
+            symmetricDecorrelationInto(ws.W_new, ws.W, ws);
+        }
 
         // Check for convergence
-        // We look at ||W - W_last||
-        Matrix diff = matSub(W, W_last);
-        float dist = frobeniusNorm(diff);
-        if (dist < tol) {
+        // |cos(w_i, w_last_i)| is 1 once row i stops turning; the abs lets a
+        // component flip sign between iterations (which FastICA does freely)
+        // and still count as converged. Rows are unit vectors up to the
+        // decorrelation's round-off, which the norms divide out.
+        float lim = 0.0f;
+        for (int r = 0; r < ws.W.rows; r++) {
+            float dot = 0.0f, n1 = 0.0f, n2 = 0.0f;
+            for (int c = 0; c < ws.W.cols; c++) {
+                dot += at(ws.W, r, c) * at(ws.W_last, r, c);
+                n1 += at(ws.W, r, c) * at(ws.W, r, c);
+                n2 += at(ws.W_last, r, c) * at(ws.W_last, r, c);
+            }
+            lim = std::max(lim, std::fabs(std::fabs(dot) / std::sqrt(n1 * n2) - 1.0f));
+        }
+        if (lim < tol) {
+            ws.converged = true;
             break;
         }
     }
-
-    // The independent components are in W * whitened_data, shape: (num_components x n_samples)
-    Matrix S = matMul(W, whitened_data);
-    return S; // shape => (num_components x n_samples)
 }
 
 // -----------------------------------------------------------------------------
-// Example "analogWrite" simulators
+// Deflation mode: row p of W is estimated alone, kept orthogonal to rows
+// 0..p-1 by Gram-Schmidt, and stops on its own convergence (the symmetric
+// test for a single row: | |w . w_last| - 1 | < tol). Once the budget's
+// deadline passes, the rows not yet reached keep their orthonormalized
+// starting vectors.
 // -----------------------------------------------------------------------------
-void analogWrite(int& pin, int value) {
-    pin = value;
-    std::cout << "Pin " << &pin << " set to " << value << std::endl;
+
+// v -= sum_{j<p} (v . W_j) W_j, then v /= |v|. Returns |v| before normalising
+// (v is left as is when that is 0).
+static float orthonormalizeAgainst(float* v, const Matrix& W, int p) {
+    const int dims = W.cols;
+    for (int j = 0; j < p; j++) {
+        const float* wj = &W.data[static_cast<size_t>(j) * dims];
+        float d = 0.0f;
+        for (int c = 0; c < dims; c++) d += v[c] * wj[c];
+        for (int c = 0; c < dims; c++) v[c] -= d * wj[c];
+    }
+    float len = 0.0f;
+    for (int c = 0; c < dims; c++) len += v[c] * v[c];
+    len = std::sqrt(len);
+    if (len > 0.0f) {
+        for (int c = 0; c < dims; c++) v[c] /= len;
+    }
+    return len;
+}
+
+static void deflationIteration(IcaWorkspace& ws, const IcaBudget& budget, float tol, const Matrix* W_init,
+                               const ContrastOptions& contrast) {
+    const int k = ws.num_components, dims = ws.whitened_dims;
+    const float inv_n = 1.0f / (float)ws.n_samples;
+    const IcaBudget::Clock::time_point start = IcaBudget::Clock::now();
+
+    // Starting rows: W_init as given (each is orthonormalized in turn below);
+    // &ws.W is already in place
+    if (W_init && W_init->rows == ws.W.rows && W_init->cols == ws.W.cols) {
+        if (W_init != &ws.W) std::copy(W_init->data.begin(), W_init->data.end(), ws.W.data.begin());
+    } else {
+        fillRandom(ws.W);
+    }
+    ws.iterations = 0;
+    ws.converged  = true;
+    ws.out_of_time = false;
+
+    float* w = ws.unit_w.data.data();
+    float* w_new = ws.unit_w_new.data.data();
+    for (int p = 0; p < k; p++) {
+        float* row = &ws.W.data[static_cast<size_t>(p) * dims];
+        std::copy(row, row + dims, w);
+        if (orthonormalizeAgainst(w, ws.W, p) <= 1e-6f) {
+            // Start lies in the span already found: take a unit vector outside it
+            for (int e = 0; e < dims; e++) {
+                std::fill(w, w + dims, 0.0f);
+                w[e] = 1.0f;
+                if (orthonormalizeAgainst(w, ws.W, p) > 0.5f) break;
+            }
+        }
+
+        // With one whitened direction left, orthogonality alone fixes w
+        int it = 0;
+        bool done = (p == dims - 1);
+        while (!done && it < budget.max_iter && !ws.out_of_time) {
+            if (!budget.fits(ws.iterations + it, start)) {
+                ws.out_of_time = true;
+                break;
+            }
+            it++;
+
+            // w_new = E{x g(w^T x)} - E{g'(w^T x)} w
+            gemm(ws.unit_w, Trans::No, ws.whitened, Trans::No, ws.unit_wx);
+            float gprime_mean;
+            {
+                ICA_PROFILE_SCOPE(Contrast);
+                contrastKernel(ws.unit_wx, ws.whitened, contrast, &gprime_mean, ws.unit_w_new, inv_n);
+                for (int c = 0; c < dims; c++) w_new[c] -= gprime_mean * w[c];
+            }
+            {
+                ICA_PROFILE_SCOPE(Decorrelate);
+                if (orthonormalizeAgainst(w_new, ws.W, p) == 0.0f) break;
+            }
+
+            float dot = 0.0f;
+            for (int c = 0; c < dims; c++) dot += w_new[c] * w[c];
+            std::copy(w_new, w_new + dims, w);
+            done = std::fabs(std::fabs(dot) - 1.0f) < tol;
+        }
+
+        std::copy(w, w + dims, row);
+        ws.unit_iterations[p] = it;
+        ws.iterations += it;
+        if (!done) ws.converged = false;
+    }
 }
 
 // -----------------------------------------------------------------------------
-// Example ICAProcessingTask
+// FastICA (tanh non-linearity by default; see ContrastOptions)
+//   data: (n_samples x n_features)
+//   Returns: (num_components x n_samples) => the independent components
+//
+//   The workspace overload writes everything into ws and returns ws.S; reuse
+//   the same workspace across windows to keep the hot loop allocation-free.
+//   fastICAWhitened() runs only the fixed-point iteration on data already in
+//   ws.whitened (e.g. filled by a StreamingWhitener).
+//
+//   W_init warm-starts the iteration (typically the previous window's W, or
+//   &ws.W to continue from whatever the workspace holds); it is decorrelated
+//   before use. Without it W starts random.
+//
+//   mode picks symmetric or deflation estimation, and an IcaBudget bounds the
+//   solve in iterations and wall time (see ica_options.hpp). A solve stopped
+//   by either still unmixes with its last W; with a warm start and no
+//   iteration at all that is W_init, decorrelated.
+//
+//   ws.pool, if set, spreads long windows over its threads (see IcaWorkspace);
+//   in deflation mode only the final unmixing uses it.
 // -----------------------------------------------------------------------------
-void ICAProcessingTask() {
-    // Simulated input (replace with real data streams)
-    const int num_samples = 100; // Example
-    const int num_channels = 8;  // Example
-    static float eeg_data_buffer[100][8]; 
-    // Fill with dummy data for demonstration
-    for (int i = 0; i < num_samples; i++) {
-        for (int j = 0; j < num_channels; j++) {
-            eeg_data_buffer[i][j] = std::sin(0.01f * i * (j+1)); // arbitrary wave
-        }
+const Matrix& fastICAWhitened(IcaWorkspace& ws, const IcaBudget& budget, float tol,
+                              const Matrix* W_init, const ContrastOptions& contrast, IcaMode mode) {
+    ICA_PROFILE_SCOPE(Solve);
+    const bool parallel = useParallel(ws);
+
+    if (mode == IcaMode::Deflation) {
+        deflationIteration(ws, budget, tol, W_init, contrast);
+    } else {
+        symmetricIteration(ws, budget, tol, W_init, contrast, parallel);
     }
 
-    // Example "pins"
-    int GAIN_PIN_1 = 0;
-    int GAIN_PIN_2 = 0;
+    ICA_PROFILE_COUNT(Solves, 1);
+    ICA_PROFILE_COUNT(Iterations, ws.iterations);
+    ICA_PROFILE_COUNT(NotConverged, ws.converged ? 0 : 1);
+    ICA_PROFILE_COUNT(OutOfTime, ws.out_of_time ? 1 : 0);
 
-    while (true) {
-        // Simulate waiting for new data
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // The independent components are in W * whitened_data, shape: (num_components x n_samples)
+    if (parallel) {
+        unmixParallel(ws);
+    } else {
+        gemm(ws.W, Trans::No, ws.whitened, Trans::No, ws.S);
+    }
+    return ws.S; // shape => (num_components x n_samples)
+}
 
-        // Convert buffer into our Matrix: shape (num_samples x num_channels)
-        Matrix eeg_data(num_samples, num_channels);
-        for (int i = 0; i < num_samples; i++) {
-            for (int j = 0; j < num_channels; j++) {
-                at(eeg_data, i, j) = eeg_data_buffer[i][j];
-            }
-        }
+const Matrix& fastICAWhitened(IcaWorkspace& ws, int max_iter, float tol,
+                              const Matrix* W_init, const ContrastOptions& contrast, IcaMode mode) {
+    return fastICAWhitened(ws, IcaBudget(max_iter), tol, W_init, contrast, mode);
+}
 
-        // Perform FastICA => 2 components
-        Matrix ica_components = fastICA(eeg_data, 2);
+const Matrix& fastICA(const Matrix& data, int num_components, IcaWorkspace& ws,
+                      int max_iter, float tol, const Matrix* W_init,
+                      const ContrastOptions& contrast, IcaMode mode) {
+    return fastICA(data, num_components, ws, IcaBudget(max_iter), tol, W_init, contrast, mode);
+}
 
-        // ica_components shape = (2 x num_samples)
-        // We'll interpret col(0) as the first sample, so let's turn them into 2 vectors:
-        // but in the original code, they took the first 2 columns from a (num_samples x 2) matrix.
-        // Our S is (2 x num_samples). We want each row as a component across samples.
-        // We'll take row 0 => component 1, row 1 => component 2.
-        // Then compute min, max, mean, etc.
-        // For consistency with original code's approach:
-        // "component_1 = ica_components.col(0)" => old code used column 0 as the first component
-        // Now our first component is row(0).
-        // We'll define a helper to get row stats.
+const Matrix& fastICA(const Matrix& data, int num_components, IcaWorkspace& ws,
+                      const IcaBudget& budget, float tol, const Matrix* W_init,
+                      const ContrastOptions& contrast, IcaMode mode) {
+    ws.prepare(data.rows, data.cols, num_components);
 
-        auto getRow = [&](const Matrix& M, int rowIndex) {
-            std::vector<float> rowVals(M.cols);
-            for (int c = 0; c < M.cols; c++) {
-                rowVals[c] = at(M, rowIndex, c);
-            }
-            return rowVals;
-        };
+    // 1. Center and whiten
+    centerDataInto(data, ws.mean, ws.centered);   // (n_samples x n_features)
+    whitenDataInto(ws);                           // ws.whitened: (k x n_samples)
 
-        auto minVal = [](const std::vector<float>& v){
-            float m = v[0];
-            for (auto x : v) if (x < m) m = x;
-            return m;
-        };
-        auto maxVal = [](const std::vector<float>& v){
-            float m = v[0];
-            for (auto x : v) if (x > m) m = x;
-            return m;
-        };
-        auto meanVal = [](const std::vector<float>& v){
-            float s = 0.0f;
-            for (auto x : v) s += x;
-            return s / v.size();
-        };
+    return fastICAWhitened(ws, budget, tol, W_init, contrast, mode);
+}
+
+Matrix fastICA(const Matrix& data, int num_components, int max_iter, float tol) {
+    IcaWorkspace ws(data.rows, data.cols, num_components);
+    return fastICA(data, num_components, ws, max_iter, tol);
+}
 
-        std::vector<float> comp1 = getRow(ica_components, 0);
-        std::vector<float> comp2 = getRow(ica_components, 1);
+#ifndef ICA_ENGINE_LIBRARY
+// Demo task and entry point below are left out when this file is built as
+// the ica_engine library.
 
-        float c1_min = minVal(comp1);
-        float c1_max = maxVal(comp1);
-        float c1_mean = meanVal(comp1);
+// -----------------------------------------------------------------------------
+// Example acquisition task
+//   Publishes one frame per millisecond into a lock-free ring; an IcaPipeline
+//   drains it on a scheduler worker and publishes its gains to the output
+//   stage (see gain_output.hpp). Run with --ingest SPEC to fill the ring
+//   from the headband instead (see emg_transport.hpp), or with
+//   --replay FILE[@SPEED] to play a recording (see emg_recording.hpp).
+// -----------------------------------------------------------------------------
+const int demo_channels = 5;                // headband channels (EMG_CH)
+using DemoRing = SpscFrameRing<float, demo_channels, 1024>;
+
+void AcquisitionTask(DemoRing& ring) {
+    long sample_clock = 0;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        float* frame = ring.beginWrite();
+        if (frame) {
+            for (int j = 0; j < demo_channels; j++) {
+                frame[j] = (float)std::sin(0.01 * sample_clock * (j+1)); // arbitrary wave
+            }
+            ring.publish();
+        }
+        sample_clock++;
+    }
+}
 
-        float c2_min = minVal(comp2);
-        float c2_max = maxVal(comp2);
-        float c2_mean = meanVal(comp2);
+// One input stream: its ring, whatever fills it, its pipeline and gain port
+struct DemoStream {
+    std::string name;
+    std::unique_ptr<DemoRing> ring = std::make_unique<DemoRing>();
+    std::unique_ptr<ingest::EmgIngest<DemoRing>> ingest;
+    std::unique_ptr<recording::RecordingReplay<DemoRing>> replay;
+    uint64_t frames = 0;                    // replay length
+    bool full_speed = false;                // replay @0: solve every hop
+    std::unique_ptr<RingSource<DemoRing>> source;
+    std::unique_ptr<IcaPipeline> pipeline;
+    output::GainPort* port = nullptr;
+};
 
-        // Normalize [mean] to [0..255] using min,max
-        float gain_1 = 0.f;
-        if (c1_max > c1_min) {
-            gain_1 = (c1_mean - c1_min) / (c1_max - c1_min) * 255.f;
+// Usage: mainprocess_internal [--workers N] [--mode symmetric|deflation]
+//                             [--calibrate N] [--output SINK]... [STREAM...]
+//   STREAM: --ingest SPEC [--record FILE] | --replay FILE[@SPEED]
+//   Every stream gets its own ring, pipeline and gain port; all of them
+//   share one scheduler with N worker threads (default 1). Without a
+//   stream the synthetic AcquisitionTask feeds a single pipeline.
+//   Each --output adds a sink (gain_output.hpp) to every stream's port,
+//   default stdout.
+//   SPEED 1 (default) plays at the recorded pace, 0 as fast as ICA keeps up
+//   --calibrate N runs the pipelines two-rate, re-estimating the unmixing in
+//   the background on the last N frames (see ica_pipeline.hpp)
+int main(int argc, char** argv) {
+    int workers = 1;
+    IcaMode mode = IcaMode::Symmetric;
+    int calibrate = 0;
+    std::vector<std::string> outputs;
+    std::vector<std::unique_ptr<DemoStream>> streams;
+    bool live = false;
+
+    // Every option takes a value
+    static const char* const kOptions[] = {"--workers", "--mode", "--calibrate", "--output",
+                                           "--ingest", "--record", "--replay"};
+    for (int i = 1; i < argc; i += 2) {
+        std::string opt = argv[i];
+        if (std::find(std::begin(kOptions), std::end(kOptions), opt) == std::end(kOptions)) {
+            std::cerr << "unknown option " << opt << std::endl;
+            return 2;
         }
-        float gain_2 = 0.f;
-        if (c2_max > c2_min) {
-            gain_2 = (c2_mean - c2_min) / (c2_max - c2_min) * 255.f;
+        if (i + 1 >= argc) {
+            std::cerr << opt << " needs a value" << std::endl;
+            return 2;
         }
+        std::string value = argv[i + 1];
+        if (opt == "--workers") {
+            workers = std::max(1, std::atoi(value.c_str()));
+        } else if (opt == "--mode") {
+            if (value != "symmetric" && value != "deflation") {
+                std::cerr << "--mode must be symmetric or deflation" << std::endl;
+                return 2;
+            }
+            mode = (value == "deflation") ? IcaMode::Deflation : IcaMode::Symmetric;
+        } else if (opt == "--calibrate") {
+            calibrate = std::max(0, std::atoi(value.c_str()));
+        } else if (opt == "--output") {
+            outputs.push_back(value);
+        } else if (opt == "--ingest") {
+            std::string error;
+            auto transport = ingest::makeTransport(value, &error);
+            if (!transport) {
+                std::cerr << value << ": " << error << std::endl;
+                return 1;
+            }
+            std::cerr << "ingest: " << transport->describe() << std::endl;
+            auto st = std::make_unique<DemoStream>();
+            st->name = value;
+            st->ingest = std::make_unique<ingest::EmgIngest<DemoRing>>(*st->ring, std::move(transport));
+            st->source = std::make_unique<RingSource<DemoRing>>(*st->ring);
+            streams.push_back(std::move(st));
+            live = true;
+        } else if (opt == "--record") {
+            if (streams.empty() || !streams.back()->ingest) {
+                std::cerr << "--record needs a preceding --ingest" << std::endl;
+                return 2;
+            }
+            auto capture = std::make_unique<ingest::CaptureWriter>(value);
+            if (!capture->ok()) {
+                std::cerr << value << ": cannot create capture" << std::endl;
+                return 1;
+            }
+            streams.back()->ingest->record(std::move(capture));
+        } else if (opt == "--replay") {
+            double speed = 1.0;
+            size_t at = value.rfind('@');
+            std::string path = value;
+            if (at != std::string::npos) {
+                speed = std::atof(value.c_str() + at + 1);
+                path.resize(at);
+            }
+            std::string error;
+            auto rec = recording::Recording::open(path, &error);
+            if (!rec) {
+                std::cerr << path << ": " << error << std::endl;
+                return 1;
+            }
+            auto st = std::make_unique<DemoStream>();
+            st->name = path;
+            st->frames = rec->frames();
+            st->replay = std::make_unique<recording::RecordingReplay<DemoRing>>(*st->ring, std::move(rec), speed);
+            st->source = std::make_unique<RingSource<DemoRing>>(*st->ring, &st->replay->finishedFlag());
+            st->full_speed = (speed <= 0.0);
+            streams.push_back(std::move(st));
+        }
+    }
 
-        // Output to simulated pins
-        analogWrite(GAIN_PIN_1, (int)gain_1);
-        analogWrite(GAIN_PIN_2, (int)gain_2);
+    bool synthetic = false;
+    if (streams.empty()) {
+        auto st = std::make_unique<DemoStream>();
+        st->name = "demo";
+        st->source = std::make_unique<RingSource<DemoRing>>(*st->ring);
+        streams.push_back(std::move(st));
+        synthetic = true;
+        live = true;
+    }
 
-        // Short delay
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Gains leave through the output thread: the pipelines only publish
+    // targets, which it smooths and writes at 1 kHz
+    if (outputs.empty()) outputs.push_back("stdout");
+    output::GainStage gain_stage;
+    for (auto& st : streams) {
+        std::vector<std::unique_ptr<output::Sink>> sinks;
+        for (const auto& spec : outputs) {
+            std::string error;
+            auto sink = output::makeSink(spec, &error);
+            if (!sink) {
+                std::cerr << spec << ": " << error << std::endl;
+                return 1;
+            }
+            std::cerr << "output: " << sink->describe() << std::endl;
+            sinks.push_back(std::move(sink));
+        }
+        st->port = &gain_stage.addPort(st->name, 2, std::move(sinks));
+    }
+
+    // 100-sample windows, 2 components, a hop of ~10 frames due within 10 ms
+    PipelineScheduler scheduler(workers);
+    for (auto& st : streams) {
+        PipelineConfig cfg;
+        cfg.name = st->name;
+        cfg.drain = !st->full_speed;        // paced replays behave like live input
+        cfg.mode = mode;
+        cfg.calibration_window = calibrate;
+        output::GainPort* port = st->port;
+        st->pipeline = std::make_unique<IcaPipeline>(cfg, *st->source, [port](const float* gains, int n) {
+            port->publish(gains, n);
+        });
+        scheduler.add(*st->pipeline);
     }
-}
 
-int main() {
-    ICAProcessingTask();
+#ifdef ICA_PROFILE
+    // Stage histograms go to stderr every few seconds and can be queried any
+    // time with: nc -U /tmp/ica_profile.sock < /dev/null
+    profile::QueryServer profile_server("/tmp/ica_profile.sock");
+#endif
+
+    const auto t0 = std::chrono::steady_clock::now();
+    gain_stage.start();
+    scheduler.start();
+    std::thread acquisition;
+    if (synthetic) acquisition = std::thread(AcquisitionTask, std::ref(*streams[0]->ring));
+    for (auto& st : streams) {
+        if (st->ingest) st->ingest->start();
+        if (st->replay) st->replay->start();
+    }
+    while (live || !scheduler.allDone()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+#ifdef ICA_PROFILE
+        profile::dumpIfDue(std::cerr, std::chrono::seconds(5));
+#endif
+    }
+    scheduler.stop();
+    gain_stage.stop();
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    for (size_t i = 0; i < streams.size(); i++) {
+        const DemoStream& st = *streams[i];
+        if (!st.replay) continue;
+        PipelineStats ps = scheduler.stats(static_cast<int>(i));
+        std::cerr << st.name << ": replayed " << st.replay->played() << "/" << st.frames << " frames in "
+                  << s << " s, " << st.ring->dropped() << " dropped, " << ps.hops << " hops, "
+                  << ps.deadline_misses << " late (max " << ps.latency_max_ns / 1000 << " us)" << std::endl;
+    }
     return 0;
 }
+#endif // ICA_ENGINE_LIBRARY
@@ -0,0 +1,582 @@
+#pragma once
+// Hand-rolled FastICA engine for the ground unit (no external dependencies).
+// Implementation in mainprocess_internal.cpp; the Eigen engine lives in
+// mainprocess.cpp / mainprocess.hpp.
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+#include "ica_options.hpp"
+
+class ThreadPool;   // thread_pool.hpp
+
+// -----------------------------------------------------------------------------
+// Basic Matrix structure and utility functions
+// -----------------------------------------------------------------------------
+struct Matrix {
+    int rows;
+    int cols;
+    std::vector<float> data; // row-major
+
+    Matrix(int r, int c) : rows(r), cols(c), data(r * c, 0.0f) {}
+};
+
+inline float& at(Matrix& M, int r, int c) {
+    return M.data[r * M.cols + c];
+}
+
+inline float  at(const Matrix& M, int r, int c) {
+    return M.data[r * M.cols + c];
+}
+
+void   reshape(Matrix& M, int rows, int cols);
+void   fillRandom(Matrix& M, float min_val = -1.0f, float max_val = 1.0f);
+Matrix randomMatrix(int rows, int cols, float min_val = -1.0f, float max_val = 1.0f);
+void   printMatrix(const Matrix& M, const std::string& name = "Matrix");
+
+// -----------------------------------------------------------------------------
+// Matrix Arithmetic
+// -----------------------------------------------------------------------------
+enum class Trans { No, Yes };
+
+// C = alpha * op(A) * op(B); C must already have the result shape and must
+// not alias A or B. Transposed operands are read in place.
+void   gemm(const Matrix& A, Trans ta, const Matrix& B, Trans tb, Matrix& C, float alpha = 1.0f);
+Matrix matMul(const Matrix& A, const Matrix& B);     // A * B
+Matrix matMulABt(const Matrix& A, const Matrix& B);  // A * B^T
+Matrix matMulAtB(const Matrix& A, const Matrix& B);  // A^T * B
+Matrix transpose(const Matrix& A);
+Matrix matDiv(const Matrix& A, float val);
+Matrix matSub(const Matrix& A, const Matrix& B);
+Matrix matAdd(const Matrix& A, const Matrix& B);
+void   setIdentity(Matrix& M, int size);
+Matrix identity(int size);
+float  frobeniusNorm(const Matrix& A);
+
+// -----------------------------------------------------------------------------
+// FastICA contrast functions
+//   G(u)          g(u) = G'(u)              g'(u)
+//   LogCosh       tanh(a u)                 a (1 - g^2)
+//   Cube (kurt.)  u^3                       3 u^2
+//   Gauss (exp)   u exp(-u^2/2)             (1 - u^2) exp(-u^2/2)
+//
+//   tanh is evaluated with a SIMD rational approximation whose accuracy is
+//   selectable (max abs error vs std::tanh over all inputs):
+//     Precise  ~1e-6   [13/6] minimax rational, same form Eigen uses
+//     Medium   ~1e-4   [7/6] Lambert continued fraction
+//     Fast     ~2e-2   [3/2] Pade; clamps at |u| = 3
+//   Cube and Gauss are cheaper still and sometimes more robust (Gauss) or
+//   better for sub-Gaussian sources (Cube).
+// -----------------------------------------------------------------------------
+enum class Contrast { LogCosh, Cube, Gauss };
+enum class TanhAccuracy { Precise, Medium, Fast };
+
+struct ContrastOptions {
+    Contrast     contrast = Contrast::LogCosh;
+    TanhAccuracy accuracy = TanhAccuracy::Precise;
+    float        alpha    = 1.0f;   // LogCosh scale, usually in [1, 2]
+};
+
+// One pass over WX (k x N) against X (C x N): WX <- g(WX),
+// gprime_mean[r] = mean g'(WX[r, :]), GX (k x C) = scale * g(WX) * X^T.
+void contrastKernel(Matrix& WX, const Matrix& X, const ContrastOptions& opt,
+                    float* gprime_mean, Matrix& GX, float scale);
+
+// -----------------------------------------------------------------------------
+// Mean / Centering / Covariance
+// -----------------------------------------------------------------------------
+void   columnMeanInto(const Matrix& data, Matrix& mean);
+Matrix columnMean(const Matrix& data);
+void   centerDataInto(const Matrix& data, Matrix& mean, Matrix& centered);
+Matrix centerData(const Matrix& data);
+void   covarianceInto(const Matrix& X, Matrix& Cov);
+Matrix covariance(const Matrix& X);
+
+// -----------------------------------------------------------------------------
+// Symmetric EVD: A = V * D * V^T, eigenvalues on diag(D) in descending order.
+// symmetricEVD() uses cyclic Jacobi up to EVD_JACOBI_MAX_N and
+// Householder + implicit QL above it.
+// -----------------------------------------------------------------------------
+struct EvdResult {
+    int  sweeps;     // Jacobi sweeps, or total implicit-QL iterations
+    bool converged;
+    int  rotations = 0; // Jacobi rotations applied (0 for QL)
+};
+
+constexpr int EVD_JACOBI_MAX_N = 12;
+
+EvdResult jacobiEVD(const Matrix& A, Matrix& V, Matrix& D, int maxSweeps = 50, float tol = 1e-6f);
+EvdResult tridiagonalQLEVD(const Matrix& A, Matrix& V, Matrix& D, int maxIterPerEig = 30);
+EvdResult symmetricEVD(const Matrix& A, Matrix& V, Matrix& D);
+
+Matrix diagVector(const Matrix& M);
+Matrix diagMatrix(const Matrix& vec);
+Matrix sqrtVector(const Matrix& vec);
+Matrix invVector(const Matrix& vec);
+// out = V * D^{-1/2} * V^T; scaledV receives V * D^{-1/2}
+void   inverseSqrtFromEVD(const Matrix& V, const Matrix& D, Matrix& scaledV, Matrix& out);
+
+// -----------------------------------------------------------------------------
+// Top-k eigenpairs of a symmetric PSD A (n x n) by subspace iteration:
+//   Q <- orth(A Q), with a Rayleigh-Ritz step (EVD of the k x k Q^T A Q) every
+//   iteration, until ||A q_i - lambda_i q_i|| <= tol * lambda_1 for all i.
+//   Q^T A Q is diagonal after every Rayleigh-Ritz step, so whitening with
+//   the result is exact even when the subspace has not fully converged.
+//   V (n x k) receives the eigenvectors, D (k x k) the eigenvalues on its
+//   diagonal, descending. With warm_start, a V already n x k seeds Q (e.g.
+//   the previous window's); otherwise Q starts from the k columns of A with
+//   the largest diagonal. Cost per iteration O(n^2 k).
+// -----------------------------------------------------------------------------
+struct SubspaceScratch {
+    Matrix AQ{0, 0};            // n x k
+    Matrix T{0, 0};             // k x k Rayleigh quotient, then its EVD
+    Matrix TV{0, 0};
+    Matrix TD{0, 0};
+    Matrix rotated{0, 0};       // n x k
+};
+
+EvdResult topEigenpairs(const Matrix& A, int k, Matrix& V, Matrix& D, SubspaceScratch& scratch,
+                        bool warm_start = false, int maxIter = 100, float tol = 1e-5f);
+
+// The leading k eigenpairs of a covariance, by whichever solver is cheaper:
+// topEigenpairs when k < n and n is past the fixed-size Jacobi, else
+// symmetricEVD (V, D then hold all n pairs, the leading k first)
+EvdResult leadingEigenpairs(const Matrix& A, int k, Matrix& V, Matrix& D, SubspaceScratch& scratch,
+                            bool warm_start = false);
+
+// PCA whitening from the leading k eigenpairs (V: n x m, D: m x m, m >= k):
+// out (k x n) = D_k^{-1/2} V_k^T. Zero or negative eigenvalues give zero rows.
+void   whiteningFromEVD(const Matrix& V, const Matrix& D, int k, Matrix& out);
+
+// -----------------------------------------------------------------------------
+// IcaWorkspace
+//   Every buffer the solver touches, sized once for
+//   (n_samples, n_features, num_components). fastICA(data, k, ws) runs
+//   entirely inside it: once a workspace has seen a window shape, further
+//   windows of that shape do no heap allocation at all.
+//
+//   Whitening keeps only the num_components leading principal directions
+//   (whitened_dims rows; all n_features when num_components is 0, as for
+//   whitenData), so the iteration works on k x n_samples and W is k x k.
+//
+//   With a pool attached, windows of at least ICA_PARALLEL_MIN_SAMPLES split
+//   W * X, the contrast pass and g(WX) * X^T into blocks of
+//   ICA_PARALLEL_BLOCK samples. The block size does not depend on the thread
+//   count and partial sums are added in block order, so a pool of any size
+//   gives the same result.
+// -----------------------------------------------------------------------------
+constexpr int ICA_PARALLEL_MIN_SAMPLES = 2048;
+constexpr int ICA_PARALLEL_BLOCK = 512;
+
+struct IcaWorkspace {
+    int n_samples      = 0;
+    int n_features     = 0;
+    int num_components = 0;
+    int whitened_dims  = 0;     // num_components, or n_features if that is 0
+
+    // Preprocessing
+    Matrix mean{0, 0};          // 1 x n_features
+    Matrix centered{0, 0};      // n_samples x n_features
+    Matrix cov{0, 0};           // n_features x n_features
+    Matrix evdV{0, 0};          // EVD eigenvectors (n_features x whitened_dims, reused for k x k)
+    Matrix evdD{0, 0};          // EVD working matrix / eigenvalues
+    Matrix scaledV{0, 0};       // V * D^{-1/2}
+    SubspaceScratch subspace;   // top-k EVD of cov
+    Matrix whiteningMat{0, 0};  // whitened_dims x n_features
+    Matrix whitened{0, 0};      // whitened_dims x n_samples
+
+    // Iteration
+    Matrix W{0, 0};             // num_components x whitened_dims
+    Matrix W_last{0, 0};
+    Matrix W_new{0, 0};
+    Matrix WX{0, 0};            // num_components x n_samples (g(WX) is written in place)
+    std::vector<float> mean_gprime; // num_components
+
+    // Symmetric decorrelation
+    Matrix M{0, 0};             // num_components x num_components
+    Matrix M_inv_sqrt{0, 0};
+
+    // Deflation (one unit at a time)
+    Matrix unit_w{0, 0};        // 1 x whitened_dims
+    Matrix unit_wx{0, 0};       // 1 x n_samples (g(w^T X) in place)
+    Matrix unit_w_new{0, 0};    // 1 x whitened_dims
+    std::vector<int> unit_iterations; // per component, last deflation solve
+
+    // Output
+    Matrix S{0, 0};             // num_components x n_samples
+    int  iterations = 0;        // iterations used by the last solve (deflation: summed over components)
+    bool converged  = false;
+    bool out_of_time = false;   // the last solve stopped at its budget's deadline
+
+    // Parallel kernels (optional, not owned)
+    ThreadPool* pool = nullptr;
+    std::vector<float> block_partials; // per sample block: k g' sums, then k x whitened_dims of g(WX) X^T
+
+    IcaWorkspace() = default;
+    IcaWorkspace(int samples, int features, int components) {
+        prepare(samples, features, components);
+    }
+
+    // Size every buffer for the given problem. Cheap when the shape is unchanged.
+    // Throws std::runtime_error if components is negative or exceeds features.
+    void prepare(int samples, int features, int components) {
+        if (samples == n_samples && features == n_features && components == num_components) {
+            return;
+        }
+        if (components < 0 || components > features) {
+            throw std::runtime_error("IcaWorkspace: components must be in [0, features]");
+        }
+        n_samples = samples;
+        n_features = features;
+        num_components = components;
+        whitened_dims = (components > 0) ? components : features;
+        const int dims = whitened_dims;
+        int big = std::max(features, components);
+
+        reshape(mean, 1, features);
+        reshape(centered, samples, features);
+        reshape(cov, features, features);
+        evdV.data.reserve(static_cast<size_t>(big) * big);
+        evdD.data.reserve(static_cast<size_t>(big) * big);
+        scaledV.data.reserve(static_cast<size_t>(big) * big);
+        reshape(subspace.AQ, features, dims);
+        reshape(subspace.rotated, features, dims);
+        reshape(subspace.T, dims, dims);
+        subspace.TV.data.reserve(static_cast<size_t>(dims) * dims);
+        subspace.TD.data.reserve(static_cast<size_t>(dims) * dims);
+        reshape(whiteningMat, dims, features);
+        reshape(whitened, dims, samples);
+
+        reshape(W, components, dims);
+        reshape(W_last, components, dims);
+        reshape(W_new, components, dims);
+        reshape(WX, components, samples);
+        mean_gprime.assign(components, 0.0f);
+
+        reshape(M, components, components);
+        reshape(M_inv_sqrt, components, components);
+
+        reshape(unit_w, 1, dims);
+        reshape(unit_wx, 1, samples);
+        reshape(unit_w_new, 1, dims);
+        unit_iterations.assign(components, 0);
+
+        reshape(S, components, samples);
+
+        size_t blocks = (samples >= ICA_PARALLEL_MIN_SAMPLES)
+                            ? (samples + ICA_PARALLEL_BLOCK - 1) / ICA_PARALLEL_BLOCK : 0;
+        block_partials.assign(blocks * components * (1 + dims), 0.0f);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Whitening / decorrelation / FastICA
+// -----------------------------------------------------------------------------
+void   whitenDataInto(IcaWorkspace& ws);          // ws.centered -> ws.whitened
+Matrix whitenData(const Matrix& data_centered);   // (n_features x n_samples)
+void   symmetricDecorrelationInto(const Matrix& W_in, Matrix& W_out, IcaWorkspace& ws);
+Matrix symmetricDecorrelation(const Matrix& W_in);
+
+// Fixed-point iteration on ws.whitened; returns ws.S (num_components x n_samples).
+// Converged once max_i | |w_i . w_last_i| - 1 | < tol over the rows of W.
+const Matrix& fastICAWhitened(IcaWorkspace& ws, int max_iter = 1000, float tol = 1e-5,
+                              const Matrix* W_init = nullptr,
+                              const ContrastOptions& contrast = ContrastOptions(),
+                              IcaMode mode = IcaMode::Symmetric);
+// Anytime variant: stops at the budget (see IcaBudget) with the best W so far;
+// ws.converged, ws.iterations and ws.out_of_time describe how it ended
+const Matrix& fastICAWhitened(IcaWorkspace& ws, const IcaBudget& budget, float tol = 1e-5,
+                              const Matrix* W_init = nullptr,
+                              const ContrastOptions& contrast = ContrastOptions(),
+                              IcaMode mode = IcaMode::Symmetric);
+// Center + whiten data (n_samples x n_features), then iterate inside ws
+const Matrix& fastICA(const Matrix& data, int num_components, IcaWorkspace& ws,
+                      int max_iter = 1000, float tol = 1e-5, const Matrix* W_init = nullptr,
+                      const ContrastOptions& contrast = ContrastOptions(),
+                      IcaMode mode = IcaMode::Symmetric);
+const Matrix& fastICA(const Matrix& data, int num_components, IcaWorkspace& ws,
+                      const IcaBudget& budget, float tol = 1e-5, const Matrix* W_init = nullptr,
+                      const ContrastOptions& contrast = ContrastOptions(),
+                      IcaMode mode = IcaMode::Symmetric);
+Matrix fastICA(const Matrix& data, int num_components, int max_iter = 1000, float tol = 1e-5);
+
+// -----------------------------------------------------------------------------
+// Component tracking across windows
+//   ICA returns sources in arbitrary order and sign. The tracker keeps the
+//   previous window's unmixing rows in channel space (W * whitening, unit
+//   norm) and, after each solve, greedily pairs every new component with the
+//   old one it is most correlated with (|cosine|), then permutes and flips
+//   the rows of ws.W and ws.S so component i stays component i with a stable
+//   sign. Comparing in channel space keeps the match valid even when the
+//   whitening matrix has been re-derived between windows.
+// -----------------------------------------------------------------------------
+class ComponentTracker {
+public:
+    ComponentTracker(int num_components, int n_features)
+        : k_(num_components), cur_(num_components, n_features), ref_(num_components, n_features),
+          perm_(num_components, 0), sign_(num_components, 1.0f), used_(num_components, 0) {}
+
+    // Align ws.W / ws.S to the previous window. Returns the mean |correlation|
+    // of the chosen matches (1.0 on the first window). A non-finite solve
+    // (NaN or inf in W or the whitening) is left as is, returns 0 and resets
+    // the tracker, so the next finite window starts a new reference.
+    float align(IcaWorkspace& ws, const Matrix& whitening) {
+        // cur = W * whitening, rows normalised
+        reshape(cur_, ws.W.rows, whitening.cols);
+        gemm(ws.W, Trans::No, whitening, Trans::No, cur_);
+        for (int r = 0; r < cur_.rows; r++) {
+            float* row = &cur_.data[static_cast<size_t>(r) * cur_.cols];
+            float n2 = 0.0f;
+            for (int c = 0; c < cur_.cols; c++) n2 += row[c] * row[c];
+            if (!std::isfinite(n2)) {
+                reset();
+                return 0.0f;
+            }
+            float inv = (n2 > 0.0f) ? 1.0f / std::sqrt(n2) : 0.0f;
+            for (int c = 0; c < cur_.cols; c++) row[c] *= inv;
+        }
+
+        if (!have_ref_ || ref_.rows != cur_.rows || ref_.cols != cur_.cols) {
+            reshape(ref_, cur_.rows, cur_.cols);
+            std::copy(cur_.data.begin(), cur_.data.end(), ref_.data.begin());
+            for (int i = 0; i < k_; i++) {
+                perm_[i] = i;
+                sign_[i] = 1.0f;
+            }
+            have_ref_ = true;
+            return 1.0f;
+        }
+
+        // Greedy assignment: for each old slot take the best unused new component
+        std::fill(used_.begin(), used_.end(), 0);
+        float total = 0.0f;
+        for (int old_i = 0; old_i < k_; old_i++) {
+            // Start from the first unused component, so a slot always gets one
+            int best = -1;
+            float best_abs = -1.0f, best_val = 0.0f;
+            for (int j = 0; j < k_; j++) {
+                if (used_[j]) continue;
+                if (best < 0) {
+                    best = j;
+                    best_abs = 0.0f;
+                }
+                float corr = 0.0f;
+                for (int c = 0; c < cur_.cols; c++) corr += at(ref_, old_i, c) * at(cur_, j, c);
+                if (std::isfinite(corr) && std::fabs(corr) > best_abs) {
+                    best_abs = std::fabs(corr);
+                    best_val = corr;
+                    best = j;
+                }
+            }
+            used_[best] = 1;
+            perm_[old_i] = best;
+            sign_[old_i] = (best_val < 0.0f) ? -1.0f : 1.0f;
+            total += best_abs;
+        }
+
+        permuteRows(ws.W, ws.W_last);
+        permuteRows(ws.S, ws.WX);
+        permuteRows(cur_, ref_); // ref_ now holds the aligned current rows
+        return total / k_;
+    }
+
+    void reset() { have_ref_ = false; }
+    const std::vector<int>& permutation() const { return perm_; }
+    const std::vector<float>& signs() const { return sign_; }
+
+private:
+    // M.row(i) = sign_[i] * M_old.row(perm_[i]), using scratch (same shape) as the copy
+    void permuteRows(Matrix& M, Matrix& scratch) {
+        reshape(scratch, M.rows, M.cols);
+        std::copy(M.data.begin(), M.data.end(), scratch.data.begin());
+        for (int i = 0; i < k_; i++) {
+            const float* src = &scratch.data[static_cast<size_t>(perm_[i]) * M.cols];
+            float* dst = &M.data[static_cast<size_t>(i) * M.cols];
+            for (int c = 0; c < M.cols; c++) dst[c] = sign_[i] * src[c];
+        }
+    }
+
+    int k_;
+    bool have_ref_ = false;
+    Matrix cur_, ref_;
+    std::vector<int>   perm_;
+    std::vector<float> sign_;
+    std::vector<char>  used_;
+};
+
+// -----------------------------------------------------------------------------
+// Streaming whitening over a sliding window
+//   Keeps the last `window` frames in a ring together with running column sums
+//   and the upper triangle of the scatter matrix sum(x x^T), updated by rank-1
+//   add/remove as frames enter and leave. Each frame is whitened (without the
+//   mean) on arrival, so a hop costs O(hop * C^2) instead of O(N * C^2).
+//   The whitening matrix is only re-derived (EVD + re-whitening the ring)
+//   when the covariance has drifted more than drift_tol (relative Frobenius)
+//   from the one it was built from. Like whitenDataInto it keeps the leading
+//   `components` principal directions (all channels if 0); on wide channel
+//   counts each re-derivation warm-starts the top-k solver from the last one.
+// -----------------------------------------------------------------------------
+class StreamingWhitener {
+public:
+    StreamingWhitener(int window, int channels, int components = 0, float drift_tol = 0.05f)
+        : window_(window), channels_(channels),
+          dims_((components > 0) ? components : channels), drift_tol_(drift_tol),
+          raw_(static_cast<size_t>(window) * channels, 0.0f),
+          white_(static_cast<size_t>(window) * dims_, 0.0f),
+          sum_(channels, 0.0),
+          scatter_(static_cast<size_t>(channels) * channels, 0.0),
+          cov_(channels, channels), cov_ref_(channels, channels),
+          V_(channels, channels), D_(channels, channels),
+          whitening_(dims_, channels), mean_(1, channels),
+          white_mean_(dims_, 0.0f) {
+        if (window <= 0 || channels <= 0) {
+            throw std::runtime_error("StreamingWhitener: window and channels must be positive");
+        }
+        if (dims_ > channels) {
+            throw std::runtime_error("StreamingWhitener: components must be in [0, channels]");
+        }
+    }
+
+    // Append one frame of `channels` samples, evicting the oldest once full
+    void push(const float* frame) {
+        float* slot = &raw_[static_cast<size_t>(head_) * channels_];
+        if (count_ == window_) {
+            rankOne(slot, -1.0);
+        } else {
+            count_++;
+        }
+        std::copy(frame, frame + channels_, slot);
+        rankOne(slot, +1.0);
+        if (have_whitening_) whitenSlot(head_);
+        head_ = (head_ + 1) % window_;
+
+        // Periodically rebuild the sums from the ring to flush add/remove round-off
+        if (++since_refresh_ >= window_ * kRefreshWindows) refreshSums();
+    }
+
+    // Append `count` frames stored contiguously (count x channels)
+    void push(const float* frames, int count) {
+        for (int i = 0; i < count; i++) push(frames + static_cast<size_t>(i) * channels_);
+    }
+
+    bool ready() const { return count_ == window_; }
+    int  window() const { return window_; }
+    int  channels() const { return channels_; }
+    int  dims() const { return dims_; }        // rows of the whitened window
+
+    // Current covariance (population, same scaling as covariance()) into cov_
+    const Matrix& covariance() {
+        double inv_n = 1.0 / std::max(count_, 1);
+        for (int i = 0; i < channels_; i++) {
+            double mi = sum_[i] * inv_n;
+            mean_.data[i] = static_cast<float>(mi);
+            for (int j = i; j < channels_; j++) {
+                double c = scatter_[i * channels_ + j] * inv_n - mi * sum_[j] * inv_n;
+                at(cov_, i, j) = at(cov_, j, i) = static_cast<float>(c);
+            }
+        }
+        return cov_;
+    }
+
+    // Relative change of the covariance since the whitening matrix was built
+    float drift() {
+        if (!have_whitening_) return std::numeric_limits<float>::infinity();
+        covariance();
+        float num = 0.0f, den = 0.0f;
+        for (size_t i = 0; i < cov_.data.size(); i++) {
+            float d = cov_.data[i] - cov_ref_.data[i];
+            num += d * d;
+            den += cov_ref_.data[i] * cov_ref_.data[i];
+        }
+        return (den > 0.0f) ? std::sqrt(num / den) : std::numeric_limits<float>::infinity();
+    }
+
+    // Re-derive the whitening matrix if the covariance drifted (or force it).
+    // Returns true when a new matrix was computed.
+    bool updateWhitening(bool force = false) {
+        if (!force && drift() <= drift_tol_) return false;
+        covariance();
+        std::copy(cov_.data.begin(), cov_.data.end(), cov_ref_.data.begin());
+        last_evd_ = leadingEigenpairs(cov_, dims_, V_, D_, subspace_, have_whitening_);
+        whiteningFromEVD(V_, D_, dims_, whitening_);
+        have_whitening_ = true;
+        for (int s = 0; s < count_; s++) whitenSlot(s);
+        return true;
+    }
+
+    // Whitened, centered window in time order: out (dims x window) =
+    // whitening * (x - mean). O(N * k) copy; no products over the window.
+    void whitenedWindow(Matrix& out) {
+        if (!have_whitening_) updateWhitening(true);
+        reshape(out, dims_, count_);
+        covariance(); // refreshes mean_
+        for (int r = 0; r < dims_; r++) {
+            float acc = 0.0f;
+            for (int c = 0; c < channels_; c++) acc += at(whitening_, r, c) * mean_.data[c];
+            white_mean_[r] = acc;
+        }
+        int oldest = (count_ == window_) ? head_ : 0;
+        for (int r = 0; r < dims_; r++) {
+            const float* src = &white_[static_cast<size_t>(r) * window_];
+            float* dst = &out.data[static_cast<size_t>(r) * count_];
+            float wm = white_mean_[r];
+            int first = std::min(count_, window_ - oldest);
+            for (int i = 0; i < first; i++)          dst[i] = src[oldest + i] - wm;
+            for (int i = first; i < count_; i++)     dst[i] = src[i - first] - wm;
+        }
+    }
+
+    const Matrix& whiteningMatrix() const { return whitening_; }
+    const Matrix& mean() const { return mean_; }
+    EvdResult lastEvd() const { return last_evd_; }
+
+private:
+    static constexpr int kRefreshWindows = 16;
+
+    void rankOne(const float* x, double sign) {
+        for (int i = 0; i < channels_; i++) {
+            double xi = x[i];
+            sum_[i] += sign * xi;
+            double* row = &scatter_[static_cast<size_t>(i) * channels_];
+            for (int j = i; j < channels_; j++) row[j] += sign * xi * x[j];
+        }
+    }
+
+    void refreshSums() {
+        std::fill(sum_.begin(), sum_.end(), 0.0);
+        std::fill(scatter_.begin(), scatter_.end(), 0.0);
+        for (int s = 0; s < count_; s++) rankOne(&raw_[static_cast<size_t>(s) * channels_], +1.0);
+        since_refresh_ = 0;
+    }
+
+    // white_[:, slot] = whitening_ * raw_[slot, :]
+    void whitenSlot(int slot) {
+        const float* x = &raw_[static_cast<size_t>(slot) * channels_];
+        for (int r = 0; r < dims_; r++) {
+            float acc = 0.0f;
+            for (int c = 0; c < channels_; c++) acc += at(whitening_, r, c) * x[c];
+            white_[static_cast<size_t>(r) * window_ + slot] = acc;
+        }
+    }
+
+    int   window_;
+    int   channels_;
+    int   dims_;
+    float drift_tol_;
+    int   head_ = 0;           // next slot to write
+    int   count_ = 0;          // frames currently in the window
+    int   since_refresh_ = 0;
+    bool  have_whitening_ = false;
+
+    std::vector<float>  raw_;      // window x channels ring (row per frame)
+    std::vector<float>  white_;    // dims x window ring (whitened, uncentered)
+    std::vector<double> sum_;      // running column sums
+    std::vector<double> scatter_;  // running sum(x x^T), upper triangle used
+    Matrix cov_, cov_ref_, V_, D_, whitening_, mean_;
+    SubspaceScratch subspace_;
+    std::vector<float>  white_mean_;
+    EvdResult last_evd_{0, false};
+};
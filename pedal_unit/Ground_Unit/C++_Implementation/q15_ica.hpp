@@ -0,0 +1,550 @@
+#pragma once
+// Fixed-point FastICA for ground units without (or with a slow) FPU.
+//
+// The same steps as the float engine in mainprocess_internal.cpp: centering,
+// whitening, the symmetric fixed-point iteration with the logcosh contrast
+// (alpha = 1) and symmetric decorrelation. Everything is integer arithmetic
+// (16x16 -> 32 and 32x32 -> 64 bit products, 64-bit accumulators, arithmetic
+// right shifts) with a fixed evaluation order, so the host build and an
+// ESP32 or i.MX RT target fed the same int16_t frames produce bit-identical
+// W and S. bench/q15_ica_check.cpp is that host reference; it also checks
+// separation quality against the float engine.
+//
+// Header-only, C++11, no heap: a Q15IcaWorkspace<C, K, N> holds every
+// buffer for C channels, K components and up to N samples per window, so
+// declare it as a global/static on the target.
+//
+// Scaling (Qm = value * 2^m):
+//   input frames   int16_t ADC counts, any offset
+//   centered x     frame - window mean, saturated to int16
+//   covariance     int64 sums of x_p * x_q (exact), / n, then scaled by an
+//                  even power of two 2^-e so the trace lies in (2^28, 2^30]
+//                  (Q30, trace in (0.25, 1])
+//   EVD            cyclic Jacobi in Q30 (int32, 64-bit products); the
+//                  rotation is derived with integer square roots and
+//                  divisions, eigenvectors are Q30
+//   whitening      PCA whitening z = D^-1/2 V^T x onto the K leading
+//                  principal directions (as whitenDataInto). Each row of the
+//                  whitening matrix is an int32 mantissa with its own right
+//                  shift, so rows of very different variance keep full
+//                  precision. Eigenvalues below 2^-24 of the trace whiten to
+//                  zero (as inverseSqrtFromEVD maps zero eigenvalues)
+//   z              Q12 int16, K x n: unit variance, saturates at +-8 sigma
+//   W              Q14 int16, K x K, rows of unit norm
+//   y = W z        Q26 in int32 (|y| <= |z| <= 8 sqrt(8) < 32 for K <= 8),
+//                  rounded to Q12 int16 for the contrast
+//   g(y), g'(y)    tanh(y) from a 193-entry Q15 table over [0, 6) with
+//                  linear interpolation (error < 1.2e-4), saturated to 1 past
+//                  6; g' = 1 - g^2 in Q15
+//   E{z g(y)}      Q27, 64-bit sums divided by n
+//   W_new          Q27 (int32)
+//   decorrelation  (W W^T)^-1/2 W by the iteration
+//                  W <- 1.5 W - 0.5 W W^T W in Q28 after scaling W by a
+//                  power of two and by 1/sqrt(||W W^T||_1) so it converges;
+//                  the result is rounded to Q14
+//   S = W z        Q12 int16, saturated
+//
+// Saturation happens only where noted (centered x, z, y and S at int16);
+// ws.clipped counts the samples clipped while whitening. Convergence is the
+// float engine's max_i | |cos(w_i, w_last_i)| - 1 | < tol, with tol in units
+// of 2^-20; the cosine is taken exactly from the Q14 rows, so their rounding
+// does not count as turning. A Q15Deadline bounds a solve in time.
+#include <cstddef>
+#include <cstdint>
+
+constexpr int Q15_ICA_MAX_CHANNELS = 8;   // keeps y = W z inside int32
+
+namespace q15_detail {
+
+// x * 2^-s rounded to nearest (ties up); a left shift for s < 0
+inline int64_t shiftRound(int64_t x, int s) {
+    if (s <= 0) return x * (int64_t(1) << -s);
+    return (x + (int64_t(1) << (s - 1))) >> s;
+}
+
+// a / b rounded to nearest, b > 0
+inline int64_t divRound(int64_t a, int64_t b) {
+    return (a >= 0) ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+inline int16_t sat16(int64_t x) {
+    return static_cast<int16_t>(x > 32767 ? 32767 : (x < -32768 ? -32768 : x));
+}
+
+inline int32_t mulQ30(int32_t a, int32_t b) {
+    return static_cast<int32_t>(shiftRound(int64_t(a) * b, 30));
+}
+
+// floor(sqrt(x)), bit by bit
+inline uint64_t isqrt64(uint64_t x) {
+    uint64_t r = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+inline int64_t abs64(int64_t x) { return x < 0 ? -x : x; }
+
+// tanh(i / 32) in Q15, i = 0..192
+static const int16_t kTanhQ15[193] = {
+        0,  1024,  2045,  3063,  4075,  5079,  6073,  7056,  8025,  8980,  9919, 10840,
+    11743, 12625, 13486, 14326, 15143, 15936, 16706, 17452, 18173, 18870, 19542, 20189,
+    20813, 21411, 21986, 22538, 23066, 23571, 24054, 24516, 24956, 25376, 25776, 26157,
+    26519, 26864, 27191, 27502, 27797, 28076, 28341, 28592, 28830, 29055, 29268, 29470,
+    29660, 29840, 30010, 30170, 30322, 30465, 30600, 30727, 30847, 30960, 31067, 31167,
+    31262, 31351, 31435, 31515, 31589, 31659, 31726, 31788, 31846, 31901, 31953, 32002,
+    32048, 32091, 32132, 32170, 32206, 32240, 32271, 32301, 32329, 32356, 32381, 32404,
+    32426, 32447, 32466, 32484, 32501, 32517, 32532, 32547, 32560, 32573, 32584, 32596,
+    32606, 32616, 32625, 32634, 32642, 32649, 32657, 32663, 32670, 32676, 32681, 32686,
+    32691, 32696, 32700, 32704, 32708, 32712, 32715, 32718, 32721, 32724, 32727, 32729,
+    32732, 32734, 32736, 32738, 32740, 32741, 32743, 32745, 32746, 32747, 32749, 32750,
+    32751, 32752, 32753, 32754, 32755, 32755, 32756, 32757, 32758, 32758, 32759, 32759,
+    32760, 32760, 32761, 32761, 32762, 32762, 32762, 32763, 32763, 32763, 32764, 32764,
+    32764, 32764, 32765, 32765, 32765, 32765, 32765, 32766, 32766, 32766, 32766, 32766,
+    32766, 32766, 32766, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+    32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+    32767,
+};
+
+// tanh of a Q12 value, Q15
+inline int32_t tanhQ15(int16_t y) {
+    int32_t a = (y < 0) ? -int32_t(y) : int32_t(y);
+    int32_t t;
+    if (a >= (6 << 12)) {
+        t = 32767;
+    } else {
+        int idx = a >> 7;                  // steps of 1/32
+        int32_t frac = a & 127;
+        int32_t t0 = kTanhQ15[idx];
+        t = t0 + (((kTanhQ15[idx + 1] - t0) * frac + 64) >> 7);
+    }
+    return (y < 0) ? -t : t;
+}
+
+// Cyclic Jacobi on the symmetric Q30 matrix A (C x C, row-major). On return
+// diag(A) holds the eigenvalues in descending order and V (Q30) the matching
+// eigenvectors in its columns. Returns the sweeps used.
+template <int C>
+inline int jacobiQ30(int32_t* A, int32_t* V, int maxSweeps = 12) {
+    for (int r = 0; r < C; r++)
+        for (int c = 0; c < C; c++) V[r * C + c] = (r == c) ? (int32_t(1) << 30) : 0;
+
+    // Off-diagonals at or below this many Q30 steps count as zero
+    const int32_t eps = 4;
+    int sweeps = 0;
+    for (int sweep = 1; sweep <= maxSweeps; sweep++) {
+        bool rotated = false;
+        for (int p = 0; p < C - 1; p++) {
+            for (int q = p + 1; q < C; q++) {
+                const int32_t apq = A[p * C + q];
+                if (abs64(apq) <= eps) continue;
+                rotated = true;
+
+                // t = tan(angle) = sgn(h) 2 apq / (|h| + sqrt(h^2 + 4 apq^2)),
+                // h = aqq - app, |t| <= 1
+                const int64_t h = int64_t(A[q * C + q]) - A[p * C + p];
+                const uint64_t rad = isqrt64(static_cast<uint64_t>(h * h) +
+                                             4 * static_cast<uint64_t>(int64_t(apq) * apq));
+                int64_t t = divRound(int64_t(apq) * (int64_t(1) << 31),
+                                     abs64(h) + static_cast<int64_t>(rad));
+                if (h < 0) t = -t;
+                const int64_t sec = static_cast<int64_t>(
+                    isqrt64((uint64_t(1) << 60) + static_cast<uint64_t>(t * t)));
+                const int32_t c = static_cast<int32_t>(divRound(int64_t(1) << 60, sec));
+                const int32_t s = static_cast<int32_t>(shiftRound(t * c, 30));
+
+                const int32_t tapq = mulQ30(static_cast<int32_t>(t), apq);
+                A[p * C + p] -= tapq;
+                A[q * C + q] += tapq;
+                A[p * C + q] = A[q * C + p] = 0;
+                for (int r = 0; r < C; r++) {
+                    if (r == p || r == q) continue;
+                    int32_t arp = A[r * C + p], arq = A[r * C + q];
+                    int32_t nrp = mulQ30(c, arp) - mulQ30(s, arq);
+                    int32_t nrq = mulQ30(s, arp) + mulQ30(c, arq);
+                    A[r * C + p] = A[p * C + r] = nrp;
+                    A[r * C + q] = A[q * C + r] = nrq;
+                }
+                for (int r = 0; r < C; r++) {
+                    int32_t vrp = V[r * C + p], vrq = V[r * C + q];
+                    V[r * C + p] = mulQ30(c, vrp) - mulQ30(s, vrq);
+                    V[r * C + q] = mulQ30(s, vrp) + mulQ30(c, vrq);
+                }
+            }
+        }
+        if (!rotated) break;
+        sweeps = sweep;
+    }
+
+    // Sort eigenpairs by descending eigenvalue
+    for (int i = 0; i < C - 1; i++) {
+        int best = i;
+        for (int j = i + 1; j < C; j++) {
+            if (A[j * C + j] > A[best * C + best]) best = j;
+        }
+        if (best == i) continue;
+        int32_t d = A[i * C + i];
+        A[i * C + i] = A[best * C + best];
+        A[best * C + best] = d;
+        for (int r = 0; r < C; r++) {
+            int32_t v = V[r * C + i];
+            V[r * C + i] = V[r * C + best];
+            V[r * C + best] = v;
+        }
+    }
+    return sweeps;
+}
+
+} // namespace q15_detail
+
+// Contiguous row-major frames (n x channels) for the q15 entry points, which
+// accept anything with frame(i) -> const int16_t* (e.g. an int16_t
+// SpscFrameRing's Window)
+struct Q15Frames {
+    const int16_t* data;
+    int channels;
+    const int16_t* frame(size_t i) const { return data + i * static_cast<size_t>(channels); }
+};
+
+template <int C, int K, int N>
+struct Q15IcaWorkspace {
+    static_assert(C >= 1 && C <= Q15_ICA_MAX_CHANNELS, "Q15IcaWorkspace: 1..8 channels");
+    static_assert(K >= 1 && K <= C, "Q15IcaWorkspace: components must be in [1, channels]");
+    static_assert(N >= 2, "Q15IcaWorkspace: window too short");
+
+    int n = 0;                    // samples in the current window
+
+    // Preprocessing
+    int32_t mean[C];              // channel means (ADC counts)
+    int32_t cov[C * C];           // covariance * 2^-e (trace ~ Q30 one); eigenvalues after the EVD
+    int cov_exp = 0;              // e
+    int32_t evdV[C * C];          // eigenvectors, Q30
+    int32_t whiten[K * C];        // whitening rows (K leading directions): mantissas ...
+    int whiten_shift[K];          // ... and their right shifts
+    int16_t z[N * K];             // whitened window, Q12, sample-major
+
+    // Iteration
+    int16_t W[K * K];             // Q14
+    int16_t W_last[K * K];
+    int32_t W_new[K * K];         // Q27
+    int64_t zg_sum[K * K];        // sum z g(y), Q27
+    int64_t gprime_sum[K];        // sum g'(y), Q15
+
+    // Symmetric decorrelation
+    int32_t X[K * K];             // Q28
+    int32_t X_next[K * K];
+    int64_t M[K * K];             // X X^T, Q28
+
+    // Output
+    int16_t S[K * N];             // Q12, component-major (K x n)
+    int iterations = 0;
+    bool converged = false;
+    bool out_of_time = false;     // the last solve was stopped by its Q15Deadline
+    int evd_sweeps = 0;
+    uint32_t clipped = 0;         // samples saturated while whitening
+};
+
+namespace q15_detail {
+
+// W (Q14) = (W_new W_new^T)^-1/2 W_new for W_new in Q27. Returns the
+// iterations of the inverse square root.
+template <int C, int K, int N>
+inline int decorrelate(Q15IcaWorkspace<C, K, N>& ws) {
+    // The result does not depend on W_new's scale: bring the largest entry
+    // into [2^27, 2^28) of a Q28 matrix
+    int64_t peak = 0;
+    for (int i = 0; i < K * K; i++) {
+        int64_t a = abs64(ws.W_new[i]);
+        if (a > peak) peak = a;
+    }
+    if (peak == 0) {
+        // Nothing to decorrelate; restart from the unit rows
+        for (int r = 0; r < K; r++)
+            for (int c = 0; c < K; c++) ws.W[r * K + c] = (r == c) ? (1 << 14) : 0;
+        return 0;
+    }
+    int up = 0;
+    while ((peak << up) < (int64_t(1) << 27)) up++;
+    int down = 0;
+    while ((peak >> down) >= (int64_t(1) << 28)) down++;
+    for (int i = 0; i < K * K; i++) {
+        ws.X[i] = static_cast<int32_t>(shiftRound(int64_t(ws.W_new[i]) * (int64_t(1) << up), down));
+    }
+
+    auto gram = [&]() {
+        for (int r = 0; r < K; r++) {
+            for (int c = r; c < K; c++) {
+                int64_t s = 0;
+                for (int j = 0; j < K; j++) s += int64_t(ws.X[r * K + j]) * ws.X[c * K + j];
+                ws.M[r * K + c] = ws.M[c * K + r] = shiftRound(s, 28);
+            }
+        }
+    };
+
+    // Scale by 1/sqrt(||X X^T||_1) so every singular value is <= 1 and the
+    // iteration below converges
+    gram();
+    int64_t norm = 0;
+    for (int r = 0; r < K; r++) {
+        int64_t row = 0;
+        for (int c = 0; c < K; c++) row += abs64(ws.M[r * K + c]);
+        if (row > norm) norm = row;
+    }
+    const int64_t root = static_cast<int64_t>(isqrt64(static_cast<uint64_t>(norm) << 28));
+    for (int i = 0; i < K * K; i++) {
+        ws.X[i] = static_cast<int32_t>(divRound(int64_t(ws.X[i]) * (int64_t(1) << 28), root));
+    }
+
+    // X <- 1.5 X - 0.5 (X X^T) X until X X^T = I to within 2^-20
+    const int64_t one = int64_t(1) << 28;
+    const int64_t eps = one >> 20;
+    const int max_iter = 40;
+    int it = 0;
+    for (; it < max_iter; it++) {
+        gram();
+        int64_t err = 0;
+        for (int r = 0; r < K; r++) {
+            for (int c = 0; c < K; c++) {
+                int64_t e = abs64(ws.M[r * K + c] - ((r == c) ? one : 0));
+                if (e > err) err = e;
+            }
+        }
+        if (err <= eps) break;
+        for (int r = 0; r < K; r++) {
+            for (int c = 0; c < K; c++) {
+                int64_t mx = 0;
+                for (int j = 0; j < K; j++) mx += ws.M[r * K + j] * ws.X[j * K + c];
+                int64_t x = ws.X[r * K + c];
+                ws.X_next[r * K + c] = static_cast<int32_t>(x + shiftRound(x, 1) - shiftRound(mx, 29));
+            }
+        }
+        for (int i = 0; i < K * K; i++) ws.X[i] = ws.X_next[i];
+    }
+
+    for (int i = 0; i < K * K; i++) ws.W[i] = sat16(shiftRound(ws.X[i], 14));
+    return it;
+}
+
+// Q26 -> Q12 dot product of a W row (Q14) with a z sample (Q12)
+template <int C>
+inline int16_t project(const int16_t* w, const int16_t* z) {
+    int32_t y = 0;
+    for (int c = 0; c < C; c++) y += int32_t(w[c]) * z[c];
+    return sat16(shiftRound(y, 14));
+}
+
+} // namespace q15_detail
+
+// -----------------------------------------------------------------------------
+// Centering + whitening: frames (n frames of C int16_t samples, oldest first)
+// -> ws.z. Returns false if n is out of range or the window is flat.
+// -----------------------------------------------------------------------------
+template <class Frames, int C, int K, int N>
+inline bool q15Whiten(const Frames& frames, int n, Q15IcaWorkspace<C, K, N>& ws) {
+    using namespace q15_detail;
+    if (n < 2 || n > N) return false;
+    ws.n = n;
+    ws.clipped = 0;
+
+    // 1. Channel means, rounded to whole counts
+    int64_t sum[C] = {};
+    for (int i = 0; i < n; i++) {
+        const int16_t* f = frames.frame(i);
+        for (int c = 0; c < C; c++) sum[c] += f[c];
+    }
+    for (int c = 0; c < C; c++) ws.mean[c] = static_cast<int32_t>(divRound(sum[c], n));
+
+    // 2. Covariance: exact 64-bit sums over the centered window
+    int64_t acc[C * C] = {};
+    for (int i = 0; i < n; i++) {
+        const int16_t* f = frames.frame(i);
+        int16_t x[C];
+        for (int c = 0; c < C; c++) {
+            int32_t v = f[c] - ws.mean[c];
+            x[c] = sat16(v);
+            if (x[c] != v) ws.clipped++;
+        }
+        for (int p = 0; p < C; p++)
+            for (int q = p; q < C; q++) acc[p * C + q] += int32_t(x[p]) * x[q];
+    }
+
+    // Scale by 2^-e (e even, so the square root below stays a shift) to put
+    // the trace of the mean in (2^28, 2^30]
+    int64_t trace = 0;
+    for (int c = 0; c < C; c++) trace += acc[c * C + c];
+    if (trace <= 0) return false;
+    const int64_t lo = int64_t(n) << 28, hi = int64_t(n) << 30;
+    int e = 0;
+    while ((trace >> e) > hi) e += 2;
+    while (e > -56 && shiftRound(trace, e) <= lo) e -= 2;
+    ws.cov_exp = e;
+    for (int p = 0; p < C; p++) {
+        for (int q = p; q < C; q++) {
+            int64_t v = divRound(shiftRound(acc[p * C + q], e), n);
+            ws.cov[p * C + q] = ws.cov[q * C + p] = static_cast<int32_t>(v);
+        }
+    }
+
+    // 3. EVD (all C pairs: the Jacobi is cheap at these sizes), then the K
+    //    leading whitening rows z_i = (v_i . x) / sqrt(lambda_i * 2^e):
+    //    1/sqrt(lambda) = m * 2^(r - 46) with m in [2^30, 2^31)
+    ws.evd_sweeps = jacobiQ30<C>(ws.cov, ws.evdV);
+    const int64_t floor_eig = (int64_t(1) << 30) >> 24;
+    for (int i = 0; i < K; i++) {
+        const int64_t lambda = ws.cov[i * C + i];
+        if (lambda < floor_eig) {
+            for (int k = 0; k < C; k++) ws.whiten[i * C + k] = 0;
+            ws.whiten_shift[i] = 0;
+            continue;
+        }
+        const int64_t root = static_cast<int64_t>(isqrt64(static_cast<uint64_t>(lambda) << 32));
+        int64_t m = divRound(int64_t(1) << 62, root);
+        int r = 0;
+        while (m >= (int64_t(1) << 31)) { m = shiftRound(m, 1); r++; }
+        while (m < (int64_t(1) << 30)) { m <<= 1; r--; }
+        for (int k = 0; k < C; k++) {
+            ws.whiten[i * C + k] = static_cast<int32_t>(shiftRound(int64_t(ws.evdV[k * C + i]) * m, 31));
+        }
+        // coefficient = mantissa * 2^(r - 33 - e/2); the 2^12 of Q12 included
+        ws.whiten_shift[i] = 33 - r + e / 2;
+    }
+
+    // 4. z = whitening * x, Q12
+    for (int i = 0; i < n; i++) {
+        const int16_t* f = frames.frame(i);
+        int16_t x[C];
+        for (int c = 0; c < C; c++) x[c] = sat16(int32_t(f[c]) - ws.mean[c]);
+        int16_t* z = ws.z + static_cast<size_t>(i) * K;
+        for (int r = 0; r < K; r++) {
+            int64_t s = 0;
+            for (int k = 0; k < C; k++) s += int64_t(ws.whiten[r * C + k]) * x[k];
+            int64_t v = shiftRound(s, ws.whiten_shift[r]);
+            z[r] = sat16(v);
+            if (z[r] != v) ws.clipped++;
+        }
+    }
+    return true;
+}
+
+// Time budget for a solve: expired(ctx) is polled before every iteration,
+// and once it returns true the solve stops with the current W (already
+// decorrelated, so S is still a usable unmixing). Read a hardware timer in
+// it, e.g. micros() or esp_timer_get_time() against a precomputed end.
+struct Q15Deadline {
+    bool (*expired)(void* ctx);
+    void* ctx;
+};
+
+// -----------------------------------------------------------------------------
+// Fixed-point iteration on ws.z; returns ws.S (K x n, Q12)
+//   tol_q20:  | |cos(w_i, w_last_i)| - 1 | in units of 2^-20 (16 = ~1.5e-5)
+//   W_init:   Q14 warm start (e.g. ws.W from the previous window); decorrelated
+//             before use. Without it W starts from a fixed pseudo-random draw,
+//             the same on every target.
+//   deadline: optional time budget (see Q15Deadline). Stopping on it is the
+//             only thing that can make two runs on the same frames differ.
+// -----------------------------------------------------------------------------
+template <int C, int K, int N>
+inline const int16_t* q15FastICAWhitened(Q15IcaWorkspace<C, K, N>& ws, int max_iter = 1000,
+                                         int tol_q20 = 16, const int16_t* W_init = nullptr,
+                                         const Q15Deadline* deadline = nullptr) {
+    using namespace q15_detail;
+    const int n = ws.n;
+
+    if (W_init) {
+        for (int i = 0; i < K * K; i++) ws.W_new[i] = int32_t(W_init[i]) * (1 << 13);
+    } else {
+        uint32_t seed = 0x9E3779B9u;
+        for (int i = 0; i < K * K; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            ws.W_new[i] = static_cast<int32_t>(seed >> 4) - (int32_t(1) << 27);  // [-1, 1) Q27
+        }
+    }
+    decorrelate(ws);
+
+    ws.iterations = 0;
+    ws.converged = false;
+    ws.out_of_time = false;
+    for (int iter = 0; iter < max_iter; iter++) {
+        if (deadline && deadline->expired(deadline->ctx)) {
+            ws.out_of_time = true;
+            break;
+        }
+        ws.iterations = iter + 1;
+        for (int i = 0; i < K * K; i++) ws.W_last[i] = ws.W[i];
+
+        // One pass: y = W z, g(y), g'(y), sum z g(y)
+        for (int i = 0; i < K * K; i++) ws.zg_sum[i] = 0;
+        for (int k = 0; k < K; k++) ws.gprime_sum[k] = 0;
+        for (int i = 0; i < n; i++) {
+            const int16_t* z = ws.z + static_cast<size_t>(i) * K;
+            for (int k = 0; k < K; k++) {
+                const int32_t g = tanhQ15(project<K>(ws.W + k * K, z));
+                ws.gprime_sum[k] += 32768 - ((g * g + 16384) >> 15);
+                int64_t* acc = ws.zg_sum + k * K;
+                for (int c = 0; c < K; c++) acc[c] += int32_t(z[c]) * g;
+            }
+        }
+
+        // W_new = E{z g(W z)} - E{g'(W z)} W, Q27
+        for (int k = 0; k < K; k++) {
+            const int64_t gprime_mean = divRound(ws.gprime_sum[k], n);                  // Q15
+            for (int c = 0; c < K; c++) {
+                int64_t v = divRound(ws.zg_sum[k * K + c], n) -
+                            shiftRound(gprime_mean * ws.W[k * K + c], 2);
+                ws.W_new[k * K + c] = static_cast<int32_t>(v);
+            }
+        }
+
+        decorrelate(ws);
+
+        // 1 - cos^2 < 2 tol 2^-20 on every row, i.e. | |cos| - 1 | < tol 2^-20
+        // (blind to sign flips). Rows are unit norm in Q14, so the products
+        // stay near 2^56.
+        bool done = true;
+        for (int k = 0; k < K && done; k++) {
+            int64_t dot = 0, n1 = 0, n2 = 0;
+            for (int c = 0; c < K; c++) {
+                const int64_t a = ws.W[k * K + c], b = ws.W_last[k * K + c];
+                dot += a * b;
+                n1 += a * a;
+                n2 += b * b;
+            }
+            const int64_t nn = n1 * n2;
+            done = nn - dot * dot < (nn >> 19) * tol_q20;
+        }
+        if (done) {
+            ws.converged = true;
+            break;
+        }
+    }
+
+    // S = W z
+    for (int i = 0; i < n; i++) {
+        const int16_t* z = ws.z + static_cast<size_t>(i) * K;
+        for (int k = 0; k < K; k++) ws.S[static_cast<size_t>(k) * n + i] = q15_detail::project<K>(ws.W + k * K, z);
+    }
+    return ws.S;
+}
+
+// Center + whiten frames, then iterate inside ws. Returns nullptr if the
+// window could not be whitened (see q15Whiten).
+template <class Frames, int C, int K, int N>
+inline const int16_t* q15FastICA(const Frames& frames, int n, Q15IcaWorkspace<C, K, N>& ws,
+                                 int max_iter = 1000, int tol_q20 = 16,
+                                 const int16_t* W_init = nullptr,
+                                 const Q15Deadline* deadline = nullptr) {
+    if (!q15Whiten(frames, n, ws)) return nullptr;
+    return q15FastICAWhitened(ws, max_iter, tol_q20, W_init, deadline);
+}
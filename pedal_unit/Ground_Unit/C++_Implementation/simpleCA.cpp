@@ -1,6 +1,8 @@
 #include <WiFi.h>
 #include <Wire.h>
 #include <Arduino.h>
+#include "spsc_ring.hpp"
+#include "q15_ica.hpp"
 
 const int GAIN_PIN_1 = 12;
 const int GAIN_PIN_2 = 13;
@@ -11,9 +13,24 @@ const char* password = "your_PASSWORD";
 
 // Variables for EEG data
 const int num_channels = 4;
-const int num_samples = 1000;  // Number of samples to store
-float eeg_data[num_samples][num_channels];  // Buffer to hold EEG data
-int data_index = 0;  // Keep track of the EEG data index
+const int num_samples = 1000;  // Samples per ICA window
+const int num_components = 2;  // one per gain pin
+// Frames flow core 0 -> core 1 through a lock-free ring. The extra capacity
+// over num_samples is slack for frames that arrive while a window is being
+// processed (~100 ms at 1 kHz). Samples stay int16_t ADC counts end to end:
+// the ICA below is fixed-point (q15_ica.hpp), so core 1 needs no FPU work.
+SpscFrameRing<int16_t, num_channels, 2048> eeg_ring;
+
+// ICA buffers (~12 KB), static rather than on the task stack
+Q15IcaWorkspace<num_channels, num_components, num_samples> ica;
+
+// Time one window's solve may take; past it the best unmixing so far is used
+const uint32_t ica_budget_us = 50000;
+uint32_t ica_deadline_us = 0;
+
+bool icaPastDeadline(void*) {
+    return static_cast<int32_t>(micros() - ica_deadline_us) >= 0;  // wraps every ~71 min
+}
 
 // Task handles
 TaskHandle_t Task1;
@@ -32,72 +49,61 @@ void receiveEEGData(void * parameter) {
 
     while (true) {
         // Simulate receiving data (replace this with actual WiFi data receive logic)
-        for (int i = 0; i < num_channels; i++) {
-            eeg_data[data_index][i] = random(0, 2048);  // Simulating EEG data as random values (0-2048)
+        int16_t* frame = eeg_ring.beginWrite();
+        if (frame) {
+            for (int i = 0; i < num_channels; i++) {
+                frame[i] = random(0, 2048);  // Simulating EEG data as random values (0-2048)
+            }
+            eeg_ring.publish();  // frame becomes visible to core 1 all at once
         }
-        data_index = (data_index + 1) % num_samples;
 
         delay(1);  // Simulate some delay
     }
 }
 
-// Normalize values to control gain (range: 0-255 for GPIO PWM)
-float normalize(float value, float min_val, float max_val, float new_min, float new_max) {
-    return (value - min_val) / (max_val - min_val) * (new_max - new_min) + new_min;
+// Gain for one component (range: 0-255 for GPIO PWM): its window mean
+// normalised by the window's min and max
+int componentGain(const int16_t* component, int n) {
+    int32_t lo = component[0], hi = component[0], sum = 0;
+    for (int i = 0; i < n; i++) {
+        if (component[i] < lo) lo = component[i];
+        if (component[i] > hi) hi = component[i];
+        sum += component[i];
+    }
+    if (hi == lo) return 0;
+    int32_t mean = sum / n;
+    return (mean - lo) * 255 / (hi - lo);
 }
 
-// ICA processing function (simplified for ESP32)
+// ICA processing function: fixed-point FastICA on the newest window
 void performICA(void * parameter) {
-    // Placeholder for two independent components
-    float component_1[num_samples];
-    float component_2[num_samples];
+    bool have_W = false;
 
-    // Simplified ICA processing
     while (true) {
-        // Step 1: Mean center the data
-        float means[num_channels] = {0};
-
-        for (int i = 0; i < num_samples; i++) {
-            for (int j = 0; j < num_channels; j++) {
-                means[j] += eeg_data[i][j];
-            }
-        }
-
-        for (int j = 0; j < num_channels; j++) {
-            means[j] /= num_samples;
+        // Latest num_samples frames, read in place. Core 0 cannot overwrite
+        // them until the next latest() call, so the window is consistent.
+        auto window = eeg_ring.latest(num_samples);
+        if (!window) {
+            delay(10);  // Not a full window yet
+            continue;
         }
 
-        for (int i = 0; i < num_samples; i++) {
-            for (int j = 0; j < num_channels; j++) {
-                eeg_data[i][j] -= means[j];
-            }
+        // Step 1: Center, whiten and separate in Q15 (the ring is read-only
+        // here; the window is read in place). Warm-start from the previous
+        // window's unmixing; the iteration cap and the deadline bound the
+        // time per window.
+        ica_deadline_us = micros() + ica_budget_us;
+        const Q15Deadline deadline = {icaPastDeadline, nullptr};
+        const int16_t* S = q15FastICA(window, num_samples, ica, 200, 16, have_W ? ica.W : nullptr, &deadline);
+        if (!S) {
+            delay(10);  // Flat window (nothing connected)
+            continue;
         }
+        have_W = true;
 
-        // Step 2: Simplified ICA
-        // We will use a linear transformation approach for simplicity
-        for (int i = 0; i < num_samples; i++) {
-            component_1[i] = eeg_data[i][0] - eeg_data[i][1];  // Rough approximation
-            component_2[i] = eeg_data[i][2] - eeg_data[i][3];  // Rough approximation
-        }
-
-        // Step 3: Normalize the components for gain control
-        float min_comp1 = component_1[0], max_comp1 = component_1[0];
-        float min_comp2 = component_2[0], max_comp2 = component_2[0];
-
-        for (int i = 1; i < num_samples; i++) {
-            if (component_1[i] < min_comp1) min_comp1 = component_1[i];
-            if (component_1[i] > max_comp1) max_comp1 = component_1[i];
-
-            if (component_2[i] < min_comp2) min_comp2 = component_2[i];
-            if (component_2[i] > max_comp2) max_comp2 = component_2[i];
-        }
-
-        float gain_1 = normalize(component_1[num_samples-1], min_comp1, max_comp1, 0, 255);
-        float gain_2 = normalize(component_2[num_samples-1], min_comp2, max_comp2, 0, 255);
-
-        // Step 4: Apply the gain values to the GPIO pins
-        analogWrite(GAIN_PIN_1, (int)gain_1);
-        analogWrite(GAIN_PIN_2, (int)gain_2);
+        // Step 2: Map each component to a gain and apply it to the GPIO pins
+        analogWrite(GAIN_PIN_1, componentGain(S, num_samples));
+        analogWrite(GAIN_PIN_2, componentGain(S + num_samples, num_samples));
 
         delay(100);  // Adjust processing frequency as needed
     }
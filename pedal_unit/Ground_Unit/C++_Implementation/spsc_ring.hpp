@@ -0,0 +1,169 @@
+#pragma once
+// Lock-free single-producer / single-consumer frame ring.
+//
+// Shared by the ESP32 sketches (acquisition task on core 0, ICA task on
+// core 1) and the Linux ground process. Header-only, C++11, no heap: the
+// storage lives inside the object, so declare it as a global/static.
+//
+// The producer writes a whole frame (Channels samples) into the slot returned
+// by beginWrite() and makes it visible with publish(). The consumer never
+// sees a partly written frame, and the producer never overwrites a frame the
+// consumer has not released: frames in [tail, head) belong to the consumer
+// until consume()/latest() moves tail past them. When the consumer falls a
+// full ring behind, beginWrite() returns nullptr and the frame is dropped
+// (counted in dropped()) rather than tearing a window that is being read.
+//
+// Reads hand out a Window: up to two contiguous spans of frames (before and
+// after the wrap) pointing straight into the ring, so a consistent window
+// costs no mutex and no copy.
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef SPSC_CACHE_LINE
+#define SPSC_CACHE_LINE 64
+#endif
+
+template <typename T, size_t Channels, size_t Capacity>
+class SpscFrameRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscFrameRing: Capacity must be a power of two");
+    static_assert(Capacity <= (size_t(1) << 31), "SpscFrameRing: Capacity too large");
+
+public:
+    static constexpr size_t channels = Channels;
+    static constexpr size_t capacity = Capacity;
+
+    // Frames [0, first_frames) of the window live at first, the rest at
+    // second. Both are row-major (frame x Channels).
+    struct Window {
+        const T* first = nullptr;
+        size_t   first_frames = 0;
+        const T* second = nullptr;
+        size_t   second_frames = 0;
+
+        size_t frames() const { return first_frames + second_frames; }
+        explicit operator bool() const { return frames() != 0; }
+
+        // Sample ch of the i-th frame in the window (oldest first)
+        const T& at(size_t i, size_t ch) const {
+            return (i < first_frames) ? first[i * Channels + ch]
+                                      : second[(i - first_frames) * Channels + ch];
+        }
+        const T* frame(size_t i) const {
+            return (i < first_frames) ? first + i * Channels
+                                      : second + (i - first_frames) * Channels;
+        }
+    };
+
+    SpscFrameRing() : head_(0), tail_(0) {}
+    SpscFrameRing(const SpscFrameRing&) = delete;
+    SpscFrameRing& operator=(const SpscFrameRing&) = delete;
+
+    // -------------------------------------------------------------------------
+    // Producer side
+    // -------------------------------------------------------------------------
+
+    // Slot for the next frame, or nullptr if the ring is full (the frame is
+    // then counted as dropped). Fill all Channels samples, then publish().
+    T* beginWrite() {
+        uint32_t h = head_.load(std::memory_order_relaxed);
+        if (h - tail_cache_ >= Capacity) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (h - tail_cache_ >= Capacity) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        return &buf_[(h & kMask) * Channels];
+    }
+
+    // Make the frame filled through beginWrite() visible to the consumer
+    void publish() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Free slots, as seen by the producer. A source that can wait (file
+    // replay) checks this instead of letting beginWrite() drop frames.
+    size_t writable() const {
+        return Capacity - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+    }
+
+    // Copy one frame in and publish it. Returns false if it was dropped.
+    bool push(const T* frame) {
+        T* slot = beginWrite();
+        if (!slot) return false;
+        for (size_t c = 0; c < Channels; c++) slot[c] = frame[c];
+        publish();
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Consumer side
+    // -------------------------------------------------------------------------
+
+    // Frames published and not yet released
+    size_t readable() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+    }
+
+    // The oldest n unreleased frames (fewer if fewer are readable). They stay
+    // valid until consume() releases them.
+    Window window(size_t n) const {
+        uint32_t t = tail_.load(std::memory_order_relaxed);
+        uint32_t h = head_.load(std::memory_order_acquire);
+        size_t avail = h - t;
+        return spans(t, n < avail ? n : avail);
+    }
+
+    // The newest n frames, releasing everything older. Returns an empty
+    // window until n frames are readable. This is the sliding-window read:
+    // call it once per cycle and the window stays valid until the next call.
+    Window latest(size_t n) {
+        if (n > Capacity) return Window();
+        uint32_t t = tail_.load(std::memory_order_relaxed);
+        uint32_t h = head_.load(std::memory_order_acquire);
+        if (h - t < n) return Window();
+        uint32_t start = h - static_cast<uint32_t>(n);
+        if (start != t) tail_.store(start, std::memory_order_release);
+        return spans(start, n);
+    }
+
+    // Release the oldest n frames back to the producer
+    void consume(size_t n) {
+        uint32_t t = tail_.load(std::memory_order_relaxed);
+        size_t avail = head_.load(std::memory_order_acquire) - t;
+        if (n > avail) n = avail;
+        tail_.store(t + static_cast<uint32_t>(n), std::memory_order_release);
+    }
+
+    // Frames rejected because the ring was full
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t kMask = static_cast<uint32_t>(Capacity - 1);
+
+    Window spans(uint32_t start, size_t n) const {
+        Window w;
+        size_t idx = start & kMask;
+        size_t first = Capacity - idx;
+        if (first > n) first = n;
+        w.first = &buf_[idx * Channels];
+        w.first_frames = first;
+        if (n > first) {
+            w.second = &buf_[0];
+            w.second_frames = n - first;
+        }
+        return w;
+    }
+
+    // head_ is written by the producer only, tail_ by the consumer only. Each
+    // sits on its own cache line together with the state its owner touches,
+    // so the two cores only share a line when one actually has to look at the
+    // other's index.
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> head_;
+    uint32_t tail_cache_ = 0;            // producer's last view of tail_
+    std::atomic<uint32_t> dropped_{0};
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> tail_;
+    alignas(SPSC_CACHE_LINE) T buf_[Capacity * Channels];
+};
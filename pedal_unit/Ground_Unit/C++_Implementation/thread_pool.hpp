@@ -0,0 +1,143 @@
+#pragma once
+// Persistent fork-join pool for the ICA kernels.
+//
+// run(tasks, fn) calls fn(t) for every t in [0, tasks) and returns once all
+// of them are done. The calling thread takes tasks too. Tasks are claimed one
+// at a time from a shared counter, so a core that is busy elsewhere simply
+// ends up running fewer of them. Which thread runs which task is not fixed:
+// kernels that reduce write one partial result per task index and sum them in
+// index order afterwards, which keeps their output independent of the thread
+// count and of timing.
+//
+// After a job the workers keep polling (yielding) for a short while before
+// they block, so the back-to-back jobs of one FastICA solve do not each pay a
+// thread wake-up. A job does not allocate. run() calls from different threads
+// are serialised; fn must not call run() on the same pool.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+    // threads counts the caller: 1 runs everything inline, 0 picks one per
+    // hardware thread
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int i = 1; i < threads; i++) workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    template <typename Fn>
+    void run(int tasks, Fn&& fn) {
+        if (tasks <= 0) return;
+        if (workers_.empty() || tasks == 1) {
+            for (int t = 0; t < tasks; t++) fn(t);
+            return;
+        }
+        std::lock_guard<std::mutex> serial(run_mutex_);
+        using F = typename std::remove_reference<Fn>::type;
+        job_fn_ = [](void* ctx, int t) { (*static_cast<F*>(ctx))(t); };
+        job_ctx_ = const_cast<void*>(static_cast<const void*>(&fn));
+        tasks_.store(tasks, std::memory_order_relaxed);
+        remaining_.store(tasks, std::memory_order_relaxed);
+        const uint32_t gen = ++generation_;
+        claim_.store(uint64_t(gen) << 32, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            published_.store(gen, std::memory_order_release);
+            if (sleepers_ != 0) wake_.notify_all();
+        }
+
+        work(gen);
+
+        // Wait for tasks still running on workers
+        const auto spin_until = std::chrono::steady_clock::now() + kSpin;
+        while (remaining_.load(std::memory_order_acquire) != 0) {
+            if (std::chrono::steady_clock::now() < spin_until) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(m_);
+            done_.wait(lk, [&] { return remaining_.load(std::memory_order_acquire) == 0; });
+        }
+    }
+
+private:
+    static constexpr std::chrono::microseconds kSpin{200};
+
+    // Claim and run tasks of job gen until none are left. A claim is a CAS on
+    // (generation, next task), so a worker that is late for one job can never
+    // take a task of the next one.
+    void work(uint32_t gen) {
+        while (true) {
+            uint64_t s = claim_.load(std::memory_order_acquire);
+            if (static_cast<uint32_t>(s >> 32) != gen) return;
+            const uint32_t t = static_cast<uint32_t>(s);
+            if (t >= static_cast<uint32_t>(tasks_.load(std::memory_order_relaxed))) return;
+            if (!claim_.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel)) continue;
+            job_fn_(job_ctx_, static_cast<int>(t));
+            if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lk(m_);
+                done_.notify_all();
+            }
+        }
+    }
+
+    void workerLoop() {
+        uint32_t seen = 0;
+        while (true) {
+            const auto spin_until = std::chrono::steady_clock::now() + kSpin;
+            while (published_.load(std::memory_order_acquire) == seen &&
+                   std::chrono::steady_clock::now() < spin_until) {
+                std::this_thread::yield();
+            }
+            if (published_.load(std::memory_order_acquire) == seen) {
+                std::unique_lock<std::mutex> lk(m_);
+                sleepers_++;
+                wake_.wait(lk, [&] { return stop_ || published_.load(std::memory_order_acquire) != seen; });
+                sleepers_--;
+                if (stop_) return;
+            }
+            seen = published_.load(std::memory_order_acquire);
+            work(seen);
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;
+
+    // Current job
+    void (*job_fn_)(void*, int) = nullptr;
+    void* job_ctx_ = nullptr;
+    std::atomic<int> tasks_{0};
+    std::atomic<int> remaining_{0};
+    std::atomic<uint64_t> claim_{0};
+    uint32_t generation_ = 0;            // written by run() only
+
+    // Wake-up and completion
+    std::mutex m_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<uint32_t> published_{0};
+    int sleepers_ = 0;
+    bool stop_ = false;
+};
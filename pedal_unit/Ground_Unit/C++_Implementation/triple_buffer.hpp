@@ -0,0 +1,87 @@
+#pragma once
+// Lock-free single-writer / single-reader "latest value" mailbox.
+//
+// Three slots of T: one owned by the writer, one by the reader, and one in
+// the middle. The writer fills its slot through write() and publish()es it,
+// which swaps it with the middle one in a single atomic exchange. The reader
+// calls update() to swap its slot with the middle one if that holds
+// something newer, then reads it through read() for as long as it likes.
+// Neither side ever waits for the other, allocates or copies a T: a publish
+// is a pointer (index) swap, and a reader keeps its snapshot until its next
+// update(), however many times the writer publishes in the meantime. Values
+// published between two updates are dropped; only the newest is seen.
+//
+// This is the single-reader form of an RCU pointer swap: the reader's slot
+// is its read-side critical section, and the writer can only ever reuse the
+// slot the reader has handed back. Header-only, C++11, no heap of its own.
+#include <atomic>
+#include <cstdint>
+
+#ifndef TRIPLE_BUFFER_CACHE_LINE
+#define TRIPLE_BUFFER_CACHE_LINE 64
+#endif
+
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle_(1) {}
+    // Every slot starts as a copy of init, so a T that owns storage (vectors
+    // sized for the problem) never reallocates once running
+    explicit TripleBuffer(const T& init) : middle_(1) {
+        for (auto& s : slots_) s.value = init;
+    }
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // -------------------------------------------------------------------------
+    // Writer side
+    // -------------------------------------------------------------------------
+
+    // The writer's slot. It holds whatever was last published from it (or
+    // handed back by the reader), so overwrite every field that matters.
+    T& write() { return slots_[write_].value; }
+
+    // Hand the writer's slot to the reader, taking the middle one in exchange.
+    // Returns false if that replaced a value the reader never took.
+    bool publish() {
+        uint8_t prev = middle_.exchange(static_cast<uint8_t>(write_ | kFresh), std::memory_order_acq_rel);
+        write_ = prev & kIndex;
+        return (prev & kFresh) == 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // Reader side
+    // -------------------------------------------------------------------------
+
+    // Something was published since the last update()
+    bool pending() const { return (middle_.load(std::memory_order_acquire) & kFresh) != 0; }
+
+    // Take the newest published value, if there is one. Returns true if read()
+    // changed.
+    bool update() {
+        if (!pending()) return false;
+        uint8_t prev = middle_.exchange(read_, std::memory_order_acq_rel);
+        read_ = prev & kIndex;
+        return true;
+    }
+
+    // The reader's slot: the value taken by the last update(), stable until
+    // the next one (the initial T before any)
+    const T& read() const { return slots_[read_].value; }
+    T& read() { return slots_[read_].value; }
+
+private:
+    static constexpr uint8_t kIndex = 0x3;
+    static constexpr uint8_t kFresh = 0x4;
+
+    // Each slot on its own cache lines, so the writer filling one does not
+    // bounce the line the reader is reading
+    struct alignas(TRIPLE_BUFFER_CACHE_LINE) Slot {
+        T value;
+    };
+
+    Slot slots_[3];
+    uint8_t write_ = 0;                     // writer only
+    alignas(TRIPLE_BUFFER_CACHE_LINE) std::atomic<uint8_t> middle_; // index | kFresh
+    alignas(TRIPLE_BUFFER_CACHE_LINE) uint8_t read_ = 2;            // reader only
+};
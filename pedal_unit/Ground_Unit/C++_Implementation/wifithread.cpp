@@ -1,6 +1,7 @@
 #include <WiFi.h>
 #include <Eigen/Dense>
 #include <FreeRTOS.h>
+#include "spsc_ring.hpp"
 
 // WiFi credentials
 const char* ssid = "your_SSID";
@@ -9,7 +10,9 @@ const char* password = "your_PASSWORD";
 // Variables to store EEG data
 const int num_channels = 4;
 const int num_samples = 1000;
-float eeg_data_buffer[num_samples][num_channels];
+// Lock-free frame ring shared with the processing task; it reads windows with
+// eeg_ring.latest(num_samples) (two spans, no copy) after each notification.
+SpscFrameRing<float, num_channels, 2048> eeg_ring;
 
 // FreeRTOS handle for the processing task
 TaskHandle_t processingTaskHandle;
@@ -25,11 +28,14 @@ void WiFiReceiveTask(void* parameter) {
     Serial.println("Connected to WiFi!");
 
     while (true) {
-        // Simulate receiving EEG data via Wi-Fi
+        // Simulate receiving EEG data via Wi-Fi, one published frame at a time
         for (int i = 0; i < num_samples; i++) {
+            float* frame = eeg_ring.beginWrite();
+            if (!frame) break;  // Processing task is a full ring behind; drop
             for (int j = 0; j < num_channels; j++) {
-                eeg_data_buffer[i][j] = random(0, 2048);  // Replace with actual Wi-Fi receive code
+                frame[j] = random(0, 2048);  // Replace with actual Wi-Fi receive code
             }
+            eeg_ring.publish();
         }
 
         // Notify processing task that new data is available